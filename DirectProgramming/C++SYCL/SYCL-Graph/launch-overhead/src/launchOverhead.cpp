@@ -0,0 +1,422 @@
+//==============================================================
+// Copyright © 2025 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+#include "../../common/aspect_queries.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sycl/ext/oneapi/experimental/graph.hpp>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+namespace sycl_ext = sycl::ext::oneapi::experimental;
+using namespace sycl;
+
+using Clock = std::chrono::steady_clock;
+using ModifiableGraph =
+    sycl_ext::command_graph<sycl_ext::graph_state::modifiable>;
+using ExecutableGraph =
+    sycl_ext::command_graph<sycl_ext::graph_state::executable>;
+
+// Dependencies of each node. A node only depends on nodes with a lower index,
+// so the index order is a valid submission order.
+using Topology = std::vector<std::vector<size_t>>;
+
+// Every node runs the same small kernel, which reads the output of its first
+// dependency (or the source array for the root) and writes its own slice.
+struct Workload {
+  size_t Size;
+  const int *Src;
+  int *Data;
+  int Step;
+};
+
+struct Timing {
+  double SubmitUs;  // host time spent submitting, per node
+  double TotalUs;   // time until all the work has completed, per node
+};
+
+static double elapsedUs(Clock::time_point Start, Clock::time_point End) {
+  return std::chrono::duration<double, std::micro>(End - Start).count();
+}
+
+// A chain of nodes, each one depending on the previous one.
+static Topology makeChain(size_t Nodes) {
+  Topology Deps(Nodes);
+  for (size_t i = 1; i < Nodes; ++i) {
+    Deps[i] = {i - 1};
+  }
+  return Deps;
+}
+
+// One root followed by independent nodes which all depend on it.
+static Topology makeFanOut(size_t Nodes) {
+  Topology Deps(Nodes);
+  for (size_t i = 1; i < Nodes; ++i) {
+    Deps[i] = {0};
+  }
+  return Deps;
+}
+
+// One root, independent nodes depending on it, and a last node which joins
+// all of them.
+static Topology makeDiamond(size_t Nodes) {
+  Topology Deps = makeFanOut(Nodes);
+  if (Nodes > 2) {
+    Deps[Nodes - 1].clear();
+    for (size_t i = 1; i < Nodes - 1; ++i) {
+      Deps[Nodes - 1].push_back(i);
+    }
+  }
+  return Deps;
+}
+
+// Nodes which no other node depends on.
+static std::vector<size_t> sinks(const Topology &Deps) {
+  std::vector<bool> HasSuccessor(Deps.size(), false);
+  for (const auto &NodeDeps : Deps) {
+    for (size_t Dep : NodeDeps) {
+      HasSuccessor[Dep] = true;
+    }
+  }
+
+  std::vector<size_t> Sinks;
+  for (size_t i = 0; i < Deps.size(); ++i) {
+    if (!HasSuccessor[i]) {
+      Sinks.push_back(i);
+    }
+  }
+  return Sinks;
+}
+
+static void nodeKernel(handler &CGH, const Topology &Deps, size_t Node,
+                       const Workload &W) {
+  const int *In = Deps[Node].empty() ? W.Src : W.Data + Deps[Node][0] * W.Size;
+  int *Out = W.Data + Node * W.Size;
+  int Step = W.Step;
+
+  CGH.parallel_for(range<1>{W.Size},
+                   [=](id<1> Id) { Out[Id] = In[Id] + Step; });
+}
+
+// Checks the slice of every node against the values computed on the host.
+static bool verify(queue &Queue, const Topology &Deps, const Workload &W,
+                   const std::vector<int> &HostSrc) {
+  std::vector<int> Result(Deps.size() * W.Size);
+  Queue.copy(W.Data, Result.data(), Result.size()).wait();
+
+  std::vector<int> Expected(Deps.size() * W.Size);
+  for (size_t Node = 0; Node < Deps.size(); ++Node) {
+    for (size_t i = 0; i < W.Size; ++i) {
+      int In = Deps[Node].empty() ? HostSrc[i]
+                                  : Expected[Deps[Node][0] * W.Size + i];
+      Expected[Node * W.Size + i] = In + W.Step;
+    }
+  }
+
+  return Result == Expected;
+}
+
+// Eager submission to an in-order queue: the order of the queue enforces the
+// dependencies, whatever the topology.
+static Timing runInOrder(queue &InOrderQueue, const Topology &Deps,
+                         const Workload &W, size_t Reps) {
+  auto Start = Clock::now();
+  for (size_t Rep = 0; Rep < Reps; ++Rep) {
+    for (size_t Node = 0; Node < Deps.size(); ++Node) {
+      InOrderQueue.submit(
+          [&](handler &CGH) { nodeKernel(CGH, Deps, Node, W); });
+    }
+  }
+  auto Submitted = Clock::now();
+  InOrderQueue.wait();
+  auto End = Clock::now();
+
+  double Launches = double(Reps * Deps.size());
+  return {elapsedUs(Start, Submitted) / Launches,
+          elapsedUs(Start, End) / Launches};
+}
+
+// Eager submission to an out-of-order queue, with the dependencies given as
+// events. The root of a repetition waits for the sinks of the previous one,
+// so that the slices are not overwritten while they are read.
+static Timing runOutOfOrder(queue &Queue, const Topology &Deps,
+                            const Workload &W, size_t Reps) {
+  const std::vector<size_t> Sinks = sinks(Deps);
+  std::vector<event> Events(Deps.size());
+  std::vector<event> Previous;
+
+  auto Start = Clock::now();
+  for (size_t Rep = 0; Rep < Reps; ++Rep) {
+    for (size_t Node = 0; Node < Deps.size(); ++Node) {
+      Events[Node] = Queue.submit([&](handler &CGH) {
+        if (Deps[Node].empty()) {
+          CGH.depends_on(Previous);
+        }
+        for (size_t Dep : Deps[Node]) {
+          CGH.depends_on(Events[Dep]);
+        }
+        nodeKernel(CGH, Deps, Node, W);
+      });
+    }
+
+    Previous.clear();
+    for (size_t Sink : Sinks) {
+      Previous.push_back(Events[Sink]);
+    }
+  }
+  auto Submitted = Clock::now();
+  Queue.wait();
+  auto End = Clock::now();
+
+  double Launches = double(Reps * Deps.size());
+  return {elapsedUs(Start, Submitted) / Launches,
+          elapsedUs(Start, End) / Launches};
+}
+
+// Builds the topology with the explicit graph API, the edges being added once
+// all the nodes exist.
+static ModifiableGraph buildGraph(queue &Queue, const Topology &Deps,
+                                  const Workload &W) {
+  ModifiableGraph Graph(Queue.get_context(), Queue.get_device());
+
+  std::vector<sycl_ext::node> Nodes;
+  Nodes.reserve(Deps.size());
+  for (size_t Node = 0; Node < Deps.size(); ++Node) {
+    Nodes.push_back(
+        Graph.add([&](handler &CGH) { nodeKernel(CGH, Deps, Node, W); }));
+  }
+
+  for (size_t Node = 0; Node < Deps.size(); ++Node) {
+    for (size_t Dep : Deps[Node]) {
+      Graph.make_edge(Nodes[Dep], Nodes[Node]);
+    }
+  }
+
+  return Graph;
+}
+
+// Replays of a finalized graph, all submitted to the in-order queue.
+static Timing runGraph(queue &InOrderQueue, ExecutableGraph &GraphExec,
+                       size_t Nodes, size_t Reps) {
+  auto Start = Clock::now();
+  for (size_t Rep = 0; Rep < Reps; ++Rep) {
+    InOrderQueue.ext_oneapi_graph(GraphExec);
+  }
+  auto Submitted = Clock::now();
+  InOrderQueue.wait();
+  auto End = Clock::now();
+
+  double Launches = double(Reps * Nodes);
+  return {elapsedUs(Start, Submitted) / Launches,
+          elapsedUs(Start, End) / Launches};
+}
+
+// Parses a comma separated list of positive integers.
+static std::vector<size_t> parseList(const std::string &Text) {
+  std::vector<size_t> Values;
+  size_t Begin = 0;
+  while (Begin <= Text.size()) {
+    size_t End = std::min(Text.find(',', Begin), Text.size());
+    long Value = std::atol(Text.substr(Begin, End - Begin).c_str());
+    if (Value > 0) {
+      Values.push_back(size_t(Value));
+    }
+    Begin = End + 1;
+  }
+  return Values;
+}
+
+static void usage(const char *Name) {
+  std::cout << "Usage: " << Name << " [options]\n"
+            << "  --nodes=<n,...>  nodes per topology (default 1,10,100,1000)\n"
+            << "  --reps=<n>       repetitions of each topology (default 100)\n"
+            << "  --updates=<n>    parameter changes of the update test "
+               "(default 20)\n"
+            << "  --size=<n>       elements written by each node (default 64)\n"
+            << "  --gpu            use the default device instead of the CPU\n";
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<size_t> NodeCounts = {1, 10, 100, 1000};
+  size_t Reps = 100;
+  size_t Updates = 20;
+  size_t Size = 64;
+  bool UseGpu = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string Arg = argv[i];
+    std::string Value = Arg.substr(std::min(Arg.find('=') + 1, Arg.size()));
+
+    if (Arg.rfind("--nodes=", 0) == 0) {
+      NodeCounts = parseList(Value);
+    } else if (Arg.rfind("--reps=", 0) == 0) {
+      Reps = std::max(1l, std::atol(Value.c_str()));
+    } else if (Arg.rfind("--updates=", 0) == 0) {
+      Updates = std::max(1l, std::atol(Value.c_str()));
+    } else if (Arg.rfind("--size=", 0) == 0) {
+      Size = std::max(1l, std::atol(Value.c_str()));
+    } else if (Arg == "--gpu") {
+      UseGpu = true;
+    } else {
+      usage(argv[0]);
+      return Arg == "--help" ? 0 : 1;
+    }
+  }
+
+  if (NodeCounts.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // The CPU device runs the same runtime and scheduling code as a GPU, which
+  // measures the host overhead without any accelerator.
+  device Device;
+  try {
+    Device = UseGpu ? device{default_selector_v} : device{cpu_selector_v};
+  } catch (const sycl::exception &E) {
+    std::cerr << "Error: no " << (UseGpu ? "SYCL" : "CPU SYCL")
+              << " device found: " << E.what() << "\n";
+    return 1;
+  }
+
+  ensure_graph_support(Device);
+  bool CanUpdate = Device.has(aspect::ext_oneapi_graph);
+
+  queue Queue{Device};
+  queue InOrderQueue{Queue.get_context(), Device, property::queue::in_order{}};
+
+  std::cout << "Running on " << Device.get_info<info::device::name>() << "\n"
+            << Reps << " repetitions, " << Size
+            << " elements per node, times in us per node\n\n";
+
+  const size_t MaxNodes =
+      *std::max_element(NodeCounts.begin(), NodeCounts.end());
+
+  std::vector<int> HostSrc(Size), HostSrc2(Size);
+  for (size_t i = 0; i < Size; ++i) {
+    HostSrc[i] = int(i);
+    HostSrc2[i] = int(2 * i + 1);
+  }
+
+  int *Src = malloc_device<int>(Size, Queue);
+  int *Src2 = malloc_device<int>(Size, Queue);
+  int *Data = malloc_device<int>(MaxNodes * Size, Queue);
+  Queue.copy(HostSrc.data(), Src, Size);
+  Queue.copy(HostSrc2.data(), Src2, Size);
+  Queue.wait();
+
+  struct NamedTopology {
+    const char *Name;
+    Topology (*Make)(size_t);
+  };
+  const NamedTopology Topologies[] = {
+      {"chain", makeChain}, {"fan-out", makeFanOut}, {"diamond", makeDiamond}};
+
+  bool Passed = true;
+
+  std::printf("%-8s %6s | %19s | %19s | %19s | %10s\n", "", "",
+              "in-order queue", "out-of-order queue", "graph replay",
+              "finalize");
+  std::printf("%-8s %6s | %9s %9s | %9s %9s | %9s %9s | %10s\n", "topology",
+              "nodes", "submit", "total", "submit", "total", "submit", "total",
+              "(us)");
+
+  for (const NamedTopology &T : Topologies) {
+    for (size_t Nodes : NodeCounts) {
+      const Topology Deps = T.Make(Nodes);
+      const Workload W{Size, Src, Data, 1};
+
+      // One untimed repetition of each mode compiles the kernel and warms up
+      // the runtime.
+      runInOrder(InOrderQueue, Deps, W, 1);
+      Timing InOrder = runInOrder(InOrderQueue, Deps, W, Reps);
+      Passed &= verify(Queue, Deps, W, HostSrc);
+
+      runOutOfOrder(Queue, Deps, W, 1);
+      Timing OutOfOrder = runOutOfOrder(Queue, Deps, W, Reps);
+      Passed &= verify(Queue, Deps, W, HostSrc);
+
+      auto Graph = buildGraph(Queue, Deps, W);
+      auto FinalizeStart = Clock::now();
+      auto GraphExec = Graph.finalize();
+      double FinalizeUs = elapsedUs(FinalizeStart, Clock::now());
+
+      runGraph(InOrderQueue, GraphExec, Nodes, 1);
+      Timing Replay = runGraph(InOrderQueue, GraphExec, Nodes, Reps);
+      Passed &= verify(Queue, Deps, W, HostSrc);
+
+      std::printf("%-8s %6zu | %9.3f %9.3f | %9.3f %9.3f | %9.3f %9.3f | "
+                  "%10.1f\n",
+                  T.Name, Nodes, InOrder.SubmitUs, InOrder.TotalUs,
+                  OutOfOrder.SubmitUs, OutOfOrder.TotalUs, Replay.SubmitUs,
+                  Replay.TotalUs, FinalizeUs);
+    }
+  }
+
+  // Changing the source pointer and the step of every node of a finalized
+  // graph, either by finalizing a new graph or by updating the executable
+  // graph in place from a graph of the same topology.
+  if (CanUpdate) {
+    std::printf("\n%u parameter changes, times in us per change\n",
+                unsigned(Updates));
+    std::printf("%-8s %6s | %12s | %12s\n", "topology", "nodes",
+                "re-finalize", "update");
+
+    for (const NamedTopology &T : Topologies) {
+      for (size_t Nodes : NodeCounts) {
+        const Topology Deps = T.Make(Nodes);
+        Workload W{Size, Src, Data, 1};
+
+        auto Start = Clock::now();
+        for (size_t Change = 0; Change < Updates; ++Change) {
+          W.Src = (Change & 1) ? Src2 : Src;
+          W.Step = int(Change + 1);
+          auto GraphExec = buildGraph(Queue, Deps, W).finalize();
+          InOrderQueue.ext_oneapi_graph(GraphExec).wait();
+        }
+        double RefinalizeUs = elapsedUs(Start, Clock::now()) / Updates;
+        Passed &=
+            verify(Queue, Deps, W, (Updates & 1) ? HostSrc : HostSrc2);
+
+        W.Src = Src;
+        W.Step = 1;
+        auto GraphExec = buildGraph(Queue, Deps, W).finalize(
+            {sycl_ext::property::graph::updatable{}});
+        InOrderQueue.ext_oneapi_graph(GraphExec).wait();
+
+        Start = Clock::now();
+        for (size_t Change = 0; Change < Updates; ++Change) {
+          W.Src = (Change & 1) ? Src2 : Src;
+          W.Step = int(Change + 1);
+          GraphExec.update(buildGraph(Queue, Deps, W));
+          InOrderQueue.ext_oneapi_graph(GraphExec).wait();
+        }
+        double UpdateUs = elapsedUs(Start, Clock::now()) / Updates;
+        Passed &=
+            verify(Queue, Deps, W, (Updates & 1) ? HostSrc : HostSrc2);
+
+        std::printf("%-8s %6zu | %12.1f | %12.1f\n", T.Name, Nodes,
+                    RefinalizeUs, UpdateUs);
+      }
+    }
+  } else {
+    std::cout << "\nThe device does not support ext_oneapi_graph, graph "
+                 "update is not measured.\n";
+  }
+
+  free(Src, Queue);
+  free(Src2, Queue);
+  free(Data, Queue);
+
+  std::cout << (Passed ? "\nSuccess!" : "\nFailed!") << std::endl;
+
+  return Passed ? 0 : 1;
+}
@@ -0,0 +1,463 @@
+//=========================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: BSD-3-Clause
+//=========================================================
+
+/*
+* Batched 1D / 2D DWT for Haar, Daubechies-4 and CDF 9/7 wavelets and signals
+* of arbitrary length.
+* A batch is a set of "count" items of width x height samples stored one after
+* the other, a 1D signal being an item with a height of 1. One decomposition
+* level filters every row of the current approximation region and then every
+* column of the result, each line of length n giving ceil(n / 2) approximation
+* and floor(n / 2) detail coefficients. Lines are extended symmetrically
+* across their ends (whole-sample symmetry, x[-1] = x[1]) so that no length
+* restriction applies and the number of coefficients equals the number of
+* samples. The coefficients are stored with the same scheme as dwtHaar1D
+* (for power of 2 lengths the Haar result is identical to it), in 2D each
+* level splitting the approximation region into four quadrants:
+
+-------------------------------------------------
+| a_2 | d_2 | d_1 | d_1 | d_1 |
+-------------------------------
+| d_2 | d_2 | d_1 | d_1 | d_1 |
+-------------------------------
+| d_1 | d_1 | d_1 | d_1 | d_1 |
+-------------------------------------------------
+
+* Items which fit in local memory are decomposed by one work-group each, all
+* levels in one kernel: the approximation region goes back and forth between
+* two local buffers and is only written to global memory at the end. Larger
+* items are decomposed level by level in global memory until their
+* approximation region fits, the remaining levels being again computed in
+* local memory. Every launch processes the whole batch.
+* Device Code.
+*/
+
+#ifndef _DWTBATCHED_KERNEL_H_
+#define _DWTBATCHED_KERNEL_H_
+
+#include <sycl/sycl.hpp>
+#include <dpct/dpct.hpp>
+#include <algorithm>
+
+enum class WaveletFilter { Haar, Daubechies4, CDF97 };
+
+////////////////////////////////////////////////////////////////////////////////
+//! Analysis filters, a_k = sum_j lo[j] x[2k + loBegin + j] and
+//! d_k = sum_j hi[j] x[2k + 1 + hiBegin + j]
+//! All of them are normalized like the Haar filters (gain sqrt(2) for the
+//! approximation of a constant signal).
+////////////////////////////////////////////////////////////////////////////////
+template <WaveletFilter F>
+struct FilterBank;
+
+template <>
+struct FilterBank<WaveletFilter::Haar> {
+  static constexpr int loBegin = 0;
+  static constexpr int loTaps = 2;
+  static constexpr float lo[loTaps] = {0.707106781f, 0.707106781f};
+  static constexpr int hiBegin = -1;
+  static constexpr int hiTaps = 2;
+  static constexpr float hi[hiTaps] = {0.707106781f, -0.707106781f};
+};
+
+template <>
+struct FilterBank<WaveletFilter::Daubechies4> {
+  static constexpr int loBegin = 0;
+  static constexpr int loTaps = 4;
+  static constexpr float lo[loTaps] = {0.482962913f, 0.836516304f,
+                                       0.224143868f, -0.129409523f};
+  static constexpr int hiBegin = -1;
+  static constexpr int hiTaps = 4;
+  static constexpr float hi[hiTaps] = {-0.129409523f, -0.224143868f,
+                                       0.836516304f, -0.482962913f};
+};
+
+// Biorthogonal filters of JPEG 2000 lossy compression, symmetric so that the
+// symmetric extension is exactly invertible.
+template <>
+struct FilterBank<WaveletFilter::CDF97> {
+  static constexpr int loBegin = -4;
+  static constexpr int loTaps = 9;
+  static constexpr float lo[loTaps] = {
+      0.037828456f,  -0.023849465f, -0.110624404f, 0.377402856f, 0.852698679f,
+      0.377402856f,  -0.110624404f, -0.023849465f, 0.037828456f};
+  static constexpr int hiBegin = -3;
+  static constexpr int hiTaps = 7;
+  static constexpr float hi[hiTaps] = {
+      0.064538883f,  -0.040689418f, -0.418092273f, 0.788485616f,
+      -0.418092273f, -0.040689418f, 0.064538883f};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Number of approximation coefficients of a line of length len
+////////////////////////////////////////////////////////////////////////////////
+inline unsigned int approxLength(unsigned int len) { return (len + 1) / 2; }
+
+////////////////////////////////////////////////////////////////////////////////
+//! Map an index outside of [0, len) with whole-sample symmetric extension,
+//! repeated for filters wider than the line
+//! @param i    index, possibly negative
+//! @param len  line length, at least 2
+////////////////////////////////////////////////////////////////////////////////
+inline int mirrorIndex(int i, int len) {
+  const int period = 2 * len - 2;
+
+  i = ((i < 0) ? -i : i) % period;
+
+  return (i < len) ? i : period - i;
+}
+
+template <int Taps>
+inline float applyFilter(const float *line, int stride, int len, int first,
+                         const float (&taps)[Taps]) {
+  float sum = 0.0f;
+
+  if (first >= 0 && first + Taps <= len) {
+    // interior of the line, no extension
+#pragma unroll
+    for (int j = 0; j < Taps; ++j) {
+      sum += taps[j] * line[(first + j) * stride];
+    }
+  } else {
+#pragma unroll
+    for (int j = 0; j < Taps; ++j) {
+      sum += taps[j] * line[mirrorIndex(first + j, len) * stride];
+    }
+  }
+
+  return sum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Compute one coefficient of a single level decomposition of a line
+//! @return  approximation coefficient o if o < approxLength(len), detail
+//!          coefficient o - approxLength(len) otherwise; a line of length 1
+//!          is not decomposed any further and is returned as is
+//! @param line    first sample of the line
+//! @param stride  distance between two samples of the line
+//! @param len     line length
+//! @param o       index of the coefficient
+////////////////////////////////////////////////////////////////////////////////
+template <WaveletFilter F>
+inline float analyze(const float *line, int stride, int len, int o) {
+  using Bank = FilterBank<F>;
+
+  if (len == 1) {
+    return line[0];
+  }
+
+  const int half = approxLength(len);
+
+  if (o < half) {
+    return applyFilter(line, stride, len, 2 * o + Bank::loBegin, Bank::lo);
+  }
+
+  return applyFilter(line, stride, len, 2 * (o - half) + 1 + Bank::hiBegin,
+                     Bank::hi);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Filter the rows of the approximation region of every item in global memory
+//! Work-items are indexed by (item, row, coefficient)
+//! @param id          input data
+//! @param od          output data
+//! @param item_size   number of samples per item
+//! @param pitch       row pitch of an item (its width)
+//! @param region_w    width of the approximation region
+//! @param region_h    height of the approximation region
+////////////////////////////////////////////////////////////////////////////////
+template <WaveletFilter F>
+void dwtRowPass(const float *id, float *od, size_t item_size,
+                unsigned int pitch, unsigned int region_w,
+                unsigned int region_h, const sycl::nd_item<3> &item_ct1) {
+  const unsigned int o = item_ct1.get_global_id(2);
+  const unsigned int row = item_ct1.get_global_id(1);
+
+  if (o >= region_w || row >= region_h) {
+    return;
+  }
+
+  const size_t offset = (item_ct1.get_global_id(0) * item_size) +
+                        (size_t(row) * pitch);
+
+  od[offset + o] = analyze<F>(id + offset, 1, region_w, o);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Filter the columns of the approximation region of every item in global
+//! memory
+//! Work-items are indexed by (item, coefficient, column) so that neighbouring
+//! work-items access neighbouring columns
+//! @param id          input data
+//! @param od          output data
+//! @param item_size   number of samples per item
+//! @param pitch       row pitch of an item (its width)
+//! @param region_w    width of the approximation region
+//! @param region_h    height of the approximation region
+////////////////////////////////////////////////////////////////////////////////
+template <WaveletFilter F>
+void dwtColumnPass(const float *id, float *od, size_t item_size,
+                   unsigned int pitch, unsigned int region_w,
+                   unsigned int region_h, const sycl::nd_item<3> &item_ct1) {
+  const unsigned int col = item_ct1.get_global_id(2);
+  const unsigned int o = item_ct1.get_global_id(1);
+
+  if (col >= region_w || o >= region_h) {
+    return;
+  }
+
+  const size_t offset = (item_ct1.get_global_id(0) * item_size) + col;
+
+  od[offset + (size_t(o) * pitch)] =
+      analyze<F>(id + offset, pitch, region_h, o);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Compute the remaining decomposition levels of one item with one work-group
+//! The approximation region of the item is loaded to local memory, decomposed
+//! over all levels and stored to the output
+//! @param id          input data
+//! @param od          output data
+//! @param item_size   number of samples per item
+//! @param pitch       row pitch of an item (its width)
+//! @param region_w    width of the approximation region
+//! @param region_h    height of the approximation region
+//! @param dlevels     number of decomposition levels to compute
+//! @param slm         local memory for 2 * region_w * region_h samples
+////////////////////////////////////////////////////////////////////////////////
+template <WaveletFilter F>
+void dwtLocalLevels(const float *id, float *od, size_t item_size,
+                    unsigned int pitch, unsigned int region_w,
+                    unsigned int region_h, unsigned int dlevels,
+                    const sycl::nd_item<3> &item_ct1, float *slm) {
+  const unsigned int tid = item_ct1.get_local_id(2);
+  const unsigned int bdim = item_ct1.get_local_range(2);
+  const unsigned int n = region_w * region_h;
+  const size_t offset = item_ct1.get_group(2) * item_size;
+
+  // the region in "data", the result of the row pass in "rows"; both are
+  // stored with a pitch of region_w
+  float *data = slm;
+  float *rows = slm + n;
+
+  for (unsigned int i = tid; i < n; i += bdim) {
+    data[i] = id[offset + ((i / region_w) * pitch) + (i % region_w)];
+  }
+
+  item_ct1.barrier(sycl::access::fence_space::local_space);
+
+  unsigned int w = region_w;
+  unsigned int h = region_h;
+
+  for (unsigned int level = 0; level < dlevels; ++level) {
+    for (unsigned int i = tid; i < w * h; i += bdim) {
+      const unsigned int row = i / w;
+      const unsigned int o = i % w;
+
+      rows[(row * region_w) + o] = analyze<F>(data + (row * region_w), 1, w, o);
+    }
+
+    item_ct1.barrier(sycl::access::fence_space::local_space);
+
+    // everything outside of the current region in "data" holds the detail
+    // coefficients of the previous levels and is left untouched
+    for (unsigned int i = tid; i < w * h; i += bdim) {
+      const unsigned int o = i / w;
+      const unsigned int col = i % w;
+
+      data[(o * region_w) + col] = analyze<F>(rows + col, region_w, h, o);
+    }
+
+    item_ct1.barrier(sycl::access::fence_space::local_space);
+
+    w = approxLength(w);
+    h = approxLength(h);
+  }
+
+  for (unsigned int i = tid; i < n; i += bdim) {
+    od[offset + ((i / region_w) * pitch) + (i % region_w)] = data[i];
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decomposition of a batch of items of the same size on a queue
+//! The temporary storage is allocated once, run() only enqueues kernels so
+//! that consecutive batches are not synchronized with the host.
+////////////////////////////////////////////////////////////////////////////////
+class BatchedDwt {
+ public:
+  //! @param q       queue to run on, in order
+  //! @param width   width of an item (its length for 1D signals)
+  //! @param height  height of an item, 1 for 1D signals
+  //! @param count   number of items
+  //! @param levels  number of decomposition levels, at most
+  //!                maxLevels(width, height)
+  BatchedDwt(sycl::queue &q, unsigned int width, unsigned int height,
+             unsigned int count, unsigned int levels)
+      : q_(q),
+        width_(width),
+        height_(height),
+        count_(count),
+        levels_(std::min(levels, maxLevels(width, height))),
+        global_levels_(0),
+        temp_(NULL) {
+    const sycl::device dev = q_.get_device();
+
+    max_wg_ = std::min<size_t>(
+        256, dev.get_info<sycl::info::device::max_work_group_size>());
+
+    // both local buffers must fit, keeping some room for the runtime
+    const size_t local_samples =
+        (dev.get_info<sycl::info::device::local_mem_size>() - 1024) /
+        (2 * sizeof(float));
+
+    unsigned int w = width_;
+    unsigned int h = height_;
+
+    while (global_levels_ < levels_ && size_t(w) * h > local_samples) {
+      w = approxLength(w);
+      h = approxLength(h);
+      ++global_levels_;
+    }
+
+    if (global_levels_ > 0) {
+      DPCT_CHECK_ERROR(temp_ = sycl::malloc_device<float>(
+                           size_t(width_) * height_ * count_, q_));
+    }
+  }
+
+  ~BatchedDwt() {
+    if (temp_ != NULL) {
+      DPCT_CHECK_ERROR(sycl::free(temp_, q_));
+    }
+  }
+
+  BatchedDwt(const BatchedDwt &) = delete;
+  BatchedDwt &operator=(const BatchedDwt &) = delete;
+
+  //! Number of levels for a full decomposition
+  static unsigned int maxLevels(unsigned int width, unsigned int height) {
+    unsigned int levels = 0;
+
+    while (width > 1 || height > 1) {
+      width = approxLength(width);
+      height = approxLength(height);
+      ++levels;
+    }
+
+    return levels;
+  }
+
+  unsigned int levels() const { return levels_; }
+
+  //! Number of levels computed in global memory before switching to local
+  //! memory, 0 when the items fit in local memory
+  unsigned int globalLevels() const { return global_levels_; }
+
+  //! Enqueue the decomposition of the batch
+  //! @param d_idata  device input data, count * width * height samples
+  //! @param d_odata  device output data, same size, must not alias d_idata
+  void run(WaveletFilter filter, const float *d_idata, float *d_odata) {
+    switch (filter) {
+      case WaveletFilter::Haar:
+        run<WaveletFilter::Haar>(d_idata, d_odata);
+        break;
+      case WaveletFilter::Daubechies4:
+        run<WaveletFilter::Daubechies4>(d_idata, d_odata);
+        break;
+      case WaveletFilter::CDF97:
+        run<WaveletFilter::CDF97>(d_idata, d_odata);
+        break;
+    }
+  }
+
+ private:
+  template <WaveletFilter F>
+  void run(const float *d_idata, float *d_odata) {
+    const size_t item_size = size_t(width_) * height_;
+    const unsigned int pitch = width_;
+    const unsigned int count = count_;
+    float *temp = temp_;
+
+    if (levels_ == 0) {
+      q_.memcpy(d_odata, d_idata, item_size * count * sizeof(float));
+      return;
+    }
+
+    unsigned int w = width_;
+    unsigned int h = height_;
+    const float *src = d_idata;
+
+    // levels too large for local memory, the rows go to the temporary buffer
+    // and the columns back to the output
+    for (unsigned int level = 0; level < global_levels_; ++level) {
+      const unsigned int region_w = w;
+      const unsigned int region_h = h;
+
+      // (item, row or coefficient, coefficient or column) for both passes
+      const size_t bdim = std::min<size_t>(max_wg_, 128);
+      const sycl::nd_range<3> pass_range(
+          sycl::range<3>(count, region_h,
+                         ((region_w + bdim - 1) / bdim) * bdim),
+          sycl::range<3>(1, 1, bdim));
+
+      q_.parallel_for(pass_range, [=](sycl::nd_item<3> item_ct1) {
+        dwtRowPass<F>(src, temp, item_size, pitch, region_w, region_h,
+                      item_ct1);
+      });
+
+      q_.parallel_for(pass_range, [=](sycl::nd_item<3> item_ct1) {
+        dwtColumnPass<F>(temp, d_odata, item_size, pitch, region_w, region_h,
+                         item_ct1);
+      });
+
+      src = d_odata;
+      w = approxLength(w);
+      h = approxLength(h);
+    }
+
+    if (global_levels_ == levels_) {
+      return;
+    }
+
+    // remaining levels, one work-group per item
+    const unsigned int region_w = w;
+    const unsigned int region_h = h;
+    const unsigned int dlevels = levels_ - global_levels_;
+
+    size_t bdim = 32;
+    while (bdim < max_wg_ && 2 * bdim < size_t(region_w) * region_h) {
+      bdim *= 2;
+    }
+
+    q_.submit([&](sycl::handler &cgh) {
+      sycl::local_accessor<float, 1> slm_acc(
+          sycl::range<1>(2 * size_t(region_w) * region_h), cgh);
+
+      cgh.parallel_for(
+          sycl::nd_range<3>(sycl::range<3>(1, 1, count * bdim),
+                            sycl::range<3>(1, 1, bdim)),
+          [=](sycl::nd_item<3> item_ct1) {
+            dwtLocalLevels<F>(
+                src, d_odata, item_size, pitch, region_w, region_h, dlevels,
+                item_ct1,
+                slm_acc.get_multi_ptr<sycl::access::decorated::no>().get());
+          });
+    });
+  }
+
+  sycl::queue &q_;
+  unsigned int width_;
+  unsigned int height_;
+  unsigned int count_;
+  unsigned int levels_;
+  unsigned int global_levels_;
+  size_t max_wg_;
+  // rows of the levels computed in global memory
+  float *temp_;
+};
+
+#endif  // #ifndef _DWTBATCHED_KERNEL_H_
@@ -97,6 +97,7 @@ decomposition.
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <vector>
 
 // includes, project
 #include <helper_functions.h>
@@ -110,10 +111,12 @@ const unsigned int NUM_BANKS = 16;
 ////////////////////////////////////////////////////////////////////////////////
 // includes, kernels
 #include "dwtHaar1D_kernel.dp.hpp"
+#include "dwtBatched_kernel.dp.hpp"
 
 ////////////////////////////////////////////////////////////////////////////////
 // declaration, forward
 void runTest(int argc, char **argv);
+void runBatchedTest(int argc, char **argv);
 bool getLevels(unsigned int len, unsigned int *levels);
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -121,7 +124,11 @@ bool getLevels(unsigned int len, unsigned int *levels);
 ////////////////////////////////////////////////////////////////////////////////
 int main(int argc, char **argv) {
   // run test
-  runTest(argc, argv);
+  if (checkCmdLineFlag(argc, (const char **)argv, "batch")) {
+    runBatchedTest(argc, argv);
+  } else {
+    runTest(argc, argv);
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -145,7 +152,11 @@ void runTest(int argc, char **argv) {
       "  ./dwtHaar1D\n"
       "       --signal=signal.dat\n"
       "       --result=result.dat\n"
-      "       --gold=regression.gold.dat\n"};
+      "       --gold=regression.gold.dat\n"
+      "\n  dwtHaar1D --batch [--length=<n>] [--signals=<n>] [--width=<n>]\n"
+      "            [--height=<n>] [--images=<n>] [--iterations=<n>]\n\n"
+      "  Decompose batches of 1D signals and 2D images of arbitrary size with\n"
+      "  the Haar, Daubechies-4 and CDF 9/7 wavelets\n"};
 
   printf("%s Starting...\n\n", argv[0]);
 
@@ -414,3 +425,289 @@ bool getLevels(unsigned int len, unsigned int *levels) {
 
   return retval;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//! Sample of a line with symmetric extension, computed on the host
+////////////////////////////////////////////////////////////////////////////////
+float extendedSample(const float *line, int stride, int len, int i) {
+  // reflect until the index is inside the line
+  while (i < 0 || i >= len) {
+    i = (i < 0) ? -i : 2 * (len - 1) - i;
+  }
+
+  return line[i * stride];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Single level decomposition of a line on the host, computed in double
+//! precision
+//! @param line    first sample of the line
+//! @param stride  distance between two samples of the line
+//! @param len     line length
+//! @param coeffs  the len coefficients, approximation followed by detail
+////////////////////////////////////////////////////////////////////////////////
+template <WaveletFilter F>
+void referenceLine(const float *line, int stride, int len, float *coeffs) {
+  using Bank = FilterBank<F>;
+
+  if (len == 1) {
+    coeffs[0] = line[0];
+    return;
+  }
+
+  const int half = (len + 1) / 2;
+
+  for (int k = 0; k < half; ++k) {
+    double sum = 0.0;
+
+    for (int j = 0; j < Bank::loTaps; ++j) {
+      sum += Bank::lo[j] *
+             extendedSample(line, stride, len, 2 * k + Bank::loBegin + j);
+    }
+
+    coeffs[k] = (float)sum;
+  }
+
+  for (int k = 0; k < len / 2; ++k) {
+    double sum = 0.0;
+
+    for (int j = 0; j < Bank::hiTaps; ++j) {
+      sum += Bank::hi[j] *
+             extendedSample(line, stride, len, 2 * k + 1 + Bank::hiBegin + j);
+    }
+
+    coeffs[half + k] = (float)sum;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decomposition of one item on the host, rows then columns of the
+//! approximation region at each level
+////////////////////////////////////////////////////////////////////////////////
+template <WaveletFilter F>
+void referenceDwt(const float *idata, float *odata, unsigned int width,
+                  unsigned int height, unsigned int levels) {
+  std::vector<float> coeffs(std::max(width, height));
+
+  memcpy(odata, idata, sizeof(float) * width * height);
+
+  unsigned int w = width;
+  unsigned int h = height;
+
+  for (unsigned int level = 0; level < levels; ++level) {
+    for (unsigned int row = 0; row < h; ++row) {
+      referenceLine<F>(odata + (row * width), 1, w, coeffs.data());
+
+      for (unsigned int o = 0; o < w; ++o) {
+        odata[(row * width) + o] = coeffs[o];
+      }
+    }
+
+    for (unsigned int col = 0; col < w; ++col) {
+      referenceLine<F>(odata + col, width, h, coeffs.data());
+
+      for (unsigned int o = 0; o < h; ++o) {
+        odata[(o * width) + col] = coeffs[o];
+      }
+    }
+
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+  }
+}
+
+void referenceDwt(WaveletFilter filter, const float *idata, float *odata,
+                  unsigned int width, unsigned int height,
+                  unsigned int levels) {
+  switch (filter) {
+    case WaveletFilter::Haar:
+      referenceDwt<WaveletFilter::Haar>(idata, odata, width, height, levels);
+      break;
+    case WaveletFilter::Daubechies4:
+      referenceDwt<WaveletFilter::Daubechies4>(idata, odata, width, height,
+                                               levels);
+      break;
+    case WaveletFilter::CDF97:
+      referenceDwt<WaveletFilter::CDF97>(idata, odata, width, height, levels);
+      break;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decompose a batch of random items with each filter, check the result
+//! against the host and report the throughput
+//! @return  true if the results of all filters match the host
+////////////////////////////////////////////////////////////////////////////////
+bool runBatch(sycl::queue &q, const char *name, unsigned int width,
+              unsigned int height, unsigned int count, int iterations) {
+  const WaveletFilter filters[] = {WaveletFilter::Haar,
+                                   WaveletFilter::Daubechies4,
+                                   WaveletFilter::CDF97};
+  const char *filter_names[] = {"Haar", "Daubechies-4", "CDF 9/7"};
+
+  const size_t item_size = size_t(width) * height;
+  const size_t batch_size = item_size * count;
+
+  std::vector<float> signal(batch_size);
+  std::vector<float> odata(batch_size);
+  std::vector<float> reference(item_size);
+
+  srand(2022);
+
+  for (size_t i = 0; i < batch_size; ++i) {
+    signal[i] = (float)rand() / RAND_MAX - 0.5f;
+  }
+
+  float *d_idata = NULL;
+  float *d_odata = NULL;
+
+  DPCT_CHECK_ERROR(d_idata = sycl::malloc_device<float>(batch_size, q));
+  DPCT_CHECK_ERROR(d_odata = sycl::malloc_device<float>(batch_size, q));
+  DPCT_CHECK_ERROR(
+      q.memcpy(d_idata, signal.data(), batch_size * sizeof(float)).wait());
+
+  printf("\n%s: %u items of %u x %u samples\n", name, count, width, height);
+
+  bool bResult = true;
+  BatchedDwt dwt(q, width, height, count,
+                 BatchedDwt::maxLevels(width, height));
+
+  for (int f = 0; f < 3; ++f) {
+    // first run, also compiles the kernels
+    dwt.run(filters[f], d_idata, d_odata);
+    DPCT_CHECK_ERROR(
+        q.memcpy(odata.data(), d_odata, batch_size * sizeof(float)).wait());
+
+    bool bFilterResult = true;
+
+    for (unsigned int item = 0; item < count; ++item) {
+      referenceDwt(filters[f], signal.data() + (item * item_size),
+                   reference.data(), width, height, dwt.levels());
+      bFilterResult &=
+          (bool)sdkCompareL2fe(reference.data(),
+                               odata.data() + (item * item_size),
+                               (unsigned int)item_size, 1e-5f);
+    }
+
+    StopWatchInterface *timer = NULL;
+    sdkCreateTimer(&timer);
+    sdkStartTimer(&timer);
+
+    for (int i = 0; i < iterations; ++i) {
+      dwt.run(filters[f], d_idata, d_odata);
+    }
+
+    q.wait();
+    sdkStopTimer(&timer);
+
+    float batchTime = sdkGetTimerValue(&timer) / iterations;
+    sdkDeleteTimer(&timer);
+
+    printf("  %-12s %u levels (%u in global memory): %.3f ms per batch, "
+           "%.1f Msamples/s %s\n",
+           filter_names[f], dwt.levels(), dwt.globalLevels(), batchTime,
+           batch_size / (batchTime * 1000.0f),
+           bFilterResult ? "" : "(wrong result)");
+
+    bResult &= bFilterResult;
+  }
+
+  DPCT_CHECK_ERROR(sycl::free(d_idata, q));
+  DPCT_CHECK_ERROR(sycl::free(d_odata, q));
+
+  return bResult;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decompose batches of 1D signals and 2D images with the batched engine
+////////////////////////////////////////////////////////////////////////////////
+void runBatchedTest(int argc, char **argv) {
+  printf("%s Starting...\n\n", argv[0]);
+
+  sycl::queue &q = dpct::get_in_order_queue();
+  std::cout << "\nRunning on "
+            << q.get_device().get_info<sycl::info::device::name>() << "\n";
+
+  // lengths which are not powers of 2 by default
+  int length = 1000, signals = 4096;
+  int width = 509, height = 383, images = 64;
+  int iterations = 20;
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "length")) {
+    length = getCmdLineArgumentInt(argc, (const char **)argv, "length");
+  }
+  if (checkCmdLineFlag(argc, (const char **)argv, "signals")) {
+    signals = getCmdLineArgumentInt(argc, (const char **)argv, "signals");
+  }
+  if (checkCmdLineFlag(argc, (const char **)argv, "width")) {
+    width = getCmdLineArgumentInt(argc, (const char **)argv, "width");
+  }
+  if (checkCmdLineFlag(argc, (const char **)argv, "height")) {
+    height = getCmdLineArgumentInt(argc, (const char **)argv, "height");
+  }
+  if (checkCmdLineFlag(argc, (const char **)argv, "images")) {
+    images = getCmdLineArgumentInt(argc, (const char **)argv, "images");
+  }
+  if (checkCmdLineFlag(argc, (const char **)argv, "iterations")) {
+    iterations = getCmdLineArgumentInt(argc, (const char **)argv, "iterations");
+  }
+
+  if (length < 1 || signals < 1 || width < 1 || height < 1 || images < 1 ||
+      iterations < 1) {
+    fprintf(stderr, "Invalid batch size.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  bool bResult = true;
+
+  // the Haar decomposition of the regression signal must match the gold file
+  char *s_fname = sdkFindFilePath("signal.dat", argv[0]);
+  char *r_gold_fname = sdkFindFilePath("regression.gold.dat", argv[0]);
+  unsigned int slength = 0, len_reference = 0;
+  float *signal = NULL, *reference = NULL;
+
+  if (s_fname == NULL || r_gold_fname == NULL ||
+      sdkReadFile(s_fname, &signal, &slength, false) != true ||
+      sdkReadFile(r_gold_fname, &reference, &len_reference, false) != true ||
+      slength != len_reference) {
+    fprintf(stderr, "Cannot read the regression signal and its result.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  float *d_idata = NULL;
+  float *d_odata = NULL;
+  float *odata = (float *)malloc(sizeof(float) * slength);
+
+  DPCT_CHECK_ERROR(d_idata = sycl::malloc_device<float>(slength, q));
+  DPCT_CHECK_ERROR(d_odata = sycl::malloc_device<float>(slength, q));
+  DPCT_CHECK_ERROR(q.memcpy(d_idata, signal, sizeof(float) * slength));
+
+  {
+    BatchedDwt dwt(q, slength, 1, 1, BatchedDwt::maxLevels(slength, 1));
+    dwt.run(WaveletFilter::Haar, d_idata, d_odata);
+    DPCT_CHECK_ERROR(
+        q.memcpy(odata, d_odata, sizeof(float) * slength).wait());
+  }
+
+  bool bRegression =
+      (bool)sdkCompareL2fe(reference, odata, slength, 0.001f);
+  printf("Regression signal (%u samples): %s\n", slength,
+         bRegression ? "match" : "mismatch");
+  bResult &= bRegression;
+
+  DPCT_CHECK_ERROR(sycl::free(d_idata, q));
+  DPCT_CHECK_ERROR(sycl::free(d_odata, q));
+  free(odata);
+  free(signal);
+  free(reference);
+  free(s_fname);
+  free(r_gold_fname);
+
+  // many short signals, each decomposed in local memory by one work-group
+  bResult &= runBatch(q, "1D signals", length, 1, signals, iterations);
+  // long signals, the first levels are computed in global memory
+  bResult &= runBatch(q, "Long 1D signals", 262147, 1, 8, iterations);
+  bResult &= runBatch(q, "2D images", width, height, images, iterations);
+
+  printf(bResult ? "\nTest success!\n" : "\nTest failure!\n");
+}
@@ -62,18 +62,82 @@ extern "C" void dyadicConvolutionCPU(float *h_Result, float *h_Data,
 #include <cmath>
 
 ////////////////////////////////////////////////////////////////////////////////
-// Data configuration
+// Default data configuration, overridden by --log2Data, --log2Kernel and
+// --batch
 ////////////////////////////////////////////////////////////////////////////////
-const int log2Kernel = 7;
-const int log2Data = 23;
+const int DEFAULT_LOG2KERNEL = 7;
+const int DEFAULT_LOG2DATA = 23;
 
-const int dataN = 1 << log2Data;
-const int kernelN = 1 << log2Kernel;
+////////////////////////////////////////////////////////////////////////////////
+// Relative L2 norm of the difference between two vectors
+////////////////////////////////////////////////////////////////////////////////
+double relativeL2(const float *h_Ref, const float *h_Data, size_t N) {
+  double sum_delta2 = 0, sum_ref2 = 0;
 
-const int DATA_SIZE = dataN * sizeof(float);
-const int KERNEL_SIZE = kernelN * sizeof(float);
+  for (size_t i = 0; i < N; i++) {
+    double delta = h_Ref[i] - h_Data[i];
+    sum_delta2 += delta * delta;
+    sum_ref2 += (double)h_Ref[i] * h_Ref[i];
+  }
 
-const double NOPS = 3.0 * (double)dataN * (double)log2Data / 2.0;
+  return sqrt(sum_delta2 / sum_ref2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Check the forward and the inverse transforms of batches of vectors of all
+// lengths up to 2 ** maxLog2N against the CPU
+////////////////////////////////////////////////////////////////////////////////
+bool testTransforms(int maxLog2N, int M) {
+  const size_t maxN = (size_t)1 << maxLog2N;
+  float *h_Input = (float *)malloc(M * maxN * sizeof(float));
+  float *h_ResultCPU = (float *)malloc(maxN * sizeof(float));
+  float *h_ResultGPU = (float *)malloc(M * maxN * sizeof(float));
+  float *d_Data;
+  bool passed = true;
+
+  DPCT_CHECK_ERROR(d_Data = sycl::malloc_device<float>(
+                       M * maxN, dpct::get_in_order_queue()));
+
+  for (size_t i = 0; i < M * maxN; i++) {
+    h_Input[i] = (float)rand() / (float)RAND_MAX;
+  }
+
+  for (int log2N = 0; log2N <= maxLog2N; log2N++) {
+    const size_t N = (size_t)1 << log2N;
+    double L2norm = 0;
+
+    DPCT_CHECK_ERROR(dpct::get_in_order_queue().memcpy(
+        d_Data, h_Input, M * N * sizeof(float)));
+    fwtBatchGPU(d_Data, M, log2N);
+    DPCT_CHECK_ERROR(dpct::get_in_order_queue()
+                         .memcpy(h_ResultGPU, d_Data, M * N * sizeof(float))
+                         .wait());
+
+    for (int m = 0; m < M; m++) {
+      fwtCPU(h_ResultCPU, h_Input + m * N, log2N);
+      L2norm =
+          std::max(L2norm, relativeL2(h_ResultCPU, h_ResultGPU + m * N, N));
+    }
+
+    ifwtBatchGPU(d_Data, M, log2N);
+    DPCT_CHECK_ERROR(dpct::get_in_order_queue()
+                         .memcpy(h_ResultGPU, d_Data, M * N * sizeof(float))
+                         .wait());
+    L2norm = std::max(L2norm, relativeL2(h_Input, h_ResultGPU, M * N));
+
+    if (L2norm >= 1e-6) {
+      printf("...%i vectors of 2^%i elements: L2 norm %E\n", M, log2N, L2norm);
+      passed = false;
+    }
+  }
+
+  DPCT_CHECK_ERROR(dpct::dpct_free(d_Data, dpct::get_in_order_queue()));
+  free(h_ResultGPU);
+  free(h_ResultCPU);
+  free(h_Input);
+
+  return passed;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 // Main program
@@ -83,85 +147,136 @@ int main(int argc, char *argv[]) {
 
   float *d_Data, *d_Kernel;
 
-  double delta, ref, sum_delta2, sum_ref2, L2norm, gpuTime;
+  double L2norm, gpuTime;
 
   StopWatchInterface *hTimer = NULL;
   int i;
 
   printf("%s Starting...\n\n", argv[0]);
 
+  int log2Data = DEFAULT_LOG2DATA;
+  int log2Kernel = DEFAULT_LOG2KERNEL;
+  int batch = 1;
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "log2Data")) {
+    log2Data = getCmdLineArgumentInt(argc, (const char **)argv, "log2Data");
+  }
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "log2Kernel")) {
+    log2Kernel = getCmdLineArgumentInt(argc, (const char **)argv, "log2Kernel");
+  }
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "batch")) {
+    batch = getCmdLineArgumentInt(argc, (const char **)argv, "batch");
+  }
+
+  if (log2Data < 0 || log2Data > 28 || log2Kernel < 0 ||
+      log2Kernel > log2Data || batch < 1) {
+    fprintf(stderr,
+            "Usage: %s [--log2Data=<0..28>] [--log2Kernel=<0..log2Data>] "
+            "[--batch=<vectors>]\n",
+            argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  const int dataN = 1 << log2Data;
+  const int kernelN = 1 << log2Kernel;
+
+  const size_t DATA_SIZE = (size_t)dataN * sizeof(float);
+  const size_t KERNEL_SIZE = (size_t)kernelN * sizeof(float);
+
+  // forward transform, modulation and inverse transform of the data
+  const double NOPS = 2.0 * (double)batch * (double)dataN * (double)log2Data +
+                      (double)batch * (double)dataN;
+
   // use command-line specified CUDA device, otherwise use device with highest
   // Gflops/s
 
   sdkCreateTimer(&hTimer);
 
+  srand(2007);
+
+  printf("Testing batched forward and inverse transforms...\n");
+  bool transformsPassed = testTransforms(16, 8);
+
   printf("Initializing data...\n");
   printf("...allocating CPU memory\n");
   h_Kernel = (float *)malloc(KERNEL_SIZE);
-  h_Data = (float *)malloc(DATA_SIZE);
+  h_Data = (float *)malloc(batch * DATA_SIZE);
   h_ResultCPU = (float *)malloc(DATA_SIZE);
-  h_ResultGPU = (float *)malloc(DATA_SIZE);
+  h_ResultGPU = (float *)malloc(batch * DATA_SIZE);
   printf("...allocating GPU memory\n");
   DPCT_CHECK_ERROR(d_Kernel = (float *)sycl::malloc_device(
-                                       DATA_SIZE, dpct::get_in_order_queue()));
+                       KERNEL_SIZE, dpct::get_in_order_queue()));
   DPCT_CHECK_ERROR(d_Data = (float *)sycl::malloc_device(
-                                       DATA_SIZE, dpct::get_in_order_queue()));
+                       batch * DATA_SIZE, dpct::get_in_order_queue()));
 
   printf("...generating data\n");
-  printf("Data length: %i; kernel length: %i\n", dataN, kernelN);
-  srand(2007);
+  printf("Data length: %i; kernel length: %i; vectors: %i\n", dataN, kernelN,
+         batch);
 
+  // normalized so that the repeated convolutions below keep the data in range
   for (i = 0; i < kernelN; i++) {
-    h_Kernel[i] = (float)rand() / (float)RAND_MAX;
+    h_Kernel[i] = (float)rand() / (float)RAND_MAX / (float)kernelN;
   }
 
-  for (i = 0; i < dataN; i++) {
-    h_Data[i] = (float)rand() / (float)RAND_MAX;
+  for (size_t j = 0; j < batch * (size_t)dataN; j++) {
+    h_Data[j] = (float)rand() / (float)RAND_MAX;
   }
 
-  DPCT_CHECK_ERROR(
-      dpct::get_in_order_queue().memset(d_Kernel, 0, DATA_SIZE).wait());
   DPCT_CHECK_ERROR(dpct::get_in_order_queue()
                                        .memcpy(d_Kernel, h_Kernel, KERNEL_SIZE)
                                        .wait());
-  DPCT_CHECK_ERROR(
-      dpct::get_in_order_queue().memcpy(d_Data, h_Data, DATA_SIZE).wait());
+  DPCT_CHECK_ERROR(dpct::get_in_order_queue()
+                       .memcpy(d_Data, h_Data, batch * DATA_SIZE)
+                       .wait());
+
+  DyadicConvolution convolution(log2Data, log2Kernel);
 
   printf("Running GPU dyadic convolution using Fast Walsh Transform...\n");
   DPCT_CHECK_ERROR(dpct::get_current_device().queues_wait_and_throw());
   sdkResetTimer(&hTimer);
   sdkStartTimer(&hTimer);
-  fwtBatchGPU(d_Data, 1, log2Data);
-  fwtBatchGPU(d_Kernel, 1, log2Data);
-  modulateGPU(d_Data, d_Kernel, dataN);
-  fwtBatchGPU(d_Data, 1, log2Data);
+  convolution.dyadic_convolve(d_Data, d_Kernel, batch);
   DPCT_CHECK_ERROR(dpct::get_current_device().queues_wait_and_throw());
   sdkStopTimer(&hTimer);
   gpuTime = sdkGetTimerValue(&hTimer);
-  printf("GPU time: %f ms; GOP/s: %f\n", gpuTime,
-         NOPS / (gpuTime * 0.001 * 1E+9));
+  printf("GPU time (transforming the kernel): %f ms\n", gpuTime);
 
   printf("Reading back GPU results...\n");
   DPCT_CHECK_ERROR(dpct::get_in_order_queue()
-                                       .memcpy(h_ResultGPU, d_Data, DATA_SIZE)
+                                       .memcpy(h_ResultGPU, d_Data,
+                                               batch * DATA_SIZE)
                                        .wait());
 
-  printf("Running straightforward CPU dyadic convolution...\n");
-  dyadicConvolutionCPU(h_ResultCPU, h_Data, h_Kernel, log2Data, log2Kernel);
+  // again with the cached kernel spectrum, on the result of the first call
+  const int iterations = 10;
+  sdkResetTimer(&hTimer);
+  sdkStartTimer(&hTimer);
 
+  for (i = 0; i < iterations; i++) {
+    convolution.dyadic_convolve(d_Data, d_Kernel, batch);
+  }
+
+  DPCT_CHECK_ERROR(dpct::get_current_device().queues_wait_and_throw());
+  sdkStopTimer(&hTimer);
+  gpuTime = sdkGetTimerValue(&hTimer) / iterations;
+  printf("GPU time (cached kernel): %f ms; GOP/s: %f\n", gpuTime,
+         NOPS / (gpuTime * 0.001 * 1E+9));
+
+  printf("Running straightforward CPU dyadic convolution...\n");
   printf("Comparing the results...\n");
-  sum_delta2 = 0;
-  sum_ref2 = 0;
+  L2norm = 0;
 
-  for (i = 0; i < dataN; i++) {
-    delta = h_ResultCPU[i] - h_ResultGPU[i];
-    ref = h_ResultCPU[i];
-    sum_delta2 += delta * delta;
-    sum_ref2 += ref * ref;
+  // first and last vector of the batch
+  for (int m = 0; m < batch; m += std::max(batch - 1, 1)) {
+    dyadicConvolutionCPU(h_ResultCPU, h_Data + m * (size_t)dataN, h_Kernel,
+                         log2Data, log2Kernel);
+    L2norm = std::max(L2norm, relativeL2(h_ResultCPU,
+                                         h_ResultGPU + m * (size_t)dataN,
+                                         dataN));
   }
 
-  L2norm = sqrt(sum_delta2 / sum_ref2);
-
   printf("Shutting down...\n");
   sdkDeleteTimer(&hTimer);
   DPCT_CHECK_ERROR(dpct::dpct_free(d_Data, dpct::get_in_order_queue()));
@@ -171,6 +286,8 @@ int main(int argc, char *argv[]) {
   free(h_Data);
   free(h_Kernel);
 
+  printf("Batched transforms: %s\n", transformsPassed ? "passed" : "failed");
   printf("L2 norm: %E\n", L2norm);
-  printf(L2norm < 1e-6 ? "Test passed\n" : "Test failed!\n");
+  printf(L2norm < 1e-6 && transformsPassed ? "Test passed\n"
+                                            : "Test failed!\n");
 }
@@ -25,6 +25,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+
 #ifndef FWT_KERNEL_CUH
 #define FWT_KERNEL_CUH
 #ifndef fwt_kernel_cuh
@@ -32,187 +33,298 @@
 
 #include <sycl/sycl.hpp>
 #include <dpct/dpct.hpp>
+#include <algorithm>
+
+///////////////////////////////////////////////////////////////////////////////
+// The transform of a batch of M vectors of N = 2 ** log2N elements is split
+// into log2N radix-2 stages which commute, so that they can be grouped
+// freely. The stages with strides below the elementary size are computed in
+// local memory by one work-group per elementary block, those with larger
+// strides by in-global memory passes. Both combine up to three stages
+// (radix-8) per read / write of the data.
+// The elementary size is chosen at runtime from the device limits, up to
+// 2 ** MAX_ELEMENTARY_LOG2SIZE elements.
+///////////////////////////////////////////////////////////////////////////////
+#define MAX_ELEMENTARY_LOG2SIZE 12
+
+///////////////////////////////////////////////////////////////////////////////
+// R consecutive radix-2 stages on 2 ** R elements in registers
+///////////////////////////////////////////////////////////////////////////////
+template <int R>
+inline void fwtButterflies(float (&D)[1 << R]) {
+#pragma unroll
+  for (int s = (1 << R) >> 1; s > 0; s >>= 1) {
+#pragma unroll
+    for (int k = 0; k < (1 << R); k++) {
+      if ((k & s) == 0) {
+        float T = D[k];
+        D[k] = T + D[k + s];
+        D[k + s] = T - D[k + s];
+      }
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// First of the 2 ** R elements combined by butterfly group "pos" at "stride"
+///////////////////////////////////////////////////////////////////////////////
+template <int R>
+inline int fwtGroupBase(int pos, int stride) {
+  int lo = pos & (stride - 1);
+  return ((pos - lo) << R) + lo;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
-// Elementary(for vectors less than elementary size) in-shared memory
-// combined radix-2 + radix-4 Fast Walsh Transform
+// Radix-2 ** R stages on a vector in local memory, for all groups
 ///////////////////////////////////////////////////////////////////////////////
-#define ELEMENTARY_LOG2SIZE 10
+template <int R>
+inline void fwtLocalStage(float *s_data, int N, int stride,
+                          const sycl::nd_item<3> &item_ct1) {
+  for (int pos = item_ct1.get_local_id(2); pos < (N >> R);
+       pos += item_ct1.get_local_range(2)) {
+    int i0 = fwtGroupBase<R>(pos, stride);
+    float D[1 << R];
 
-void fwtBatch1Kernel(float *d_Output, float *d_Input, int log2N,
-                     const sycl::nd_item<3> &item_ct1, uint8_t *dpct_local) {
-  // Handle to thread block group
-  sycl::group<3> cta = item_ct1.get_group();
+#pragma unroll
+    for (int k = 0; k < (1 << R); k++) D[k] = s_data[i0 + k * stride];
+
+    fwtButterflies<R>(D);
+
+#pragma unroll
+    for (int k = 0; k < (1 << R); k++) s_data[i0 + k * stride] = D[k];
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Elementary in-local memory radix-8 (+ radix-4 or radix-2) Fast Walsh
+// Transform of one block of 2 ** log2N elements per work-group
+// d_Modulate: if not NULL, the input is multiplied by it on load, indexed
+//             modulo the vector length (vectorMask + 1)
+// scale:      factor applied on store
+///////////////////////////////////////////////////////////////////////////////
+void fwtElementaryKernel(float *d_Data, int log2N, const float *d_Modulate,
+                         int vectorMask, float scale,
+                         const sycl::nd_item<3> &item_ct1, float *s_data) {
   const int N = 1 << log2N;
-  const int base = item_ct1.get_group(2) << log2N;
+  const size_t base = (size_t)item_ct1.get_group(2) << log2N;
 
-  //(2 ** 11) * 4 bytes == 8KB -- maximum s_data[] size for G80
-  auto s_data = (float *)dpct_local;
-  float *d_Src = d_Input + base;
-  float *d_Dst = d_Output + base;
+  float *d_Src = d_Data + base;
 
   for (int pos = item_ct1.get_local_id(2); pos < N;
        pos += item_ct1.get_local_range(2)) {
     s_data[pos] = d_Src[pos];
-  }
 
-  // Main radix-4 stages
-  const int pos = item_ct1.get_local_id(2);
-
-  for (int stride = N >> 2; stride > 0; stride >>= 2) {
-    int lo = pos & (stride - 1);
-    int i0 = ((pos - lo) << 2) + lo;
-    int i1 = i0 + stride;
-    int i2 = i1 + stride;
-    int i3 = i2 + stride;
-    item_ct1.barrier();
-    float D0 = s_data[i0];
-    float D1 = s_data[i1];
-    float D2 = s_data[i2];
-    float D3 = s_data[i3];
-
-    float T;
-    T = D0;
-    D0 = D0 + D2;
-    D2 = T - D2;
-    T = D1;
-    D1 = D1 + D3;
-    D3 = T - D3;
-    T = D0;
-    s_data[i0] = D0 + D1;
-    s_data[i1] = T - D1;
-    T = D2;
-    s_data[i2] = D2 + D3;
-    s_data[i3] = T - D3;
+    if (d_Modulate) s_data[pos] *= d_Modulate[(base + pos) & vectorMask];
   }
 
-  // Do single radix-2 stage for odd power of two
-  if (log2N & 1) {
-   
-    item_ct1.barrier();
+  // Main radix-8 stages
+  int stride = 1;
 
-    for (int pos = item_ct1.get_local_id(2); pos < N / 2;
-         pos += item_ct1.get_local_range(2)) {
-      int i0 = pos << 1;
-      int i1 = i0 + 1;
+  for (; stride * 8 <= N; stride *= 8) {
+    item_ct1.barrier(sycl::access::fence_space::local_space);
+    fwtLocalStage<3>(s_data, N, stride, item_ct1);
+  }
 
-      float D0 = s_data[i0];
-      float D1 = s_data[i1];
-      s_data[i0] = D0 + D1;
-      s_data[i1] = D0 - D1;
-    }
+  // Remaining radix-4 or radix-2 stage
+  item_ct1.barrier(sycl::access::fence_space::local_space);
+
+  if (stride * 4 == N) {
+    fwtLocalStage<2>(s_data, N, stride, item_ct1);
+  } else if (stride * 2 == N) {
+    fwtLocalStage<1>(s_data, N, stride, item_ct1);
   }
 
-  item_ct1.barrier();
+  item_ct1.barrier(sycl::access::fence_space::local_space);
 
   for (int pos = item_ct1.get_local_id(2); pos < N;
        pos += item_ct1.get_local_range(2)) {
-    d_Dst[pos] = s_data[pos];
+    d_Src[pos] = s_data[pos] * scale;
   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Single in-global memory radix-4 Fast Walsh Transform pass
-// (for strides exceeding elementary vector size)
+// Single in-global memory radix-2 ** R Fast Walsh Transform pass
+// (for strides exceeding elementary vector size), one work-item per butterfly
+// group of the whole batch
 ////////////////////////////////////////////////////////////////////////////////
-void fwtBatch2Kernel(float *d_Output, float *d_Input, int stride,
-                     const sycl::nd_item<3> &item_ct1) {
-  const int pos = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
-                  item_ct1.get_local_id(2);
-  const int N = item_ct1.get_local_range(2) * item_ct1.get_group_range(2) * 4;
+template <int R>
+void fwtGlobalPassKernel(float *d_Data, int log2N, int stride,
+                         const float *d_Modulate, size_t groupsN,
+                         const sycl::nd_item<3> &item_ct1) {
+  const size_t id = item_ct1.get_global_id(2);
 
-  float *d_Src = d_Input + item_ct1.get_group(1) * N;
-  float *d_Dst = d_Output + item_ct1.get_group(1) * N;
+  if (id >= groupsN) return;
 
-  int lo = pos & (stride - 1);
-  int i0 = ((pos - lo) << 2) + lo;
-  int i1 = i0 + stride;
-  int i2 = i1 + stride;
-  int i3 = i2 + stride;
-
-  float D0 = d_Src[i0];
-  float D1 = d_Src[i1];
-  float D2 = d_Src[i2];
-  float D3 = d_Src[i3];
-
-  float T;
-  T = D0;
-  D0 = D0 + D2;
-  D2 = T - D2;
-  T = D1;
-  D1 = D1 + D3;
-  D3 = T - D3;
-  T = D0;
-  d_Dst[i0] = D0 + D1;
-  d_Dst[i1] = T - D1;
-  T = D2;
-  d_Dst[i2] = D2 + D3;
-  d_Dst[i3] = T - D3;
+  const int log2GroupsPerVector = log2N - R;
+  const size_t vector = id >> log2GroupsPerVector;
+  const int pos = (int)(id & ((1 << log2GroupsPerVector) - 1));
+  const int i0 = fwtGroupBase<R>(pos, stride);
+
+  float *d_Src = d_Data + (vector << log2N);
+  float D[1 << R];
+
+#pragma unroll
+  for (int k = 0; k < (1 << R); k++) {
+    D[k] = d_Src[i0 + k * stride];
+
+    if (d_Modulate) D[k] *= d_Modulate[i0 + k * stride];
+  }
+
+  fwtButterflies<R>(D);
+
+#pragma unroll
+  for (int k = 0; k < (1 << R); k++) d_Src[i0 + k * stride] = D[k];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Largest elementary size supported by the device of the queue
+////////////////////////////////////////////////////////////////////////////////
+int fwtElementaryLog2Size(sycl::queue &q) {
+  sycl::device dev = q.get_device();
+  size_t localFloats =
+      dev.get_info<sycl::info::device::local_mem_size>() / sizeof(float);
+  size_t maxWorkGroup =
+      dev.get_info<sycl::info::device::max_work_group_size>();
+
+  // elementary blocks of 8 * maxWorkGroup elements at most, one
+  // radix-8 group per work-item
+  int log2Size = MAX_ELEMENTARY_LOG2SIZE;
+
+  while (log2Size > 3 && (((size_t)1 << log2Size) > localFloats ||
+                          ((size_t)1 << (log2Size - 3)) > maxWorkGroup)) {
+    log2Size--;
+  }
+
+  return log2Size;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Put everything together: batched Fast Walsh Transform CPU front-end
+// d_Modulate: if not NULL, vector of 2 ** log2N elements multiplying each
+//             input vector before the transform
+// scale:      factor applied to the result
 ////////////////////////////////////////////////////////////////////////////////
-void fwtBatchGPU(float *d_Data, int M, int log2N) {
+void fwtBatchGPU(sycl::queue &q, float *d_Data, int M, int log2N,
+                 const float *d_Modulate, float scale) {
   const int THREAD_N = 256;
 
-  int N = 1 << log2N;
-  dpct::dim3 grid((1 << log2N) / (4 * THREAD_N), M, 1);
+  const int log2Elementary = std::min(log2N, fwtElementaryLog2Size(q));
+
+  // Stages with strides above the elementary size, up to three per pass
+  for (int log2Stride = log2Elementary; log2Stride < log2N;) {
+    const int R = std::min(3, log2N - log2Stride);
+    const int stride = 1 << log2Stride;
+    const size_t groupsN = ((size_t)M << log2N) >> R;
+    const size_t globalN = (groupsN + THREAD_N - 1) / THREAD_N * THREAD_N;
+    const float *d_Mod = d_Modulate;
+
+    sycl::nd_range<3> range(sycl::range<3>(1, 1, globalN),
+                            sycl::range<3>(1, 1, THREAD_N));
 
-  for (; log2N > ELEMENTARY_LOG2SIZE; log2N -= 2, N >>= 2, M <<= 2) {
-    dpct::get_in_order_queue().submit([&](sycl::handler &cgh) {
-      auto N_ct2 = N / 4;
+    if (R == 3) {
+      q.parallel_for(range, [=](sycl::nd_item<3> item_ct1) {
+        fwtGlobalPassKernel<3>(d_Data, log2N, stride, d_Mod, groupsN,
+                               item_ct1);
+      });
+    } else if (R == 2) {
+      q.parallel_for(range, [=](sycl::nd_item<3> item_ct1) {
+        fwtGlobalPassKernel<2>(d_Data, log2N, stride, d_Mod, groupsN,
+                               item_ct1);
+      });
+    } else {
+      q.parallel_for(range, [=](sycl::nd_item<3> item_ct1) {
+        fwtGlobalPassKernel<1>(d_Data, log2N, stride, d_Mod, groupsN,
+                               item_ct1);
+      });
+    }
 
-      cgh.parallel_for(sycl::nd_range<3>(grid * sycl::range<3>(1, 1, THREAD_N),
-                                         sycl::range<3>(1, 1, THREAD_N)),
-                       [=](sycl::nd_item<3> item_ct1) {
-                         fwtBatch2Kernel(d_Data, d_Data, N_ct2, item_ct1);
-                       });
-    });
+    // only the first pass reads the input
+    d_Modulate = NULL;
+    log2Stride += R;
   }
 
-  dpct::get_in_order_queue().submit([&](sycl::handler &cgh) {
-   
-    sycl::local_accessor<uint8_t, 1> dpct_local_acc_ct1(
-        sycl::range<1>(N * sizeof(float)), cgh);
+  const int elementaryN = 1 << log2Elementary;
+  const size_t blocksN = (size_t)M << (log2N - log2Elementary);
+  const int threadN = std::max(elementaryN / 8, 1);
+  const int vectorMask = (1 << log2N) - 1;
+
+  q.submit([&](sycl::handler &cgh) {
+    sycl::local_accessor<float, 1> s_data_acc(sycl::range<1>(elementaryN),
+                                              cgh);
 
     cgh.parallel_for(
-        sycl::nd_range<3>(sycl::range<3>(1, 1, M) * sycl::range<3>(1, 1, N / 4),
-                          sycl::range<3>(1, 1, N / 4)),
+        sycl::nd_range<3>(sycl::range<3>(1, 1, blocksN * threadN),
+                          sycl::range<3>(1, 1, threadN)),
         [=](sycl::nd_item<3> item_ct1) {
-          fwtBatch1Kernel(
-              d_Data, d_Data, log2N, item_ct1,
-              dpct_local_acc_ct1.get_multi_ptr<sycl::access::decorated::no>()
-                  .get());
+          fwtElementaryKernel(
+              d_Data, log2Elementary, d_Modulate, vectorMask, scale, item_ct1,
+              s_data_acc.get_multi_ptr<sycl::access::decorated::no>().get());
         });
   });
+}
+
+// Forward transform of M vectors of 2 ** log2N elements, in place
+void fwtBatchGPU(float *d_Data, int M, int log2N,
+                 sycl::queue &q = dpct::get_in_order_queue()) {
+  fwtBatchGPU(q, d_Data, M, log2N, NULL, 1.0f);
+}
 
+// Inverse transform: the forward one scaled by 1 / 2 ** log2N
+void ifwtBatchGPU(float *d_Data, int M, int log2N,
+                  sycl::queue &q = dpct::get_in_order_queue()) {
+  fwtBatchGPU(q, d_Data, M, log2N, NULL, 1.0f / (float)(1 << log2N));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Modulate two arrays
+// Dyadic convolution of vectors of 2 ** log2N elements with a kernel of
+// 2 ** log2KernelN elements: result[i] = sum_j data[i ^ j] * kernel[j]
+// The transformed kernel is cached, so that convolving with the same kernel
+// again only costs the forward and the inverse transforms of the data; the
+// product with the kernel spectrum is done while the inverse transform loads
+// its input. Call invalidate() when the kernel at the same address changes.
 ////////////////////////////////////////////////////////////////////////////////
-void modulateKernel(float *d_A, float *d_B, int N,
-                    const sycl::nd_item<3> &item_ct1) {
-  int tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
-            item_ct1.get_local_id(2);
-  int numThreads = item_ct1.get_local_range(2) * item_ct1.get_group_range(2);
-  float rcpN = 1.0f / (float)N;
-
-  for (int pos = tid; pos < N; pos += numThreads) {
-    d_A[pos] *= d_B[pos] * rcpN;
+class DyadicConvolution {
+ public:
+  DyadicConvolution(int log2N, int log2KernelN,
+                    sycl::queue &q = dpct::get_in_order_queue())
+      : q_(q), log2N_(log2N), log2KernelN_(log2KernelN), d_Kernel_(NULL) {
+    DPCT_CHECK_ERROR(d_Spectrum_ =
+                         sycl::malloc_device<float>((size_t)1 << log2N, q_));
   }
-}
 
-// Interface to modulateKernel()
-void modulateGPU(float *d_A, float *d_B, int N) {
-  dpct::get_in_order_queue().parallel_for(
-      sycl::nd_range<3>(sycl::range<3>(1, 1, 128) * sycl::range<3>(1, 1, 256),
-                        sycl::range<3>(1, 1, 256)),
-      [=](sycl::nd_item<3> item_ct1) {
-        modulateKernel(d_A, d_B, N, item_ct1);
-      });
-}
+  ~DyadicConvolution() {
+    DPCT_CHECK_ERROR(dpct::dpct_free(d_Spectrum_, q_));
+  }
+
+  DyadicConvolution(const DyadicConvolution &) = delete;
+  DyadicConvolution &operator=(const DyadicConvolution &) = delete;
+
+  // Convolve the M vectors of d_Data in place with d_Kernel
+  void dyadic_convolve(float *d_Data, const float *d_Kernel, int M = 1) {
+    if (d_Kernel != d_Kernel_) {
+      DPCT_CHECK_ERROR(
+          q_.memset(d_Spectrum_, 0, sizeof(float) << log2N_));
+      DPCT_CHECK_ERROR(q_.memcpy(d_Spectrum_, d_Kernel,
+                                 sizeof(float) << log2KernelN_));
+      fwtBatchGPU(q_, d_Spectrum_, 1, log2N_, NULL, 1.0f);
+      d_Kernel_ = d_Kernel;
+    }
+
+    fwtBatchGPU(q_, d_Data, M, log2N_, NULL, 1.0f);
+    fwtBatchGPU(q_, d_Data, M, log2N_, d_Spectrum_,
+                1.0f / (float)(1 << log2N_));
+  }
+
+  void invalidate() { d_Kernel_ = NULL; }
+
+ private:
+  sycl::queue &q_;
+  int log2N_;
+  int log2KernelN_;
+  // kernel whose transform is in d_Spectrum_
+  const float *d_Kernel_;
+  float *d_Spectrum_;
+};
 
 #endif
 #endif
@@ -61,7 +61,8 @@ void AddKernel(const float *op1, const float *op2, int count,
 /// \param[in]  count vector size
 /// \param[out] sum   result
 ///////////////////////////////////////////////////////////////////////////////
-static void Add(const float *op1, const float *op2, int count, float *sum, sycl::queue q) {
+static void Add(const float *op1, const float *op2, int count, float *sum,
+                sycl::queue &q) {
   sycl::range<3> threads(1, 1, 256);
   sycl::range<3> blocks(1, 1, iDivUp(count, threads[2]));
 
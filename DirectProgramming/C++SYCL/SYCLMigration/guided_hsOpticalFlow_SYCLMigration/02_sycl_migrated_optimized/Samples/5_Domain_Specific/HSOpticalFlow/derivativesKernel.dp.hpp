@@ -34,160 +34,146 @@
 #include <sycl/sycl.hpp>
 #include <dpct/dpct.hpp>
 #include "common.h"
+#include "warpingKernel.dp.hpp"
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief compute image derivatives
+/// \brief warp tracked image and compute image derivatives, kernel
 ///
-/// CUDA kernel, relies heavily on texture unit
-/// \param[in]  width   image width
-/// \param[in]  height  image height
-/// \param[in]  stride  image stride
+/// Source pixels and warped tracked pixels of the tile, plus a two pixels
+/// wide halo, are first stored to local memory. Clamping the halo coordinates
+/// gives the derivative filter the same border handling as a clamp_to_edge
+/// sampler. The kernel also resets the solver initial approximation, so no
+/// warped image or memset goes through global memory.
+/// Template parameters describe CTA size
+/// \param[in]  I0      source image
+/// \param[in]  I1      tracked image
+/// \param[in]  u       horizontal displacement
+/// \param[in]  v       vertical displacement
+/// \param[in]  w       image width
+/// \param[in]  h       image height
+/// \param[in]  s       image stride
 /// \param[out] Ix      x derivative
 /// \param[out] Iy      y derivative
 /// \param[out] Iz      temporal derivative
+/// \param[out] du0     horizontal displacement approximation, zeroed
+/// \param[out] dv0     vertical displacement approximation, zeroed
 ///////////////////////////////////////////////////////////////////////////////
-void ComputeDerivativesKernel(int width, int height, int stride, float *Ix,
-                              float *Iy, float *Iz,
-                              sycl::accessor<sycl::float4, 2, sycl::access::mode::read,
-             sycl::access::target::image>
-        texSource,
-    sycl::accessor<sycl::float4, 2, sycl::access::mode::read,
-             sycl::access::target::image>
-        texTarget,
-    sycl::sampler texDesc,
-                              const sycl::nd_item<3> &item_ct1) {
-  const int ix = item_ct1.get_local_id(2) +
-                 item_ct1.get_group(2) * item_ct1.get_local_range(2);
-  const int iy = item_ct1.get_local_id(1) +
-                 item_ct1.get_group(1) * item_ct1.get_local_range(1);
-
-  const int pos = ix + iy * stride;
-
-  if (ix >= width || iy >= height) return;
+template <int bx, int by>
+void ComputeDerivativesKernel(const float *I0, const float *I1,
+                              const float *u, const float *v, int w, int h,
+                              int s, float *Ix, float *Iy, float *Iz,
+                              float *du0, float *dv0,
+                              const sycl::nd_item<3> &item_ct1,
+                              float *source, float *target) {
+  // tile with halo
+  const int tw = bx + 4;
+  const int th = by + 4;
+
+  // tile origin within the image
+  const int tx = item_ct1.get_group(2) * bx - 2;
+  const int ty = item_ct1.get_group(1) * by - 2;
+
+  for (int i = item_ct1.get_local_linear_id(); i < tw * th; i += bx * by) {
+    const int x = sycl::clamp(tx + i % tw, 0, w - 1);
+    const int y = sycl::clamp(ty + i / tw, 0, h - 1);
+
+    source[i] = I0[x + y * s];
+    target[i] = WarpPixel(I1, w, h, s, u, v, x, y);
+  }
 
-  float t0, t1;
+  sycl::group_barrier(item_ct1.get_group());
+
+  const int ix = item_ct1.get_local_id(2) + tx + 2;
+  const int iy = item_ct1.get_local_id(1) + ty + 2;
+
+  if (ix >= w || iy >= h) return;
+
+  const int pos = ix + iy * s;
 
-  auto x_inputCoords1 = sycl::float2(ix - 2.0f, iy);
-  auto x_inputCoords2 = sycl::float2(ix - 1.0f, iy);
-  auto x_inputCoords3 = sycl::float2(ix + 1.0f, iy);
-  auto x_inputCoords4 = sycl::float2(ix + 2.0f, iy);
+  // position within the tile
+  const int c = item_ct1.get_local_id(2) + 2 +
+                (item_ct1.get_local_id(1) + 2) * tw;
 
-  t0 = texSource.read(x_inputCoords1, texDesc)[0];
-  t0 -= texSource.read(x_inputCoords2, texDesc)[0] * 8.0f;
-  t0 += texSource.read(x_inputCoords3, texDesc)[0] * 8.0f;
-  t0 -= texSource.read(x_inputCoords4, texDesc)[0];
+  float t0, t1;
+  // derivative filter is (1, -8, 0, 8, -1)/12
+  // x derivative
+  t0 = source[c - 2];
+  t0 -= source[c - 1] * 8.0f;
+  t0 += source[c + 1] * 8.0f;
+  t0 -= source[c + 2];
   t0 /= 12.0f;
 
-  t1 = texTarget.read(x_inputCoords1, texDesc)[0];
-  t1 -= texTarget.read(x_inputCoords2, texDesc)[0] * 8.0f;
-  t1 += texTarget.read(x_inputCoords3, texDesc)[0] * 8.0f;
-  t1 -= texTarget.read(x_inputCoords4, texDesc)[0];
+  t1 = target[c - 2];
+  t1 -= target[c - 1] * 8.0f;
+  t1 += target[c + 1] * 8.0f;
+  t1 -= target[c + 2];
   t1 /= 12.0f;
 
+  // spatial derivatives are averaged
   Ix[pos] = (t0 + t1) * 0.5f;
 
   // t derivative
-  auto inputCoord = sycl::float2(ix, iy);
-  Iz[pos] = texTarget.read(inputCoord, texDesc)[0] -
-            texSource.read(inputCoord, texDesc)[0];
+  Iz[pos] = target[c] - source[c];
 
   // y derivative
-  auto y_inputCoords1 = sycl::float2(ix, iy - 2.0f);
-  auto y_inputCoords2 = sycl::float2(ix, iy - 1.0f);
-  auto y_inputCoords3 = sycl::float2(ix, iy + 1.0f);
-  auto y_inputCoords4 = sycl::float2(ix, iy + 2.0f);
-
-  t0 = texSource.read(y_inputCoords1, texDesc)[0];
-  t0 -= texSource.read(y_inputCoords2, texDesc)[0] * 8.0f;
-  t0 += texSource.read(y_inputCoords3, texDesc)[0] * 8.0f;
-  t0 -= texSource.read(y_inputCoords4, texDesc)[0];
+  t0 = source[c - 2 * tw];
+  t0 -= source[c - tw] * 8.0f;
+  t0 += source[c + tw] * 8.0f;
+  t0 -= source[c + 2 * tw];
   t0 /= 12.0f;
 
-  t1 = texTarget.read(y_inputCoords1, texDesc)[0];
-  t1 -= texTarget.read(y_inputCoords2, texDesc)[0] * 8.0f;
-  t1 += texTarget.read(y_inputCoords3, texDesc)[0] * 8.0f;
-  t1 -= texTarget.read(y_inputCoords4, texDesc)[0];
+  t1 = target[c - 2 * tw];
+  t1 -= target[c - tw] * 8.0f;
+  t1 += target[c + tw] * 8.0f;
+  t1 -= target[c + 2 * tw];
   t1 /= 12.0f;
 
   Iy[pos] = (t0 + t1) * 0.5f;
+
+  // initial approximation for the solver
+  du0[pos] = 0.0f;
+  dv0[pos] = 0.0f;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief compute image derivatives
+/// \brief warp tracked image and compute image derivatives
 ///
 /// \param[in]  I0  source image
 /// \param[in]  I1  tracked image
+/// \param[in]  u   horizontal displacement
+/// \param[in]  v   vertical displacement
 /// \param[in]  w   image width
 /// \param[in]  h   image height
 /// \param[in]  s   image stride
 /// \param[out] Ix  x derivative
 /// \param[out] Iy  y derivative
 /// \param[out] Iz  temporal derivative
+/// \param[out] du0 horizontal displacement approximation, zeroed
+/// \param[out] dv0 vertical displacement approximation, zeroed
+/// \param[in]  q   queue the kernel is submitted to
 ///////////////////////////////////////////////////////////////////////////////
-static void ComputeDerivatives(const float *I0, const float *I1, float *pI0_h,
-                               float *pI1_h, float *I0_h, float *I1_h,
-                               float *src_d0, float *src_d1, int w, int h,
-                               int s, float *Ix, float *Iy, float *Iz, sycl::queue q) {
-  sycl::range<3> threads(1, 6, 32);
+static void ComputeDerivatives(const float *I0, const float *I1,
+                               const float *u, const float *v, int w, int h,
+                               int s, float *Ix, float *Iy, float *Iz,
+                               float *du0, float *dv0, sycl::queue &q) {
+  // CTA size
+  sycl::range<3> threads(1, 8, 32);
+  // grid size
   sycl::range<3> blocks(1, iDivUp(h, threads[1]), iDivUp(w, threads[2]));
 
-  int dataSize = s * h * sizeof(float);
-
-  q.memcpy(I0_h, I0, dataSize);
-  q.memcpy(I1_h, I1, dataSize);
-  q.wait();
-
-  for (int i = 0; i < h; i++) {
-    for (int j = 0; j < w; j++) {
-      int index = i * s + j;
-      pI0_h[index * 4 + 0] = I0_h[index];
-      pI0_h[index * 4 + 1] = pI0_h[index * 4 + 2] = pI0_h[index * 4 + 3] = 0.f;
-    }
-  }
-
-  for (int i = 0; i < h; i++) {
-    for (int j = 0; j < w; j++) {
-      int index = i * s + j;
-      pI1_h[index * 4 + 0] = I1_h[index];
-      pI1_h[index * 4 + 1] = pI1_h[index * 4 + 2] = pI1_h[index * 4 + 3] = 0.f;
-    }
-  }
-
-  q.memcpy(src_d0, pI0_h, s * h * sizeof(sycl::float4));
-  q.memcpy(src_d1, pI1_h, s * h * sizeof(sycl::float4));
-
-  q.wait();
-
-  auto texDescr = sycl::sampler(
-      sycl::coordinate_normalization_mode::unnormalized,
-      sycl::addressing_mode::clamp_to_edge, sycl::filtering_mode::nearest);
-
-  auto texSource =
-      sycl::image<2>(src_d0, sycl::image_channel_order::rgba,
-                         sycl::image_channel_type::fp32, sycl::range<2>(w, h),
-                         sycl::range<1>(s * sizeof(sycl::float4)));
-
-  auto texTarget =
-      sycl::image<2>(src_d1, sycl::image_channel_order::rgba,
-                         sycl::image_channel_type::fp32, sycl::range<2>(w, h),
-                         sycl::range<1>(s * sizeof(sycl::float4)));
-  
-  
   q.submit([&](sycl::handler &cgh) {
-    auto texSource_acc =
-         texSource.template get_access<sycl::float4,
-                                       sycl::access::mode::read>(cgh);
-     auto texTarget_acc =
-         texTarget.template get_access<sycl::float4,
-                                       sycl::access::mode::read>(cgh);
+    sycl::local_accessor<float, 1> source_acc(
+        sycl::range<1>((32 + 4) * (8 + 4)), cgh);
+    sycl::local_accessor<float, 1> target_acc(
+        sycl::range<1>((32 + 4) * (8 + 4)), cgh);
 
     cgh.parallel_for(
         sycl::nd_range<3>(blocks * threads, threads),
         [=](sycl::nd_item<3> item_ct1) {
-          ComputeDerivativesKernel(
-              w, h, s, Ix, Iy, Iz,
-             texSource_acc, texTarget_acc,
-              texDescr, item_ct1);
+          ComputeDerivativesKernel<32, 8>(
+              I0, I1, u, v, w, h, s, Ix, Iy, Iz, du0, dv0, item_ct1,
+              source_acc.get_multi_ptr<sycl::access::decorated::no>().get(),
+              target_acc.get_multi_ptr<sycl::access::decorated::no>().get());
         });
   });
 }
\ No newline at end of file
@@ -33,7 +33,9 @@
 
 #include <sycl/sycl.hpp>
 #include <dpct/dpct.hpp>
+#include <algorithm>
 #include "common.h"
+#include "flowSYCL.h"
 
 // include kernels
 #include "downscaleKernel.dp.hpp"
@@ -44,232 +46,229 @@
 #include "addKernel.dp.hpp"
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief method logic
+/// \brief allocates the pyramids and the scratch buffers
 ///
-/// handles memory allocations, control flow
-/// \param[in]  I0           source image
-/// \param[in]  I1           tracked image
-/// \param[in]  width        images width
-/// \param[in]  height       images height
-/// \param[in]  stride       images stride
-/// \param[in]  alpha        degree of displacement field smoothness
+/// \param[in]  q            queue the flow is solved on
+/// \param[in]  width        frames width
+/// \param[in]  height       frames height
+/// \param[in]  stride       frames stride
 /// \param[in]  nLevels      number of levels in a pyramid
-/// \param[in]  nWarpIters   number of warping iterations per pyramid level
-/// \param[in]  nSolverIters number of solver iterations (Jacobi iterations)
-/// \param[out] u            horizontal displacement
-/// \param[out] v            vertical displacement
 ///////////////////////////////////////////////////////////////////////////////
-void ComputeFlowCUDA(const float *I0, const float *I1, int width, int height,
-                     int stride, float alpha, int nLevels, int nWarpIters,
-                     int nSolverIters, float *u, float *v) {
-  printf("Computing optical flow on Device...\n");
+FlowContext::FlowContext(sycl::queue &q, int width, int height, int stride,
+                         int nLevels)
+    : q_(q),
+      pyramidQueue_(q.get_context(), q.get_device(),
+                    sycl::property::queue::in_order()),
+      nLevels_(nLevels),
+      framesLoaded_(0) {
+  pW_ = new int[nLevels];
+  pH_ = new int[nLevels];
+  pS_ = new int[nLevels];
+
+  int currentLevel = nLevels - 1;
 
-  sycl::queue q{aspect_selector(sycl::aspect::ext_intel_legacy_image), sycl::property::queue::in_order()};
+  pW_[currentLevel] = width;
+  pH_[currentLevel] = height;
+  pS_[currentLevel] = stride;
 
-  std::cout << "\nRunning on "
-            << q.get_device().get_info<sycl::info::device::name>() << "\n";
-  // pI0 and pI1 will hold device pointers
-  const float **pI0 = new const float *[nLevels];
-  const float **pI1 = new const float *[nLevels];
-
-  int *pW = new int[nLevels];
-  int *pH = new int[nLevels];
-  int *pS = new int[nLevels];
-
-  // device memory pointers
-  float *d_tmp;
-  float *d_du0;
-  float *d_dv0;
-  float *d_du1;
-  float *d_dv1;
-
-  float *d_Ix;
-  float *d_Iy;
-  float *d_Iz;
-
-  float *d_u;
-  float *d_v;
-  float *d_nu;
-  float *d_nv;
+  for (; currentLevel > 0; --currentLevel) {
+    pW_[currentLevel - 1] = pW_[currentLevel] / 2;
+    pH_[currentLevel - 1] = pH_[currentLevel] / 2;
+    pS_[currentLevel - 1] = iAlignUp(pW_[currentLevel - 1]);
+  }
+
+  for (int frame = 0; frame < 3; ++frame) {
+    pI_[frame] = new float *[nLevels];
+
+    for (int level = 0; level < nLevels; ++level) {
+      DPCT_CHECK_ERROR(pI_[frame][level] = (float *)sycl::malloc_device(
+                           pS_[level] * pH_[level] * sizeof(float), q_));
+    }
+  }
 
   const int dataSize = stride * height * sizeof(float);
 
-  DPCT_CHECK_ERROR(d_tmp = (float *)sycl::malloc_device(
-                                       dataSize, q));
-  DPCT_CHECK_ERROR(d_du0 = (float *)sycl::malloc_device(
-                                       dataSize, q));
-  DPCT_CHECK_ERROR(d_dv0 = (float *)sycl::malloc_device(
-                                       dataSize, q));
-  DPCT_CHECK_ERROR(d_du1 = (float *)sycl::malloc_device(
-                                       dataSize, q));
-  DPCT_CHECK_ERROR(d_dv1 = (float *)sycl::malloc_device(
-                                       dataSize, q));
-
-  DPCT_CHECK_ERROR(d_Ix = (float *)sycl::malloc_device(
-                                       dataSize, q));
-  DPCT_CHECK_ERROR(d_Iy = (float *)sycl::malloc_device(
-                                       dataSize, q));
-  DPCT_CHECK_ERROR(d_Iz = (float *)sycl::malloc_device(
-                                       dataSize, q));
-
-  DPCT_CHECK_ERROR(
-      d_u = (float *)sycl::malloc_device(dataSize, q));
-  DPCT_CHECK_ERROR(
-      d_v = (float *)sycl::malloc_device(dataSize, q));
-  DPCT_CHECK_ERROR(d_nu = (float *)sycl::malloc_device(
-                                       dataSize, q));
-  DPCT_CHECK_ERROR(d_nv = (float *)sycl::malloc_device(
-                                       dataSize, q));
-
-  // prepare pyramid
+  DPCT_CHECK_ERROR(d_du0 = (float *)sycl::malloc_device(dataSize, q_));
+  DPCT_CHECK_ERROR(d_dv0 = (float *)sycl::malloc_device(dataSize, q_));
+  DPCT_CHECK_ERROR(d_du1 = (float *)sycl::malloc_device(dataSize, q_));
+  DPCT_CHECK_ERROR(d_dv1 = (float *)sycl::malloc_device(dataSize, q_));
 
-  int currentLevel = nLevels - 1;
-  // allocate GPU memory for input images
-  DPCT_CHECK_ERROR(
-      *(pI0 + currentLevel) = (const float *)sycl::malloc_device(
-          dataSize, q));
-  DPCT_CHECK_ERROR(
-      *(pI1 + currentLevel) = (const float *)sycl::malloc_device(
-          dataSize, q));
+  DPCT_CHECK_ERROR(d_Ix = (float *)sycl::malloc_device(dataSize, q_));
+  DPCT_CHECK_ERROR(d_Iy = (float *)sycl::malloc_device(dataSize, q_));
+  DPCT_CHECK_ERROR(d_Iz = (float *)sycl::malloc_device(dataSize, q_));
 
-  float *pI0_h =
-      (float *)sycl::malloc_host(stride * height * sizeof(sycl::float4), q);
-  float *I0_h = (float *)sycl::malloc_host(dataSize, q);
+  DPCT_CHECK_ERROR(d_u = (float *)sycl::malloc_device(dataSize, q_));
+  DPCT_CHECK_ERROR(d_v = (float *)sycl::malloc_device(dataSize, q_));
+  DPCT_CHECK_ERROR(d_nu = (float *)sycl::malloc_device(dataSize, q_));
+  DPCT_CHECK_ERROR(d_nv = (float *)sycl::malloc_device(dataSize, q_));
+}
 
-  float *pI1_h =
-      (float *)sycl::malloc_host(stride * height * sizeof(sycl::float4), q);
-  float *I1_h = (float *)sycl::malloc_host(dataSize, q);
+FlowContext::~FlowContext() {
+  DPCT_CHECK_ERROR(pyramidQueue_.wait());
+  DPCT_CHECK_ERROR(q_.wait());
 
-  float *src_d0 =
-      (float *)sycl::malloc_device(stride * height * sizeof(sycl::float4), q);
-  float *src_d1 =
-      (float *)sycl::malloc_device(stride * height * sizeof(sycl::float4), q);
+  for (int frame = 0; frame < 3; ++frame) {
+    for (int level = 0; level < nLevels_; ++level) {
+      DPCT_CHECK_ERROR(sycl::free(pI_[frame][level], q_));
+    }
 
-  q.memcpy((void *)I0_h, I0, dataSize);
-  q.memcpy((void *)I1_h, I1, dataSize);
+    delete[] pI_[frame];
+  }
+
+  delete[] pW_;
+  delete[] pH_;
+  delete[] pS_;
+
+  DPCT_CHECK_ERROR(sycl::free(d_du0, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_dv0, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_du1, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_dv1, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_Ix, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_Iy, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_Iz, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_nu, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_nv, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_u, q_));
+  DPCT_CHECK_ERROR(sycl::free(d_v, q_));
+}
 
-  q.memcpy((void *)pI0[currentLevel], I0, dataSize);
-  q.memcpy((void *)pI1[currentLevel], I1, dataSize);
+///////////////////////////////////////////////////////////////////////////////
+/// \brief uploads a frame and builds its pyramid, asynchronously
+///
+/// The pyramid goes to the slot of the frame loaded three frames ago, which
+/// no longer takes part in the flow computation.
+/// \param[in]  I            frame
+///////////////////////////////////////////////////////////////////////////////
+void FlowContext::LoadFrame(const float *I) {
+  float **pI = pI_[framesLoaded_ % 3];
 
-  q.wait();
+  int currentLevel = nLevels_ - 1;
 
-  pW[currentLevel] = width;
-  pH[currentLevel] = height;
-  pS[currentLevel] = stride;
+  DPCT_CHECK_ERROR(pyramidQueue_.memcpy(
+      pI[currentLevel], I,
+      pS_[currentLevel] * pH_[currentLevel] * sizeof(float)));
 
   for (; currentLevel > 0; --currentLevel) {
-    int nw = pW[currentLevel] / 2;
-    int nh = pH[currentLevel] / 2;
-    int ns = iAlignUp(nw);
-
-    DPCT_CHECK_ERROR(
-        *(pI0 + currentLevel - 1) = (const float *)sycl::malloc_device(
-            ns * nh * sizeof(float), q));
-    DPCT_CHECK_ERROR(
-        *(pI1 + currentLevel - 1) = (const float *)sycl::malloc_device(
-            ns * nh * sizeof(float), q));
-
-    Downscale(pI0[currentLevel], pI0_h, I0_h, src_d0, pW[currentLevel],
-              pH[currentLevel], pS[currentLevel], nw, nh, ns,
-              (float *)pI0[currentLevel - 1], q);
-
-    Downscale(pI1[currentLevel], pI0_h, I0_h, src_d0, pW[currentLevel],
-              pH[currentLevel], pS[currentLevel], nw, nh, ns,
-              (float *)pI1[currentLevel - 1], q);
-
-    pW[currentLevel - 1] = nw;
-    pH[currentLevel - 1] = nh;
-    pS[currentLevel - 1] = ns;
+    Downscale(pI[currentLevel], pS_[currentLevel], pW_[currentLevel - 1],
+              pH_[currentLevel - 1], pS_[currentLevel - 1],
+              pI[currentLevel - 1], pyramidQueue_);
   }
 
-  DPCT_CHECK_ERROR(q.memset(d_u, 0, stride * height * sizeof(float)));
-  DPCT_CHECK_ERROR(q.memset(d_v, 0, stride * height * sizeof(float)));
-  DPCT_CHECK_ERROR(q.wait());
+  ++framesLoaded_;
+}
 
-  // compute flow
-  for (; currentLevel < nLevels; ++currentLevel) {
-    for (int warpIter = 0; warpIter < nWarpIters; ++warpIter) {
-      DPCT_CHECK_ERROR(
-          q.memset(d_du0, 0, dataSize));
-      DPCT_CHECK_ERROR(
-          q.memset(d_dv0, 0, dataSize));
+///////////////////////////////////////////////////////////////////////////////
+/// \brief method logic
+///
+/// handles control flow, on the two last loaded frames
+/// \param[in]  alpha        degree of displacement field smoothness
+/// \param[in]  nWarpIters   number of warping iterations per pyramid level
+/// \param[in]  nSolverIters number of solver iterations (Jacobi iterations)
+/// \param[out] u            horizontal displacement
+/// \param[out] v            vertical displacement
+/// \param[in]  next         frame loaded while solving, may be null
+///////////////////////////////////////////////////////////////////////////////
+void FlowContext::ComputeFlow(float alpha, int nWarpIters, int nSolverIters,
+                              float *u, float *v, const float *next) {
+  if (framesLoaded_ < 2) {
+    printf("Two frames must be loaded to compute the flow\n");
+    exit(EXIT_FAILURE);
+  }
+
+  float **pI0 = pI_[(framesLoaded_ - 2) % 3];
+  float **pI1 = pI_[(framesLoaded_ - 1) % 3];
+
+  // pyramids of the pair must be complete before solving
+  DPCT_CHECK_ERROR(pyramidQueue_.wait());
+
+  // the next pyramid is built meanwhile, on the other queue
+  if (next) {
+    LoadFrame(next);
+  }
+
+  const int dataSize = pS_[nLevels_ - 1] * pH_[nLevels_ - 1] * sizeof(float);
 
-      DPCT_CHECK_ERROR(
-          q.memset(d_du1, 0, dataSize));
-      DPCT_CHECK_ERROR(
-          q.memset(d_dv1, 0, dataSize));
+  DPCT_CHECK_ERROR(q_.memset(d_u, 0, dataSize));
+  DPCT_CHECK_ERROR(q_.memset(d_v, 0, dataSize));
 
+  // compute flow
+  for (int currentLevel = 0; currentLevel < nLevels_; ++currentLevel) {
+    for (int warpIter = 0; warpIter < nWarpIters; ++warpIter) {
       // on current level we compute optical flow
       // between frame 0 and warped frame 1
-       WarpImage(pI1[currentLevel], pI0_h, I0_h, src_d0, pW[currentLevel], pH[currentLevel],
-                pS[currentLevel], d_u, d_v, d_tmp, q);
-
-      ComputeDerivatives(pI0[currentLevel], d_tmp, pI0_h, pI1_h, I0_h, I1_h,
-                         src_d0, src_d1, pW[currentLevel],
-                         pH[currentLevel], pS[currentLevel], d_Ix, d_Iy, d_Iz, q);
+      ComputeDerivatives(pI0[currentLevel], pI1[currentLevel], d_u, d_v,
+                         pW_[currentLevel], pH_[currentLevel],
+                         pS_[currentLevel], d_Ix, d_Iy, d_Iz, d_du0, d_dv0,
+                         q_);
 
-      for (int iter = 0; iter < nSolverIters; ++iter) {
-        SolveForUpdate(d_du0, d_dv0, d_Ix, d_Iy, d_Iz, pW[currentLevel],
-                       pH[currentLevel], pS[currentLevel], alpha, d_du1, d_dv1, q);
+      for (int iter = 0; iter < nSolverIters; iter += JacobiItersPerKernel) {
+        SolveForUpdate(d_du0, d_dv0, d_Ix, d_Iy, d_Iz, pW_[currentLevel],
+                       pH_[currentLevel], pS_[currentLevel], alpha,
+                       std::min(JacobiItersPerKernel, nSolverIters - iter),
+                       d_du1, d_dv1, q_);
 
         Swap(d_du0, d_du1);
         Swap(d_dv0, d_dv1);
       }
 
       // update u, v
-      Add(d_u, d_du0, pH[currentLevel] * pS[currentLevel], d_u, q);
-      Add(d_v, d_dv0, pH[currentLevel] * pS[currentLevel], d_v, q);
+      Add(d_u, d_du0, pH_[currentLevel] * pS_[currentLevel], d_u, q_);
+      Add(d_v, d_dv0, pH_[currentLevel] * pS_[currentLevel], d_v, q_);
     }
 
-    if (currentLevel != nLevels - 1) {
+    if (currentLevel != nLevels_ - 1) {
       // prolongate solution
-      float scaleX = (float)pW[currentLevel + 1] / (float)pW[currentLevel];
+      float scaleX = (float)pW_[currentLevel + 1] / (float)pW_[currentLevel];
 
-      Upscale(d_u, pI0_h, I0_h, src_d0, pW[currentLevel], pH[currentLevel], pS[currentLevel],
-              pW[currentLevel + 1], pH[currentLevel + 1], pS[currentLevel + 1],
-              scaleX, d_nu, q);
+      Upscale(d_u, pW_[currentLevel], pH_[currentLevel], pS_[currentLevel],
+              pW_[currentLevel + 1], pH_[currentLevel + 1],
+              pS_[currentLevel + 1], scaleX, d_nu, q_);
 
-      float scaleY = (float)pH[currentLevel + 1] / (float)pH[currentLevel];
+      float scaleY = (float)pH_[currentLevel + 1] / (float)pH_[currentLevel];
 
-      Upscale(d_v, pI0_h, I0_h, src_d0, pW[currentLevel], pH[currentLevel], pS[currentLevel],
-              pW[currentLevel + 1], pH[currentLevel + 1], pS[currentLevel + 1],
-              scaleY, d_nv, q);
+      Upscale(d_v, pW_[currentLevel], pH_[currentLevel], pS_[currentLevel],
+              pW_[currentLevel + 1], pH_[currentLevel + 1],
+              pS_[currentLevel + 1], scaleY, d_nv, q_);
 
       Swap(d_u, d_nu);
       Swap(d_v, d_nv);
     }
   }
 
-  DPCT_CHECK_ERROR(
-      q.memcpy(u, d_u, dataSize));
-  DPCT_CHECK_ERROR(
-      q.memcpy(v, d_v, dataSize));
-  DPCT_CHECK_ERROR(q.wait());
-
-  // cleanup
-  for (int i = 0; i < nLevels; ++i) {
-    DPCT_CHECK_ERROR(
-        sycl::free((void *)pI0[i], q));
-    DPCT_CHECK_ERROR(
-        sycl::free((void *)pI1[i], q));
-  }
-
-  delete[] pI0;
-  delete[] pI1;
-  delete[] pW;
-  delete[] pH;
-  delete[] pS;
-
-  DPCT_CHECK_ERROR(sycl::free(d_tmp, q));
-  DPCT_CHECK_ERROR(sycl::free(d_du0, q));
-  DPCT_CHECK_ERROR(sycl::free(d_dv0, q));
-  DPCT_CHECK_ERROR(sycl::free(d_du1, q));
-  DPCT_CHECK_ERROR(sycl::free(d_dv1, q));
-  DPCT_CHECK_ERROR(sycl::free(d_Ix, q));
-  DPCT_CHECK_ERROR(sycl::free(d_Iy, q));
-  DPCT_CHECK_ERROR(sycl::free(d_Iz, q));
-  DPCT_CHECK_ERROR(sycl::free(d_nu, q));
-  DPCT_CHECK_ERROR(sycl::free(d_nv, q));
-  DPCT_CHECK_ERROR(sycl::free(d_u, q));
-  DPCT_CHECK_ERROR(sycl::free(d_v, q));
+  DPCT_CHECK_ERROR(q_.memcpy(u, d_u, dataSize));
+  DPCT_CHECK_ERROR(q_.memcpy(v, d_v, dataSize));
+  DPCT_CHECK_ERROR(q_.wait());
+  DPCT_CHECK_ERROR(pyramidQueue_.wait());
 }
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief computes the flow of a single pair of frames
+///
+/// \param[in]  I0           source image
+/// \param[in]  I1           tracked image
+/// \param[in]  width        images width
+/// \param[in]  height       images height
+/// \param[in]  stride       images stride
+/// \param[in]  alpha        degree of displacement field smoothness
+/// \param[in]  nLevels      number of levels in a pyramid
+/// \param[in]  nWarpIters   number of warping iterations per pyramid level
+/// \param[in]  nSolverIters number of solver iterations (Jacobi iterations)
+/// \param[out] u            horizontal displacement
+/// \param[out] v            vertical displacement
+///////////////////////////////////////////////////////////////////////////////
+void ComputeFlowCUDA(const float *I0, const float *I1, int width, int height,
+                     int stride, float alpha, int nLevels, int nWarpIters,
+                     int nSolverIters, float *u, float *v) {
+  printf("Computing optical flow on Device...\n");
+
+  sycl::queue q{sycl::default_selector_v, sycl::property::queue::in_order()};
+
+  std::cout << "\nRunning on "
+            << q.get_device().get_info<sycl::info::device::name>() << "\n";
+
+  FlowContext context(q, width, height, stride, nLevels);
+
+  context.LoadFrame(I0);
+  context.LoadFrame(I1);
+  context.ComputeFlow(alpha, nWarpIters, nSolverIters, u, v);
+}
\ No newline at end of file
@@ -34,6 +34,76 @@
 #ifndef FLOW_CUDA_H
 #define FLOW_CUDA_H
 
+#include <sycl/sycl.hpp>
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief device state of the method, reused from one frame to the next
+///
+/// Holds the image pyramids and the scratch buffers, which are allocated once
+/// for a given frame size. Pyramids are kept for three frames: the two frames
+/// the flow is computed between, and the next frame, whose pyramid is built
+/// on a second queue while the flow of the current pair is being solved.
+/// Each frame pyramid is built once and used by two consecutive pairs.
+///////////////////////////////////////////////////////////////////////////////
+class FlowContext {
+ public:
+  FlowContext(sycl::queue &q,  // queue the flow is solved on
+              int width,       // frame width
+              int height,      // frame height
+              int stride,      // row access stride
+              int nLevels);    // number of levels in pyramid
+  ~FlowContext();
+
+  FlowContext(const FlowContext &) = delete;
+  FlowContext &operator=(const FlowContext &) = delete;
+
+  // Starts building the pyramid of the next frame and returns; the frame
+  // must stay valid until the next call to ComputeFlow() returns.
+  void LoadFrame(const float *I);
+
+  // Computes the flow from the next to last loaded frame to the last one.
+  // When "next" is given, it is loaded while the flow is solved, and the
+  // following call computes the flow from the last frame to "next".
+  void ComputeFlow(
+      float alpha,       // smoothness coefficient
+      int nWarpIters,    // number of warping iterations per pyramid level
+      int nSolverIters,  // number of solver iterations (for linear system)
+      float *u,          // output horizontal flow
+      float *v,          // output vertical flow
+      const float *next = nullptr);  // frame to load meanwhile, optional
+
+ private:
+  // flow is solved on q_, pyramids are built on pyramidQueue_
+  sycl::queue q_;
+  sycl::queue pyramidQueue_;
+
+  int nLevels_;
+  int framesLoaded_;
+
+  // pyramid levels sizes, the last level is the frame itself
+  int *pW_;
+  int *pH_;
+  int *pS_;
+
+  // pyramid levels of the three frames
+  float **pI_[3];
+
+  // scratch buffers, as large as the frame
+  float *d_du0;
+  float *d_dv0;
+  float *d_du1;
+  float *d_dv1;
+
+  float *d_Ix;
+  float *d_Iy;
+  float *d_Iz;
+
+  float *d_u;
+  float *d_v;
+  float *d_nu;
+  float *d_nv;
+};
+
 void ComputeFlowCUDA(
     const float *I0,   // source frame
     const float *I1,   // tracked frame
@@ -46,4 +116,4 @@ void ComputeFlowCUDA(
     int nSolverIters,  // number of solver iterations (for linear system)
     float *u,          // output horizontal flow
     float *v);         // output vertical flow
-#endif
+#endif
\ No newline at end of file
@@ -35,11 +35,19 @@
 #include <dpct/dpct.hpp>
 #include "common.h"
 
+// Jacobi iterations performed by one solver kernel launch
+const int JacobiItersPerKernel = 4;
+
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief one iteration of classical Horn-Schunck method, CUDA kernel.
+/// \brief several iterations of classical Horn-Schunck method, kernel.
 ///
-/// It is one iteration of Jacobi method for a corresponding linear system.
-/// Template parameters are describe CTA size
+/// Those are iterations of Jacobi method for a corresponding linear system.
+/// Template parameters describe CTA size and the maximum number of fused
+/// iterations, which is also the width of the halo loaded around the tile.
+/// Each iteration updates the tile minus one more ring of the halo, in local
+/// memory, so only the tile after the last iteration is written back.
+/// Neighbours out of the image are clamped to the border, like the single
+/// iteration does.
 /// \param[in]  du0     current horizontal displacement approximation
 /// \param[in]  dv0     current vertical displacement approximation
 /// \param[in]  Ix      image x derivative
@@ -49,133 +57,96 @@
 /// \param[in]  h       height
 /// \param[in]  s       stride
 /// \param[in]  alpha   degree of smoothness
+/// \param[in]  iters   number of iterations, at most maxIters
 /// \param[out] du1     new horizontal displacement approximation
 /// \param[out] dv1     new vertical displacement approximation
 ///////////////////////////////////////////////////////////////////////////////
-template <int bx, int by>
-void JacobiIteration(const float *du0, const float *dv0,
-                                const float *Ix, const float *Iy,
-                                const float *Iz, int w, int h, int s,
-                                float alpha, float *du1, float *dv1,
-                                const sycl::nd_item<3> &item_ct1,
-                                volatile float *du, volatile float *dv) {
-  // Handle to thread block group
-  auto cta = item_ct1.get_group();
-
-  const int ix = item_ct1.get_local_id(2) +
-                 item_ct1.get_group(2) * item_ct1.get_local_range(2);
-  const int iy = item_ct1.get_local_id(1) +
-                 item_ct1.get_group(1) * item_ct1.get_local_range(1);
-
-  // position within global memory array
-  const int pos = sycl::min(ix, w - 1) + sycl::min(iy, h - 1) * s;
-
-  // position within shared memory array
-  const int shMemPos =
-      item_ct1.get_local_id(2) + 1 + (item_ct1.get_local_id(1) + 1) * (bx + 2);
-
-  // Load data to shared memory.
-  // load tile being processed
-  du[shMemPos] = du0[pos];
-  dv[shMemPos] = dv0[pos];
-
-  // load necessary neighbouring elements
-  // We clamp out-of-range coordinates.
-  // It is equivalent to mirroring
-  // because we access data only one step away from borders.
-  if (item_ct1.get_local_id(1) == 0) {
-    // beginning of the tile
-    const int bsx = item_ct1.get_group(2) * item_ct1.get_local_range(2);
-    const int bsy = item_ct1.get_group(1) * item_ct1.get_local_range(1);
-    // element position within matrix
-    int x, y;
-    // element position within linear array
-    // gm - global memory
-    // sm - shared memory
-    int gmPos, smPos;
-
-    /*
-    DPCT1064:30: Migrated min call is used in a macro/template definition and
-    may not be valid for all macro/template uses. Adjust the code.
-    */
-    x = dpct::min((unsigned int)(bsx + item_ct1.get_local_id(2)), (unsigned int)w - 1);
-    // row just below the tile
-    y = sycl::max(bsy - 1, 0);
-    gmPos = y * s + x;
-    smPos = item_ct1.get_local_id(2) + 1;
-    du[smPos] = du0[gmPos];
-    dv[smPos] = dv0[gmPos];
-
-    // row above the tile
-    y = sycl::min(bsy + by, h - 1);
-    smPos += (by + 1) * (bx + 2);
-    gmPos = y * s + x;
-    du[smPos] = du0[gmPos];
-    dv[smPos] = dv0[gmPos];
-  } else if (item_ct1.get_local_id(1) == 1) {
-    // beginning of the tile
-    const int bsx = item_ct1.get_group(2) * item_ct1.get_local_range(2);
-    const int bsy = item_ct1.get_group(1) * item_ct1.get_local_range(1);
-    // element position within matrix
-    int x, y;
-    // element position within linear array
-    // gm - global memory
-    // sm - shared memory
-    int gmPos, smPos;
-
-    /*
-    DPCT1064:31: Migrated min call is used in a macro/template definition and
-    may not be valid for all macro/template uses. Adjust the code.
-    */
-    y = dpct::min((unsigned int)(bsy + item_ct1.get_local_id(2)), (unsigned int)h - 1);
-    // column to the left
-    x = sycl::max(bsx - 1, 0);
-    smPos = bx + 2 + item_ct1.get_local_id(2) * (bx + 2);
-    gmPos = x + y * s;
-
-    // check if we are within tile
-    if (item_ct1.get_local_id(2) < by) {
-      du[smPos] = du0[gmPos];
-      dv[smPos] = dv0[gmPos];
-      // column to the right
-      x = sycl::min(bsx + bx, w - 1);
-      gmPos = y * s + x;
-      smPos += bx + 1;
-      du[smPos] = du0[gmPos];
-      dv[smPos] = dv0[gmPos];
-    }
+template <int bx, int by, int maxIters>
+void JacobiIterations(const float *du0, const float *dv0, const float *Ix,
+                      const float *Iy, const float *Iz, int w, int h, int s,
+                      float alpha, int iters, float *du1, float *dv1,
+                      const sycl::nd_item<3> &item_ct1, float *du, float *dv,
+                      float *dx, float *dy, float *dz, float *norm) {
+  // tile with halo, du and dv hold two of them to ping-pong between
+  const int tw = bx + 2 * maxIters;
+  const int th = by + 2 * maxIters;
+  const int tileSize = tw * th;
+
+  // tile origin within the image
+  const int tx = item_ct1.get_group(2) * bx - maxIters;
+  const int ty = item_ct1.get_group(1) * by - maxIters;
+
+  const int lid = item_ct1.get_local_linear_id();
+
+  // load the part of the tile that lies within the image
+  for (int i = lid; i < tileSize; i += bx * by) {
+    const int x = tx + i % tw;
+    const int y = ty + i / tw;
+
+    if (x < 0 || x >= w || y < 0 || y >= h) continue;
+
+    const int pos = x + y * s;
+
+    du[i] = du0[pos];
+    dv[i] = dv0[pos];
+    dx[i] = Ix[pos];
+    dy[i] = Iy[pos];
+    dz[i] = Iz[pos];
+    norm[i] = Ix[pos] * Ix[pos] + Iy[pos] * Iy[pos] + alpha;
   }
 
-  /*
-  DPCT1065:13: Consider replacing sycl::nd_item::barrier() with
-  sycl::nd_item::barrier(sycl::access::fence_space::local_space) for better
-  performance if there is no access to global memory.
-  */
-  item_ct1.barrier();
+  sycl::group_barrier(item_ct1.get_group());
 
-  if (ix >= w || iy >= h) return;
+  for (int iter = 1; iter <= iters; ++iter) {
+    const float *u0 = du + ((iter - 1) & 1) * tileSize;
+    const float *v0 = dv + ((iter - 1) & 1) * tileSize;
+    float *u1 = du + (iter & 1) * tileSize;
+    float *v1 = dv + (iter & 1) * tileSize;
+
+    for (int i = lid; i < tileSize; i += bx * by) {
+      const int cx = i % tw;
+      const int cy = i / tw;
+      const int x = tx + cx;
+      const int y = ty + cy;
 
-  // now all necessary data are loaded to shared memory
-  int left, right, up, down;
-  left = shMemPos - 1;
-  right = shMemPos + 1;
-  up = shMemPos + bx + 2;
-  down = shMemPos - bx - 2;
+      // skip the ring that is no longer valid and pixels out of the image
+      if (cx < iter || cx >= tw - iter || cy < iter || cy >= th - iter ||
+          x < 0 || x >= w || y < 0 || y >= h)
+        continue;
 
-  float sumU = (du[left] + du[right] + du[up] + du[down]) * 0.25f;
-  float sumV = (dv[left] + dv[right] + dv[up] + dv[down]) * 0.25f;
+      const int left = x != 0 ? i - 1 : i;
+      const int right = x != w - 1 ? i + 1 : i;
+      const int down = y != 0 ? i - tw : i;
+      const int up = y != h - 1 ? i + tw : i;
 
-  float frac = (Ix[pos] * sumU + Iy[pos] * sumV + Iz[pos]) /
-               (Ix[pos] * Ix[pos] + Iy[pos] * Iy[pos] + alpha);
+      float sumU = (u0[left] + u0[right] + u0[up] + u0[down]) * 0.25f;
+      float sumV = (v0[left] + v0[right] + v0[up] + v0[down]) * 0.25f;
 
-  du1[pos] = sumU - Ix[pos] * frac;
-  dv1[pos] = sumV - Iy[pos] * frac;
+      float frac = (dx[i] * sumU + dy[i] * sumV + dz[i]) / norm[i];
+
+      u1[i] = sumU - dx[i] * frac;
+      v1[i] = sumV - dy[i] * frac;
+    }
+
+    sycl::group_barrier(item_ct1.get_group());
+  }
+
+  const int ix = item_ct1.get_local_id(2) + tx + maxIters;
+  const int iy = item_ct1.get_local_id(1) + ty + maxIters;
+
+  if (ix >= w || iy >= h) return;
+
+  const int c = item_ct1.get_local_id(2) + maxIters +
+                (item_ct1.get_local_id(1) + maxIters) * tw;
+
+  du1[ix + iy * s] = du[(iters & 1) * tileSize + c];
+  dv1[ix + iy * s] = dv[(iters & 1) * tileSize + c];
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief one iteration of classical Horn-Schunck method, CUDA kernel wrapper.
+/// \brief several iterations of classical Horn-Schunck method, kernel wrapper.
 ///
-/// It is one iteration of Jacobi method for a corresponding linear system.
+/// Those are iterations of Jacobi method for a corresponding linear system.
 /// \param[in]  du0     current horizontal displacement approximation
 /// \param[in]  dv0     current vertical displacement approximation
 /// \param[in]  Ix      image x derivative
@@ -185,34 +156,42 @@ void JacobiIteration(const float *du0, const float *dv0,
 /// \param[in]  h       height
 /// \param[in]  s       stride
 /// \param[in]  alpha   degree of smoothness
+/// \param[in]  iters   number of iterations, at most JacobiItersPerKernel
 /// \param[out] du1     new horizontal displacement approximation
 /// \param[out] dv1     new vertical displacement approximation
+/// \param[in]  q       queue the kernel is submitted to
 ///////////////////////////////////////////////////////////////////////////////
 static void SolveForUpdate(const float *du0, const float *dv0, const float *Ix,
                            const float *Iy, const float *Iz, int w, int h,
-                           int s, float alpha, float *du1, float *dv1, sycl::queue q) {
+                           int s, float alpha, int iters, float *du1,
+                           float *dv1, sycl::queue &q) {
   // CTA size
-  sycl::range<3> threads(1, 6, 32);
+  sycl::range<3> threads(1, 8, 32);
   // grid size
   sycl::range<3> blocks(1, iDivUp(h, threads[1]), iDivUp(w, threads[2]));
 
-  /*
-  DPCT1049:14: The work-group size passed to the SYCL kernel may exceed the
-  limit. To get the device limit, query info::device::max_work_group_size.
-  Adjust the work-group size if needed.
-  */
+  const int tileSize =
+      (32 + 2 * JacobiItersPerKernel) * (8 + 2 * JacobiItersPerKernel);
+
   q.submit([&](sycl::handler &cgh) {
-    sycl::local_accessor<float, 1> du_acc_ct1(
-        sycl::range<1>((32 + 2) * (6 + 2)), cgh);
-    sycl::local_accessor<float, 1> dv_acc_ct1(
-        sycl::range<1>((32 + 2) * (6 + 2)), cgh);
-
-    cgh.parallel_for(sycl::nd_range<3>(blocks * threads, threads),
-                     [=](sycl::nd_item<3> item_ct1) {
-                       JacobiIteration<32, 6>(du0, dv0, Ix, Iy, Iz, w, h, s,
-                                              alpha, du1, dv1, item_ct1,
-					      du_acc_ct1.get_multi_ptr<sycl::access::decorated::no>().get(),
-					      dv_acc_ct1.get_multi_ptr<sycl::access::decorated::no>().get());
-                     });
+    sycl::local_accessor<float, 1> du_acc(sycl::range<1>(2 * tileSize), cgh);
+    sycl::local_accessor<float, 1> dv_acc(sycl::range<1>(2 * tileSize), cgh);
+    sycl::local_accessor<float, 1> dx_acc(sycl::range<1>(tileSize), cgh);
+    sycl::local_accessor<float, 1> dy_acc(sycl::range<1>(tileSize), cgh);
+    sycl::local_accessor<float, 1> dz_acc(sycl::range<1>(tileSize), cgh);
+    sycl::local_accessor<float, 1> norm_acc(sycl::range<1>(tileSize), cgh);
+
+    cgh.parallel_for(
+        sycl::nd_range<3>(blocks * threads, threads),
+        [=](sycl::nd_item<3> item_ct1) {
+          JacobiIterations<32, 8, JacobiItersPerKernel>(
+              du0, dv0, Ix, Iy, Iz, w, h, s, alpha, iters, du1, dv1, item_ct1,
+              du_acc.get_multi_ptr<sycl::access::decorated::no>().get(),
+              dv_acc.get_multi_ptr<sycl::access::decorated::no>().get(),
+              dx_acc.get_multi_ptr<sycl::access::decorated::no>().get(),
+              dy_acc.get_multi_ptr<sycl::access::decorated::no>().get(),
+              dz_acc.get_multi_ptr<sycl::access::decorated::no>().get(),
+              norm_acc.get_multi_ptr<sycl::access::decorated::no>().get());
+        });
   });
-}
+}
\ No newline at end of file
@@ -31,94 +31,75 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifndef WARPING_KERNEL_H
+#define WARPING_KERNEL_H
+
 #include <sycl/sycl.hpp>
 #include <dpct/dpct.hpp>
 #include "common.h"
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief warp image with a given displacement field, CUDA kernel.
-/// \param[in]  width   image width
-/// \param[in]  height  image height
-/// \param[in]  stride  image stride
-/// \param[in]  u       horizontal displacement
-/// \param[in]  v       vertical displacement
-/// \param[out] out     result
+/// \brief fetch from an arbitrary position within an image
+///
+/// Bilinear interpolation with out of range coordinates clamped to the
+/// border, which is what a linear sampler with unnormalized coordinates and
+/// clamp_to_edge addressing returns: pixel centers are at half-integer
+/// positions.
+/// \param[in]  t   image
+/// \param[in]  w   image width
+/// \param[in]  h   image height
+/// \param[in]  s   image stride
+/// \param[in]  x   x coord of the point to fetch value at
+/// \param[in]  y   y coord of the point to fetch value at
+/// \return fetched value
 ///////////////////////////////////////////////////////////////////////////////
-void WarpingKernel(int width, int height, int stride, const float *u,
-                   const float *v, float *out,
-                   sycl::accessor<sycl::float4, 2, sycl::access::mode::read,
-                            sycl::access::target::image>
-                       texToWarp,
-                   sycl::sampler texDesc,
-                   const sycl::nd_item<3> &item_ct1) {
-  const int ix = item_ct1.get_local_id(2) +
-                 item_ct1.get_group(2) * item_ct1.get_local_range(2);
-  const int iy = item_ct1.get_local_id(1) +
-                 item_ct1.get_group(1) * item_ct1.get_local_range(1);
+inline float Tex2DLinear(const float *t, int w, int h, int s, float x,
+                         float y) {
+  x -= 0.5f;
+  y -= 0.5f;
 
-  const int pos = ix + iy * stride;
+  const float x0 = sycl::floor(x);
+  const float y0 = sycl::floor(y);
 
-  if (ix >= width || iy >= height) return;
+  const float dx = x - x0;
+  const float dy = y - y0;
 
-  float x = ((float)ix + u[pos]);
-  float y = ((float)iy + v[pos]);
+  const int ix0 = sycl::clamp((int)x0, 0, w - 1);
+  const int iy0 = sycl::clamp((int)y0, 0, h - 1);
+  const int ix1 = sycl::clamp((int)x0 + 1, 0, w - 1);
+  const int iy1 = sycl::clamp((int)y0 + 1, 0, h - 1);
 
-  auto inputCoord = sycl::float2(x, y);
+  float res = t[ix0 + iy0 * s] * (1.0f - dx) * (1.0f - dy);
+  res += t[ix1 + iy0 * s] * dx * (1.0f - dy);
+  res += t[ix0 + iy1 * s] * (1.0f - dx) * dy;
+  res += t[ix1 + iy1 * s] * dx * dy;
 
-  out[pos] = texToWarp.read(inputCoord, texDesc)[0];
+  return res;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief warp image with provided vector field, CUDA kernel wrapper.
+/// \brief warp one pixel of an image with a given displacement field
 ///
 /// For each output pixel there is a vector which tells which pixel
 /// from a source image should be mapped to this particular output
 /// pixel.
-/// It is assumed that images and the vector field have the same stride and
-/// resolution.
+/// It is assumed that the image and the vector field have the same stride and
+/// resolution. The warping is fused into the derivatives kernel, which warps
+/// the pixels it needs on the fly instead of reading a warped image back.
 /// \param[in]  src source image
 /// \param[in]  w   width
 /// \param[in]  h   height
 /// \param[in]  s   stride
 /// \param[in]  u   horizontal displacement
 /// \param[in]  v   vertical displacement
-/// \param[out] out warped image
+/// \param[in]  ix  x coord of the pixel, within the image
+/// \param[in]  iy  y coord of the pixel, within the image
+/// \return warped pixel value
 ///////////////////////////////////////////////////////////////////////////////
-static void WarpImage(const float *src, float *pI0_h, float *I0_h, float *src_p, int w, int h, int s, const float *u,
-                      const float *v, float *out, sycl::queue q) {
-  sycl::range<3> threads(1, 6, 32);
-  sycl::range<3> blocks(1, iDivUp(h, threads[1]), iDivUp(w, threads[2]));
-
-  int dataSize = s * h * sizeof(float);
-  q.memcpy(I0_h, src, dataSize).wait();
-
-  for (int i = 0; i < h; i++) {
-    for (int j = 0; j < w; j++) {
-      int index = i * s + j;
-      pI0_h[index * 4 + 0] = I0_h[index];
-      pI0_h[index * 4 + 1] = pI0_h[index * 4 + 2] = pI0_h[index * 4 + 3] = 0.f;
-    }
-  }
-  q.memcpy(src_p, pI0_h, s * h * sizeof(sycl::float4)).wait();
+inline float WarpPixel(const float *src, int w, int h, int s, const float *u,
+                       const float *v, int ix, int iy) {
+  const int pos = ix + iy * s;
 
-  auto texDescr = sycl::sampler(
-      sycl::coordinate_normalization_mode::unnormalized,
-      sycl::addressing_mode::clamp_to_edge, sycl::filtering_mode::linear);
-
-  auto texToWarp =
-      sycl::image<2>(src_p, sycl::image_channel_order::rgba,
-                         sycl::image_channel_type::fp32, sycl::range<2>(w, h),
-                         sycl::range<1>(s * sizeof(sycl::float4)));
-  
-  q.submit([&](sycl::handler &cgh) {
-    auto texToWarp_acc =
-         texToWarp.template get_access<sycl::float4,
-                                       sycl::access::mode::read>(cgh);
-
-    cgh.parallel_for(sycl::nd_range<3>(blocks * threads, threads),
-                     [=](sycl::nd_item<3> item_ct1) {
-                       WarpingKernel(w, h, s, u, v, out,
-                                     texToWarp_acc, texDescr, item_ct1);
-                     });
-  });
-}
\ No newline at end of file
+  return Tex2DLinear(src, w, h, s, (float)ix + u[pos], (float)iy + v[pos]);
+}
+#endif
\ No newline at end of file
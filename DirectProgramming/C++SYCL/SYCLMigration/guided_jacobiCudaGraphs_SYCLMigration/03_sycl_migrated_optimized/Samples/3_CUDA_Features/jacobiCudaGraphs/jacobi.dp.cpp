@@ -38,10 +38,6 @@
 #include "jacobi.h"
 #include <taskflow/sycl/syclflow.hpp>
 
-// 8 Rows of square-matrix A processed by each CTA.
-// This can be max 32 and only power of 2 (i.e., 2/4/8/16/32).
-#define ROWS_PER_CTA 8
-
 #if !defined(DPCT_COMPATIBILITY_TEMP) || DPCT_COMPATIBILITY_TEMP >= 600
 #else
 __device__ double atomicAdd(double *address, double val) {
@@ -63,14 +59,13 @@ __device__ double atomicAdd(double *address, double val) {
 
 static void JacobiMethod(const float *A, const double *b,
                                     const float conv_threshold, double *x,
-                                    double *x_new, double *sum,
+                                    double *x_new, double *sum, const int n,
                                     const sycl::nd_item<3> &item_ct1,
                                     double *x_shared, double *b_shared) {
   // Handle to thread block group
   sycl::group<3> cta = item_ct1.get_group();
-    // N_ROWS == n
 
-  for (int i = item_ct1.get_local_id(2); i < N_ROWS;
+  for (int i = item_ct1.get_local_id(2); i < n;
        i += item_ct1.get_local_range(2)) {
     x_shared[i] = x[i];
   }
@@ -78,7 +73,7 @@ static void JacobiMethod(const float *A, const double *b,
   if (item_ct1.get_local_id(2) < ROWS_PER_CTA) {
     int k = item_ct1.get_local_id(2);
     for (int i = k + (item_ct1.get_group(2) * ROWS_PER_CTA);
-         (k < ROWS_PER_CTA) && (i < N_ROWS);
+         (k < ROWS_PER_CTA) && (i < n);
          k += ROWS_PER_CTA, i += ROWS_PER_CTA) {
       b_shared[i % (ROWS_PER_CTA + 1)] = b[i];
     }
@@ -89,11 +84,11 @@ static void JacobiMethod(const float *A, const double *b,
   sycl::sub_group tile32 = item_ct1.get_sub_group();
 
   for (int k = 0, i = item_ct1.get_group(2) * ROWS_PER_CTA;
-       (k < ROWS_PER_CTA) && (i < N_ROWS); k++, i++) {
+       (k < ROWS_PER_CTA) && (i < n); k++, i++) {
     double rowThreadSum = 0.0;
-    for (int j = item_ct1.get_local_id(2); j < N_ROWS;
+    for (int j = item_ct1.get_local_id(2); j < n;
          j += item_ct1.get_local_range(2)) {
-      rowThreadSum += (A[i * N_ROWS + j] * x_shared[j]);
+      rowThreadSum += (A[i * n + j] * x_shared[j]);
     }
 
     rowThreadSum =
@@ -119,10 +114,10 @@ static void JacobiMethod(const float *A, const double *b,
     int k = item_ct1.get_local_id(2);
 
     for (int i = k + (item_ct1.get_group(2) * ROWS_PER_CTA);
-         (k < ROWS_PER_CTA) && (i < N_ROWS);
+         (k < ROWS_PER_CTA) && (i < n);
          k += ROWS_PER_CTA, i += ROWS_PER_CTA) {
       double dx = b_shared[i % (ROWS_PER_CTA + 1)];
-      dx /= A[i * N_ROWS + i];
+      dx /= A[i * n + i];
 
       x_new[i] = (x_shared[i] + dx);
       temp_sum += sycl::fabs(dx);
@@ -145,7 +140,7 @@ static void JacobiMethod(const float *A, const double *b,
 }
 
 // Thread block size for finalError kernel should be multiple of 32
-static void finalError(double *x, double *g_sum,
+static void finalError(double *x, double *g_sum, const int n,
                        const sycl::nd_item<3> &item_ct1, uint8_t *dpct_local) {
   // Handle to thread block group
   sycl::group<3> cta = item_ct1.get_group();
@@ -155,7 +150,7 @@ static void finalError(double *x, double *g_sum,
   int globalThreadId = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                        item_ct1.get_local_id(2);
 
-  for (int i = globalThreadId; i < N_ROWS;
+  for (int i = globalThreadId; i < n;
        i += item_ct1.get_local_range(2) * item_ct1.get_group_range(2)) {
     double d = x[i] - 1.0;
     sum += sycl::fabs(d);
@@ -192,13 +187,62 @@ static void finalError(double *x, double *g_sum,
   }
 }
 
+// Convergence state of the iterations replayed by the command graph. It stays
+// on the device, the host only reads it back once per replay.
+struct JacobiGraphState {
+  double sum;                // sum of |dx| of the running iteration
+  unsigned int groups_done;  // work-groups which added their part to sum
+  int iterations;            // iterations run, up to the converged one
+  int converged;
+};
+
+// One Jacobi iteration which tests convergence on the device: the last
+// work-group to finish compares the sum with the threshold and resets it for
+// the next iteration, so no memset or memcpy node is needed between two
+// iterations. Once converged, or once max_iter iterations have run, the
+// remaining iterations of the replay return immediately and leave the
+// solution in place.
+static void JacobiMethodConverge(const float *A, const double *b,
+                                 const float conv_threshold,
+                                 const int max_iter, double *x,
+                                 double *x_new, JacobiGraphState *state,
+                                 const int n, const sycl::nd_item<3> &item_ct1,
+                                 double *x_shared, double *b_shared) {
+  // The state is only written by an earlier iteration, hence all the
+  // work-items take the same branch.
+  if (state->converged || state->iterations >= max_iter) return;
+
+  JacobiMethod(A, b, conv_threshold, x, x_new, &state->sum, n, item_ct1,
+               x_shared, b_shared);
+
+  // Work-item 0 is the one which added the sum of its work-group.
+  if (item_ct1.get_local_linear_id() == 0) {
+    sycl::atomic_ref<unsigned int, sycl::memory_order::acq_rel,
+                     sycl::memory_scope::device,
+                     sycl::access::address_space::global_space>
+        at_groups_done{state->groups_done};
+
+    if (at_groups_done.fetch_add(1u) == item_ct1.get_group_range(2) - 1) {
+      sycl::atomic_ref<double, sycl::memory_order::relaxed,
+                       sycl::memory_scope::device,
+                       sycl::access::address_space::global_space>
+          at_sum{state->sum};
+
+      state->iterations++;
+      state->converged = (at_sum.load() <= conv_threshold);
+      at_sum.store(0.0);
+      at_groups_done.store(0u);
+    }
+  }
+}
+
 double JacobiMethodGpuCudaGraphExecKernelSetParams(
     const float *A, const double *b, const float conv_threshold,
-    const int max_iter, double *x, double *x_new, sycl::queue q) {
+    const int max_iter, double *x, double *x_new, const int n, sycl::queue q) {
   // CTA size
   sycl::range<3> nthreads(1, 1, 256);
   // grid size
-  sycl::range<3> nblocks(1, 1, (N_ROWS / ROWS_PER_CTA) + 2);
+  sycl::range<3> nblocks(1, 1, (n / ROWS_PER_CTA) + 2);
 
   tf::Taskflow tflow;
   tf::Executor exe;
@@ -220,7 +264,7 @@ double JacobiMethodGpuCudaGraphExecKernelSetParams(
                 tf::syclTask jM_kernel =
                     sf.on([=](sycl::handler &cgh) {
                         sycl::local_accessor<double, 1> x_shared_acc_ct1(
-                            sycl::range<1>(N_ROWS), cgh);
+                            sycl::range<1>(n), cgh);
 
                         sycl::local_accessor<double, 1> b_shared_acc_ct1(
                             sycl::range<1>(ROWS_PER_CTA + 1), cgh);
@@ -229,7 +273,7 @@ double JacobiMethodGpuCudaGraphExecKernelSetParams(
                             [=](sycl::nd_item<3> item_ct1) [
                                 [intel::reqd_sub_group_size(32)]] {
                               JacobiMethod(A, b, conv_threshold, params[k % 2],
-                                           params[(k + 1) % 2], d_sum, item_ct1,
+                                           params[(k + 1) % 2], d_sum, n, item_ct1,
                                            x_shared_acc_ct1.get_multi_ptr<sycl::access::decorated::no>()
                       .get(),
                   b_shared_acc_ct1.get_multi_ptr<sycl::access::decorated::no>()
@@ -251,7 +295,7 @@ double JacobiMethodGpuCudaGraphExecKernelSetParams(
 
     if (sum <= conv_threshold) {
       q.memset(d_sum, 0, sizeof(double));
-      nblocks[2] = (N_ROWS / nthreads[2]) + 1;
+      nblocks[2] = (n / nthreads[2]) + 1;
 
       size_t sharedMemSize =
           ((nthreads[2] / 32) + 1) * sizeof(double);
@@ -263,7 +307,7 @@ double JacobiMethodGpuCudaGraphExecKernelSetParams(
           cgh.parallel_for(
               sycl::nd_range<3>(nblocks * nthreads, nthreads), [=
           ](sycl::nd_item<3> item_ct1) [[intel::reqd_sub_group_size(32)]] {
-                finalError(x_new, d_sum, item_ct1,
+                finalError(x_new, d_sum, n, item_ct1,
                            dpct_local_acc_ct1
                                    .get_multi_ptr<sycl::access::decorated::no>()
                                    .get());
@@ -277,7 +321,7 @@ double JacobiMethodGpuCudaGraphExecKernelSetParams(
           cgh.parallel_for(
               sycl::nd_range<3>(nblocks * nthreads, nthreads), [=
           ](sycl::nd_item<3> item_ct1) [[intel::reqd_sub_group_size(32)]] {
-                finalError(x, d_sum, item_ct1,
+                finalError(x, d_sum, n, item_ct1,
                            dpct_local_acc_ct1
                                    .get_multi_ptr<sycl::access::decorated::no>()
                                    .get());
@@ -297,11 +341,11 @@ double JacobiMethodGpuCudaGraphExecKernelSetParams(
 
 double JacobiMethodGpu(const float *A, const double *b,
                        const float conv_threshold, const int max_iter,
-                       double *x, double *x_new, sycl::queue q) {
+                       double *x, double *x_new, const int n, sycl::queue q) {
   // CTA size
   sycl::range<3> nthreads(1, 1, 256);
   // grid size
-  sycl::range<3> nblocks(1, 1, (N_ROWS / ROWS_PER_CTA) + 2);
+  sycl::range<3> nblocks(1, 1, (n / ROWS_PER_CTA) + 2);
 
   double sum = 0.0;
   double *d_sum;
@@ -315,7 +359,7 @@ double JacobiMethodGpu(const float *A, const double *b,
      q.submit([&](sycl::handler &cgh) {
        
         sycl::local_accessor<double, 1> x_shared_acc_ct1(
-            sycl::range<1>(N_ROWS), cgh);
+            sycl::range<1>(n), cgh);
         
         sycl::local_accessor<double, 1> b_shared_acc_ct1(
             sycl::range<1>(ROWS_PER_CTA + 1), cgh);
@@ -324,7 +368,7 @@ double JacobiMethodGpu(const float *A, const double *b,
             sycl::nd_range<3>(nblocks * nthreads, nthreads),
             [=](sycl::nd_item<3> item_ct1) [[intel::reqd_sub_group_size(32)]] {
               JacobiMethod(
-                  A, b, conv_threshold, x, x_new, d_sum, item_ct1,
+                  A, b, conv_threshold, x, x_new, d_sum, n, item_ct1,
                   x_shared_acc_ct1.get_multi_ptr<sycl::access::decorated::no>()
                       .get(),
                   b_shared_acc_ct1.get_multi_ptr<sycl::access::decorated::no>()
@@ -336,7 +380,7 @@ double JacobiMethodGpu(const float *A, const double *b,
       q.submit([&](sycl::handler &cgh) {
         
         sycl::local_accessor<double, 1> x_shared_acc_ct1(
-            sycl::range<1>(N_ROWS), cgh);
+            sycl::range<1>(n), cgh);
         
         sycl::local_accessor<double, 1> b_shared_acc_ct1(
             sycl::range<1>(ROWS_PER_CTA + 1), cgh);
@@ -345,7 +389,7 @@ double JacobiMethodGpu(const float *A, const double *b,
             sycl::nd_range<3>(nblocks * nthreads, nthreads),
             [=](sycl::nd_item<3> item_ct1) [[intel::reqd_sub_group_size(32)]] {
               JacobiMethod(
-                  A, b, conv_threshold, x_new, x, d_sum, item_ct1,
+                  A, b, conv_threshold, x_new, x, d_sum, n, item_ct1,
                   x_shared_acc_ct1.get_multi_ptr<sycl::access::decorated::no>()
                       .get(),
                   b_shared_acc_ct1.get_multi_ptr<sycl::access::decorated::no>()
@@ -358,7 +402,7 @@ double JacobiMethodGpu(const float *A, const double *b,
 
     if (sum <= conv_threshold) {
       DPCT_CHECK_ERROR(q.memset(d_sum, 0, sizeof(double)));
-      nblocks[2] = (N_ROWS / nthreads[2]) + 1;
+      nblocks[2] = (n / nthreads[2]) + 1;
      
       size_t sharedMemSize = ((nthreads[2] / 32) + 1) * sizeof(double);
       if ((k & 1) == 0) {
@@ -371,7 +415,7 @@ double JacobiMethodGpu(const float *A, const double *b,
               sycl::nd_range<3>(nblocks * nthreads, nthreads),
               [=](sycl::nd_item<3> item_ct1)
                   [[intel::reqd_sub_group_size(32)]] {
-                    finalError(x_new, d_sum, item_ct1,
+                    finalError(x_new, d_sum, n, item_ct1,
                                dpct_local_acc_ct1
                                    .get_multi_ptr<sycl::access::decorated::no>()
                                    .get());
@@ -386,7 +430,7 @@ double JacobiMethodGpu(const float *A, const double *b,
               sycl::nd_range<3>(nblocks * nthreads, nthreads),
               [=](sycl::nd_item<3> item_ct1)
                   [[intel::reqd_sub_group_size(32)]] {
-                    finalError(x, d_sum, item_ct1,
+                    finalError(x, d_sum, n, item_ct1,
                                dpct_local_acc_ct1
                                    .get_multi_ptr<sycl::access::decorated::no>()
                                    .get());
@@ -405,3 +449,96 @@ double JacobiMethodGpu(const float *A, const double *b,
   DPCT_CHECK_ERROR(sycl::free(d_sum, q));
   return sum;
 }
+
+double JacobiMethodGpuCommandGraph(const float *A, const double *b,
+                                   const float conv_threshold,
+                                   const int max_iter, const int graph_iters,
+                                   double *x, double *x_new, const int n,
+                                   sycl::queue q) {
+  namespace sycl_ext = sycl::ext::oneapi::experimental;
+
+  // CTA size
+  sycl::range<3> nthreads(1, 1, 256);
+  // grid size
+  sycl::range<3> nblocks(1, 1, (n / ROWS_PER_CTA) + 2);
+
+  // An even number of iterations per replay, so that each replay starts from
+  // the solution in x like the first one.
+  int iters = std::max(2, (graph_iters + 1) & ~1);
+
+  JacobiGraphState state = {};
+  JacobiGraphState *d_state;
+  DPCT_CHECK_ERROR(d_state = sycl::malloc_device<JacobiGraphState>(1, q));
+  DPCT_CHECK_ERROR(q.memcpy(d_state, &state, sizeof(JacobiGraphState)));
+
+  // The iterations are recorded once from the in-order queue, and the whole
+  // sequence is then replayed with a single submission.
+  sycl_ext::command_graph graph(q.get_context(), q.get_device());
+  graph.begin_recording(q);
+
+  for (int k = 0; k < iters; k++) {
+    double *x_in = (k & 1) ? x_new : x;
+    double *x_out = (k & 1) ? x : x_new;
+
+    q.submit([&](sycl::handler &cgh) {
+      sycl::local_accessor<double, 1> x_shared_acc_ct1(sycl::range<1>(n), cgh);
+
+      sycl::local_accessor<double, 1> b_shared_acc_ct1(
+          sycl::range<1>(ROWS_PER_CTA + 1), cgh);
+
+      cgh.parallel_for(
+          sycl::nd_range<3>(nblocks * nthreads, nthreads),
+          [=](sycl::nd_item<3> item_ct1) [[intel::reqd_sub_group_size(32)]] {
+            JacobiMethodConverge(
+                A, b, conv_threshold, max_iter, x_in, x_out, d_state, n,
+                item_ct1,
+                x_shared_acc_ct1.get_multi_ptr<sycl::access::decorated::no>()
+                    .get(),
+                b_shared_acc_ct1.get_multi_ptr<sycl::access::decorated::no>()
+                    .get());
+          });
+    });
+  }
+
+  graph.end_recording();
+  auto exec_graph = graph.finalize();
+
+  // The host only looks at the convergence state between two replays.
+  while (!state.converged && state.iterations < max_iter) {
+    q.submit([&](sycl::handler &cgh) { cgh.ext_oneapi_graph(exec_graph); });
+    DPCT_CHECK_ERROR(
+        q.memcpy(&state, d_state, sizeof(JacobiGraphState)).wait());
+  }
+
+  // Iteration k writes x_new when k is even, the last one run is
+  // state.iterations - 1.
+  double *x_final = (state.iterations & 1) ? x_new : x;
+
+  double sum = 0.0;
+  double *d_sum = &d_state->sum;
+  nblocks[2] = (n / nthreads[2]) + 1;
+
+  size_t sharedMemSize = ((nthreads[2] / 32) + 1) * sizeof(double);
+  q.submit([&](sycl::handler &cgh) {
+    sycl::local_accessor<uint8_t, 1> dpct_local_acc_ct1(
+        sycl::range<1>(sharedMemSize), cgh);
+
+    cgh.parallel_for(
+        sycl::nd_range<3>(nblocks * nthreads, nthreads),
+        [=](sycl::nd_item<3> item_ct1) [[intel::reqd_sub_group_size(32)]] {
+          finalError(x_final, d_sum, n, item_ct1,
+                     dpct_local_acc_ct1
+                         .get_multi_ptr<sycl::access::decorated::no>()
+                         .get());
+        });
+  });
+
+  DPCT_CHECK_ERROR(q.memcpy(&sum, d_sum, sizeof(double)));
+  DPCT_CHECK_ERROR(q.wait());
+  printf("GPU iterations : %d (%d per graph replay)\n", state.iterations,
+         iters);
+  printf("GPU error : %.3e\n", sum);
+
+  DPCT_CHECK_ERROR(sycl::free(d_state, q));
+  return sum;
+}
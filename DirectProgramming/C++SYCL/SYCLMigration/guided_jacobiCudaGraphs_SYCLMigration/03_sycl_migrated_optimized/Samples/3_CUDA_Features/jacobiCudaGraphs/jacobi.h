@@ -34,6 +34,12 @@
 #ifndef JACOBI_H
 #define JACOBI_H
 
+// Default dimension of the linear system, it can be changed at runtime with
+// the -rows option.
 #define N_ROWS 512
 
+// 8 Rows of square-matrix A processed by each CTA.
+// This can be max 32 and only power of 2 (i.e., 2/4/8/16/32).
+#define ROWS_PER_CTA 8
+
 #endif
\ No newline at end of file
@@ -37,11 +37,13 @@
 // cudaGraphExecKernelNodeSetParams() 2 - JacobiMethodGpuCudaGraphExecUpdate() -
 // CUDA Graph with cudaGraphExecUpdate() 3 - JacobiMethodGpu() - Non CUDA Graph
 // method
+// The SYCL version adds JacobiMethodGpuCommandGraph(), which records several
+// iterations once in a SYCL command_graph and replays them.
 
 // Jacobi method on a linear system A*x = b,
 // where A is diagonally dominant and the exact solution consists
 // of all ones.
-// The dimension N_ROWS is included in jacobi.h
+// The default dimension N_ROWS is included in jacobi.h
 
 #include <sycl/sycl.hpp>
 #include <dpct/dpct.hpp>
@@ -57,21 +59,32 @@
 // cudaGraphExecKernelNodeSetParams().
 extern double JacobiMethodGpuCudaGraphExecKernelSetParams(
     const float *A, const double *b, const float conv_threshold,
-    const int max_iter, double *x, double *x_new, sycl::queue q);
+    const int max_iter, double *x, double *x_new, const int n, sycl::queue q);
 
 // Run the Jacobi method for A*x = b on GPU without CUDA Graph.
 extern double JacobiMethodGpu(const float *A, const double *b,
                               const float conv_threshold, const int max_iter,
-                              double *x, double *x_new, sycl::queue q);
-
-// creates N_ROWS x N_ROWS matrix A with N_ROWS+1 on the diagonal and 1
-// elsewhere. The elements of the right hand side b all equal 2*n, hence the
-// exact solution x to A*x = b is a vector of ones.
-void createLinearSystem(float *A, double *b);
+                              double *x, double *x_new, const int n,
+                              sycl::queue q);
+
+// Run the Jacobi method for A*x = b on GPU with a SYCL command_graph of
+// graph_iters iterations, convergence is tested on the device and read back
+// once per replay.
+extern double JacobiMethodGpuCommandGraph(const float *A, const double *b,
+                                          const float conv_threshold,
+                                          const int max_iter,
+                                          const int graph_iters, double *x,
+                                          double *x_new, const int n,
+                                          sycl::queue q);
+
+// creates n x n matrix A with n+1 on the diagonal and 1 elsewhere. The
+// elements of the right hand side b all equal 2*n, hence the exact solution x
+// to A*x = b is a vector of ones.
+void createLinearSystem(float *A, double *b, int n);
 
 // Run the Jacobi method for A*x = b on CPU.
 void JacobiMethodCPU(float *A, double *b, float conv_threshold, int max_iter,
-                     int *numit, double *x);
+                     int *numit, double *x, int n);
 
 int main(int argc, char **argv) {
   if (checkCmdLineFlag(argc, (const char **)argv, "help")) {
@@ -81,6 +94,15 @@ int main(int argc, char **argv) {
         "-gpumethod=<0 or 1>  : 0 - [Default] "
         "JacobiMethodGpuCudaGraphExecKernelSetParams\n");
     printf("                       : 1 - JacobiMethodGpu - Non CUDA Graph\n");
+    printf("                       : 2 - JacobiMethodGpuCommandGraph\n");
+    printf("-rows=<n>              : dimension of the system (default %d)\n",
+           N_ROWS);
+    printf(
+        "-graphiters=<k>        : iterations recorded in the command graph "
+        "(default 16)\n");
+    printf(
+        "-compare               : also time JacobiMethodGpu, which submits "
+        "every iteration\n");
     printf("-device=device_num     : cuda device id");
     printf("-help         : Output a help message\n");
     exit(EXIT_SUCCESS);
@@ -90,36 +112,66 @@ int main(int argc, char **argv) {
   if (checkCmdLineFlag(argc, (const char **)argv, "gpumethod")) {
     gpumethod = getCmdLineArgumentInt(argc, (const char **)argv, "gpumethod");
 
-    if (gpumethod < 0 || gpumethod > 1) {
-      printf("Error: gpumethod must be 0 or 1, gpumethod=%d is invalid\n",
+    if (gpumethod < 0 || gpumethod > 2) {
+      printf("Error: gpumethod must be 0, 1 or 2, gpumethod=%d is invalid\n",
              gpumethod);
       exit(EXIT_SUCCESS);
     }
   }
 
+  int n = N_ROWS;
+  if (checkCmdLineFlag(argc, (const char **)argv, "rows")) {
+    n = getCmdLineArgumentInt(argc, (const char **)argv, "rows");
+  }
+
+  int graph_iters = 16;
+  if (checkCmdLineFlag(argc, (const char **)argv, "graphiters")) {
+    graph_iters = getCmdLineArgumentInt(argc, (const char **)argv,
+                                        "graphiters");
+  }
+
+  bool compare = checkCmdLineFlag(argc, (const char **)argv, "compare");
+
   sycl::queue q{aspect_selector(sycl::aspect::fp64),
                 sycl::property::queue::in_order()};
 
   std::cout << "\nRunning on "
             << q.get_device().get_info<sycl::info::device::name>() << "\n";
 
+  // The Jacobi kernel keeps the whole vector x in local memory.
+  size_t localMemSize =
+      q.get_device().get_info<sycl::info::device::local_mem_size>();
+  if (n < 1 || (n + ROWS_PER_CTA + 1) * sizeof(double) > localMemSize) {
+    printf("Error: rows must be between 1 and %zu, rows=%d is invalid\n",
+           localMemSize / sizeof(double) - ROWS_PER_CTA - 1, n);
+    exit(EXIT_FAILURE);
+  }
+
+  if (graph_iters < 1) {
+    printf("Error: graphiters must be positive, graphiters=%d is invalid\n",
+           graph_iters);
+    exit(EXIT_FAILURE);
+  }
+
+  printf("Linear system of %d rows\n", n);
+
 
   double *b = NULL;
   float *A = NULL;
   DPCT_CHECK_ERROR(
-      b = sycl::malloc_host<double>(N_ROWS, q));
-  memset(b, 0, N_ROWS * sizeof(double));
+      b = sycl::malloc_host<double>(n, q));
+  memset(b, 0, n * sizeof(double));
   DPCT_CHECK_ERROR(A = sycl::malloc_host<float>(
-                           N_ROWS * N_ROWS, q));
-  memset(A, 0, N_ROWS * N_ROWS * sizeof(float));
+                           (size_t)n * n, q));
+  memset(A, 0, (size_t)n * n * sizeof(float));
 
-  createLinearSystem(A, b);
+  createLinearSystem(A, b, n);
   double *x = NULL;
   // start with array of all zeroes
-  x = (double *)calloc(N_ROWS, sizeof(double));
+  x = (double *)calloc(n, sizeof(double));
 
   float conv_threshold = 1.0e-2;
-  int max_iter = 4 * N_ROWS * N_ROWS;
+  int max_iter = 4 * n * n;
   int cnt = 0;
 
   // create timer
@@ -127,11 +179,11 @@ int main(int argc, char **argv) {
   sdkCreateTimer(&timerCPU);
 
   sdkStartTimer(&timerCPU);
-  JacobiMethodCPU(A, b, conv_threshold, max_iter, &cnt, x);
+  JacobiMethodCPU(A, b, conv_threshold, max_iter, &cnt, x, n);
 
   double sum = 0.0;
   // Compute error
-  for (int i = 0; i < N_ROWS; i++) {
+  for (int i = 0; i < n; i++) {
     double d = x[i] - 1.0;
     sum += fabs(d);
   }
@@ -144,20 +196,20 @@ int main(int argc, char **argv) {
   double *d_b, *d_x, *d_x_new;
   
   DPCT_CHECK_ERROR(
-      d_b = sycl::malloc_device<double>(N_ROWS, q));
+      d_b = sycl::malloc_device<double>(n, q));
   DPCT_CHECK_ERROR(
-      d_A = (float *)sycl::malloc_device(sizeof(float) * N_ROWS * N_ROWS,
+      d_A = (float *)sycl::malloc_device(sizeof(float) * n * n,
                                          q));
   DPCT_CHECK_ERROR(
-      d_x = sycl::malloc_device<double>(N_ROWS, q));
+      d_x = sycl::malloc_device<double>(n, q));
   DPCT_CHECK_ERROR(d_x_new = sycl::malloc_device<double>(
-                                       N_ROWS, q));
+                                       n, q));
 
-  DPCT_CHECK_ERROR(q.memset(d_x, 0, sizeof(double) * N_ROWS));
-  DPCT_CHECK_ERROR(q.memset(d_x_new, 0, sizeof(double) * N_ROWS));
+  DPCT_CHECK_ERROR(q.memset(d_x, 0, sizeof(double) * n));
+  DPCT_CHECK_ERROR(q.memset(d_x_new, 0, sizeof(double) * n));
   DPCT_CHECK_ERROR(
-      q.memcpy(d_A, A, sizeof(float) * N_ROWS * N_ROWS));
-  DPCT_CHECK_ERROR(q.memcpy(d_b, b, sizeof(double) * N_ROWS));
+      q.memcpy(d_A, A, sizeof(float) * n * n));
+  DPCT_CHECK_ERROR(q.memcpy(d_b, b, sizeof(double) * n));
 
   q.wait();
 
@@ -167,15 +219,41 @@ int main(int argc, char **argv) {
   double sumGPU = 0.0;
   if (gpumethod == 0) {
     sumGPU = JacobiMethodGpuCudaGraphExecKernelSetParams(
-        d_A, d_b, conv_threshold, max_iter, d_x, d_x_new, q);
+        d_A, d_b, conv_threshold, max_iter, d_x, d_x_new, n, q);
   } else if (gpumethod == 1){
     sumGPU = JacobiMethodGpu(d_A, d_b, conv_threshold, max_iter, d_x, d_x_new,
-                             q);
+                             n, q);
+  } else if (gpumethod == 2) {
+    sumGPU = JacobiMethodGpuCommandGraph(d_A, d_b, conv_threshold, max_iter,
+                                         graph_iters, d_x, d_x_new, n, q);
   }
 
   sdkStopTimer(&timerGpu);
   printf("GPU Processing time: %f (ms)\n", sdkGetTimerValue(&timerGpu));
 
+  // Same system solved again from zero by submitting and checking every
+  // iteration from the host.
+  bool comparePassed = true;
+  if (compare) {
+    StopWatchInterface *timerSubmit = NULL;
+    sdkCreateTimer(&timerSubmit);
+
+    DPCT_CHECK_ERROR(q.memset(d_x, 0, sizeof(double) * n));
+    DPCT_CHECK_ERROR(q.memset(d_x_new, 0, sizeof(double) * n));
+    q.wait();
+
+    sdkStartTimer(&timerSubmit);
+    double sumSubmit = JacobiMethodGpu(d_A, d_b, conv_threshold, max_iter,
+                                       d_x, d_x_new, n, q);
+    sdkStopTimer(&timerSubmit);
+
+    printf("Per-iteration submit processing time: %f (ms), %.2fx\n",
+           sdkGetTimerValue(&timerSubmit),
+           sdkGetTimerValue(&timerSubmit) / sdkGetTimerValue(&timerGpu));
+    comparePassed = fabs(sum - sumSubmit) < conv_threshold;
+    sdkDeleteTimer(&timerSubmit);
+  }
+
   DPCT_CHECK_ERROR(sycl::free(d_b, q));
   DPCT_CHECK_ERROR(sycl::free(d_A, q));
   DPCT_CHECK_ERROR(sycl::free(d_x, q));
@@ -183,38 +261,38 @@ int main(int argc, char **argv) {
   DPCT_CHECK_ERROR(sycl::free(A, q));
   DPCT_CHECK_ERROR(sycl::free(b, q));
 
-  printf("&&&& jacobiCudaGraphs %s\n",
-         (fabs(sum - sumGPU) < conv_threshold) ? "PASSED" : "FAILED");
+  bool passed = (fabs(sum - sumGPU) < conv_threshold) && comparePassed;
+  printf("&&&& jacobiCudaGraphs %s\n", passed ? "PASSED" : "FAILED");
 
-  return (fabs(sum - sumGPU) < conv_threshold) ? EXIT_SUCCESS : EXIT_FAILURE;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-void createLinearSystem(float *A, double *b) {
+void createLinearSystem(float *A, double *b, int n) {
   int i, j;
-  for (i = 0; i < N_ROWS; i++) {
-    b[i] = 2.0 * N_ROWS;
-    for (j = 0; j < N_ROWS; j++) A[i * N_ROWS + j] = 1.0;
-    A[i * N_ROWS + i] = N_ROWS + 1.0;
+  for (i = 0; i < n; i++) {
+    b[i] = 2.0 * n;
+    for (j = 0; j < n; j++) A[(size_t)i * n + j] = 1.0;
+    A[(size_t)i * n + i] = n + 1.0;
   }
 }
 
 void JacobiMethodCPU(float *A, double *b, float conv_threshold, int max_iter,
-                     int *num_iter, double *x) {
+                     int *num_iter, double *x, int n) {
   double *x_new;
-  x_new = (double *)calloc(N_ROWS, sizeof(double));
+  x_new = (double *)calloc(n, sizeof(double));
   int k;
 
   for (k = 0; k < max_iter; k++) {
     double sum = 0.0;
-    for (int i = 0; i < N_ROWS; i++) {
+    for (int i = 0; i < n; i++) {
       double temp_dx = b[i];
-      for (int j = 0; j < N_ROWS; j++) temp_dx -= A[i * N_ROWS + j] * x[j];
-      temp_dx /= A[i * N_ROWS + i];
+      for (int j = 0; j < n; j++) temp_dx -= A[(size_t)i * n + j] * x[j];
+      temp_dx /= A[(size_t)i * n + i];
       x_new[i] += temp_dx;
       sum += fabs(temp_dx);
     }
 
-    for (int i = 0; i < N_ROWS; i++) x[i] = x_new[i];
+    for (int i = 0; i < n; i++) x[i] = x_new[i];
 
     if (sum <= conv_threshold) break;
   }
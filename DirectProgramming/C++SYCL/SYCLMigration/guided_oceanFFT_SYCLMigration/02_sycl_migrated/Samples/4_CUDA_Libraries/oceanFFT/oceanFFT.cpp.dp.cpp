@@ -52,6 +52,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <algorithm>
+#include <vector>
 #include <dpct/fft_utils.hpp>
 
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
@@ -114,27 +116,28 @@ extern "C" void cudaGenerateSpectrumKernel(sycl::float2 *d_h0,
                                            unsigned int in_width,
                                            unsigned int out_width,
                                            unsigned int out_height,
-                                           float animTime, float patchSize);
+                                           float animTime, float patchSize,
+                                           unsigned int tiles);
 
-extern "C" void cudaUpdateHeightmapKernel(float *d_heightMap,
-                                          sycl::float2 *d_ht,
-                                          unsigned int width,
-                                          unsigned int height, bool autoTest);
-
-extern "C" void cudaCalculateSlopeKernel(float *h, sycl::float2 *slopeOut,
-                                         unsigned int width,
-                                         unsigned int height);
+extern "C" void cudaUpdateHeightmapAndSlopeKernel(float *d_heightMap,
+                                                  sycl::float2 *d_slope,
+                                                  sycl::float2 *d_ht,
+                                                  unsigned int width,
+                                                  unsigned int height,
+                                                  unsigned int tiles,
+                                                  bool autoTest);
 
 ////////////////////////////////////////////////////////////////////////////////
 // forward declarations
 void runAutoTest(int argc, char **argv);
+void runBenchmark(int argc, char **argv);
 
 // rendering callbacks
 void timerEvent(int value);
 
 // Cuda functionality
 void runCudaTest(char *exec_path);
-void generate_h0(sycl::float2 *h0);
+void generate_h0(sycl::float2 *h0, unsigned int size);
 
 ////////////////////////////////////////////////////////////////////////////////
 // Program main
@@ -149,7 +152,11 @@ int main(int argc, char **argv) {
     animate = false;
     fpsLimit = frameCheckNumber;
     runAutoTest(argc, argv);
-  } /* else {
+  } else {
+    // headless simulation, no display is needed
+    runBenchmark(argc, argv);
+  }
+  /* else {
      printf(
          "[%s]\n\n"
          "Left mouse button          - rotate\n"
@@ -199,7 +206,7 @@ void runAutoTest(int argc, char **argv) {
   DPCT_CHECK_ERROR(d_h0 = (sycl::float2 *)sycl::malloc_device(
                            spectrumSize, dpct::get_in_order_queue()));
   h_h0 = (sycl::float2 *)malloc(spectrumSize);
-  generate_h0(h_h0);
+  generate_h0(h_h0, meshSize);
   DPCT_CHECK_ERROR(
       dpct::get_in_order_queue().memcpy(d_h0, h_h0, spectrumSize).wait());
 
@@ -277,14 +284,12 @@ float phillips(float Kx, float Ky, float Vdir, float V, float A,
   return phillips;
 }
 
-// Generate base heightfield in frequency space
-void generate_h0(sycl::float2 *h0) {
-  for (unsigned int y = 0; y <= meshSize; y++) {
-    for (unsigned int x = 0; x <= meshSize; x++) {
-      float kx =
-          (-(int)meshSize / 2.0f + x) * (2.0f * 3.141592654F / patchSize);
-      float ky =
-          (-(int)meshSize / 2.0f + y) * (2.0f * 3.141592654F / patchSize);
+// Generate base heightfield in frequency space, for a size x size mesh
+void generate_h0(sycl::float2 *h0, unsigned int size) {
+  for (unsigned int y = 0; y <= size; y++) {
+    for (unsigned int x = 0; x <= size; x++) {
+      float kx = (-(int)size / 2.0f + x) * (2.0f * 3.141592654F / patchSize);
+      float ky = (-(int)size / 2.0f + y) * (2.0f * 3.141592654F / patchSize);
 
       float P = sqrtf(phillips(kx, ky, windDir, windSpeed, A, dirDepend));
 
@@ -300,7 +305,7 @@ void generate_h0(sycl::float2 *h0) {
       float h0_re = Er * P * SYCLRT_SQRT_HALF_F;
       float h0_im = Ei * P * SYCLRT_SQRT_HALF_F;
 
-      int i = y * spectrumW + x;
+      int i = y * (size + 4) + x;
       h0[i].x() = h0_re;
       h0[i].y() = h0_im;
     }
@@ -317,15 +322,16 @@ void runCudaTest(char *exec_path) {
 
   // generate wave spectrum in frequency domain
   cudaGenerateSpectrumKernel(d_h0, d_ht, spectrumW, meshSize, meshSize,
-                             animTime, patchSize);
+                             animTime, patchSize, 1);
 
   // execute inverse FFT to convert to spatial domain
   
   DPCT_CHECK_ERROR((fftPlan->compute<sycl::float2, sycl::float2>(
           d_ht, d_ht, dpct::fft::fft_direction::backward)));
 
-  // update heightmap values
-  cudaUpdateHeightmapKernel(g_hptr, d_ht, meshSize, meshSize, true);
+  // update heightmap values and calculate slope for shading
+  cudaUpdateHeightmapAndSlopeKernel(g_hptr, g_sptr, d_ht, meshSize, meshSize, 1,
+                                    true);
 
   {
     float *hptr = (float *)malloc(meshSize * meshSize * sizeof(float));
@@ -345,9 +351,6 @@ void runCudaTest(char *exec_path) {
     free(hptr);
   }
 
-  // calculate slope for shading
-  cudaCalculateSlopeKernel(g_hptr, g_sptr, meshSize, meshSize);
-
   {
     sycl::float2 *sptr =
         (sycl::float2 *)malloc(meshSize * meshSize * sizeof(sycl::float2));
@@ -373,3 +376,126 @@ void runCudaTest(char *exec_path) {
   
     DPCT_CHECK_ERROR(dpct::dpct_free(g_sptr, dpct::get_in_order_queue()));
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//! Run headless benchmark
+//! Every frame simulates "tiles" independent ocean tiles: their spectra are
+//! generated by one kernel, transformed by one batched FFT and turned into
+//! heights and slopes by one kernel. The FFT descriptor is committed once, for
+//! in-place backward transforms, and reused by all the frames.
+////////////////////////////////////////////////////////////////////////////////
+void runBenchmark(int argc, char **argv) {
+  printf("%s Starting...\n\n", argv[0]);
+
+  sycl::queue &q = dpct::get_in_order_queue();
+
+  printf("Running on %s\n\n",
+         q.get_device().get_info<sycl::info::device::name>().c_str());
+
+  // all the mesh sizes, unless one is given
+  std::vector<unsigned int> sizes = {256, 512, 1024, 2048};
+  unsigned int tiles = 4;
+  int frames = 100;
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "size")) {
+    sizes = {(unsigned int)std::max(
+        getCmdLineArgumentInt(argc, (const char **)argv, "size"), 2)};
+  }
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "tiles")) {
+    tiles = (unsigned int)std::max(
+        getCmdLineArgumentInt(argc, (const char **)argv, "tiles"), 1);
+  }
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "frames")) {
+    frames = std::max(
+        getCmdLineArgumentInt(argc, (const char **)argv, "frames"), 1);
+  }
+
+  for (unsigned int size : sizes) {
+    const unsigned int spectrumWidth = size + 4;
+    const unsigned int spectrumHeight = size + 1;
+    const size_t spectrumCount = (size_t)spectrumWidth * spectrumHeight;
+    const size_t meshCount = (size_t)size * size;
+
+    // independent initial heightfields, one per tile
+    std::vector<sycl::float2> h_h0Tiles(spectrumCount * tiles);
+
+    for (unsigned int tile = 0; tile < tiles; tile++) {
+      generate_h0(h_h0Tiles.data() + tile * spectrumCount, size);
+    }
+
+    sycl::float2 *d_h0Tiles = 0;
+    sycl::float2 *d_htTiles = 0;
+    sycl::float2 *d_slopeTiles = 0;
+    float *d_heightTiles = 0;
+
+    DPCT_CHECK_ERROR(d_h0Tiles = sycl::malloc_device<sycl::float2>(
+                         spectrumCount * tiles, q));
+    DPCT_CHECK_ERROR(d_htTiles = sycl::malloc_device<sycl::float2>(
+                         meshCount * tiles, q));
+    DPCT_CHECK_ERROR(d_slopeTiles = sycl::malloc_device<sycl::float2>(
+                         meshCount * tiles, q));
+    DPCT_CHECK_ERROR(d_heightTiles =
+                         sycl::malloc_device<float>(meshCount * tiles, q));
+
+    DPCT_CHECK_ERROR(q.memcpy(d_h0Tiles, h_h0Tiles.data(),
+                              spectrumCount * tiles * sizeof(sycl::float2))
+                         .wait());
+
+    // batched plan, committed once for in-place backward transforms
+    int n[2] = {(int)size, (int)size};
+    dpct::fft::fft_engine_ptr batchPlan;
+
+    DPCT_CHECK_ERROR(
+        batchPlan = dpct::fft::fft_engine::create(
+            &q, 2, n, nullptr, 0, 0, nullptr, 0, 0,
+            dpct::fft::fft_type::complex_float_to_complex_float, tiles,
+            std::make_pair(dpct::fft::fft_direction::backward, true)));
+
+    // frames are 1/60 s apart, with no host synchronization between them
+    auto simulateFrame = [&](int frame) {
+      float frameTime = frame * (1000.0f / 60.0f) * animationRate;
+
+      cudaGenerateSpectrumKernel(d_h0Tiles, d_htTiles, spectrumWidth, size,
+                                 size, frameTime, patchSize, tiles);
+
+      DPCT_CHECK_ERROR((batchPlan->compute<sycl::float2, sycl::float2>(
+          d_htTiles, d_htTiles, dpct::fft::fft_direction::backward)));
+
+      cudaUpdateHeightmapAndSlopeKernel(d_heightTiles, d_slopeTiles, d_htTiles,
+                                        size, size, tiles, false);
+    };
+
+    // the first frame includes one-time costs, like kernel compilation
+    simulateFrame(0);
+    q.wait();
+
+    StopWatchInterface *benchmarkTimer = NULL;
+    sdkCreateTimer(&benchmarkTimer);
+    sdkStartTimer(&benchmarkTimer);
+
+    for (int frame = 1; frame <= frames; frame++) {
+      simulateFrame(frame);
+    }
+
+    q.wait();
+    sdkStopTimer(&benchmarkTimer);
+
+    float elapsedTime = sdkGetTimerValue(&benchmarkTimer);
+    float framesPerSecond = frames * 1000.0f / elapsedTime;
+
+    sdkDeleteTimer(&benchmarkTimer);
+
+    printf("%4u x %-4u mesh, %u tiles: %8.1f frames/s, %9.1f tiles/s "
+           "(%.3f ms per frame)\n",
+           size, size, tiles, framesPerSecond, framesPerSecond * tiles,
+           elapsedTime / frames);
+
+    DPCT_CHECK_ERROR(dpct::fft::fft_engine::destroy(batchPlan));
+    DPCT_CHECK_ERROR(dpct::dpct_free(d_heightTiles, q));
+    DPCT_CHECK_ERROR(dpct::dpct_free(d_slopeTiles, q));
+    DPCT_CHECK_ERROR(dpct::dpct_free(d_htTiles, q));
+    DPCT_CHECK_ERROR(dpct::dpct_free(d_h0Tiles, q));
+  }
+}
@@ -53,6 +53,8 @@ sycl::float2 complex_mult(sycl::float2 ab, sycl::float2 cd) {
 
 // generate wave heightfield at time t based on initial heightfield and
 // dispersion relationship
+// the third dimension of the range selects the tile, each tile having its own
+// initial heightfield and output spectrum, stored one after the other
 void generateSpectrumKernel(sycl::float2 *h0, sycl::float2 *ht,
                             unsigned int in_width, unsigned int out_width,
                             unsigned int out_height, float t, float patchSize,
@@ -61,6 +63,11 @@ void generateSpectrumKernel(sycl::float2 *h0, sycl::float2 *ht,
                    item_ct1.get_local_id(2);
   unsigned int y = item_ct1.get_group(1) * item_ct1.get_local_range(1) +
                    item_ct1.get_local_id(1);
+  size_t tile = item_ct1.get_global_id(0);
+
+  h0 += tile * in_width * (out_height + 1);
+  ht += tile * out_width * out_height;
+
   unsigned int in_index = y * in_width + x;
   unsigned int in_mindex =
       (out_height - y) * in_width + (out_width - x);  // mirrored
@@ -87,53 +94,46 @@ void generateSpectrumKernel(sycl::float2 *h0, sycl::float2 *ht,
   }
 }
 
-// update height map values based on output of FFT
-void updateHeightmapKernel(float *heightMap, sycl::float2 *ht,
-                           unsigned int width,
-                           const sycl::nd_item<3> &item_ct1) {
+// update height map values based on output of FFT, and generate slope by
+// partial differences in spatial domain
+// the neighbouring heights are computed from the FFT output as well, so height
+// and slope are produced by a single kernel instead of a second kernel reading
+// the height map back
+void updateHeightmapAndSlopeKernel(float *heightMap, sycl::float2 *slopeOut,
+                                   sycl::float2 *ht, unsigned int width,
+                                   unsigned int height, bool autoTest,
+                                   const sycl::nd_item<3> &item_ct1) {
   unsigned int x = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                    item_ct1.get_local_id(2);
   unsigned int y = item_ct1.get_group(1) * item_ct1.get_local_range(1) +
                    item_ct1.get_local_id(1);
-  unsigned int i = y * width + x;
+  size_t tile = item_ct1.get_global_id(0);
 
-  // cos(pi * (m1 + m2))
-  float sign_correction = ((x + y) & 0x01) ? -1.0f : 1.0f;
-
-  heightMap[i] = ht[i].x() * sign_correction;
-}
+  if ((x >= width) || (y >= height)) {
+    return;
+  }
 
-// update height map values based on output of FFT
-void updateHeightmapKernel_y(float *heightMap, sycl::float2 *ht,
-                             unsigned int width,
-                             const sycl::nd_item<3> &item_ct1) {
-  unsigned int x = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
-                   item_ct1.get_local_id(2);
-  unsigned int y = item_ct1.get_group(1) * item_ct1.get_local_range(1) +
-                   item_ct1.get_local_id(1);
-  unsigned int i = y * width + x;
+  heightMap += tile * width * height;
+  slopeOut += tile * width * height;
+  ht += tile * width * height;
 
-  // cos(pi * (m1 + m2))
-  float sign_correction = ((x + y) & 0x01) ? -1.0f : 1.0f;
+  // the self test checks the imaginary part
+  auto heightAt = [=](unsigned int i, unsigned int m1_plus_m2) {
+    // cos(pi * (m1 + m2))
+    float sign_correction = (m1_plus_m2 & 0x01) ? -1.0f : 1.0f;
 
-  heightMap[i] = ht[i].y() * sign_correction;
-}
+    return (autoTest ? ht[i].y() : ht[i].x()) * sign_correction;
+  };
 
-// generate slope by partial differences in spatial domain
-void calculateSlopeKernel(float *h, sycl::float2 *slopeOut, unsigned int width,
-                          unsigned int height,
-                          const sycl::nd_item<3> &item_ct1) {
-  unsigned int x = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
-                   item_ct1.get_local_id(2);
-  unsigned int y = item_ct1.get_group(1) * item_ct1.get_local_range(1) +
-                   item_ct1.get_local_id(1);
   unsigned int i = y * width + x;
 
+  heightMap[i] = heightAt(i, x + y);
+
   sycl::float2 slope = sycl::float2(0.0f, 0.0f);
 
   if ((x > 0) && (y > 0) && (x < width - 1) && (y < height - 1)) {
-    slope.x() = h[i + 1] - h[i - 1];
-    slope.y() = h[i + width] - h[i - width];
+    slope.x() = heightAt(i + 1, x + y + 1) - heightAt(i - 1, x + y - 1);
+    slope.y() = heightAt(i + width, x + y + 1) - heightAt(i - width, x + y - 1);
   }
 
   slopeOut[i] = slope;
@@ -145,10 +145,11 @@ extern "C" void cudaGenerateSpectrumKernel(sycl::float2 *d_h0,
                                            unsigned int in_width,
                                            unsigned int out_width,
                                            unsigned int out_height,
-                                           float animTime, float patchSize) {
+                                           float animTime, float patchSize,
+                                           unsigned int tiles) {
   dpct::dim3 block(8, 8, 1);
   dpct::dim3 grid(cuda_iDivUp(out_width, block.x),
-                  cuda_iDivUp(out_height, block.y), 1);
+                  cuda_iDivUp(out_height, block.y), tiles);
   dpct::get_in_order_queue().parallel_for(
       sycl::nd_range<3>(grid * block, block), [=](sycl::nd_item<3> item_ct1) {
         generateSpectrumKernel(d_h0, d_ht, in_width, out_width, out_height,
@@ -156,34 +157,20 @@ extern "C" void cudaGenerateSpectrumKernel(sycl::float2 *d_h0,
       });
 }
 
-extern "C" void cudaUpdateHeightmapKernel(float *d_heightMap,
-                                          sycl::float2 *d_ht,
-                                          unsigned int width,
-                                          unsigned int height, bool autoTest) {
+extern "C" void cudaUpdateHeightmapAndSlopeKernel(float *d_heightMap,
+                                                  sycl::float2 *d_slope,
+                                                  sycl::float2 *d_ht,
+                                                  unsigned int width,
+                                                  unsigned int height,
+                                                  unsigned int tiles,
+                                                  bool autoTest) {
   dpct::dim3 block(8, 8, 1);
-  dpct::dim3 grid(cuda_iDivUp(width, block.x), cuda_iDivUp(height, block.y), 1);
-  if (autoTest) {
-   dpct::get_in_order_queue().parallel_for(
-        sycl::nd_range<3>(grid * block, block), [=](sycl::nd_item<3> item_ct1) {
-          updateHeightmapKernel_y(d_heightMap, d_ht, width, item_ct1);
-        });
-  } else {
-    dpct::get_in_order_queue().parallel_for(
-        sycl::nd_range<3>(grid * block, block), [=](sycl::nd_item<3> item_ct1) {
-          updateHeightmapKernel(d_heightMap, d_ht, width, item_ct1);
-        });
-  }
-}
-
-extern "C" void cudaCalculateSlopeKernel(float *hptr, sycl::float2 *slopeOut,
-                                         unsigned int width,
-                                         unsigned int height) {
-  dpct::dim3 block(8, 8, 1);
-  dpct::dim3 grid2(cuda_iDivUp(width, block.x), cuda_iDivUp(height, block.y),
-                   1);
+  dpct::dim3 grid(cuda_iDivUp(width, block.x), cuda_iDivUp(height, block.y),
+                  tiles);
 
   dpct::get_in_order_queue().parallel_for(
-      sycl::nd_range<3>(grid2 * block, block), [=](sycl::nd_item<3> item_ct1) {
-        calculateSlopeKernel(hptr, slopeOut, width, height, item_ct1);
+      sycl::nd_range<3>(grid * block, block), [=](sycl::nd_item<3> item_ct1) {
+        updateHeightmapAndSlopeKernel(d_heightMap, d_slope, d_ht, width, height,
+                                      autoTest, item_ct1);
       });
 }
@@ -34,16 +34,16 @@
 #include <helper_cuda.h>
 using namespace sycl;
 #include "quasirandomGenerator_common.h"
+#include <algorithm>
 #include <cmath>
 
 ////////////////////////////////////////////////////////////////////////////////
 // CPU code
 ////////////////////////////////////////////////////////////////////////////////
-extern "C" void initQuasirandomGenerator(
-    unsigned int table[QRNG_DIMENSIONS][QRNG_RESOLUTION]);
+extern "C" void initQuasirandomGenerator(unsigned int *table, int dimensions);
 
-extern "C" float getQuasirandomValue(
-    unsigned int table[QRNG_DIMENSIONS][QRNG_RESOLUTION], int i, int dim);
+extern "C" unsigned int getQuasirandomInt(unsigned int *table, int i,
+                                          int dim);
 
 extern "C" double getQuasirandomValue63(INT64 i, int dim);
 extern "C" double MoroInvCNDcpu(unsigned int p);
@@ -51,14 +51,22 @@ extern "C" double MoroInvCNDcpu(unsigned int p);
 ////////////////////////////////////////////////////////////////////////////////
 // GPU code
 ////////////////////////////////////////////////////////////////////////////////
-extern "C" void initTableGPU(
-    unsigned int tableCPU[QRNG_DIMENSIONS][QRNG_RESOLUTION], sycl::queue q_ct1);
+extern "C" void initTableGPU(unsigned int *tableCPU, int dimensions,
+                             sycl::queue q_ct1);
+extern "C" void freeTableGPU(sycl::queue q_ct1);
 extern "C" void quasirandomGeneratorGPU(float *d_Output, unsigned int seed,
-                                        unsigned int N, sycl::queue q_ct1);
+                                        unsigned int N, bool normalOutput,
+                                        sycl::queue q_ct1);
 extern "C" void inverseCNDgpu(float *d_Output, unsigned int *d_Input,
                               unsigned int N, sycl::queue q_ct1);
+extern "C" void uniformToNormalGPU(float *d_Data, unsigned int N,
+                                   sycl::queue q_ct1);
 
-const int N = 1048576;
+// Default number of points per dimension
+const int DEFAULT_N = 1048576;
+
+// Index of the point generated at position "pos" (Gray code order)
+inline unsigned int grayCode(unsigned int pos) { return pos ^ (pos >> 1); }
 
 int main(int argc, char **argv) {
   // Start logs
@@ -66,12 +74,45 @@ int main(int argc, char **argv) {
   printf("%s Starting...\n\n", argv[0]);
    std::cout << "\nRunning on " << q_ct1.get_device().get_info<info::device::name>()
             << "\n";
-  unsigned int tableCPU[QRNG_DIMENSIONS][QRNG_RESOLUTION];
+
+  int dimensions = QRNG_DEFAULT_DIMENSIONS;
+  int N = DEFAULT_N;
+  unsigned int seed = 0;
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "dimensions")) {
+    dimensions =
+        getCmdLineArgumentInt(argc, (const char **)argv, "dimensions");
+  }
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "points")) {
+    N = getCmdLineArgumentInt(argc, (const char **)argv, "points");
+  }
+
+  if (checkCmdLineFlag(argc, (const char **)argv, "seed")) {
+    seed = getCmdLineArgumentInt(argc, (const char **)argv, "seed");
+  }
+
+  // the sequence has 2^QRNG_RESOLUTION points
+  if (dimensions < 1 || dimensions > QRNG_MAX_DIMENSIONS || N < 1 ||
+      (size_t)dimensions * N > ((size_t)1 << 30) ||
+      (size_t)seed + N > ((size_t)1 << QRNG_RESOLUTION)) {
+    printf("Usage: %s [--dimensions=<1..%d>] [--points=<per dimension>] "
+           "[--seed=<first point>]\n"
+           "dimensions * points must not exceed 2^30, seed + points 2^31\n",
+           argv[0], QRNG_MAX_DIMENSIONS);
+    return EXIT_FAILURE;
+  }
+
+  const size_t totalN = (size_t)dimensions * N;
+
+  unsigned int *tableCPU;
 
   float *h_OutputGPU, *d_Output;
 
-  int dim, pos;
+  size_t pos;
+  int dim;
   double delta, ref, sumDelta, sumRef, L1norm, gpuTime;
+  bool passed = true;
 
   StopWatchInterface *hTimer = NULL;
 
@@ -83,20 +124,25 @@ int main(int argc, char **argv) {
   sdkCreateTimer(&hTimer);
 
   printf("Allocating GPU memory...\n");
-      DPCT_CHECK_ERROR(d_Output = sycl::malloc_device<float>(
-                           QRNG_DIMENSIONS * N, q_ct1));
+      DPCT_CHECK_ERROR(d_Output = sycl::malloc_device<float>(totalN, q_ct1));
 
   printf("Allocating CPU memory...\n");
-  h_OutputGPU = (float *)malloc(QRNG_DIMENSIONS * N * sizeof(float));
+  h_OutputGPU = (float *)malloc(totalN * sizeof(float));
+  tableCPU = (unsigned int *)malloc(dimensions * QRNG_RESOLUTION *
+                                    sizeof(unsigned int));
+
+  printf("Initializing QRNG tables for %d dimensions...\n\n", dimensions);
+  initQuasirandomGenerator(tableCPU, dimensions);
 
-  printf("Initializing QRNG tables...\n\n");
-  initQuasirandomGenerator(tableCPU);
+  initTableGPU(tableCPU, dimensions, q_ct1);
 
-  initTableGPU(tableCPU, q_ct1);
+  // The CPU references are computed for at most 4M numbers spread over
+  // all the dimensions
+  const size_t checkStep = std::max<size_t>(totalN >> 22, 1);
 
   printf("Testing QRNG...\n\n");
   DPCT_CHECK_ERROR(
-          q_ct1.memset(d_Output, 0, QRNG_DIMENSIONS * N * sizeof(float))
+          q_ct1.memset(d_Output, 0, totalN * sizeof(float))
           .wait());
   int numIterations = 20;
 
@@ -107,39 +153,131 @@ int main(int argc, char **argv) {
       sdkStartTimer(&hTimer);
     }
 
-    quasirandomGeneratorGPU(d_Output, 0, N, q_ct1);
+    quasirandomGeneratorGPU(d_Output, seed, N, false, q_ct1);
   }
   DPCT_CHECK_ERROR(q_ct1.wait_and_throw());
   sdkStopTimer(&hTimer);
   gpuTime = sdkGetTimerValue(&hTimer) / (double)numIterations * 1e-3;
   printf(
       "quasirandomGenerator, Throughput = %.4f GNumbers/s, Time = %.5f s, Size "
-      "= %u Numbers, NumDevsUsed = %u, Workgroup = %u\n",
-      (double)QRNG_DIMENSIONS * (double)N * 1.0E-9 / gpuTime, gpuTime,
-      QRNG_DIMENSIONS * N, 1, 128 * QRNG_DIMENSIONS);
+      "= %zu Numbers, NumDevsUsed = %u, Workgroup = %u\n",
+      (double)totalN * 1.0E-9 / gpuTime, gpuTime, totalN, 1, 128);
 
   printf("\nReading GPU results...\n");
   DPCT_CHECK_ERROR(
-          q_ct1.memcpy(h_OutputGPU, d_Output, QRNG_DIMENSIONS * N * sizeof(float))
+          q_ct1.memcpy(h_OutputGPU, d_Output, totalN * sizeof(float))
           .wait());
 
   printf("Comparing to the CPU results...\n\n");
   sumDelta = 0;
   sumRef = 0;
 
-  for (dim = 0; dim < QRNG_DIMENSIONS; dim++)
-    for (pos = 0; pos < N; pos++) {
-      ref = getQuasirandomValue63(pos, dim);
-      delta = (double)h_OutputGPU[dim * N + pos] - ref;
-      sumDelta += sycl::fabs(delta);
-      sumRef += sycl::fabs(ref);
+  for (pos = 0; pos < totalN; pos += checkStep) {
+    dim = pos / N;
+    ref = getQuasirandomValue63(grayCode(seed + pos % N), dim);
+    delta = (double)h_OutputGPU[pos] - ref;
+    sumDelta += sycl::fabs(delta);
+    sumRef += sycl::fabs(ref);
+  }
+
+  printf("L1 norm: %E\n", L1norm = sumDelta / sumRef);
+  passed &= L1norm < 1e-6;
+
+  printf("\nTesting QRNG with fused inverse CND...\n\n");
+  DPCT_CHECK_ERROR(
+          q_ct1.memset(d_Output, 0, totalN * sizeof(float))
+          .wait());
+
+  for (int i = -1; i < numIterations; i++) {
+    if (i == 0) {
+          DPCT_CHECK_ERROR(q_ct1.wait_and_throw());
+      sdkResetTimer(&hTimer);
+      sdkStartTimer(&hTimer);
     }
 
-  printf("L1 norm: %E\n", sumDelta / sumRef);
+    quasirandomGeneratorGPU(d_Output, seed, N, true, q_ct1);
+  }
+  DPCT_CHECK_ERROR(q_ct1.wait_and_throw());
+  sdkStopTimer(&hTimer);
+  double fusedTime = sdkGetTimerValue(&hTimer) / (double)numIterations * 1e-3;
+  printf(
+      "quasirandomGenerator-normal, Throughput = %.4f GNumbers/s, Time = %.5f "
+      "s, Size = %zu Numbers, NumDevsUsed = %u, Workgroup = %u\n",
+      (double)totalN * 1.0E-9 / fusedTime, fusedTime, totalN, 1, 128);
+
+  printf("\nReading GPU results...\n");
+  DPCT_CHECK_ERROR(
+          q_ct1.memcpy(h_OutputGPU, d_Output, totalN * sizeof(float))
+          .wait());
+
+  printf("Comparing to the CPU results...\n\n");
+  sumDelta = 0;
+  sumRef = 0;
+
+  for (pos = 0; pos < totalN; pos += checkStep) {
+    dim = pos / N;
+    unsigned int x = getQuasirandomInt(tableCPU, grayCode(seed + pos % N), dim);
+    ref = MoroInvCNDcpu((x << 1) | 1);
+    delta = (double)h_OutputGPU[pos] - ref;
+    sumDelta += sycl::fabs(delta);
+    sumRef += sycl::fabs(ref);
+  }
+
+  printf("L1 norm: %E\n", L1norm = sumDelta / sumRef);
+  passed &= L1norm < 1e-6;
+
+  printf("\nTesting QRNG with a separate inverse CND pass...\n\n");
+  DPCT_CHECK_ERROR(
+          q_ct1.memset(d_Output, 0, totalN * sizeof(float))
+          .wait());
+
+  for (int i = -1; i < numIterations; i++) {
+    if (i == 0) {
+          DPCT_CHECK_ERROR(q_ct1.wait_and_throw());
+      sdkResetTimer(&hTimer);
+      sdkStartTimer(&hTimer);
+    }
+
+    quasirandomGeneratorGPU(d_Output, seed, N, false, q_ct1);
+    uniformToNormalGPU(d_Output, totalN, q_ct1);
+  }
+  DPCT_CHECK_ERROR(q_ct1.wait_and_throw());
+  sdkStopTimer(&hTimer);
+  double separateTime =
+      sdkGetTimerValue(&hTimer) / (double)numIterations * 1e-3;
+  printf(
+      "quasirandomGenerator-separate, Throughput = %.4f GNumbers/s, Time = "
+      "%.5f s, Size = %zu Numbers, NumDevsUsed = %u, Workgroup = %u\n",
+      (double)totalN * 1.0E-9 / separateTime, separateTime, totalN, 1, 128);
+  printf("Normal variates: %.5f s fused, %.5f s with a separate pass\n",
+         fusedTime, separateTime);
+
+  printf("\nReading GPU results...\n");
+  DPCT_CHECK_ERROR(
+          q_ct1.memcpy(h_OutputGPU, d_Output, totalN * sizeof(float))
+          .wait());
+
+  printf("Comparing to the CPU results...\n\n");
+  sumDelta = 0;
+  sumRef = 0;
+
+  for (pos = 0; pos < totalN; pos += checkStep) {
+    dim = pos / N;
+    unsigned int x = getQuasirandomInt(tableCPU, grayCode(seed + pos % N), dim);
+    ref = MoroInvCNDcpu((x << 1) | 1);
+    delta = (double)h_OutputGPU[pos] - ref;
+    sumDelta += sycl::fabs(delta);
+    sumRef += sycl::fabs(ref);
+  }
+
+  // The uniform variates only keep 24 bits of the integers in between the
+  // two passes, which the fused kernel avoids
+  printf("L1 norm: %E\n", L1norm = sumDelta / sumRef);
+  passed &= L1norm < 1e-5;
 
   printf("\nTesting inverseCNDgpu()...\n\n");
   DPCT_CHECK_ERROR(
-          q_ct1.memset(d_Output, 0, QRNG_DIMENSIONS * N * sizeof(float))
+          q_ct1.memset(d_Output, 0, totalN * sizeof(float))
           .wait());
 
   for (int i = -1; i < numIterations; i++) {
@@ -149,27 +287,26 @@ int main(int argc, char **argv) {
       sdkStartTimer(&hTimer);
     }
 
-    inverseCNDgpu(d_Output, NULL, QRNG_DIMENSIONS * N,q_ct1);
+    inverseCNDgpu(d_Output, NULL, totalN, q_ct1);
   }
       DPCT_CHECK_ERROR(q_ct1.wait_and_throw());
   sdkStopTimer(&hTimer);
-  gpuTime = sdkGetTimerValue(&hTimer) / (double)numIterations * 1e-3;
+  double inverseTime = sdkGetTimerValue(&hTimer) / (double)numIterations * 1e-3;
   printf(
       "quasirandomGenerator-inverse, Throughput = %.4f GNumbers/s, Time = %.5f "
-      "s, Size = %u Numbers, NumDevsUsed = %u, Workgroup = %u\n",
-      (double)QRNG_DIMENSIONS * (double)N * 1E-9 / gpuTime, gpuTime,
-      QRNG_DIMENSIONS * N, 1, 128);
+      "s, Size = %zu Numbers, NumDevsUsed = %u, Workgroup = %u\n",
+      (double)totalN * 1E-9 / inverseTime, inverseTime, totalN, 1, 128);
 
   printf("Reading GPU results...\n");
   DPCT_CHECK_ERROR(
-          q_ct1.memcpy(h_OutputGPU, d_Output, QRNG_DIMENSIONS * N * sizeof(float))
+          q_ct1.memcpy(h_OutputGPU, d_Output, totalN * sizeof(float))
           .wait());
   printf("\nComparing to the CPU results...\n");
   sumDelta = 0;
   sumRef = 0;
-  unsigned int distance = ((unsigned int)-1) / (QRNG_DIMENSIONS * N + 1);
+  unsigned int distance = ((unsigned int)-1) / (totalN + 1);
 
-  for (pos = 0; pos < QRNG_DIMENSIONS * N; pos++) {
+  for (pos = 0; pos < totalN; pos += checkStep) {
     unsigned int d = (pos + 1) * distance;
     ref = MoroInvCNDcpu(d);
     delta = (double)h_OutputGPU[pos] - ref;
@@ -178,11 +315,14 @@ int main(int argc, char **argv) {
   }
 
   printf("L1 norm: %E\n\n", L1norm = sumDelta / sumRef);
+  passed &= L1norm < 1e-6;
 
   printf("Shutting down...\n");
   sdkDeleteTimer(&hTimer);
+  freeTableGPU(q_ct1);
+  free(tableCPU);
   free(h_OutputGPU);
       DPCT_CHECK_ERROR(sycl::free(d_Output, q_ct1));
 
-  exit(L1norm < 1e-6 ? EXIT_SUCCESS : EXIT_FAILURE);
+  exit(passed ? EXIT_SUCCESS : EXIT_FAILURE);
 }
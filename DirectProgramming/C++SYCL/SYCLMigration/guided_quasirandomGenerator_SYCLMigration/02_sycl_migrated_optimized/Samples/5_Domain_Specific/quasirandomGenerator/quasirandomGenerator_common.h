@@ -33,7 +33,9 @@
 ////////////////////////////////////////////////////////////////////////////////
 typedef long long int INT64;
 
-#define QRNG_DIMENSIONS 2
+// Default and maximum number of dimensions, chosen at runtime
+#define QRNG_DEFAULT_DIMENSIONS 2
+#define QRNG_MAX_DIMENSIONS 4096
 #define QRNG_RESOLUTION 31
 #define INT_SCALE (1.0f / (float)0x80000001U)
 
@@ -27,21 +27,23 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <vector>
 
 #include "quasirandomGenerator_common.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Table generation functions
 ////////////////////////////////////////////////////////////////////////////////
-// Internal 64(63)-bit table
-static INT64 cjn[63][QRNG_DIMENSIONS];
+// Internal 64(63)-bit table, cjn[bit * dimensions + dim]
+static std::vector<INT64> cjn;
+static int cjnDimensions = 0;
 
-static int GeneratePolynomials(int buffer[QRNG_DIMENSIONS], bool primitive) {
+static int GeneratePolynomials(int *buffer, int dimensions, bool primitive) {
   int i, j, n, p1, p2, l;
   int e_p1, e_p2, e_b;
 
   // generate all polynomials to buffer
-  for (n = 1, buffer[0] = 0x2, p2 = 0, l = 0; n < QRNG_DIMENSIONS; ++n) {
+  for (n = 1, buffer[0] = 0x2, p2 = 0, l = 0; n < dimensions; ++n) {
     // search for the next irreducible polynomial
     for (p1 = buffer[n - 1] + 1;; ++p1) {
       // find degree of polynomial p1
@@ -112,19 +114,22 @@ static int GeneratePolynomials(int buffer[QRNG_DIMENSIONS], bool primitive) {
 //      July 1992.",
 //    year = "1992" }
 ////////////////////////////////////////////////////////////////////////////////
-static void GenerateCJ() {
-  int buffer[QRNG_DIMENSIONS];
+static void GenerateCJ(int dimensions) {
+  std::vector<int> buffer(dimensions);
   int *polynomials;
   int n, p1, l, e_p1;
 
+  cjn.assign(63 * dimensions, 0);
+  cjnDimensions = dimensions;
+
   // Niederreiter (in contrast to Sobol) allows to use not primitive, but just
   // irreducible polynomials
-  l = GeneratePolynomials(buffer, false);
+  l = GeneratePolynomials(buffer.data(), dimensions, false);
 
   // convert all polynomials from buffer to polynomials table
-  polynomials = new int[l + 2 * QRNG_DIMENSIONS + 1];
+  polynomials = new int[l + 2 * dimensions + 1];
 
-  for (n = 0, l = 0; n < QRNG_DIMENSIONS; ++n) {
+  for (n = 0, l = 0; n < dimensions; ++n) {
     // find degree of polynomial p1
     for (p1 = buffer[n], e_p1 = 30; (p1 & (1 << e_p1)) == 0; --e_p1) {
     }
@@ -154,10 +159,7 @@ static void GenerateCJ() {
 
   // cycle over monic irreducible polynomials
   for (d = 0; p[0] != -1; p += e + 2) {
-    // allocate memory for cj array for dimension (ip + 1)
-    for (i = 0; i < 63; ++i) {
-      cjn[i][d] = 0;
-    }
+    // cj array for dimension (ip + 1) is zeroed by the assign() above
 
     // determine the power of irreducible polynomial
     for (e = 0; p[e + 1] != -1; ++e) {
@@ -212,7 +214,7 @@ static void GenerateCJ() {
 
       // copy calculated v to cj
       for (i = 0; i < 63; i++) {
-        cjn[i][d] |= (INT64)v[i + u] << j;
+        cjn[i * dimensions + d] |= (INT64)v[i + u] << j;
       }
     }
 
@@ -229,7 +231,7 @@ extern "C" double getQuasirandomValue63(INT64 i, int dim) {
   INT64 result = 0;
 
   for (int bit = 0; bit < 63; bit++, i >>= 1)
-    if (i & 1) result ^= cjn[bit][dim];
+    if (i & 1) result ^= cjn[bit * cjnDimensions + dim];
 
   return (double)(result + 1) * INT63_SCALE;
 }
@@ -237,26 +239,31 @@ extern "C" double getQuasirandomValue63(INT64 i, int dim) {
 ////////////////////////////////////////////////////////////////////////////////
 // Initialization (table setup)
 ////////////////////////////////////////////////////////////////////////////////
-extern "C" void initQuasirandomGenerator(
-    unsigned int table[QRNG_DIMENSIONS][QRNG_RESOLUTION]) {
-  GenerateCJ();
+// table[dim * QRNG_RESOLUTION + bit]
+extern "C" void initQuasirandomGenerator(unsigned int *table, int dimensions) {
+  GenerateCJ(dimensions);
 
-  for (int dim = 0; dim < QRNG_DIMENSIONS; dim++)
+  for (int dim = 0; dim < dimensions; dim++)
     for (int bit = 0; bit < QRNG_RESOLUTION; bit++)
-      table[dim][bit] = (int)((cjn[bit][dim] >> 32) & 0x7FFFFFFF);
+      table[dim * QRNG_RESOLUTION + bit] =
+          (int)((cjn[bit * dimensions + dim] >> 32) & 0x7FFFFFFF);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Generate 31-bit quasirandom number for given index and dimension
 ////////////////////////////////////////////////////////////////////////////////
-extern "C" float getQuasirandomValue(
-    unsigned int table[QRNG_DIMENSIONS][QRNG_RESOLUTION], int i, int dim) {
-  int result = 0;
+extern "C" unsigned int getQuasirandomInt(unsigned int *table, int i,
+                                          int dim) {
+  unsigned int result = 0;
 
   for (int bit = 0; bit < QRNG_RESOLUTION; bit++, i >>= 1)
-    if (i & 1) result ^= table[dim][bit];
+    if (i & 1) result ^= table[dim * QRNG_RESOLUTION + bit];
+
+  return result;
+}
 
-  return (float)(result + 1) * INT_SCALE;
+extern "C" float getQuasirandomValue(unsigned int *table, int i, int dim) {
+  return (float)(getQuasirandomInt(table, i, dim) + 1) * INT_SCALE;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -40,59 +40,138 @@ using namespace sycl;
 
 ////////////////////////////////////////////////////////////////////////////////
 // Niederreiter quasirandom number generation kernel
+// The direction table has QRNG_RESOLUTION entries per dimension and is sized at
+// runtime, so it lives in global memory; each work-group generates one
+// dimension and first copies its row to local memory.
+// Points are generated in Gray code order: point n is the XOR of the
+// directions of the bits of n ^ (n >> 1), so that consecutive points differ
+// by a single direction. The 2 ** log2ThreadN work-items of a dimension
+// generate the points seed + tid, seed + tid + threadN, ...: the first one
+// is computed directly (skip-ahead), each following one with two XORs, and
+// neighbouring work-items write neighbouring points.
 ////////////////////////////////////////////////////////////////////////////////
-static dpct::constant_memory<unsigned int, 2> c_Table(QRNG_DIMENSIONS,
-                                                      QRNG_RESOLUTION);
+static unsigned int *d_Table = NULL;
+static int tableDimensions = 0;
 
+inline unsigned int grayCodePoint(const unsigned int *dimBase,
+                                  unsigned int index) {
+  unsigned int result = 0;
+  unsigned int data = index ^ (index >> 1);
+
+  for (int bit = 0; bit < QRNG_RESOLUTION; bit++, data >>= 1)
+    if (data & 1) {
+      result ^= dimBase[bit];
+    }
+
+  return result;
+}
+
+inline float MoroInvCNDgpu(unsigned int x);
+
+template <bool normalOutput>
 static void quasirandomGeneratorKernel(float *d_Output,
-                                                  unsigned int seed,
-                                                  unsigned int N,
-                                                  const sycl::nd_item<3> &item_ct1,
-                                                  dpct::accessor<unsigned int, dpct::constant, 2> c_Table) {
-  unsigned int *dimBase = &c_Table[item_ct1.get_local_id(1)][0];
-  unsigned int tid = MUL(item_ct1.get_local_range(2), item_ct1.get_group(2)) +
-                     item_ct1.get_local_id(2);
-  unsigned int threadN =
-      MUL(item_ct1.get_local_range(2), item_ct1.get_group_range(2));
+                                       const unsigned int *d_Table,
+                                       unsigned int seed, unsigned int N,
+                                       int log2ThreadN,
+                                       const sycl::nd_item<3> &item_ct1,
+                                       unsigned int *s_dimBase) {
+  const unsigned int dim = item_ct1.get_group(1);
+  const unsigned int tid = MUL(item_ct1.get_local_range(2),
+                               item_ct1.get_group(2)) +
+                           item_ct1.get_local_id(2);
+  const unsigned int threadN = 1U << log2ThreadN;
+
+  for (int bit = item_ct1.get_local_id(2); bit < QRNG_RESOLUTION;
+       bit += item_ct1.get_local_range(2)) {
+    s_dimBase[bit] = d_Table[dim * QRNG_RESOLUTION + bit];
+  }
+
+  item_ct1.barrier(sycl::access::fence_space::local_space);
+
+  if (tid >= N) return;
+
+  // Stepping from n to n + threadN flips bit (log2ThreadN - 1) of the Gray
+  // code, and bit log2ThreadN + k where k is the number of trailing zeros of
+  // (n >> log2ThreadN) + 1
+  const unsigned int lowDirection =
+      log2ThreadN > 0 ? s_dimBase[log2ThreadN - 1] : 0;
+  unsigned int index = seed + tid;
+  unsigned int result = grayCodePoint(s_dimBase, index);
+  float *d_Dim = d_Output + (size_t)dim * N;
 
   for (unsigned int pos = tid; pos < N; pos += threadN) {
-    unsigned int result = 0;
-    unsigned int data = seed + pos;
+    d_Dim[pos] = normalOutput ? MoroInvCNDgpu((result << 1) | 1)
+                              : (float)(result + 1) * INT_SCALE;
 
-    for (int bit = 0; bit < QRNG_RESOLUTION; bit++, data >>= 1)
-      if (data & 1) {
-        result ^= dimBase[bit];
-      }
+    unsigned int high = (index >> log2ThreadN) + 1;
+    int highBit = log2ThreadN + sycl::ctz(high);
 
-    d_Output[MUL(item_ct1.get_local_id(1), N) + pos] =
-        (float)(result + 1) * INT_SCALE;
+    if (highBit < QRNG_RESOLUTION) result ^= s_dimBase[highBit];
+    result ^= lowDirection;
+    index += threadN;
   }
 }
 
 // Table initialization routine
-extern "C" void initTableGPU(
-    unsigned int tableCPU[QRNG_DIMENSIONS][QRNG_RESOLUTION],sycl::queue q_ct1) {
+// tableCPU[dim * QRNG_RESOLUTION + bit] for "dimensions" dimensions
+extern "C" void initTableGPU(unsigned int *tableCPU, int dimensions,
+                             sycl::queue q_ct1) {
+  if (d_Table) DPCT_CHECK_ERROR(sycl::free(d_Table, q_ct1));
+
+  DPCT_CHECK_ERROR(d_Table = sycl::malloc_device<unsigned int>(
+                       dimensions * QRNG_RESOLUTION, q_ct1));
   DPCT_CHECK_ERROR(
-          q_ct1.memcpy(c_Table.get_ptr(), tableCPU,
-                  QRNG_DIMENSIONS * QRNG_RESOLUTION * sizeof(unsigned int))
+      q_ct1.memcpy(d_Table, tableCPU,
+                   dimensions * QRNG_RESOLUTION * sizeof(unsigned int))
           .wait());
+  tableDimensions = dimensions;
+}
+
+extern "C" void freeTableGPU(sycl::queue q_ct1) {
+  if (d_Table) DPCT_CHECK_ERROR(sycl::free(d_Table, q_ct1));
+
+  d_Table = NULL;
+  tableDimensions = 0;
 }
 
 // Host-side interface
+// Writes the points seed, ..., seed + N - 1 (in Gray code order) of all the
+// dimensions of the table, dimension by dimension: as uniform variates in
+// (0, 1), or as standard normal variates when "normalOutput" is set
 extern "C" void quasirandomGeneratorGPU(float *d_Output, unsigned int seed,
-                                        unsigned int N, sycl::queue q_ct1) {
-  sycl::range<3> threads(1, QRNG_DIMENSIONS, 128);
-  q_ct1.submit([&](sycl::handler &cgh) {
-    c_Table.init();
+                                        unsigned int N, bool normalOutput,
+                                        sycl::queue q_ct1) {
+  const int THREAD_N = 128;
+
+  // Work-items per dimension: a power of 2, no more than needed for N and no
+  // more than 128 work-groups
+  int log2ThreadN = 7;
+
+  while (log2ThreadN < 14 && (1U << log2ThreadN) < N) log2ThreadN++;
+
+  const unsigned int threadN = 1U << log2ThreadN;
+  const unsigned int *table = d_Table;
 
-    auto c_Table_acc_ct1 = c_Table.get_access(cgh);
+  sycl::nd_range<3> range(sycl::range<3>(1, tableDimensions, threadN),
+                          sycl::range<3>(1, 1, THREAD_N));
 
-    cgh.parallel_for(
-        sycl::nd_range<3>(sycl::range<3>(1, 1, 128) * threads, threads),
-        [=](sycl::nd_item<3> item_ct1) {
-          quasirandomGeneratorKernel(d_Output, seed, N, item_ct1,
-                                     c_Table_acc_ct1);
-        });
+  q_ct1.submit([&](sycl::handler &cgh) {
+    sycl::local_accessor<unsigned int, 1> s_dimBase_acc(
+        sycl::range<1>(QRNG_RESOLUTION), cgh);
+
+    if (normalOutput) {
+      cgh.parallel_for(range, [=](sycl::nd_item<3> item_ct1) {
+        quasirandomGeneratorKernel<true>(
+            d_Output, table, seed, N, log2ThreadN, item_ct1,
+            s_dimBase_acc.get_multi_ptr<sycl::access::decorated::no>().get());
+      });
+    } else {
+      cgh.parallel_for(range, [=](sycl::nd_item<3> item_ct1) {
+        quasirandomGeneratorKernel<false>(
+            d_Output, table, seed, N, log2ThreadN, item_ct1,
+            s_dimBase_acc.get_multi_ptr<sycl::access::decorated::no>().get());
+      });
+    }
   });
 }
 
@@ -201,4 +280,33 @@ extern "C" void inverseCNDgpu(float *d_Output, unsigned int *d_Input,
       });
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Separate pass: transforms in place the uniform variates written by
+// quasirandomGeneratorGPU() to standard normal variates. (result + 1) *
+// INT_SCALE scaled by 2^32 gives back (result << 1) | 1 up to float rounding.
+////////////////////////////////////////////////////////////////////////////////
+static void uniformToNormalKernel(float *d_Data, unsigned int pathN,
+                                  const sycl::nd_item<3> &item_ct1) {
+  unsigned int tid = MUL(item_ct1.get_local_range(2), item_ct1.get_group(2)) +
+                     item_ct1.get_local_id(2);
+  unsigned int threadN =
+      MUL(item_ct1.get_local_range(2), item_ct1.get_group_range(2));
+
+  for (unsigned int pos = tid; pos < pathN; pos += threadN) {
+    float u = d_Data[pos];
+    unsigned int d = u < 1.0f ? (unsigned int)(u * 4294967296.0f) : 0xffffffffU;
+    d_Data[pos] = MoroInvCNDgpu(d);
+  }
+}
+
+extern "C" void uniformToNormalGPU(float *d_Data, unsigned int N,
+                                   sycl::queue q_ct1) {
+  q_ct1.parallel_for(
+      sycl::nd_range<3>(sycl::range<3>(1, 1, 128) * sycl::range<3>(1, 1, 128),
+                        sycl::range<3>(1, 1, 128)),
+      [=](sycl::nd_item<3> item_ct1) {
+        uniformToNormalKernel(d_Data, N, item_ct1);
+      });
+}
+
 #endif
@@ -52,6 +52,7 @@
 #include <iterator>
 #include <vector>
 #include <list>
+#include <map>
 #include <deque>
 #include <algorithm>
 #include <dpct/dpl_utils.hpp>
@@ -92,108 +93,85 @@ int myrand(void)
     return seed;
 }
 
-// Simple memory pool class. It is nothing more than array of fixed-sized
-// arrays.
-template <typename T>
-class DeviceMemoryPool
+// Growable device memory allocator. Unlike a pool of fixed-size arrays, it
+// serves requests of any size: with the smallest free block that is large
+// enough, or with a new block when there is none. Blocks are only released by
+// the destructor.
+// Blocks are handed back with "put()" right after submitting the last kernel
+// that uses them, without waiting for it: all the work is submitted to the
+// same in-order queue, so the kernels using the block next run after it.
+// Once a frame has been segmented, the following frames of the same size
+// allocate nothing.
+class StreamOrderedAllocator
 {
     public:
-        // The parameters of the constructor are as follows:
-        // 1) uint chunkSize --- size of the particular array;
-        // 2) uint chunksCount --- number of fixed-sized arrays.
-        DeviceMemoryPool(uint chunkSize, uint chunksCount) :
-            chunkSize_(chunkSize)
-        {
-            chunkRawSize_ = (chunkSize * sizeof(T) + 511) & ~511;
+        explicit StreamOrderedAllocator(sycl::queue &queue) :
+            queue_(queue), allocatedBytes_(0)
+        {}
 
-            try
-            {
-                basePtr_ = dpct::malloc_device(chunkRawSize_ * chunksCount);
-            }
-            catch (std::system_error &e)
-            {
-                cout << "Pool memory allocation failed (" << e.what() << ")"
-                     << endl;
-                exit(EXIT_FAILURE);
-            }
-
-            for (uint chunkIndex = 0; chunkIndex < chunksCount; ++chunkIndex)
+        ~StreamOrderedAllocator()
+        {
+            for (auto &block : blocks_)
             {
-                chunks_.push_back(dpct::device_pointer<T>(
-                    reinterpret_cast<T *>(static_cast<char *>(basePtr_.get()) +
-                                          chunkRawSize_ * chunkIndex)));
+                sycl::free(block.first, queue_);
             }
         }
 
-        ~DeviceMemoryPool()
+        // Returns an array of at least "count" elements.
+        template <typename T>
+        dpct::device_pointer<T> get(size_t count)
         {
-            try
+            size_t rawSize = (std::max<size_t>(count * sizeof(T), 1) + 511) &
+                             ~size_t(511);
+            void *ptr;
+
+            auto block = freeBlocks_.lower_bound(rawSize);
+
+            if (block != freeBlocks_.end())
             {
-                dpct::free_device(basePtr_);
+                ptr = block->second;
+                freeBlocks_.erase(block);
             }
-            catch (std::system_error &e)
+            else
             {
-                cout << "Pool memory allocation failed (" << e.what() << ")"
-                     << endl;
-                exit(EXIT_FAILURE);
-            }
-        }
+                ptr = sycl::malloc_device(rawSize, queue_);
 
-        // Returns an address of the first available array
-        // in the memory pool.
-        dpct::device_pointer<T> get()
-        {
-            dpct::device_pointer<T> ptr(chunks_.back());
-            chunks_.pop_back();
+                if (ptr == NULL)
+                {
+                    cout << "Device memory allocation failed (" << rawSize
+                         << " bytes)" << endl;
+                    exit(EXIT_FAILURE);
+                }
 
-            return ptr;
+                blocks_[ptr] = rawSize;
+                allocatedBytes_ += rawSize;
+            }
+
+            return dpct::device_pointer<T>(static_cast<T *>(ptr));
         }
 
-        // Pushes an address stored in "ptr" to the list
-        // of available arrays of the memory pool.
-        // It should be noted that it is user who is responsible for returning
-        // the previously requested memory to the appropriate pool.
-        inline void put(const dpct::device_pointer<T> &ptr)
+        // Makes an array returned by "get()" available to later requests.
+        // It should be noted that it is user who is responsible for not
+        // accessing the array from the host afterwards.
+        template <typename T>
+        void put(const dpct::device_pointer<T> &ptr)
         {
-            chunks_.push_back(ptr);
+            void *rawPtr = static_cast<void *>(ptr.get());
+            freeBlocks_.insert(std::make_pair(blocks_[rawPtr], rawPtr));
         }
 
-        uint totalFreeChunks() const
+        size_t allocatedBytes() const
         {
-            return chunks_.size();
+            return allocatedBytes_;
         }
 
     private:
-        uint chunkSize_, chunkRawSize_;
-        dpct::device_pointer<void> basePtr_;
+        sycl::queue &queue_;
+        size_t allocatedBytes_;
 
-        list<dpct::device_pointer<T>> chunks_;
-};
-
-// Graph structure.
-struct Graph
-{
-    Graph() {}
-
-    Graph(uint verticesCount, uint edgesCount) :
-        vertices(verticesCount),
-        edges(edgesCount),
-        weights(edgesCount)
-    {}
-
-    // This vector stores offsets for each vertex in "edges" and "weights"
-    // vectors. For example:
-    // "vertices[0]" is an index of the first outgoing edge of vertex #0,
-    // "vertices[1]" is an index of the first outgoing edge of vertex #1, etc.
-    vector<uint> vertices;
-
-    // This vector stores indices of endpoints of the corresponding edges.
-    // For example, "edges[vertices[0]]" is the first neighbouring vertex
-    // of vertex #0.
-    vector<uint> edges;
-
-    // This vector stores weights of the corresponding edges.
-    vector<float> weights;
+        // All blocks with their sizes, and the free ones by size.
+        std::map<void *, size_t> blocks_;
+        std::multimap<size_t, void *> freeBlocks_;
 };
 
 // Simple segmentation tree class.
@@ -392,68 +370,128 @@ class Pyramid
 class SegmentationTreeBuilder
 {
     public:
-        SegmentationTreeBuilder():verticesCount_(0),edgesCount_(0)  {}
+        SegmentationTreeBuilder() :
+            allocator_(dpct::get_default_queue()), hSizes_(NULL),
+            hSizesCapacity_(0)
+        {}
 
-        ~SegmentationTreeBuilder() {}
+        ~SegmentationTreeBuilder()
+        {
+            if (hSizes_ != NULL)
+            {
+                sycl::free(hSizes_, dpct::get_default_queue());
+            }
+        }
 
-        // Repeatedly invokes the step of the algorithm
-        // until the limiting segmentation is found.
+        // Builds the graph of the image "dImage" (in device memory) and
+        // submits the steps of the algorithm level by level, without waiting
+        // for the level just submitted. The sizes of each level are copied
+        // back asynchronously and read "kSizesLag" levels later, to stop at
+        // the last level and to launch the following ones for the actual
+        // sizes. The segmentations are read back at the end.
         // Returns time (in ms) spent on building the tree.
-        float run(const Graph &graph, Pyramid &segmentations)
+        float run(const sycl::uchar3 *dImage, uint width, uint height,
+                  Pyramid &segmentations)
         {
-            dpct::event_ptr start, stop;
             std::chrono::time_point<std::chrono::steady_clock> start_ct1;
             std::chrono::time_point<std::chrono::steady_clock> stop_ct1;
 
-            start = new sycl::event();
-            stop = new sycl::event();
-
             start_ct1 = std::chrono::steady_clock::now();
 
-            // Allocate required memory pools. We need just 4 types of arrays.
-            MemoryPoolsCollection pools =
-            {
-                DeviceMemoryPool<uint>(
-                    static_cast<uint>(graph.vertices.size()),
-                    kUintVerticesPoolsRequired),
-                DeviceMemoryPool<float>(
-                    static_cast<uint>(graph.vertices.size()),
-                    kFloatVerticesPoolsRequired),
-                DeviceMemoryPool<uint>(
-                    static_cast<uint>(graph.edges.size()),
-                    kUintEdgesPoolsRequired),
-                DeviceMemoryPool<float>(
-                    static_cast<uint>(graph.edges.size()),
-                    kFloatEdgesPoolsRequired)
-            };
-            // Initialize internal variables
-            try
+            sycl::queue &queue = dpct::get_default_queue();
+
+            uint verticesCount = width * height;
+            uint edgesCount = 4 * verticesCount - 2 * (width + height);
+
+            // Every vertex is merged with at least one other at each level
+            // (the graph is connected), so that the number of vertices is
+            // at least halved.
+            uint levelsCount = 0;
+
+            for (uint bound = verticesCount; bound > 1; bound /= 2)
             {
-                initalizeData(graph, pools);
-            }
-            catch (std::system_error &e)
-            {
-                cout << "Initialization failed (" << e.what() << ")" << endl;
-                exit(EXIT_FAILURE);
+                ++levelsCount;
             }
 
-            // Run steps
-            AlgorithmStatus status;
+            dSizes_ = allocator_.get<LevelSizes>(levelsCount);
+            reserveHostSizes(levelsCount);
+
+            initializeData(dImage, width, height, verticesCount, edgesCount);
+
+            // Sizes of the graph at the beginning of level "knownLevel", the
+            // last one whose sizes have been read back.
+            uint knownLevel = 0;
+            uint knownVerticesCount = verticesCount;
+            uint knownEdgesCount = edgesCount;
 
-            try
+            vector<sycl::event> sizesCopies;
+            uint level = 0;
+
+            for (; level < levelsCount; ++level)
             {
-                do
+                if (level >= kSizesLag)
                 {
-                    status = invokeStep(pools, segmentations);
+                    // The device is still busy with the previous level.
+                    uint readLevel = level - kSizesLag;
+                    sizesCopies[readLevel].wait();
+
+                    const LevelSizes &sizes = hSizes_[readLevel];
+
+                    if (sizes.isLast)
+                    {
+                        break;
+                    }
+
+                    knownLevel = readLevel + 1;
+                    knownVerticesCount = sizes.newVerticesCount;
+                    knownEdgesCount = sizes.newEdgesCount;
                 }
-                while (status != ALGORITHM_FINISHED);
+
+                // Merging two vertices removes the edge between them in
+                // both directions, so that there are at most
+                // knownEdgesCount - 2 * (knownVerticesCount - verticesBound)
+                // edges.
+                uint verticesBound =
+                    knownVerticesCount >> (level - knownLevel);
+                uint edgesBound =
+                    knownEdgesCount -
+                    2 * (knownVerticesCount - verticesBound);
+
+                invokeStep(level, std::max(verticesBound, 1u),
+                           std::max(edgesBound, 1u));
+
+                sizesCopies.push_back(
+                    queue.memcpy(hSizes_ + level, dSizes_.get() + level,
+                                 sizeof(LevelSizes)));
             }
-            catch (std::system_error &e)
+
+            // Wait for the sizes of the levels not read yet.
+            queue.wait();
+
+            for (uint submittedLevel = 0; submittedLevel < level;
+                 ++submittedLevel)
             {
-                cout << "Algorithm failed (" << e.what() << ")" << endl;
-                exit(EXIT_FAILURE);
+                const LevelSizes &sizes = hSizes_[submittedLevel];
+
+                if (sizes.isSegmentation)
+                {
+                    segmentations.addLevel(
+                        sizes.newVerticesCount, sizes.verticesCount,
+                        levels_[submittedLevel].verticesOffsets,
+                        levels_[submittedLevel].verticesIDs);
+                }
+
+                allocator_.put(levels_[submittedLevel].verticesOffsets);
+                allocator_.put(levels_[submittedLevel].verticesIDs);
             }
 
+            levels_.clear();
+
+            allocator_.put(dSizes_);
+            allocator_.put(dVertices_);
+            allocator_.put(dEdges_);
+            allocator_.put(dWeights_);
+
             stop_ct1 = std::chrono::steady_clock::now();
 
             float elapsedTime;
@@ -461,10 +499,46 @@ class SegmentationTreeBuilder
                 std::chrono::duration<float, std::milli>(stop_ct1 - start_ct1)
                     .count();
 
-            return 0;//elapsedTime;
+            return elapsedTime;
+        }
+
+        size_t allocatedBytes() const
+        {
+            return allocator_.allocatedBytes();
         }
 
     private:
+        // Number of levels between submitting a level and reading its sizes
+        // back. With 2, the next level is queued while the host waits, so
+        // that the device does not wait for the host either.
+        static const uint kSizesLag = 2;
+
+        // Makes "hSizes_" hold the sizes of "levelsCount" levels.
+        void reserveHostSizes(uint levelsCount)
+        {
+            if (levelsCount <= hSizesCapacity_)
+            {
+                return;
+            }
+
+            sycl::queue &queue = dpct::get_default_queue();
+
+            if (hSizes_ != NULL)
+            {
+                sycl::free(hSizes_, queue);
+            }
+
+            hSizes_ = sycl::malloc_host<LevelSizes>(levelsCount, queue);
+
+            if (hSizes_ == NULL)
+            {
+                cout << "Host memory allocation failed" << endl;
+                exit(EXIT_FAILURE);
+            }
+
+            hSizesCapacity_ = levelsCount;
+        }
+
         void printMemoryUsage()
         {
             size_t availableMemory, totalMemory, usedMemory;
@@ -478,50 +552,27 @@ class SegmentationTreeBuilder
                  << " total " << totalMemory << endl;
         }
 
-        struct MemoryPoolsCollection
-        {
-            DeviceMemoryPool<uint> uintVertices;
-            DeviceMemoryPool<float> floatVertices;
-            DeviceMemoryPool<uint> uintEdges;
-            DeviceMemoryPool<float> floatEdges;
-        };
-
-        static const uint kUintVerticesPoolsRequired = 8;
-        static const uint kFloatVerticesPoolsRequired = 3;
-        static const uint kUintEdgesPoolsRequired = 8;
-        static const uint kFloatEdgesPoolsRequired = 4;
-
-        void initalizeData(const Graph &graph, MemoryPoolsCollection &pools)
+        void initializeData(const sycl::uchar3 *dImage, uint width,
+                            uint height, uint verticesCount, uint edgesCount)
         {
-            // Get memory for the internal variables
-            verticesCount_ = static_cast<uint>(graph.vertices.size());
-            edgesCount_ = static_cast<uint>(graph.edges.size());
-
-            dVertices_ = pools.uintVertices.get();
-            dEdges_ = pools.uintEdges.get();
-            dWeights_ = pools.floatEdges.get();
-
-            dOutputEdgesFlags_ = pools.uintEdges.get();
-
-            // Copy graph to the device memory
-            DPCT_CHECK_ERROR(
-                dpct::get_default_queue()
-                    .memcpy(dVertices_.get(), &(graph.vertices[0]),
-                            sizeof(uint) * verticesCount_)
-                    .wait());
-            DPCT_CHECK_ERROR(dpct::get_default_queue()
-                                     .memcpy(dEdges_.get(), &(graph.edges[0]),
-                                             sizeof(uint) * edgesCount_)
-                                     .wait());
-            DPCT_CHECK_ERROR(
-                dpct::get_default_queue()
-                    .memcpy(dWeights_.get(), &(graph.weights[0]),
-                            sizeof(float) * edgesCount_)
-                    .wait());
-
-            std::fill(oneapi::dpl::execution::make_device_policy(
-                          dpct::get_default_queue()),
-                      dOutputEdgesFlags_, dOutputEdgesFlags_ + edgesCount_, 0);
+            dVertices_ = allocator_.get<uint>(verticesCount);
+            dEdges_ = allocator_.get<uint>(edgesCount);
+            dWeights_ = allocator_.get<float>(edgesCount);
+
+            uint *vertices = dVertices_.get();
+            uint *edges = dEdges_.get();
+            float *weights = dWeights_.get();
+            LevelSizes *sizes = dSizes_.get();
+
+            launch(verticesCount, [=](sycl::nd_item<3> item_ct1) {
+                buildGraph(dImage, width, height, vertices, edges, weights,
+                           item_ct1);
+            });
+
+            dpct::get_default_queue().single_task([=]() {
+                sizes->verticesCount = verticesCount;
+                sizes->edgesCount = edgesCount;
+            });
         }
 
         static const uint kMaxThreadsPerBlock = 256;
@@ -547,64 +598,65 @@ class SegmentationTreeBuilder
             }
         }
 
-        enum AlgorithmStatus { ALGORITHM_NOT_FINISHED, ALGORITHM_FINISHED };
-
-        AlgorithmStatus invokeStep(MemoryPoolsCollection &pools,
-                                   Pyramid &segmentations)
+        // Submits "kernel" for "totalElements" elements.
+        template <typename Kernel>
+        void launch(uint totalElements, const Kernel &kernel)
         {
             uint blocksCount, threadsPerBlockCount;
 
-            calculateThreadsDistribution(edgesCount_,
+            calculateThreadsDistribution(totalElements,
                                          blocksCount,
                                          threadsPerBlockCount);
-            sycl::range<3> gridDimsForEdges(1, 1, blocksCount);
-            sycl::range<3> blockDimsForEdges(1, 1, threadsPerBlockCount);
+            sycl::range<3> gridDims(1, 1, blocksCount);
+            sycl::range<3> blockDims(1, 1, threadsPerBlockCount);
 
-            calculateThreadsDistribution(verticesCount_,
-                                         blocksCount,
-                                         threadsPerBlockCount);
-            sycl::range<3> gridDimsForVertices(1, 1, blocksCount);
-            sycl::range<3> blockDimsForVertices(1, 1, threadsPerBlockCount);
+            dpct::get_default_queue().parallel_for(
+                sycl::nd_range<3>(gridDims * blockDims, blockDims), kernel);
+        }
+
+        // Submits the step of the algorithm for the given level. The actual
+        // sizes of the graph are only known to the device ("dSizes_"):
+        // arrays are allocated, and kernels and algorithms are launched, for
+        // the upper bounds "verticesBound" and "edgesBound". Kernels write
+        // UINT_MAX past the actual sizes where sorting depends on it, and
+        // do nothing once the algorithm has finished.
+        void invokeStep(uint level, uint verticesBound, uint edgesBound)
+        {
+            sycl::queue &queue = dpct::get_default_queue();
+            auto policy = oneapi::dpl::execution::make_device_policy(queue);
+
+            LevelSizes *sizes = dSizes_.get() + level;
+
+            if (level > 0)
+            {
+                queue.single_task([=]() { startLevel(sizes - 1, sizes); });
+            }
 
-            dpct::device_pointer<uint> dEdgesFlags = pools.uintEdges.get();
+            uint *vertices = dVertices_.get();
+            uint *edges = dEdges_.get();
+            float *weights = dWeights_.get();
 
-            std::fill(oneapi::dpl::execution::make_device_policy(
-                          dpct::get_default_queue()),
-                      dEdgesFlags, dEdgesFlags + edgesCount_, 0);
+            dpct::device_pointer<uint> dEdgesFlags =
+                allocator_.get<uint>(edgesBound);
+
+            std::fill(policy, dEdgesFlags, dEdgesFlags + edgesBound, 0);
 
             // Mark the first edge for each vertex in "dEdgesFlags"
-                        dpct::get_default_queue().submit(
-                            [&](sycl::handler &cgh) {
-                                        auto dVertices__get_ct0 =
-                                            dVertices_.get();
-                                        auto dEdgesFlags_get_ct1 =
-                                            dEdgesFlags.get();
-                                        auto verticesCount__ct2 =
-                                            verticesCount_;
-
-                                        cgh.parallel_for(
-                                            sycl::nd_range<3>(
-                                                gridDimsForVertices *
-                                                    blockDimsForVertices,
-                                                blockDimsForVertices),
-                                            [=](sycl::nd_item<3> item_ct1) {
-                                                        markSegments(
-                                                            dVertices__get_ct0,
-                                                            dEdgesFlags_get_ct1,
-                                                            verticesCount__ct2,
-                                                            item_ct1);
-                                            });
-                            });
-            getLastCudaError("markSegments launch failed.");
+            uint *edgesFlags = dEdgesFlags.get();
+
+            launch(verticesBound, [=](sycl::nd_item<3> item_ct1) {
+                markSegments(vertices, edgesFlags, sizes, item_ct1);
+            });
 
             // Now find minimum edges for each vertex.
-            dpct::device_pointer<uint> dMinScannedEdges = pools.uintEdges.get();
-            dpct::device_pointer<float> dMinScannedWeights = pools.floatEdges.get();
+            dpct::device_pointer<uint> dMinScannedEdges =
+                allocator_.get<uint>(edgesBound);
+            dpct::device_pointer<float> dMinScannedWeights =
+                allocator_.get<float>(edgesBound);
 
             oneapi::dpl::inclusive_scan_by_segment(
-                oneapi::dpl::execution::make_device_policy(
-                    dpct::get_default_queue()),
-                dEdgesFlags, dEdgesFlags + edgesCount_,
+                policy,
+                dEdgesFlags, dEdgesFlags + edgesBound,
                 oneapi::dpl::make_zip_iterator(
                     std::make_tuple(dWeights_, dEdges_)),
                 oneapi::dpl::make_zip_iterator(
@@ -620,475 +672,267 @@ class SegmentationTreeBuilder
             // Calculate a successor vertex for each vertex. A successor of the
             // vertex v is a neighbouring vertex connected to v
             // by the minimal edge.
-            dpct::device_pointer<uint> dSuccessors = pools.uintVertices.get();
-
-                        dpct::get_default_queue().submit([&](sycl::handler
-                                                                 &cgh) {
-                                    auto dVertices__get_ct0 = dVertices_.get();
-                                    auto dMinScannedEdges_get_ct1 =
-                                        dMinScannedEdges.get();
-                                    auto dSuccessors_get_ct2 =
-                                        dSuccessors.get();
-                                    auto verticesCount__ct3 = verticesCount_;
-                                    auto edgesCount__ct4 = edgesCount_;
-
-                                    cgh.parallel_for(
-                                        sycl::nd_range<3>(
-                                            gridDimsForVertices *
-                                                blockDimsForVertices,
-                                            blockDimsForVertices),
-                                        [=](sycl::nd_item<3> item_ct1) {
-                                                    getSuccessors(
-                                                        dVertices__get_ct0,
-                                                        dMinScannedEdges_get_ct1,
-                                                        dSuccessors_get_ct2,
-                                                        verticesCount__ct3,
-                                                        edgesCount__ct4,
-                                                        item_ct1);
-                                        });
-                        });
-            getLastCudaError("getSuccessors launch failed.");
-
-            pools.uintEdges.put(dMinScannedEdges);
-            pools.floatEdges.put(dMinScannedWeights);
+            dpct::device_pointer<uint> dSuccessors =
+                allocator_.get<uint>(verticesBound);
+
+            uint *minScannedEdges = dMinScannedEdges.get();
+            uint *successors = dSuccessors.get();
+
+            launch(verticesBound, [=](sycl::nd_item<3> item_ct1) {
+                getSuccessors(vertices, minScannedEdges, successors, sizes,
+                              item_ct1);
+            });
+
+            allocator_.put(dMinScannedEdges);
+            allocator_.put(dMinScannedWeights);
 
             // Remove cyclic successor dependencies. Note that there can be only
             // two vertices in a cycle. See [1] for details.
-                        dpct::get_default_queue().submit(
-                            [&](sycl::handler &cgh) {
-                                        auto dSuccessors_get_ct0 =
-                                            dSuccessors.get();
-                                        auto verticesCount__ct1 =
-                                            verticesCount_;
-
-                                        cgh.parallel_for(
-                                            sycl::nd_range<3>(
-                                                gridDimsForVertices *
-                                                    blockDimsForVertices,
-                                                blockDimsForVertices),
-                                            [=](sycl::nd_item<3> item_ct1) {
-                                                        removeCycles(
-                                                            dSuccessors_get_ct0,
-                                                            verticesCount__ct1,
-                                                            item_ct1);
-                                            });
-                            });
-            getLastCudaError("removeCycles launch failed.");
+            launch(verticesBound, [=](sycl::nd_item<3> item_ct1) {
+                removeCycles(successors, sizes, item_ct1);
+            });
 
             // Build up an array of startpoints for edges. As already stated,
             // each group of edges denoted by "dEdgesFlags"
             // has the same startpoint.
-            dpct::device_pointer<uint> dStartpoints = pools.uintEdges.get();
+            dpct::device_pointer<uint> dStartpoints =
+                allocator_.get<uint>(edgesBound);
 
-            oneapi::dpl::inclusive_scan(
-                oneapi::dpl::execution::make_device_policy(
-                    dpct::get_default_queue()),
-                dEdgesFlags, dEdgesFlags + edgesCount_, dStartpoints);
-
-                        dpct::get_default_queue().submit([&](sycl::handler
-                                                                 &cgh) {
-                                    auto dStartpoints_get_ct0 =
-                                        dStartpoints.get();
-                                    auto edgesCount__ct2 = edgesCount_;
-
-                                    cgh.parallel_for(
-                                        sycl::nd_range<3>(gridDimsForEdges *
-                                                              blockDimsForEdges,
-                                                          blockDimsForEdges),
-                                        [=](sycl::nd_item<3> item_ct1) {
-                                                    addScalar(
-                                                        dStartpoints_get_ct0,
-                                                        -1, edgesCount__ct2,
-                                                        item_ct1);
-                                        });
-                        });
-            getLastCudaError("addScalar launch failed.");
+            oneapi::dpl::inclusive_scan(policy,
+                                        dEdgesFlags, dEdgesFlags + edgesBound,
+                                        dStartpoints);
+
+            uint *startpoints = dStartpoints.get();
+
+            launch(edgesBound, [=](sycl::nd_item<3> item_ct1) {
+                addScalar(startpoints, -1, edgesBound, item_ct1);
+            });
+
+            allocator_.put(dEdgesFlags);
 
             // Shrink the chains of successors. New successors will eventually
             // represent superpixels of the new level.
-            dpct::device_pointer<uint> dRepresentatives = pools.uintVertices.get();
-
-                        dpct::get_default_queue().submit([&](sycl::handler
-                                                                 &cgh) {
-                                    auto dSuccessors_get_ct0 =
-                                        dSuccessors.get();
-                                    auto dRepresentatives_get_ct1 =
-                                        dRepresentatives.get();
-                                    auto verticesCount__ct2 = verticesCount_;
-
-                                    cgh.parallel_for(
-                                        sycl::nd_range<3>(
-                                            gridDimsForVertices *
-                                                blockDimsForVertices,
-                                            blockDimsForVertices),
-                                        [=](sycl::nd_item<3> item_ct1) {
-                                                    getRepresentatives(
-                                                        dSuccessors_get_ct0,
-                                                        dRepresentatives_get_ct1,
-                                                        verticesCount__ct2,
-                                                        item_ct1);
-                                        });
-                        });
-            getLastCudaError("getRepresentatives launch failed.");
+            dpct::device_pointer<uint> dRepresentatives =
+                allocator_.get<uint>(verticesBound);
+
+            uint *representatives = dRepresentatives.get();
+
+            launch(verticesBound, [=](sycl::nd_item<3> item_ct1) {
+                getRepresentatives(successors, representatives, sizes,
+                                   verticesBound, item_ct1);
+            });
 
             swap(dSuccessors, dRepresentatives);
 
-            pools.uintVertices.put(dRepresentatives);
+            allocator_.put(dRepresentatives);
 
             // Group vertices by successors' indices.
             dpct::device_pointer<uint> dClusteredVerticesIDs =
-                pools.uintVertices.get();
+                allocator_.get<uint>(verticesBound);
 
-            dpct::iota(oneapi::dpl::execution::make_device_policy(
-                           dpct::get_default_queue()),
+            dpct::iota(policy,
                        dClusteredVerticesIDs,
-                       dClusteredVerticesIDs + verticesCount_);
+                       dClusteredVerticesIDs + verticesBound);
 
             oneapi::dpl::sort(
-                oneapi::dpl::execution::make_device_policy(
-                    dpct::get_default_queue()),
+                policy,
                 oneapi::dpl::make_zip_iterator(std::make_tuple(
                     dpct::device_pointer<uint>(dSuccessors),
                     dpct::device_pointer<uint>(dClusteredVerticesIDs))),
                 oneapi::dpl::make_zip_iterator(std::make_tuple(
-                    dpct::device_pointer<uint>(dSuccessors + verticesCount_),
+                    dpct::device_pointer<uint>(dSuccessors + verticesBound),
                     dpct::device_pointer<uint>(dClusteredVerticesIDs +
-                                               verticesCount_))));
+                                               verticesBound))));
 
             // Mark those groups.
-            dpct::device_pointer<uint> dVerticesFlags_ = pools.uintVertices.get();
-
-            std::fill(oneapi::dpl::execution::make_device_policy(
-                          dpct::get_default_queue()),
-                      dVerticesFlags_, dVerticesFlags_ + verticesCount_, 0);
+            dpct::device_pointer<uint> dVerticesFlags_ =
+                allocator_.get<uint>(verticesBound);
 
             oneapi::dpl::adjacent_difference(
-                oneapi::dpl::execution::make_device_policy(
-                    dpct::get_default_queue()),
-                dSuccessors, dSuccessors + verticesCount_, dVerticesFlags_,
+                policy,
+                dSuccessors, dSuccessors + verticesBound, dVerticesFlags_,
                 std::not_equal_to<uint>());
 
-            dpct::get_default_queue()
-                .memset((void *)dVerticesFlags_.get(), 0, sizeof(uint))
-                .wait();
+            queue.memset((void *)dVerticesFlags_.get(), 0, sizeof(uint));
 
             // Assign new indices to the successors (the indices of vertices
             // at the new level).
-            dpct::device_pointer<uint> dNewVerticesIDs_ = pools.uintVertices.get();
+            dpct::device_pointer<uint> dNewVerticesIDs_ =
+                allocator_.get<uint>(verticesBound);
 
             oneapi::dpl::inclusive_scan(
-                oneapi::dpl::execution::make_device_policy(
-                    dpct::get_default_queue()),
-                dVerticesFlags_, dVerticesFlags_ + verticesCount_,
+                policy,
+                dVerticesFlags_, dVerticesFlags_ + verticesBound,
                 dNewVerticesIDs_);
 
-            pools.uintVertices.put(dVerticesFlags_);
-
-            // Now we can calculate number of resulting superpixels easily.
-            uint newVerticesCount;
-            DPCT_CHECK_ERROR(
-                dpct::get_default_queue()
-                    .memcpy(&newVerticesCount,
-                            (dNewVerticesIDs_ + verticesCount_ - 1).get(),
-                            sizeof(uint))
-                    .wait());
-            ++newVerticesCount;
-
-            // There are two special cases when we can stop our algorithm:
-            // 1) number of vertices in the graph remained unchanged;
-            // 2) only one vertex remains.
-            if (newVerticesCount == verticesCount_)
-            {
-                return ALGORITHM_FINISHED;
-            }
-            else if (newVerticesCount == 1)
-            {
-                dpct::device_pointer<uint> dDummyVerticesOffsets =
-                    pools.uintVertices.get();
+            allocator_.put(dVerticesFlags_);
 
-                dpct::get_default_queue()
-                    .memset((void *)dDummyVerticesOffsets.get(), 0,
-                            sizeof(uint))
-                    .wait();
+            // Now we can calculate number of resulting superpixels easily,
+            // and find out whether this is the last level.
+            uint *newVerticesIDs = dNewVerticesIDs_.get();
 
-                dpct::device_pointer<uint> dDummyVerticesIDs =
-                    pools.uintVertices.get();
+            queue.single_task([=]() {
+                countNewVertices(newVerticesIDs, sizes);
+            });
 
-                dpct::iota(oneapi::dpl::execution::make_device_policy(
-                               dpct::get_default_queue()),
-                           dDummyVerticesIDs,
-                           dDummyVerticesIDs + verticesCount_);
+            // Calculate how old vertices IDs map to new vertices IDs.
+            dpct::device_pointer<uint> dVerticesMapping =
+                allocator_.get<uint>(verticesBound);
 
-                segmentations.addLevel(1,
-                                       verticesCount_,
-                                       dDummyVerticesOffsets,
-                                       dDummyVerticesIDs);
+            uint *clusteredVerticesIDs = dClusteredVerticesIDs.get();
+            uint *verticesMapping = dVerticesMapping.get();
 
-                return ALGORITHM_FINISHED;
-            }
+            launch(verticesBound, [=](sycl::nd_item<3> item_ct1) {
+                getVerticesMapping(clusteredVerticesIDs, newVerticesIDs,
+                                   verticesMapping, sizes, verticesBound,
+                                   item_ct1);
+            });
 
-            // Calculate how old vertices IDs map to new vertices IDs.
-            dpct::device_pointer<uint> dVerticesMapping = pools.uintVertices.get();
-
-                        dpct::get_default_queue().submit([&](sycl::handler
-                                                                 &cgh) {
-                                    auto dClusteredVerticesIDs_get_ct0 =
-                                        dClusteredVerticesIDs.get();
-                                    auto dNewVerticesIDs__get_ct1 =
-                                        dNewVerticesIDs_.get();
-                                    auto dVerticesMapping_get_ct2 =
-                                        dVerticesMapping.get();
-                                    auto verticesCount__ct3 = verticesCount_;
-
-                                    cgh.parallel_for(
-                                        sycl::nd_range<3>(
-                                            gridDimsForVertices *
-                                                blockDimsForVertices,
-                                            blockDimsForVertices),
-                                        [=](sycl::nd_item<3> item_ct1) {
-                                                    getVerticesMapping(
-                                                        dClusteredVerticesIDs_get_ct0,
-                                                        dNewVerticesIDs__get_ct1,
-                                                        dVerticesMapping_get_ct2,
-                                                        verticesCount__ct3,
-                                                        item_ct1);
-                                        });
-                        });
-            getLastCudaError("getVerticesMapping launch failed.");
-
-            pools.uintVertices.put(dNewVerticesIDs_);
-            pools.uintVertices.put(dClusteredVerticesIDs);
-            pools.uintVertices.put(dSuccessors);
+            allocator_.put(dNewVerticesIDs_);
+            allocator_.put(dClusteredVerticesIDs);
+            allocator_.put(dSuccessors);
 
             // Invalidate self-loops in the reduced graph (the graph
             // produced by merging all old vertices that have
             // the same successor).
-                        dpct::get_default_queue().submit([&](sycl::handler
-                                                                 &cgh) {
-                                    auto dStartpoints_get_ct0 =
-                                        dStartpoints.get();
-                                    auto dVerticesMapping_get_ct1 =
-                                        dVerticesMapping.get();
-                                    auto dEdges__get_ct2 = dEdges_.get();
-                                    auto edgesCount__ct3 = edgesCount_;
-
-                                    cgh.parallel_for(
-                                        sycl::nd_range<3>(gridDimsForEdges *
-                                                              blockDimsForEdges,
-                                                          blockDimsForEdges),
-                                        [=](sycl::nd_item<3> item_ct1) {
-                                                    invalidateLoops(
-                                                        dStartpoints_get_ct0,
-                                                        dVerticesMapping_get_ct1,
-                                                        dEdges__get_ct2,
-                                                        edgesCount__ct3,
-                                                        item_ct1);
-                                        });
-                        });
-            getLastCudaError("invalidateLoops launch failed.");
+            launch(edgesBound, [=](sycl::nd_item<3> item_ct1) {
+                invalidateLoops(startpoints, verticesMapping, edges, sizes,
+                                item_ct1);
+            });
 
             // Calculate various information about the surviving
             // (new startpoints IDs and IDs of edges) and
             // non-surviving/contracted edges (their weights).
-            dpct::device_pointer<uint> dNewStartpoints = pools.uintEdges.get();
-            dpct::device_pointer<uint> dSurvivedEdgesIDs = pools.uintEdges.get();
-
-                        dpct::get_default_queue().submit([&](sycl::handler
-                                                                 &cgh) {
-                                    auto dStartpoints_get_ct0 =
-                                        dStartpoints.get();
-                                    auto dVerticesMapping_get_ct1 =
-                                        dVerticesMapping.get();
-                                    auto dEdges__get_ct2 = dEdges_.get();
-                                    auto dWeights__get_ct3 = dWeights_.get();
-                                    auto dNewStartpoints_get_ct4 =
-                                        dNewStartpoints.get();
-                                    auto dSurvivedEdgesIDs_get_ct5 =
-                                        dSurvivedEdgesIDs.get();
-                                    auto edgesCount__ct6 = edgesCount_;
-
-                                    cgh.parallel_for(
-                                        sycl::nd_range<3>(gridDimsForEdges *
-                                                              blockDimsForEdges,
-                                                          blockDimsForEdges),
-                                        [=](sycl::nd_item<3> item_ct1) {
-                                                    calculateEdgesInfo(
-                                                        dStartpoints_get_ct0,
-                                                        dVerticesMapping_get_ct1,
-                                                        dEdges__get_ct2,
-                                                        dWeights__get_ct3,
-                                                        dNewStartpoints_get_ct4,
-                                                        dSurvivedEdgesIDs_get_ct5,
-                                                        edgesCount__ct6,
-                                                        newVerticesCount,
-                                                        item_ct1);
-                                        });
-                        });
-            getLastCudaError("calculateEdgesInfo launch failed.");
-
-            pools.uintEdges.put(dStartpoints);
+            dpct::device_pointer<uint> dNewStartpoints =
+                allocator_.get<uint>(edgesBound);
+            dpct::device_pointer<uint> dSurvivedEdgesIDs =
+                allocator_.get<uint>(edgesBound);
+
+            uint *newStartpoints = dNewStartpoints.get();
+            uint *survivedEdgesIDs = dSurvivedEdgesIDs.get();
+
+            launch(edgesBound, [=](sycl::nd_item<3> item_ct1) {
+                calculateEdgesInfo(startpoints, verticesMapping, edges,
+                                   weights, newStartpoints, survivedEdgesIDs,
+                                   sizes, edgesBound, item_ct1);
+            });
+
+            allocator_.put(dStartpoints);
 
             // Group that information by the new startpoints IDs.
             // Keep in mind that we want to build new (reduced) graph and apply
             // the step of the algorithm to that one. Hence we need to
             // preserve the structure of the original graph: neighbours and
             // weights should be grouped by vertex.
-            oneapi::dpl::sort(oneapi::dpl::execution::make_device_policy(
-                                  dpct::get_default_queue()),
+            oneapi::dpl::sort(policy,
                               oneapi::dpl::make_zip_iterator(std::make_tuple(
                                   dNewStartpoints, dSurvivedEdgesIDs)),
                               oneapi::dpl::make_zip_iterator(std::make_tuple(
-                                  dNewStartpoints + edgesCount_,
-                                  dSurvivedEdgesIDs + edgesCount_)));
-
-            // Find the group of contracted edges.
-            uint *invalidEdgesPtr =
-                oneapi::dpl::find_if(oneapi::dpl::execution::make_device_policy(
-                                         dpct::get_default_queue()),
-                                     dNewStartpoints,
-                                     dNewStartpoints + edgesCount_,
-                                     IsGreaterEqualThan<uint>(newVerticesCount))
-                    .get();
+                                  dNewStartpoints + edgesBound,
+                                  dSurvivedEdgesIDs + edgesBound)));
 
             // Calculate how many edges there are in the reduced graph.
-            uint validEdgesCount =
-                static_cast<uint>(invalidEdgesPtr - dNewStartpoints.get());
+            launch(edgesBound, [=](sycl::nd_item<3> item_ct1) {
+                countValidEdges(newStartpoints, sizes, edgesBound, item_ct1);
+            });
 
-            // Mark groups of edges corresponding to the same vertex in the
-            // reduced graph.
-            oneapi::dpl::adjacent_difference(
-                oneapi::dpl::execution::make_device_policy(
-                    dpct::get_default_queue()),
-                dNewStartpoints, dNewStartpoints + edgesCount_, dEdgesFlags,
-                std::not_equal_to<uint>());
-
-            dpct::get_default_queue()
-                .memset((void *)dEdgesFlags.get(), 0, sizeof(uint))
-                .wait();
-            dpct::get_default_queue()
-                .memset((void *)dEdgesFlags.get(), 1, 1)
-                .wait();
-
-            pools.uintEdges.put(dNewStartpoints);
-
-            // Now we are able to build the reduced graph. See "Graph"
-            // class for the details on the graph's internal structure.
+            // Now we are able to build the reduced graph. See "dVertices_"
+            // for the details on the graph's internal structure.
 
             // Calculate vertices' offsets for the reduced graph.
-            dpct::copy_if(oneapi::dpl::execution::seq,
-                          dpct::make_counting_iterator(0U),
-                          dpct::make_counting_iterator(validEdgesCount),
-                          dEdgesFlags, dVertices_, oneapi::dpl::identity())
-                .get();
+            launch(edgesBound, [=](sycl::nd_item<3> item_ct1) {
+                getVerticesOffsets(newStartpoints, vertices, sizes, item_ct1);
+            });
 
-            pools.uintEdges.put(dEdgesFlags);
+            allocator_.put(dNewStartpoints);
 
             // Build up a neighbourhood for each vertex in the reduced graph
             // (this includes recalculating edges' weights).
-            calculateThreadsDistribution(validEdgesCount,
-                                         blocksCount,
-                                         threadsPerBlockCount);
-            sycl::range<3> newGridDimsForEdges(1, 1, blocksCount);
-            sycl::range<3> newBlockDimsForEdges(1, 1, threadsPerBlockCount);
-
-            dpct::device_pointer<uint> dNewEdges = pools.uintEdges.get();
-            dpct::device_pointer<float> dNewWeights = pools.floatEdges.get();
-
-                        dpct::get_default_queue().submit([&](sycl::handler
-                                                                 &cgh) {
-                                    auto dSurvivedEdgesIDs_get_ct0 =
-                                        dSurvivedEdgesIDs.get();
-                                    auto dVerticesMapping_get_ct1 =
-                                        dVerticesMapping.get();
-                                    auto dEdges__get_ct2 = dEdges_.get();
-                                    auto dWeights__get_ct3 = dWeights_.get();
-                                    auto dNewEdges_get_ct4 = dNewEdges.get();
-                                    auto dNewWeights_get_ct5 =
-                                        dNewWeights.get();
-
-                                    cgh.parallel_for(
-                                        sycl::nd_range<3>(
-                                            newGridDimsForEdges *
-                                                newBlockDimsForEdges,
-                                            newBlockDimsForEdges),
-                                        [=](sycl::nd_item<3> item_ct1) {
-                                                    makeNewEdges(
-                                                        dSurvivedEdgesIDs_get_ct0,
-                                                        dVerticesMapping_get_ct1,
-                                                        dEdges__get_ct2,
-                                                        dWeights__get_ct3,
-                                                        dNewEdges_get_ct4,
-                                                        dNewWeights_get_ct5,
-                                                        validEdgesCount,
-                                                        item_ct1);
-                                        });
-                        });
-            getLastCudaError("makeNewEdges launch failed.");
+            dpct::device_pointer<uint> dNewEdges =
+                allocator_.get<uint>(edgesBound);
+            dpct::device_pointer<float> dNewWeights =
+                allocator_.get<float>(edgesBound);
+
+            uint *newEdges = dNewEdges.get();
+            float *newWeights = dNewWeights.get();
+
+            launch(edgesBound, [=](sycl::nd_item<3> item_ct1) {
+                makeNewEdges(survivedEdgesIDs, verticesMapping, edges,
+                             weights, newEdges, newWeights, sizes, item_ct1);
+            });
 
             swap(dEdges_, dNewEdges);
             swap(dWeights_, dNewWeights);
 
-            pools.uintEdges.put(dNewEdges);
-            pools.floatEdges.put(dNewWeights);
+            allocator_.put(dNewEdges);
+            allocator_.put(dNewWeights);
 
-            pools.uintEdges.put(dSurvivedEdgesIDs);
+            allocator_.put(dSurvivedEdgesIDs);
 
             // The graph's reconstruction is now finished.
 
             // Build new level of the segmentation tree. It is a trivial task
             // as we already have "dVerticesMapping" that contains all
             // sufficient information about the vertices' transformations.
-            dpct::device_pointer<uint> dVerticesIDs = pools.uintVertices.get();
-            dpct::device_pointer<uint> dNewVerticesOffsets =
-                pools.uintVertices.get();
+            // The level is kept in device memory until "run()" reads back
+            // whether it is a segmentation.
+            Level newLevel;
+            newLevel.verticesIDs = allocator_.get<uint>(verticesBound);
+            newLevel.verticesOffsets = allocator_.get<uint>(verticesBound + 1);
 
-            dpct::iota(oneapi::dpl::execution::make_device_policy(
-                           dpct::get_default_queue()),
-                       dVerticesIDs, dVerticesIDs + verticesCount_);
+            dpct::iota(policy,
+                       newLevel.verticesIDs,
+                       newLevel.verticesIDs + verticesBound);
 
-            dpct::sort(oneapi::dpl::execution::make_device_policy(
-                           dpct::get_default_queue()),
-                       dVerticesMapping, dVerticesMapping + verticesCount_,
-                       dVerticesIDs);
+            dpct::sort(policy,
+                       dVerticesMapping, dVerticesMapping + verticesBound,
+                       newLevel.verticesIDs);
 
             dpct::unique_copy(
-                oneapi::dpl::execution::make_device_policy(
-                    dpct::get_default_queue()),
-                dVerticesMapping, dVerticesMapping + verticesCount_,
+                policy,
+                dVerticesMapping, dVerticesMapping + verticesBound,
                 dpct::make_counting_iterator(0),
-                oneapi::dpl::discard_iterator(), dNewVerticesOffsets);
-
-            segmentations.addLevel(newVerticesCount,
-                                   verticesCount_,
-                                   dNewVerticesOffsets,
-                                   dVerticesIDs);
-
-            pools.uintVertices.put(dVerticesIDs);
-            pools.uintVertices.put(dNewVerticesOffsets);
-            pools.uintVertices.put(dVerticesMapping);
+                oneapi::dpl::discard_iterator(), newLevel.verticesOffsets);
 
-            // We can now safely set new counts for vertices and edges.
-            verticesCount_ = newVerticesCount;
-            edgesCount_ = validEdgesCount;
+            levels_.push_back(newLevel);
 
-            return ALGORITHM_NOT_FINISHED;
+            allocator_.put(dVerticesMapping);
         }
 
-        uint verticesCount_;
-        uint edgesCount_;
+        // Device data of a level of the segmentation tree, see
+        // "Pyramid::addLevel()".
+        struct Level
+        {
+            dpct::device_pointer<uint> verticesOffsets;
+            dpct::device_pointer<uint> verticesIDs;
+        };
+
+        StreamOrderedAllocator allocator_;
 
+        // This array stores offsets for each vertex in "dEdges_" and
+        // "dWeights_". For example:
+        // "dVertices_[0]" is an index of the first outgoing edge of vertex #0,
+        // "dVertices_[1]" is an index of the first outgoing edge of vertex #1,
+        // etc. "dEdges_" stores the indices of endpoints of the edges, and
+        // "dWeights_" their weights.
         dpct::device_pointer<uint> dVertices_;
         dpct::device_pointer<uint> dEdges_;
         dpct::device_pointer<float> dWeights_;
 
-        dpct::device_pointer<uint> dOutputEdgesFlags_;
+        dpct::device_pointer<LevelSizes> dSizes_;
+        vector<Level> levels_;
+
+        // Host copies of "dSizes_", in pinned memory so that they are copied
+        // asynchronously.
+        LevelSizes *hSizes_;
+        uint hSizesCapacity_;
 };
 
 // Loads PPM image.
 int loadImage(const char *filename, const char *executablePath,
               vector<sycl::uchar3> &data, uint &width, uint &height)
 {
-    
+
     const char *imagePath = sdkFindFilePath(filename, executablePath);
 
     if (imagePath == NULL)
@@ -1103,92 +947,27 @@ int loadImage(const char *filename, const char *executablePath,
     {
         return -1;
     }
-    
-    data.assign(reinterpret_cast<sycl::uchar3 *>(&dataHandle),
-                reinterpret_cast<sycl::uchar3 *>(&dataHandle) + width * height);
-
-    free(reinterpret_cast<void *>(dataHandle));
-
-    return 0;
-}
 
-inline float distance(const sycl::uchar3 &first, const sycl::uchar3 &second)
-{
-    int dx = static_cast<int>(first.x()) - static_cast<int>(second.x());
-    int dy = static_cast<int>(first.y()) - static_cast<int>(second.y());
-    int dz = static_cast<int>(first.z()) - static_cast<int>(second.z());
-
-    uint sqrResult = dx * dx + dy * dy + dz * dz;
-
-    return sqrt(static_cast<float>(sqrResult));
-}
-
-// Builds a net-graph for the image with 4-connected pixels.
-void buildGraph(const vector<sycl::uchar3> &image, uint width, uint height,
-                Graph &graph)
-{
-    uint totalNodes = static_cast<uint>(image.size());
-
-    graph.vertices.resize(totalNodes);
-    graph.edges.reserve(4 * totalNodes - 2 * (width + height));
-    // graph.weights.reserve(graph.edges.size());
-
-    uint edgesProcessed = 0;
-
-    // for (uint y = 0; y < height; ++y)
-    // {
-    //     for (uint x = 0; x < width; ++x)
-    //     {
-    //         uint nodeIndex = y * width + x;
-    //         const sycl::uchar3 &centerPixel = image[nodeIndex];
-
-    //         graph.vertices[nodeIndex] = edgesProcessed;
-
-    //         if (y > 0)
-    //         {
-    //             uint lowerNodeIndex = (y - 1) * width + x;
-    //             const sycl::uchar3 &lowerPixel = image[lowerNodeIndex];
-
-    //             graph.edges.push_back(lowerNodeIndex);
-    //             graph.weights.push_back(distance(centerPixel, lowerPixel));
-
-    //             ++edgesProcessed;
-    //         }
-
-    //         if (y + 1 < height)
-    //         {
-    //             uint upperNodeIndex = (y + 1) * width + x;
-    //             const sycl::uchar3 &upperPixel = image[upperNodeIndex];
-
-    //             graph.edges.push_back(upperNodeIndex);
-    //             graph.weights.push_back(distance(centerPixel, upperPixel));
-
-    //             ++edgesProcessed;
-    //         }
-
-    //         if (x > 0)
-    //         {
-    //             uint leftNodeIndex = y * width + x - 1;
-    //             const sycl::uchar3 &leftPixel = image[leftNodeIndex];
-
-    //             graph.edges.push_back(leftNodeIndex);
-    //             graph.weights.push_back(distance(centerPixel, leftPixel));
+    if (channels != 3)
+    {
+        free(reinterpret_cast<void *>(dataHandle));
+        return -1;
+    }
 
-    //             ++edgesProcessed;
-    //         }
+    // The pixels are packed RGB, while sycl::uchar3 is aligned like a
+    // 4-component vector, so they are converted one by one.
+    data.resize(width * height);
 
-    //         if (x + 1 < width)
-    //         {
-    //             uint rightNodeIndex = y * width + x + 1;
-    //             const sycl::uchar3 &rightPixel = image[rightNodeIndex];
+    for (uint pixelIndex = 0; pixelIndex < width * height; ++pixelIndex)
+    {
+        data[pixelIndex] = sycl::uchar3(dataHandle[pixelIndex * 3],
+                                        dataHandle[pixelIndex * 3 + 1],
+                                        dataHandle[pixelIndex * 3 + 2]);
+    }
 
-    //             graph.edges.push_back(rightNodeIndex);
-    //             graph.weights.push_back(distance(centerPixel, rightPixel));
+    free(reinterpret_cast<void *>(dataHandle));
 
-    //             ++edgesProcessed;
-    //         }
-    //     }
-    // }
+    return 0;
 }
 
 static char *kDefaultImageName = (char*)"test.ppm";
@@ -1209,7 +988,20 @@ int main(int argc, char **argv)
                                  (const char **) argv,
                                  "file",
                                  &imageName);
-    } 
+    }
+
+    // Number of times the tree is built, to measure the frame rate of
+    // segmenting a video with frames of this size.
+    int framesCount = 1;
+
+    if (checkCmdLineFlag(argc, (const char **) argv, "frames"))
+    {
+        framesCount = std::max(getCmdLineArgumentInt(argc,
+                                                     (const char **) argv,
+                                                     "frames"),
+                               1);
+    }
+
     int temp = loadImage(imageName, argv[0], image, imageWidth, imageHeight);
     if (temp != 0)
     {
@@ -1218,8 +1010,12 @@ int main(int argc, char **argv)
     }
 
     findCudaDevice(argc, (const char **)argv);
-    Graph graph;
-    buildGraph(image, imageWidth, imageHeight, graph);
+
+    sycl::queue &queue = dpct::get_default_queue();
+    sycl::uchar3 *dImage = sycl::malloc_device<sycl::uchar3>(image.size(),
+                                                             queue);
+    queue.memcpy(dImage, image.data(), sizeof(sycl::uchar3) * image.size())
+        .wait();
 
     Pyramid segmentations;
 
@@ -1227,9 +1023,34 @@ int main(int argc, char **argv)
     cout.flush();
 
     SegmentationTreeBuilder algo;
-    // float elapsedTime = algo.run(graph, segmentations);
+    float elapsedTime = algo.run(dImage, imageWidth, imageHeight,
+                                 segmentations);
+
+    cout << "done in " << elapsedTime << " (ms)" << endl;
+
+    // The first frame allocates the device memory and compiles the kernels.
+    if (framesCount > 1)
+    {
+        float totalTime = 0.0f;
+
+        for (int frame = 1; frame < framesCount; ++frame)
+        {
+            segmentations = Pyramid();
+            totalTime += algo.run(dImage, imageWidth, imageHeight,
+                                  segmentations);
+        }
+
+        float frameTime = totalTime / (framesCount - 1);
+
+        cout << "* " << imageWidth << "x" << imageHeight << " frames: "
+             << frameTime << " (ms) per frame, " << 1000.0f / frameTime
+             << " frames/s over " << framesCount - 1 << " frames" << endl;
+    }
+
+    cout << "* Device memory used by the allocator: "
+         << algo.allocatedBytes() / (1024 * 1024) << " (MB)" << endl;
 
-    // cout << "done in " << elapsedTime << " (ms)" << endl;
+    sycl::free(dImage, queue);
 
     cout << "* Dumping levels for each tree..." << endl << endl;
 
@@ -44,26 +44,100 @@
 
 #include "common.dp.hpp"
 
-// Functors used with thrust library.
-template <typename Input>
-/*
-DPCT1044:9: thrust::unary_function was removed because std::unary_function has
-been deprecated in C++11. You may need to remove references to typedefs from
-thrust::unary_function in the class definition.
-*/
-struct IsGreaterEqualThan {
-    IsGreaterEqualThan(uint upperBound) :
-        upperBound_(upperBound) {}
-
-    bool operator()(const Input &value) const
+// Sizes of the graph at one level of the algorithm. They are computed and
+// read by kernels, so that the levels are submitted one after the other
+// without waiting for the device; the host reads them a few levels later.
+// Kernels are launched for upper bounds of the sizes and return early for the
+// work-items past the actual ones.
+struct LevelSizes
+{
+    // Graph at the beginning of the level. Both are 0 for the levels after
+    // the last one.
+    uint verticesCount;
+    uint edgesCount;
+
+    // Graph at the end of the level.
+    uint newVerticesCount;
+    uint newEdgesCount;
+
+    // Whether the level is a segmentation of the tree, and whether it is the
+    // last level of the algorithm.
+    uint isSegmentation;
+    uint isLast;
+};
+
+inline float distance(const sycl::uchar3 &first, const sycl::uchar3 &second)
+{
+    int dx = static_cast<int>(first.x()) - static_cast<int>(second.x());
+    int dy = static_cast<int>(first.y()) - static_cast<int>(second.y());
+    int dz = static_cast<int>(first.z()) - static_cast<int>(second.z());
+
+    uint sqrResult = dx * dx + dy * dy + dz * dz;
+
+    return sycl::sqrt(static_cast<float>(sqrResult));
+}
+
+// CUDA kernels.
+
+// Builds a net-graph for the image with 4-connected pixels. Each pixel
+// has its edges to the lower, upper, left and right neighbours, in that
+// order, and the position of its first edge only depends on its coordinates,
+// so that every work-item writes one vertex independently.
+void buildGraph(const sycl::uchar3 *image,
+                uint width,
+                uint height,
+                uint *vertices,
+                uint *edges,
+                float *weights,
+                const sycl::nd_item<3> &item_ct1)
+{
+    uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
+               item_ct1.get_local_id(2);
+
+    if (tid < width * height)
     {
-        return value >= upperBound_;
+        uint x = tid % width;
+        uint y = tid / width;
+
+        // Edges of the rows above: 2 * (width - 1) horizontal ones per row,
+        // and width vertical ones per neighbouring row.
+        uint edgesProcessed =
+            y * 2 * (width - 1) +
+            width * ((y > 0 ? y - 1 : 0) + sycl::min(y, height - 1));
+
+        // Edges of the pixels on the left.
+        uint verticalEdges = (y > 0 ? 1 : 0) + (y + 1 < height ? 1 : 0);
+        edgesProcessed += x * verticalEdges + (x > 0 ? x - 1 : 0) +
+                          sycl::min(x, width - 1);
+
+        vertices[tid] = edgesProcessed;
+
+        const sycl::uchar3 centerPixel = image[tid];
+        uint neighbours[4] = {tid - width, tid + width, tid - 1, tid + 1};
+        bool exists[4] = {y > 0, y + 1 < height, x > 0, x + 1 < width};
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (exists[i])
+            {
+                edges[edgesProcessed] = neighbours[i];
+                weights[edgesProcessed] =
+                    distance(centerPixel, image[neighbours[i]]);
+
+                ++edgesProcessed;
+            }
+        }
     }
+}
 
-    uint upperBound_;
-};
+// Starts the level with the graph produced by the previous one.
+void startLevel(const LevelSizes *previous, LevelSizes *current)
+{
+    current->verticesCount =
+        previous->isLast ? 0 : previous->newVerticesCount;
+    current->edgesCount = previous->isLast ? 0 : previous->newEdgesCount;
+}
 
-// CUDA kernels.
 void addScalar(uint *array, int scalar, uint size,
                const sycl::nd_item<3> &item_ct1)
 {
@@ -78,62 +152,70 @@ void addScalar(uint *array, int scalar, uint size,
 
 void markSegments(const uint *verticesOffsets,
                              uint *flags,
-                             uint verticesCount,
+                             const LevelSizes *sizes,
                              const sycl::nd_item<3> &item_ct1)
 {
     uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                item_ct1.get_local_id(2);
 
-    if (tid < verticesCount)
+    if (tid < sizes->verticesCount)
     {
         flags[verticesOffsets[tid]] = 1;
     }
 }
 
+// Entries past the vertices count, up to "verticesBound", are set to
+// UINT_MAX, so that sorting the whole bound leaves the vertices in front.
 void getVerticesMapping(const uint *clusteredVerticesIDs,
                                    const uint *newVerticesIDs,
                                    uint *verticesMapping,
-                                   uint verticesCount,
+                                   const LevelSizes *sizes,
+                                   uint verticesBound,
                                    const sycl::nd_item<3> &item_ct1)
 {
     uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                item_ct1.get_local_id(2);
 
-    if (tid < verticesCount)
+    if (tid < sizes->verticesCount)
     {
         uint vertexID = clusteredVerticesIDs[tid];
         verticesMapping[vertexID] = newVerticesIDs[tid];
     }
+    else if (tid < verticesBound)
+    {
+        verticesMapping[tid] = UINT_MAX;
+    }
 }
 
 void getSuccessors(const uint *verticesOffsets,
                               const uint *minScannedEdges,
                               uint *successors,
-                              uint verticesCount,
-                              uint edgesCount,
+                              const LevelSizes *sizes,
                               const sycl::nd_item<3> &item_ct1)
 {
     uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                item_ct1.get_local_id(2);
 
+    uint verticesCount = sizes->verticesCount;
+
     if (tid < verticesCount)
     {
         uint successorPos = (tid < verticesCount - 1) ?
                             (verticesOffsets[tid + 1] - 1) :
-                            (edgesCount - 1);
+                            (sizes->edgesCount - 1);
 
         successors[tid] = minScannedEdges[successorPos];
     }
 }
 
 void removeCycles(uint *successors,
-                             uint verticesCount,
+                             const LevelSizes *sizes,
                              const sycl::nd_item<3> &item_ct1)
 {
     uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                item_ct1.get_local_id(2);
 
-    if (tid < verticesCount)
+    if (tid < sizes->verticesCount)
     {
         uint successor = successors[tid];
         uint nextSuccessor = successors[successor];
@@ -152,15 +234,18 @@ void removeCycles(uint *successors,
     }
 }
 
+// Entries past the vertices count, up to "verticesBound", are set to
+// UINT_MAX, so that sorting the whole bound leaves the vertices in front.
 void getRepresentatives(const uint *successors,
                                    uint *representatives,
-                                   uint verticesCount,
+                                   const LevelSizes *sizes,
+                                   uint verticesBound,
                                    const sycl::nd_item<3> &item_ct1)
 {
     uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                item_ct1.get_local_id(2);
 
-    if (tid < verticesCount)
+    if (tid < sizes->verticesCount)
     {
         uint successor = successors[tid];
         uint nextSuccessor = successors[successor];
@@ -173,18 +258,40 @@ void getRepresentatives(const uint *successors,
 
         representatives[tid] = successor;
     }
+    else if (tid < verticesBound)
+    {
+        representatives[tid] = UINT_MAX;
+    }
+}
+
+// Replaces reading the last new vertex ID back to the host: the number of
+// new vertices decides whether the algorithm stops at this level.
+// 1) number of vertices in the graph remained unchanged: the level is not a
+//    segmentation;
+// 2) only one vertex remains: the level is the last segmentation.
+void countNewVertices(const uint *newVerticesIDs, LevelSizes *sizes)
+{
+    uint verticesCount = sizes->verticesCount;
+    uint newVerticesCount =
+        verticesCount > 0 ? newVerticesIDs[verticesCount - 1] + 1 : 0;
+
+    sizes->newVerticesCount = newVerticesCount;
+    sizes->newEdgesCount = 0;
+    sizes->isSegmentation = newVerticesCount < verticesCount;
+    sizes->isLast = newVerticesCount == verticesCount ||
+                    newVerticesCount == 1;
 }
 
 void invalidateLoops(const uint *startpoints,
                                 const uint *verticesMapping,
                                 uint *edges,
-                                uint edgesCount,
+                                const LevelSizes *sizes,
                                 const sycl::nd_item<3> &item_ct1)
 {
     uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                item_ct1.get_local_id(2);
 
-    if (tid < edgesCount)
+    if (tid < sizes->edgesCount)
     {
         uint startpoint = startpoints[tid];
         uint &endpoint = edges[tid];
@@ -199,23 +306,26 @@ void invalidateLoops(const uint *startpoints,
     }
 }
 
+// Entries past the edges count, up to "edgesBound", are set to UINT_MAX, so
+// that sorting the whole bound leaves them after the contracted edges.
 void calculateEdgesInfo(const uint *startpoints,
                                    const uint *verticesMapping,
                                    const uint *edges,
                                    const float *weights,
                                    uint *newStartpoints,
                                    uint *survivedEdgesIDs,
-                                   uint edgesCount,
-                                   uint newVerticesCount,
+                                   const LevelSizes *sizes,
+                                   uint edgesBound,
                                    const sycl::nd_item<3> &item_ct1)
 {
     uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                item_ct1.get_local_id(2);
 
-    if (tid < edgesCount)
+    if (tid < sizes->edgesCount)
     {
         uint startpoint = startpoints[tid];
         uint endpoint = edges[tid];
+        uint newVerticesCount = sizes->newVerticesCount;
 
         newStartpoints[tid] = endpoint < UINT_MAX ?
                               verticesMapping[startpoint] :
@@ -225,6 +335,58 @@ void calculateEdgesInfo(const uint *startpoints,
                                 tid :
                                 UINT_MAX;
     }
+    else if (tid < edgesBound)
+    {
+        newStartpoints[tid] = UINT_MAX;
+        survivedEdgesIDs[tid] = UINT_MAX;
+    }
+}
+
+// Finds the end of the surviving edges in the sorted new startpoints, which
+// are followed by the contracted edges (new startpoints not less than the
+// new vertices count) and the entries past the edges count.
+void countValidEdges(const uint *newStartpoints,
+                                LevelSizes *sizes,
+                                uint edgesBound,
+                                const sycl::nd_item<3> &item_ct1)
+{
+    uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
+               item_ct1.get_local_id(2);
+
+    if (tid < edgesBound)
+    {
+        uint newVerticesCount = sizes->newVerticesCount;
+
+        bool valid = newStartpoints[tid] < newVerticesCount;
+        bool nextValid = tid + 1 < edgesBound &&
+                         newStartpoints[tid + 1] < newVerticesCount;
+
+        if (valid && !nextValid)
+        {
+            sizes->newEdgesCount = tid + 1;
+        }
+    }
+}
+
+// Offsets of the vertices of the reduced graph: the first of each group of
+// surviving edges with the same startpoint.
+void getVerticesOffsets(const uint *newStartpoints,
+                                   uint *verticesOffsets,
+                                   const LevelSizes *sizes,
+                                   const sycl::nd_item<3> &item_ct1)
+{
+    uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
+               item_ct1.get_local_id(2);
+
+    if (tid < sizes->newEdgesCount)
+    {
+        uint startpoint = newStartpoints[tid];
+
+        if (tid == 0 || newStartpoints[tid - 1] != startpoint)
+        {
+            verticesOffsets[startpoint] = tid;
+        }
+    }
 }
 
 void makeNewEdges(const uint *survivedEdgesIDs,
@@ -233,13 +395,13 @@ void makeNewEdges(const uint *survivedEdgesIDs,
                              const float *weights,
                              uint *newEdges,
                              float *newWeights,
-                             uint edgesCount,
+                             const LevelSizes *sizes,
                              const sycl::nd_item<3> &item_ct1)
 {
     uint tid = item_ct1.get_group(2) * item_ct1.get_local_range(2) +
                item_ct1.get_local_id(2);
 
-    if (tid < edgesCount)
+    if (tid < sizes->newEdgesCount)
     {
         uint edgeID = survivedEdgesIDs[tid];
         uint oldEdge = edges[edgeID];
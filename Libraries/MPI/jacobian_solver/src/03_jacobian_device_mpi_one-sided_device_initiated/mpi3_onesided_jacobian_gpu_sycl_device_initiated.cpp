@@ -6,8 +6,7 @@
 
 /* Distributed Jacobian computation sample using SYCL GPU offload and device-initiated MPI-3 one-sided.
  */
-#include "../include/common.h"
-#include <sycl.hpp>
+#include "../include/common_sycl.hpp"
 #include <vector>
 #include <iostream>
 
@@ -33,142 +32,98 @@ int main(int argc, char *argv[])
       
     /* Initialize the subarray owned by the current process
      * and create RMA windows for MPI-3 one-sided communications.
+     *  - The grid is split along both X and Y, see InitSubarray2DAndWindows.
      *  - For this sample, we use GPU memory for buffers and windows.
      *  - This sample uses MPI_Win_fence for synchronization.
      */
-    InitSubarryAndWindows(&my_subarray, buffs, win, "device", false);
-    /* Create SYCL GPU queue. */
-    sycl::queue q(sycl::gpu_selector_v);
-    /* NOTE: For simplification and unification across samples, we use a single workgroup
-     *       to avoid extra synchronization across workgroups in the future.
-     */
-#ifdef GROUP_SIZE_DEFAULT
-    int work_group_size = GROUP_SIZE_DEFAULT;
-#else
-    int work_group_size =
-      q.get_device().get_info<sycl::info::device::max_work_group_size>();
-#endif
+    InitSubarray2DAndWindows(&my_subarray, buffs, win, "device", false);
+    /* Create SYCL GPU queue. Kernels of an iteration are chained in order without returning to the host. */
+    sycl::queue q(sycl::gpu_selector_v, sycl::property::queue::in_order());
+    /* Kernels tile the subarray over as many work-groups as needed. */
+    const int work_group_size = DefaultWorkGroupSize(q);
+    /* Border columns are packed here before they are put to the left and right neighbours. */
+    double *halo_cols = sycl::malloc_device<double>(2 * my_subarray.y_size, q);
 
     /* Start the RMA exposure epoch. */
     MPI_Win_fence(0, win[0]);
     MPI_Win_fence(0, win[1]);
     
-    const int row_size = ROW_SIZE(my_subarray);
     /* Number of iterations to perform between norm calculations. */
     const int iterations_batch = (NormIteration <= 0) ? Niter : NormIteration;
 
-    /* Calculate the number of columns per workgroup. */
-    const int col_per_wg = my_subarray.x_size / work_group_size;
-    const int tail = my_subarray.y_size % my_subarray.comm_size;
+    /* The norm of every batch is accumulated by the kernels of its last iteration, and summed over
+     * processes while the next batch is computed. The solver stops once it is below the tolerance.
+     */
+    const double tolerance = (argc > 1) ? atof(argv[1]) : Tolerance;
+    AsyncNorm async_norm(q);
+    bool converged = false;
+    int passed_iters;
 
     /* Timestamp the start time to measure overall execution time. */
     BEGIN_PROFILING
-    for (int passed_iters = 0; passed_iters < Niter; passed_iters += iterations_batch) {
-
-        /* Submit a compute kernel to calculate the next "iterations_batch" steps. */
-        q.submit([&](auto & h) {
-            h.parallel_for(sycl::nd_range<1>(work_group_size, work_group_size),
-                            [=](sycl::nd_item<1> item) {
-                int id = item.get_global_id(0);
-                const int my_x_lb = col_per_wg * id + ((id < tail) ? id : tail);
-
-                for (int k = 0; k < iterations_batch; ++k)
-                {
-                    int i = passed_iters + k;
-                    MPI_Win current_win = win[(i + 1) % 2];
-                    double *in = buffs[i % 2];
-                    double *out = buffs[(1 + i) % 2];
-                    /* Calculate values on the borders to initiate communications early. */
-                    int column;
-                    for (column = 0; (column + work_group_size) < my_subarray.x_size; 
-                                column += work_group_size) {
-                        RECALCULATE_POINT(out, in, column+id, 0, row_size);
-                        RECALCULATE_POINT(out, in, column+id, my_subarray.y_size - 1, row_size);
-                    }
-
-                    if (id < my_subarray.x_size % work_group_size) {
-                        RECALCULATE_POINT(out, in, column+id, 0, row_size);
-                        RECALCULATE_POINT(out, in, column+id, my_subarray.y_size - 1, row_size);
-                    }
-
-                    item.barrier(sycl::access::fence_space::global_space);
-                    /* Perform 1D halo-exchange with neighbors. */
-                    if (my_subarray.up_neighbour != MPI_PROC_NULL) {
-                        int idx = XY_2_IDX(my_x_lb, 0, row_size);
-                        MPI_Put(&out[idx], col_per_wg, MPI_DOUBLE,
-                            my_subarray.rank - 1, my_subarray.l_nbh_offt+my_x_lb,
-                            col_per_wg, MPI_DOUBLE, current_win);
-                    }
-
-                    if (my_subarray.dn_neighbour != MPI_PROC_NULL)  {
-                        int idx = XY_2_IDX(my_x_lb, my_subarray.y_size - 1, row_size);
-                        MPI_Put(&out[idx], col_per_wg, MPI_DOUBLE,
-                            my_subarray.rank + 1, 1+my_x_lb,
-                            col_per_wg, MPI_DOUBLE, current_win);
-                    }
-
-
-                    /* Recalculate internal points in parallel with communications. */
-                    for (int row = 1; row < my_subarray.y_size - 1; ++row) {
-                        int column = 0;
-                        for (; (column + work_group_size) < my_subarray.x_size; 
-                                column += work_group_size) {
-                            RECALCULATE_POINT(out, in, column+id, row, row_size);
-                        }
-                        if (id < my_subarray.x_size % work_group_size) {
-                            RECALCULATE_POINT(out, in, column+id, row, row_size);
-                        }
-                    }
-
-                    item.barrier(sycl::access::fence_space::global_space);
-                    /* Ensure all communications are complete before the next iteration.
-                     * Synchronization primitives called within a kernel have the same
-                     * limitations as if they had been called from regular threads.
-                     * Because of that, we have to synchronize all threads of a workgroup using a barrier,
-                     * then call MPI_Win_fence from a single thread. 
-                     */
-                    if (id == 0) {
-                        MPI_Win_fence(0, current_win);
-                    }
-                    item.barrier(sycl::access::fence_space::global_space);
-                }
+    for (passed_iters = 0; passed_iters < Niter && !converged; passed_iters += iterations_batch) {
+        double *batch_norm = (NormIteration > 0) ? async_norm.Begin() : NULL;
+
+        /* Submit the kernels of the next "iterations_batch" steps. Communications are initiated and
+         * completed by single work-item kernels, after the compute kernels they depend on.
+         */
+        for (int k = 0; k < iterations_batch; ++k) {
+            int i = passed_iters + k;
+            MPI_Win current_win = win[(i + 1) % 2];
+            double *in = buffs[i % 2];
+            double *out = buffs[(1 + i) % 2];
+            double *norm = (k == iterations_batch - 1) ? batch_norm : NULL;
+
+            UnpackGhostColumns(q, my_subarray, in, work_group_size);
+            /* Calculate values on the borders to initiate communications early. */
+            RecalculateBorders(q, my_subarray, in, out, halo_cols, norm, work_group_size);
+
+            /* Perform 2D halo-exchange with neighbors. */
+            q.single_task([=]() {
+                PutHalos(my_subarray, out, halo_cols,
+                         [=](const void *origin, int origin_count, MPI_Datatype origin_type, int target,
+                             MPI_Aint target_disp, int target_count, MPI_Datatype target_type) {
+                    MPI_Put(origin, origin_count, origin_type, target, target_disp,
+                            target_count, target_type, current_win);
+                });
             });
-        }).wait();
 
+            /* Recalculate internal points in parallel with communications. */
+            RecalculateInterior(q, my_subarray, in, out, norm, work_group_size);
+
+            /* Ensure all communications are complete before the next iteration.
+             * Synchronization primitives called within a kernel have the same
+             * limitations as if they had been called from regular threads, so
+             * MPI_Win_fence is called from a single work-item once the compute
+             * kernels of the iteration are finished.
+             */
+            q.single_task([=]() {
+                MPI_Win_fence(0, current_win);
+            });
+        }
 
-        /* Calculate the norm value after the given number of iterations. */
         if (NormIteration > 0) {
-            double result_norm = 0.0;
-            double norm = 0.0;
-            double *a = buffs[0];
-            double *a_out = buffs[1];
-
-            {
-                sycl::buffer<double> norm_buf(&norm, 1);
-                q.submit([&](auto & h) {
-                    auto sumr = sycl::reduction(norm_buf, h, sycl::plus<>());
-                    h.parallel_for(sycl::range(my_subarray.x_size, my_subarray.y_size), sumr, [=] (auto index, auto &v) {
-                        int idx = XY_2_IDX(index[0], index[1], row_size);
-                        double diff = a_out[idx] - a[idx];
-                        v += (diff * diff);
-                    });
-                }).wait();
-            }
-
-            MPI_Reduce(&norm, &result_norm, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-            if (my_subarray.rank == 0) {
-                printf("NORM value on iteration %d: %f\n", passed_iters + iterations_batch, sqrt(result_norm));
-            }
+            /* The norm of the previous batch was reduced while this batch was computed. Posting the norm
+             * of this batch waits for its kernels; the reduction then overlaps the next batch.
+             */
+            converged = CheckNorm(async_norm, my_subarray, tolerance);
+            async_norm.Post(passed_iters + iterations_batch);
         }
     }
+    q.wait();
+    /* Complete the norm of the last batch. */
+    converged |= CheckNorm(async_norm, my_subarray, tolerance);
     END_PROFILING
 
     MPI_Win_fence(0, win[0]);
     MPI_Win_fence(0, win[1]);
     MPI_Win_free(&win[1]);
     MPI_Win_free(&win[0]);
+    sycl::free(halo_cols, q);
 
     if (my_subarray.rank == 0) {
+        if (converged)
+            printf("Converged to tolerance %g, stopped after %d iterations\n", tolerance, passed_iters);
         printf("SUCCESS\n");
     }
     MPI_Finalize();
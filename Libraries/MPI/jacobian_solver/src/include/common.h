@@ -15,11 +15,22 @@ struct subarray {
     int x_size, y_size;         /* Subarray size excluding border rows and columns */
     MPI_Aint l_nbh_offt;        /* Offset predecessor data to update */
     int up_neighbour, dn_neighbour; /* Up and sown neighbour ranks */
+    int dims[2], coords[2];     /* Process grid size and position in it, rows first */
+    int lt_neighbour, rt_neighbour; /* Left and right neighbour ranks */
+    MPI_Aint lt_nbh_offt, rt_nbh_offt; /* Offsets of the ghost slots to update in left and right neighbours */
 };
 
 #define ROW_SIZE(S) ((S).x_size + 2)
 #define XY_2_IDX(X,Y,RS) (((Y)+1)*(RS)+((X)+1))
 
+/* Windows of a 2D decomposition hold two ghost slots of y_size values after the grid.
+ * Left (SIDE 0) and right (SIDE 1) neighbours put their packed border columns there.
+ */
+#define GHOST_OFFT(S,SIDE) (((S).x_size + 2) * ((S).y_size + 2) + (SIDE) * (S).y_size)
+
+/* Size of part P_IDX when N points are split into P parts, the first N % P parts get an extra point */
+#define PART_SIZE(N,P,P_IDX) ((N) / (P) + (((P_IDX) < (N) % (P)) ? 1 : 0))
+
 /* This macro recalculate single point of OUT array, as an avarage of 4(top, bottom,left and right)
  * neighbours of a point from IN array.
  *
@@ -101,39 +112,12 @@ double t_start;
 
 
 
-/* InitSubarryAndWindows: Initialize subarray and windows for Jacobian solver
- *      @sub: Subarray structure to initialize. Defines part of grid process is rewsponsible for.
- *      @buffers: Array of pointers to buffers used for computation. Output. Must be size of 2.
- *      @wins: Array of windows used for RMA operations. Output. Must be size of 2.
- *      @alloc_type: "host" or "device". Defines RMA windows are allocated in host or device memory.
- *      @use_passive_target: Use passive target RMA operations. If false, MPI_Win_fence is used.
+/* InitWindows: Allocate RMA windows of total_size bytes and set the initial state of the subarray.
+ * Halo rows and columns without a neighbour hold the boundary conditions, everything else is zero.
  */
-static void InitSubarryAndWindows(struct subarray *sub, double **buffers, MPI_Win *wins,
-                                  const char *alloc_type, bool use_passive_target)
+static void InitWindows(struct subarray *sub, double **buffers, MPI_Win *wins, size_t total_size,
+                        const char *alloc_type, bool use_passive_target)
 {
-    /* Get own process index and total amount of processes */
-    MPI_Comm_size(MPI_COMM_WORLD, &sub->comm_size);
-    MPI_Comm_rank(MPI_COMM_WORLD, &sub->rank);
-
-    /* Partititon grid across processes */
-    sub->y_size = Ny / sub->comm_size;
-    sub->x_size = Nx;
-    sub->l_nbh_offt = (sub->x_size + 2) * (sub->y_size + 1) + 1;
-
-    int tail = sub->y_size % sub->comm_size;
-    if (tail != 0) {
-        if (sub->rank < tail)
-            sub->y_size++;
-        if ((sub->rank > 0) && ((sub->rank - 1) < tail))
-            sub->l_nbh_offt += (sub->x_size + 2);
-    }
-
-    /* Check if process have neighbours */
-    sub->up_neighbour = (sub->rank > 0) ? sub->rank - 1 : MPI_PROC_NULL;
-    sub->dn_neighbour = (sub->rank < (sub->comm_size - 1)) ? sub->rank + 1 : MPI_PROC_NULL;
-
-    size_t total_size = sizeof(double) * (sub->x_size + 2) * (sub->y_size + 2);
-    
     {   /* Allocate RMA-Windows using requested memory allocation type */
         MPI_Info info;
         MPI_Info_create(&info);
@@ -146,25 +130,24 @@ static void InitSubarryAndWindows(struct subarray *sub, double **buffers, MPI_Wi
 
     {
         /* Create a temporary buffer */
-        double *A = (double*) malloc(total_size * sizeof(double));
-        for (int i = 0; i < (sub->y_size + 2); i++)
-            for (int j = 0; j < (sub->x_size + 2); j++)
-                A[i * (sub->x_size + 2) + j] = 0.0;
+        double *A = (double*) calloc(total_size, 1);
 
         /* set top boundary values */
-        if (sub->rank == 0)
+        if (sub->up_neighbour == MPI_PROC_NULL)
             for (int i = 1; i <= sub->x_size; i++)
                 A[i] = 1.0;
 
         /* set bottom boundary values */
-        if (sub->rank == (sub->comm_size - 1))
+        if (sub->dn_neighbour == MPI_PROC_NULL)
             for (int i = 1; i <= sub->x_size; i++)
                 A[(sub->x_size + 2) * (sub->y_size + 1) + i] = 10.0;
 
         for (int i = 1; i <= sub->y_size; i++) {
             int row_offt = i * (sub->x_size + 2);
-            A[row_offt] = 1.0;      /* set left boundary values */
-            A[row_offt + sub->x_size + 1] = 1.0;    /* set right boundary values */
+            if (sub->lt_neighbour == MPI_PROC_NULL)
+                A[row_offt] = 1.0;      /* set left boundary values */
+            if (sub->rt_neighbour == MPI_PROC_NULL)
+                A[row_offt + sub->x_size + 1] = 1.0;    /* set right boundary values */
         }
 
         /* Use MPI_put to self as a memory and runtime anostic method to copy data
@@ -191,5 +174,90 @@ static void InitSubarryAndWindows(struct subarray *sub, double **buffers, MPI_Wi
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
-    return;
+}
+
+
+/* InitSubarryAndWindows: Initialize subarray and windows for Jacobian solver
+ *      @sub: Subarray structure to initialize. Defines part of grid process is rewsponsible for.
+ *      @buffers: Array of pointers to buffers used for computation. Output. Must be size of 2.
+ *      @wins: Array of windows used for RMA operations. Output. Must be size of 2.
+ *      @alloc_type: "host" or "device". Defines RMA windows are allocated in host or device memory.
+ *      @use_passive_target: Use passive target RMA operations. If false, MPI_Win_fence is used.
+ */
+static void InitSubarryAndWindows(struct subarray *sub, double **buffers, MPI_Win *wins,
+                                  const char *alloc_type, bool use_passive_target)
+{
+    /* Get own process index and total amount of processes */
+    MPI_Comm_size(MPI_COMM_WORLD, &sub->comm_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &sub->rank);
+
+    /* Partititon grid across processes */
+    sub->y_size = Ny / sub->comm_size;
+    sub->x_size = Nx;
+    sub->l_nbh_offt = (sub->x_size + 2) * (sub->y_size + 1) + 1;
+
+    int tail = sub->y_size % sub->comm_size;
+    if (tail != 0) {
+        if (sub->rank < tail)
+            sub->y_size++;
+        if ((sub->rank > 0) && ((sub->rank - 1) < tail))
+            sub->l_nbh_offt += (sub->x_size + 2);
+    }
+
+    /* Check if process have neighbours */
+    sub->up_neighbour = (sub->rank > 0) ? sub->rank - 1 : MPI_PROC_NULL;
+    sub->dn_neighbour = (sub->rank < (sub->comm_size - 1)) ? sub->rank + 1 : MPI_PROC_NULL;
+    sub->lt_neighbour = sub->rt_neighbour = MPI_PROC_NULL;
+    sub->dims[0] = sub->comm_size;
+    sub->dims[1] = 1;
+    sub->coords[0] = sub->rank;
+    sub->coords[1] = 0;
+
+    size_t total_size = sizeof(double) * (sub->x_size + 2) * (sub->y_size + 2);
+    InitWindows(sub, buffers, wins, total_size, alloc_type, use_passive_target);
+}
+
+/* InitSubarray2DAndWindows: Same as InitSubarryAndWindows, but the grid is split along both X and Y
+ * over a process grid chosen by MPI_Dims_create. Ranks are placed on the process grid row by row.
+ * Rows are exchanged with up and down neighbours as in the 1D decomposition; border columns are
+ * packed and put into the ghost slots (see GHOST_OFFT) of left and right neighbours.
+ */
+static void InitSubarray2DAndWindows(struct subarray *sub, double **buffers, MPI_Win *wins,
+                                     const char *alloc_type, bool use_passive_target)
+{
+    MPI_Comm_size(MPI_COMM_WORLD, &sub->comm_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &sub->rank);
+
+    /* dims[0] >= dims[1], so a prime number of processes falls back to rows only */
+    sub->dims[0] = sub->dims[1] = 0;
+    MPI_Dims_create(sub->comm_size, 2, sub->dims);
+    sub->coords[0] = sub->rank / sub->dims[1];
+    sub->coords[1] = sub->rank % sub->dims[1];
+
+    sub->y_size = PART_SIZE(Ny, sub->dims[0], sub->coords[0]);
+    sub->x_size = PART_SIZE(Nx, sub->dims[1], sub->coords[1]);
+
+    sub->up_neighbour = (sub->coords[0] > 0) ? sub->rank - sub->dims[1] : MPI_PROC_NULL;
+    sub->dn_neighbour = (sub->coords[0] < sub->dims[0] - 1) ? sub->rank + sub->dims[1] : MPI_PROC_NULL;
+    sub->lt_neighbour = (sub->coords[1] > 0) ? sub->rank - 1 : MPI_PROC_NULL;
+    sub->rt_neighbour = (sub->coords[1] < sub->dims[1] - 1) ? sub->rank + 1 : MPI_PROC_NULL;
+
+    /* The first row goes to the bottom halo row of the up neighbour */
+    if (sub->up_neighbour != MPI_PROC_NULL) {
+        int up_y_size = PART_SIZE(Ny, sub->dims[0], sub->coords[0] - 1);
+        sub->l_nbh_offt = (sub->x_size + 2) * (up_y_size + 1) + 1;
+    }
+    /* The first column goes to the right ghost slot of the left neighbour */
+    if (sub->lt_neighbour != MPI_PROC_NULL) {
+        int lt_x_size = PART_SIZE(Nx, sub->dims[1], sub->coords[1] - 1);
+        sub->lt_nbh_offt = (lt_x_size + 2) * (sub->y_size + 2) + sub->y_size;
+    }
+    /* The last column goes to the left ghost slot of the right neighbour */
+    if (sub->rt_neighbour != MPI_PROC_NULL) {
+        int rt_x_size = PART_SIZE(Nx, sub->dims[1], sub->coords[1] + 1);
+        sub->rt_nbh_offt = (rt_x_size + 2) * (sub->y_size + 2);
+    }
+
+    size_t total_size = sizeof(double) * GHOST_OFFT(*sub, 2);
+    InitWindows(sub, buffers, wins, total_size, alloc_type, use_passive_target);
 }
@@ -0,0 +1,233 @@
+/*==============================================================
+ * Copyright © 2023 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ * ============================================================= */
+
+/* SYCL kernels shared by the device variants of the Jacobian solver.
+ *
+ * The subarray is tiled over as many work-groups as needed, one work-item per point, so every kernel
+ * uses the whole device. Kernel boundaries provide the synchronization between work-groups that the
+ * single work-group versions of these samples used to get from barriers.
+ * The subarray must come from InitSubarray2DAndWindows.
+ */
+#ifndef COMMON_SYCL_HPP
+#define COMMON_SYCL_HPP
+
+#include "common.h"
+#include <sycl.hpp>
+
+static inline size_t RoundUp(size_t n, size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+/* Default work-group size: GROUP_SIZE_DEFAULT if defined, 256 otherwise, limited by the device. */
+static int DefaultWorkGroupSize(const sycl::queue &q)
+{
+#ifdef GROUP_SIZE_DEFAULT
+    int work_group_size = GROUP_SIZE_DEFAULT;
+#else
+    int work_group_size = 256;
+#endif
+    int max_size = (int) q.get_device().get_info<sycl::info::device::max_work_group_size>();
+    return (work_group_size < max_size) ? work_group_size : max_size;
+}
+
+/* UnpackGhostColumns: Copy the columns put into the ghost slots of BUF by left and right neighbours
+ * to the halo columns of BUF. Sides without a neighbour keep their boundary values.
+ */
+static sycl::event UnpackGhostColumns(sycl::queue &q, const struct subarray &sub, double *buf,
+                                      int work_group_size)
+{
+    const struct subarray s = sub;
+    const int row_size = ROW_SIZE(sub);
+    return q.parallel_for(sycl::nd_range<1>(RoundUp(sub.y_size, work_group_size), work_group_size),
+                          [=](sycl::nd_item<1> item) {
+        int row = item.get_global_id(0);
+        if (row >= s.y_size)
+            return;
+        if (s.lt_neighbour != MPI_PROC_NULL)
+            buf[XY_2_IDX(-1, row, row_size)] = buf[GHOST_OFFT(s, 0) + row];
+        if (s.rt_neighbour != MPI_PROC_NULL)
+            buf[XY_2_IDX(s.x_size, row, row_size)] = buf[GHOST_OFFT(s, 1) + row];
+    });
+}
+
+/* ParallelForWithNorm: Run KERNEL, which recalculates a point and returns the squared difference
+ * between its new and old values. If NORM is not NULL, the differences are added to *NORM.
+ */
+template <int Dims, typename Kernel>
+static sycl::event ParallelForWithNorm(sycl::queue &q, sycl::nd_range<Dims> range, double *norm, Kernel kernel)
+{
+    if (norm == NULL)
+        return q.parallel_for(range, [=](sycl::nd_item<Dims> item) { kernel(item); });
+    return q.parallel_for(range, sycl::reduction(norm, sycl::plus<double>()),
+                          [=](sycl::nd_item<Dims> item, auto &sum) { sum += kernel(item); });
+}
+
+/* RecalculatePointDiff: RECALCULATE_POINT, returning the squared difference between the new and old values. */
+static inline double RecalculatePointDiff(double *out, const double *in, int column, int row, int row_size)
+{
+    int idx = XY_2_IDX(column, row, row_size);
+    RECALCULATE_POINT(out, in, column, row, row_size);
+    double diff = out[idx] - in[idx];
+    return diff * diff;
+}
+
+/* RecalculateBorders: Recalculate the first and last rows and columns of the subarray, so that
+ * communications can start early. The first and last columns are also packed to HALO_COLS
+ * (2 * y_size values, first column then last column) to be put into neighbours' ghost slots.
+ * If NORM is not NULL, the squared differences of the recalculated points are added to *NORM.
+ */
+static sycl::event RecalculateBorders(sycl::queue &q, const struct subarray &sub, const double *in,
+                                      double *out, double *halo_cols, double *norm, int work_group_size)
+{
+    const struct subarray s = sub;
+    const int row_size = ROW_SIZE(sub);
+    const int inner_rows = (sub.y_size > 2) ? sub.y_size - 2 : 0;
+    /* Each point is recalculated once, even if the first and last rows or columns are the same */
+    const int n_row_points = ((sub.y_size > 1) ? 2 : 1) * sub.x_size;
+    const int n_points = n_row_points + ((sub.x_size > 1) ? 2 : 1) * inner_rows;
+    return ParallelForWithNorm(q, sycl::nd_range<1>(RoundUp(n_points, work_group_size), work_group_size), norm,
+                               [=](sycl::nd_item<1> item) {
+        int id = item.get_global_id(0);
+        int column, row;
+        if (id >= n_points)
+            return 0.0;
+        if (id < n_row_points) {
+            /* first and last rows */
+            column = id % s.x_size;
+            row = (id < s.x_size) ? 0 : s.y_size - 1;
+        } else {
+            /* first and last columns, without the corners */
+            id -= n_row_points;
+            column = (id < inner_rows) ? 0 : s.x_size - 1;
+            row = 1 + id % inner_rows;
+        }
+        double diff2 = RecalculatePointDiff(out, in, column, row, row_size);
+        if (column == 0)
+            halo_cols[row] = out[XY_2_IDX(column, row, row_size)];
+        if (column == s.x_size - 1)
+            halo_cols[s.y_size + row] = out[XY_2_IDX(column, row, row_size)];
+        return diff2;
+    });
+}
+
+/* RecalculateInterior: Recalculate all points that are not on the borders of the subarray.
+ * If NORM is not NULL, the squared differences of the recalculated points are added to *NORM.
+ */
+static sycl::event RecalculateInterior(sycl::queue &q, const struct subarray &sub, const double *in,
+                                       double *out, double *norm, int work_group_size)
+{
+    const int x_size = sub.x_size, y_size = sub.y_size;
+    const int row_size = ROW_SIZE(sub);
+    if (x_size <= 2 || y_size <= 2)
+        return sycl::event();
+    return ParallelForWithNorm(q, sycl::nd_range<2>(sycl::range<2>(y_size - 2, RoundUp(x_size - 2, work_group_size)),
+                                                    sycl::range<2>(1, work_group_size)), norm,
+                               [=](sycl::nd_item<2> item) {
+        int row = 1 + item.get_global_id(0);
+        int column = 1 + item.get_global_id(1);
+        if (column >= x_size - 1)
+            return 0.0;
+        return RecalculatePointDiff(out, in, column, row, row_size);
+    });
+}
+
+/* PutHalos: Put the first and last rows of OUT and the packed columns to the neighbours' windows.
+ * PUT is called with the arguments of MPI_Put without the window, so it can be used for both
+ * MPI_Put and MPI_Put_notify, from the host or from a kernel.
+ */
+template <typename Put>
+static inline void PutHalos(const struct subarray &sub, double *out, double *halo_cols, Put put)
+{
+    const int row_size = ROW_SIZE(sub);
+    if (sub.up_neighbour != MPI_PROC_NULL)
+        put(&out[XY_2_IDX(0, 0, row_size)], sub.x_size, MPI_DOUBLE,
+            sub.up_neighbour, sub.l_nbh_offt, sub.x_size, MPI_DOUBLE);
+    if (sub.dn_neighbour != MPI_PROC_NULL)
+        put(&out[XY_2_IDX(0, sub.y_size - 1, row_size)], sub.x_size, MPI_DOUBLE,
+            sub.dn_neighbour, 1, sub.x_size, MPI_DOUBLE);
+    if (sub.lt_neighbour != MPI_PROC_NULL)
+        put(&halo_cols[0], sub.y_size, MPI_DOUBLE,
+            sub.lt_neighbour, sub.lt_nbh_offt, sub.y_size, MPI_DOUBLE);
+    if (sub.rt_neighbour != MPI_PROC_NULL)
+        put(&halo_cols[sub.y_size], sub.y_size, MPI_DOUBLE,
+            sub.rt_neighbour, sub.rt_nbh_offt, sub.y_size, MPI_DOUBLE);
+}
+
+/* NeighbourCount: Number of neighbours, which is also the number of puts received per iteration. */
+static inline int NeighbourCount(const struct subarray &sub)
+{
+    return (sub.up_neighbour != MPI_PROC_NULL) + (sub.dn_neighbour != MPI_PROC_NULL)
+           + (sub.lt_neighbour != MPI_PROC_NULL) + (sub.rt_neighbour != MPI_PROC_NULL);
+}
+
+/* Iterations stop once the norm is below the tolerance, 0 to always run Niter iterations.
+ * The SYCL variants take the tolerance as their first argument.
+ */
+const double Tolerance = 0.0;
+
+/* AsyncNorm: Norm of the last iteration of every batch of iterations.
+ * The local part is accumulated by the kernels of that iteration into the device accumulator returned
+ * by Begin(). Post() sums it over all processes with MPI_Iallreduce, which completes while the next
+ * batch is computed; Wait() returns the previously posted norm. Two slots are used in turns.
+ */
+struct AsyncNorm {
+    AsyncNorm(sycl::queue &q) : q(q), dev(sycl::malloc_device<double>(2, q)) { }
+    ~AsyncNorm() { sycl::free(dev, q); }
+
+    /* Device accumulator of the next batch, zeroed in queue order. */
+    double *Begin()
+    {
+        slot = 1 - slot;
+        q.memset(&dev[slot], 0, sizeof(double));
+        return &dev[slot];
+    }
+
+    /* Start the reduction of the norm of the batch that ended on iteration ITER. */
+    void Post(int iter)
+    {
+        q.memcpy(&local[slot], &dev[slot], sizeof(double)).wait();
+        iters[slot] = iter;
+        MPI_Iallreduce(&local[slot], &global[slot], 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD, &reqs[slot]);
+    }
+
+    /* Complete the oldest posted reduction. Returns false if there is none. */
+    bool Wait(double *norm, int *iter)
+    {
+        for (int i = 1; i <= 2; i++) {
+            int s = (slot + i) % 2;
+            if (reqs[s] != MPI_REQUEST_NULL) {
+                MPI_Wait(&reqs[s], MPI_STATUS_IGNORE);
+                *norm = sqrt(global[s]);
+                *iter = iters[s];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    sycl::queue &q;
+    double *dev;
+    double local[2] = { 0.0, 0.0 }, global[2] = { 0.0, 0.0 };
+    int iters[2] = { 0, 0 };
+    MPI_Request reqs[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL };
+    int slot = 1;
+};
+
+/* CheckNorm: Complete the oldest posted norm and print it on rank 0. Returns true if it is below TOLERANCE. */
+static bool CheckNorm(AsyncNorm &async_norm, const struct subarray &sub, double tolerance)
+{
+    double norm;
+    int iter;
+    if (!async_norm.Wait(&norm, &iter))
+        return false;
+    if (sub.rank == 0) {
+        printf("NORM value on iteration %d: %f\n", iter, norm);
+    }
+    return norm < tolerance;
+}
+
+#endif /* COMMON_SYCL_HPP */
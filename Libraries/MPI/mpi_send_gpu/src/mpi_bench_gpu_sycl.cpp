@@ -0,0 +1,285 @@
+/*==============================================================
+ * Copyright © 2023 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ * ============================================================= */
+/* Description:
+ * Latency and bandwidth of MPI transfers between two ranks for every combination of
+ * buffer allocations: sycl::malloc_device, sycl::malloc_host, sycl::malloc_shared and
+ * plain heap memory. Rank 0 uses the first allocation of a pair and rank 1 the second.
+ *
+ * Modes:
+ *  pingpong  MPI_Send/MPI_Recv round trips, time is half a round trip.
+ *  stream    Windows of MPI_Isend/MPI_Irecv from rank 0 to rank 1, one acknowledgement per window.
+ *  rma       Windows of MPI_Put from rank 0 into rank 1, closed by MPI_Win_fence.
+ * Message sizes are powers of two from 8 bytes to the maximum size. Results are printed
+ * by rank 0 in CSV format; time_us is the time per message.
+ *
+ * Usage: mpi_bench_gpu_sycl [-s max_bytes] [-m pingpong,stream,rma] [-a device,host,shared,heap] [-o file.csv]
+ *
+ * How to run:
+ * mpiexec -n 2 -genv I_MPI_OFFLOAD=1 ./mpi_bench_gpu_sycl
+ * On a CPU-only host select the CPU SYCL device:
+ * mpiexec -n 2 -genv ONEAPI_DEVICE_SELECTOR=opencl:cpu ./mpi_bench_gpu_sycl
+*/
+
+#include <mpi.h>
+#include <sycl.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MIN_MSG_SIZE 8
+#define WINDOW_SIZE 64
+#define TAG 123
+
+enum alloc_kind { ALLOC_DEVICE, ALLOC_HOST, ALLOC_SHARED, ALLOC_HEAP, NUM_ALLOC_KINDS };
+static const char *alloc_names[NUM_ALLOC_KINDS] = { "device", "host", "shared", "heap" };
+
+enum bench_mode { MODE_PINGPONG, MODE_STREAM, MODE_RMA, NUM_MODES };
+static const char *mode_names[NUM_MODES] = { "pingpong", "stream", "rma" };
+
+static void *Allocate(sycl::queue &q, int kind, size_t bytes)
+{
+    switch (kind) {
+        case ALLOC_DEVICE: return sycl::malloc_device(bytes, q);
+        case ALLOC_HOST:   return sycl::malloc_host(bytes, q);
+        case ALLOC_SHARED: return sycl::malloc_shared(bytes, q);
+        default:           return malloc(bytes);
+    }
+}
+
+static void Free(sycl::queue &q, int kind, void *ptr)
+{
+    if (kind == ALLOC_HEAP)
+        free(ptr);
+    else
+        sycl::free(ptr, q);
+}
+
+static void Fill(sycl::queue &q, int kind, void *ptr, int value, size_t bytes)
+{
+    if (kind == ALLOC_HEAP)
+        memset(ptr, value, bytes);
+    else
+        q.memset(ptr, value, bytes).wait();
+}
+
+static unsigned char ReadByte(sycl::queue &q, int kind, const void *ptr, size_t offset)
+{
+    unsigned char value;
+    if (kind == ALLOC_HEAP)
+        value = ((const unsigned char *) ptr)[offset];
+    else
+        q.memcpy(&value, (const unsigned char *) ptr + offset, 1).wait();
+    return value;
+}
+
+/* Number of messages for a size: enough to move about 1 GB, between 8 and 1000. */
+static int Iterations(size_t bytes)
+{
+    size_t iters = ((size_t) 1 << 30) / bytes;
+    return (iters < 8) ? 8 : (iters > 1000) ? 1000 : (int) iters;
+}
+
+/* Messages of a window go to disjoint parts of the buffer, so the window shrinks for large messages. */
+static int Window(size_t bytes, size_t buf_bytes)
+{
+    size_t window = buf_bytes / bytes;
+    return (window > WINDOW_SIZE) ? WINDOW_SIZE : (int) window;
+}
+
+/* PingPong: Returns the time of ITERS round trips between the ranks. */
+static double PingPong(char *buf, size_t bytes, int iters, int rank)
+{
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t_start = MPI_Wtime();
+    for (int i = 0; i < iters; i++) {
+        if (rank == 0) {
+            MPI_Send(buf, (int) bytes, MPI_BYTE, 1, TAG, MPI_COMM_WORLD);
+            MPI_Recv(buf, (int) bytes, MPI_BYTE, 1, TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        } else {
+            MPI_Recv(buf, (int) bytes, MPI_BYTE, 0, TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Send(buf, (int) bytes, MPI_BYTE, 0, TAG, MPI_COMM_WORLD);
+        }
+    }
+    return MPI_Wtime() - t_start;
+}
+
+/* Stream: Returns the time of ITERS windows of WINDOW messages from rank 0 to rank 1. */
+static double Stream(char *buf, size_t bytes, int window, int iters, int rank)
+{
+    MPI_Request reqs[WINDOW_SIZE];
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t_start = MPI_Wtime();
+    for (int i = 0; i < iters; i++) {
+        for (int j = 0; j < window; j++) {
+            if (rank == 0)
+                MPI_Isend(buf + j * bytes, (int) bytes, MPI_BYTE, 1, TAG, MPI_COMM_WORLD, &reqs[j]);
+            else
+                MPI_Irecv(buf + j * bytes, (int) bytes, MPI_BYTE, 0, TAG, MPI_COMM_WORLD, &reqs[j]);
+        }
+        MPI_Waitall(window, reqs, MPI_STATUSES_IGNORE);
+        /* The receiver acknowledges every window, so the sender cannot run ahead */
+        if (rank == 0)
+            MPI_Recv(NULL, 0, MPI_BYTE, 1, TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        else
+            MPI_Send(NULL, 0, MPI_BYTE, 0, TAG, MPI_COMM_WORLD);
+    }
+    return MPI_Wtime() - t_start;
+}
+
+/* Rma: Returns the time of ITERS windows of WINDOW puts from rank 0 into rank 1. */
+static double Rma(MPI_Win win, char *buf, size_t bytes, int window, int iters, int rank)
+{
+    MPI_Win_fence(0, win);
+    double t_start = MPI_Wtime();
+    for (int i = 0; i < iters; i++) {
+        if (rank == 0) {
+            for (int j = 0; j < window; j++)
+                MPI_Put(buf + j * bytes, (int) bytes, MPI_BYTE, 1, j * bytes, (int) bytes, MPI_BYTE, win);
+        }
+        MPI_Win_fence(0, win);
+    }
+    return MPI_Wtime() - t_start;
+}
+
+/* ParseList: Set enabled[i] for every name of NAMES found in the comma-separated list ARG. */
+static void ParseList(char *arg, const char **names, int n, bool *enabled)
+{
+    for (int i = 0; i < n; i++)
+        enabled[i] = false;
+    for (char *tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        for (int i = 0; i < n; i++)
+            if (strcmp(tok, names[i]) == 0)
+                enabled[i] = true;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    int nranks, rank;
+    size_t max_bytes = (size_t) 256 << 20;
+    bool modes[NUM_MODES] = { true, true, true };
+    bool allocs[NUM_ALLOC_KINDS] = { true, true, true, true };
+    const char *csv_name = NULL;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (nranks != 2) {
+        if (rank == 0) fprintf(stderr, "run mpiexec with -n 2\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:m:a:o:")) != -1) {
+        switch (opt) {
+            case 's': max_bytes = strtoull(optarg, NULL, 0); break;
+            case 'm': ParseList(optarg, mode_names, NUM_MODES, modes); break;
+            case 'a': ParseList(optarg, alloc_names, NUM_ALLOC_KINDS, allocs); break;
+            case 'o': csv_name = optarg; break;
+            default:
+                if (rank == 0)
+                    fprintf(stderr, "usage: %s [-s max_bytes] [-m pingpong,stream,rma] "
+                                    "[-a device,host,shared,heap] [-o file.csv]\n", argv[0]);
+                MPI_Finalize();
+                return 1;
+        }
+    }
+    if (max_bytes < MIN_MSG_SIZE || max_bytes > INT_MAX) {
+        if (rank == 0) fprintf(stderr, "max_bytes must be between %d and %d\n", MIN_MSG_SIZE, INT_MAX);
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* Any SYCL device can be used: set ONEAPI_DEVICE_SELECTOR to choose it */
+    sycl::queue q;
+
+    FILE *csv = stdout;
+    if (rank == 0) {
+        if (csv_name != NULL && (csv = fopen(csv_name, "w")) == NULL) {
+            fprintf(stderr, "[%d] could not open %s\n", rank, csv_name);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        fprintf(stderr, "[%d] device: %s\n", rank, q.get_device().get_info<sycl::info::device::name>().c_str());
+        fprintf(csv, "mode,rank0_alloc,rank1_alloc,bytes,window,messages,time_us,bandwidth_MBps\n");
+    }
+
+    for (int a0 = 0; a0 < NUM_ALLOC_KINDS; a0++) {
+        for (int a1 = 0; a1 < NUM_ALLOC_KINDS; a1++) {
+            if (!allocs[a0] || !allocs[a1])
+                continue;
+            const int kind = (rank == 0) ? a0 : a1;
+            char *buf = (char *) Allocate(q, kind, max_bytes);
+            if (buf == NULL) {
+                fprintf(stderr, "[%d] could not allocate %zu bytes of %s memory\n", rank, max_bytes, alloc_names[kind]);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+
+            MPI_Win win = MPI_WIN_NULL;
+            if (modes[MODE_RMA])
+                MPI_Win_create(buf, max_bytes, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &win);
+
+            for (int mode = 0; mode < NUM_MODES; mode++) {
+                if (!modes[mode])
+                    continue;
+                for (size_t bytes = MIN_MSG_SIZE; bytes <= max_bytes; bytes *= 2) {
+                    const int messages = Iterations(bytes);
+                    const int window = (mode == MODE_PINGPONG) ? 1 : Window(bytes, max_bytes);
+                    const int iters = (messages + window - 1) / window;
+
+                    /* Rank 0 sends a size-specific pattern that rank 1 checks afterwards */
+                    const unsigned char pattern = (unsigned char) (1 + (bytes % 251));
+                    Fill(q, kind, buf, (rank == 0) ? pattern : 0, bytes);
+
+                    double time;
+                    switch (mode) {
+                        case MODE_PINGPONG:
+                            PingPong(buf, bytes, 1 + iters / 10, rank);    /* warm-up */
+                            time = PingPong(buf, bytes, iters, rank) / 2;
+                            break;
+                        case MODE_STREAM:
+                            Stream(buf, bytes, window, 1 + iters / 10, rank);
+                            time = Stream(buf, bytes, window, iters, rank);
+                            break;
+                        default:
+                            Rma(win, buf, bytes, window, 1 + iters / 10, rank);
+                            time = Rma(win, buf, bytes, window, iters, rank);
+                            break;
+                    }
+
+                    if (rank == 1) {
+                        if (ReadByte(q, kind, buf, 0) != pattern || ReadByte(q, kind, buf, bytes - 1) != pattern) {
+                            fprintf(stderr, "[%d] VALIDATION ERROR: %s %s->%s %zu bytes\n", rank,
+                                    mode_names[mode], alloc_names[a0], alloc_names[a1], bytes);
+                            MPI_Abort(MPI_COMM_WORLD, 1);
+                        }
+                    } else {
+                        const double time_per_msg = time / ((double) iters * window);
+                        fprintf(csv, "%s,%s,%s,%zu,%d,%d,%.3f,%.3f\n", mode_names[mode], alloc_names[a0],
+                                alloc_names[a1], bytes, window, iters * window, time_per_msg * 1e6,
+                                bytes / time_per_msg / 1e6);
+                        fflush(csv);
+                    }
+                }
+            }
+
+            if (win != MPI_WIN_NULL)
+                MPI_Win_free(&win);
+            Free(q, kind, buf);
+        }
+    }
+
+    if (rank == 0) {
+        if (csv != stdout)
+            fclose(csv);
+        fprintf(stderr, "[%d] SUCCESS\n", rank);
+    }
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,284 @@
+//==============================================================
+// Copyright © 2023 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+#include <algorithm>
+#include <stdexcept>
+
+#include <sycl/sycl.hpp>
+
+#include "binomial_batch.hpp"
+
+namespace binomial {
+
+template<typename Type, int BlockSize>
+class k_binomial_wg;  // can be useful for profiling
+template<typename Type, int BlockSize>
+class k_binomial_sg;  // can be useful for profiling
+
+namespace {
+
+constexpr int packed_sg_size = 16;
+constexpr int packed_wg_size = 128;
+constexpr int max_packed_block = 16;
+constexpr int max_wg_block = 32;
+constexpr int min_wg_size = 128;
+
+// Per-option constants of the Cox-Ross-Rubinstein lattice
+template<typename DATA_TYPE>
+struct lattice {
+  lattice(DATA_TYPE tx, int num_steps, DATA_TYPE risk_free,
+          DATA_TYPE volatility) {
+    const DATA_TYPE dt = tx / static_cast<DATA_TYPE>(num_steps);
+    const DATA_TYPE r_dt = risk_free * dt;
+    const DATA_TYPE i_f = sycl::exp(r_dt);
+    const DATA_TYPE df = sycl::exp(-r_dt);
+    v_dt = volatility * sycl::sqrt(dt);
+    u = sycl::exp(v_dt);
+    const DATA_TYPE d = sycl::exp(-v_dt);
+    const DATA_TYPE pu = (i_f - d) / (u - d);
+    pu_df = pu * df;
+    pd_df = (static_cast<DATA_TYPE>(1.0) - pu) * df;
+  }
+
+  DATA_TYPE v_dt, u, pu_df, pd_df;
+};
+
+// Leaves block_start .. block_start + BlockSize - 1 of the tree. Leaves past
+// num_steps are padding: they only ever feed nodes outside the triangle, and
+// are zeroed so that they cannot overflow.
+template<typename DATA_TYPE, int BlockSize>
+inline void init_leaves(DATA_TYPE (&value)[BlockSize + 1],
+                        DATA_TYPE (&spot)[BlockSize], DATA_TYPE sx,
+                        DATA_TYPE xx, DATA_TYPE sign,
+                        const lattice<DATA_TYPE>& lat, int block_start,
+                        int num_steps) {
+  const DATA_TYPE mul_c = lat.v_dt * static_cast<DATA_TYPE>(2.0);
+  DATA_TYPE id = lat.v_dt * static_cast<DATA_TYPE>(2 * block_start - num_steps);
+  for (int i = 0; i < BlockSize; i++) {
+    const bool inside = block_start + i <= num_steps;
+    spot[i] = inside ? sx * sycl::exp(id) : DATA_TYPE(0);
+    value[i] = inside ? sycl::fmax(sign * (spot[i] - xx), DATA_TYPE(0))
+                      : DATA_TYPE(0);
+    id += mul_c;
+  }
+}
+
+// One step back in time. value[BlockSize] must hold the first node of the
+// next block. For American exercise the node price moves up by one factor
+// of u (S * u^(2j - i) -> S * u^(2j - i + 1)) and the option is worth at
+// least its intrinsic value.
+template<typename DATA_TYPE, int BlockSize>
+inline void step_back(DATA_TYPE (&value)[BlockSize + 1],
+                      DATA_TYPE (&spot)[BlockSize], DATA_TYPE xx,
+                      DATA_TYPE sign, const lattice<DATA_TYPE>& lat,
+                      bool american) {
+  for (int j = 0; j < BlockSize; j++) {
+    value[j] = lat.pu_df * value[j + 1] + lat.pd_df * value[j];
+  }
+  if (american) {
+    for (int j = 0; j < BlockSize; j++) {
+      spot[j] *= lat.u;
+      value[j] = sycl::fmax(value[j], sign * (spot[j] - xx));
+    }
+  }
+}
+
+int pow2_ceil(int v) {
+  int p = 1;
+  while (p < v) p *= 2;
+  return p;
+}
+
+bool has_packed_sub_group(const sycl::device& device) {
+  const auto sizes = device.get_info<sycl::info::device::sub_group_sizes>();
+  return std::find(sizes.begin(), sizes.end(), packed_sg_size) != sizes.end() &&
+         device.get_info<sycl::info::device::max_work_group_size>() >=
+             packed_wg_size;
+}
+
+template<typename DATA_TYPE, int BlockSize>
+sycl::event price_work_group(sycl::queue& queue, const model<DATA_TYPE>& m,
+                             const option_batch<DATA_TYPE>& batch,
+                             int wg_size,
+                             const std::vector<sycl::event>& deps) {
+  const int num_steps = m.num_steps;
+  const DATA_TYPE risk_free = m.risk_free;
+  const DATA_TYPE volatility = m.volatility;
+  const DATA_TYPE sign =
+      m.type == option_type::call ? DATA_TYPE(1) : DATA_TYPE(-1);
+  const bool american = m.exercise == exercise_type::american;
+  const DATA_TYPE* stock_price = batch.stock_price;
+  const DATA_TYPE* option_strike = batch.option_strike;
+  const DATA_TYPE* option_years = batch.option_years;
+  DATA_TYPE* result = batch.result;
+
+  return queue.submit([&](sycl::handler& h) {
+    h.depends_on(deps);
+    sycl::local_accessor<DATA_TYPE> slm_call{
+        static_cast<std::size_t>(wg_size) + 1, h};
+
+    h.parallel_for<k_binomial_wg<DATA_TYPE, BlockSize>>(
+        sycl::nd_range(sycl::range<1>(batch.n * wg_size),
+                       sycl::range<1>(wg_size)),
+        [=](sycl::nd_item<1> item) [[intel::kernel_args_restrict]] {
+          const std::size_t opt = item.get_group(0);
+          const int local_id = item.get_local_id(0);
+          const int block_start = BlockSize * local_id;
+          const DATA_TYPE sx = stock_price[opt];
+          const DATA_TYPE xx = option_strike[opt];
+          const lattice<DATA_TYPE> lat(option_years[opt], num_steps,
+                                       risk_free, volatility);
+
+          DATA_TYPE local_call[BlockSize + 1];
+          DATA_TYPE local_spot[BlockSize];
+          init_leaves<DATA_TYPE, BlockSize>(local_call, local_spot, sx, xx,
+                                            sign, lat, block_start, num_steps);
+          if (local_id == wg_size - 1) {
+            slm_call[wg_size] = DATA_TYPE(0);
+          }
+
+          for (int i = num_steps; i > 0; i--) {
+            slm_call[local_id] = local_call[0];
+            item.barrier(sycl::access::fence_space::local_space);
+            local_call[BlockSize] = slm_call[local_id + 1];
+            item.barrier(sycl::access::fence_space::local_space);
+            if (block_start <= i) {
+              step_back<DATA_TYPE, BlockSize>(local_call, local_spot, xx,
+                                              sign, lat, american);
+            }
+          }
+          if (local_id == 0) {
+            result[opt] = local_call[0];
+          }
+        });
+  });
+}
+
+template<typename DATA_TYPE, int BlockSize>
+sycl::event price_sub_group(sycl::queue& queue, const model<DATA_TYPE>& m,
+                            const option_batch<DATA_TYPE>& batch,
+                            const std::vector<sycl::event>& deps) {
+  constexpr int opts_per_wg = packed_wg_size / packed_sg_size;
+  const std::size_t n = batch.n;
+  const std::size_t n_groups = (n + opts_per_wg - 1) / opts_per_wg;
+  const int num_steps = m.num_steps;
+  const DATA_TYPE risk_free = m.risk_free;
+  const DATA_TYPE volatility = m.volatility;
+  const DATA_TYPE sign =
+      m.type == option_type::call ? DATA_TYPE(1) : DATA_TYPE(-1);
+  const bool american = m.exercise == exercise_type::american;
+  const DATA_TYPE* stock_price = batch.stock_price;
+  const DATA_TYPE* option_strike = batch.option_strike;
+  const DATA_TYPE* option_years = batch.option_years;
+  DATA_TYPE* result = batch.result;
+
+  return queue.submit([&](sycl::handler& h) {
+    h.depends_on(deps);
+    h.parallel_for<k_binomial_sg<DATA_TYPE, BlockSize>>(
+        sycl::nd_range(sycl::range<1>(n_groups * packed_wg_size),
+                       sycl::range<1>(packed_wg_size)),
+        [=](sycl::nd_item<1> item)
+            [[intel::kernel_args_restrict]] [[sycl::reqd_sub_group_size(
+                packed_sg_size)]] {
+              auto sg = item.get_sub_group();
+              const std::size_t opt =
+                  item.get_group(0) * opts_per_wg + sg.get_group_linear_id();
+              // Uniform across the sub-group, so the shuffles below stay
+              // convergent
+              if (opt >= n) return;
+
+              const int block_start = BlockSize * sg.get_local_linear_id();
+              const DATA_TYPE sx = stock_price[opt];
+              const DATA_TYPE xx = option_strike[opt];
+              const lattice<DATA_TYPE> lat(option_years[opt], num_steps,
+                                           risk_free, volatility);
+
+              DATA_TYPE local_call[BlockSize + 1];
+              DATA_TYPE local_spot[BlockSize];
+              init_leaves<DATA_TYPE, BlockSize>(local_call, local_spot, sx,
+                                                xx, sign, lat, block_start,
+                                                num_steps);
+
+              for (int i = num_steps; i > 0; i--) {
+                // The last lane reads past the tree; that value only reaches
+                // padding nodes
+                local_call[BlockSize] =
+                    sycl::shift_group_left(sg, local_call[0], 1);
+                if (block_start <= i) {
+                  step_back<DATA_TYPE, BlockSize>(local_call, local_spot, xx,
+                                                  sign, lat, american);
+                }
+              }
+              if (sg.leader()) {
+                result[opt] = local_call[0];
+              }
+            });
+  });
+}
+
+}  // namespace
+
+packing choose_packing(const sycl::device& device, int num_steps) {
+  if (num_steps + 1 <= packed_sg_size * max_packed_block &&
+      has_packed_sub_group(device))
+    return packing::sub_group;
+  return packing::work_group;
+}
+
+template<typename DATA_TYPE>
+sycl::event price(sycl::queue& queue, const model<DATA_TYPE>& m,
+                  const option_batch<DATA_TYPE>& batch, packing mode,
+                  const std::vector<sycl::event>& deps) {
+  if (m.num_steps < 1)
+    throw std::invalid_argument("num_steps must be positive");
+
+  const sycl::device device = queue.get_device();
+  const int leaves = m.num_steps + 1;
+  if (mode == packing::automatic) mode = choose_packing(device, m.num_steps);
+
+  if (mode == packing::sub_group) {
+    if (!has_packed_sub_group(device))
+      throw std::invalid_argument(
+          "device does not support sub-groups of 16 work-items");
+    if (leaves > packed_sg_size * max_packed_block)
+      throw std::invalid_argument("num_steps too large for sub_group packing");
+    switch (pow2_ceil((leaves + packed_sg_size - 1) / packed_sg_size)) {
+      case 1: return price_sub_group<DATA_TYPE, 1>(queue, m, batch, deps);
+      case 2: return price_sub_group<DATA_TYPE, 2>(queue, m, batch, deps);
+      case 4: return price_sub_group<DATA_TYPE, 4>(queue, m, batch, deps);
+      case 8: return price_sub_group<DATA_TYPE, 8>(queue, m, batch, deps);
+      default: return price_sub_group<DATA_TYPE, 16>(queue, m, batch, deps);
+    }
+  }
+
+  // Grow the work-group before the per work-item block, so that long trees
+  // keep their leaves in registers
+  const int max_wg_size = static_cast<int>(
+      device.get_info<sycl::info::device::max_work_group_size>());
+  int wg_size = std::min(min_wg_size, max_wg_size);
+  while (wg_size * max_wg_block < leaves && wg_size * 2 <= max_wg_size)
+    wg_size *= 2;
+  const int block_size = pow2_ceil((leaves + wg_size - 1) / wg_size);
+  if (block_size > max_wg_block)
+    throw std::invalid_argument("num_steps too large for this device");
+
+  switch (block_size) {
+    case 1: return price_work_group<DATA_TYPE, 1>(queue, m, batch, wg_size, deps);
+    case 2: return price_work_group<DATA_TYPE, 2>(queue, m, batch, wg_size, deps);
+    case 4: return price_work_group<DATA_TYPE, 4>(queue, m, batch, wg_size, deps);
+    case 8: return price_work_group<DATA_TYPE, 8>(queue, m, batch, wg_size, deps);
+    case 16: return price_work_group<DATA_TYPE, 16>(queue, m, batch, wg_size, deps);
+    default: return price_work_group<DATA_TYPE, 32>(queue, m, batch, wg_size, deps);
+  }
+}
+
+template sycl::event price<double>(sycl::queue&, const model<double>&,
+                                   const option_batch<double>&, packing,
+                                   const std::vector<sycl::event>&);
+template sycl::event price<float>(sycl::queue&, const model<float>&,
+                                  const option_batch<float>&, packing,
+                                  const std::vector<sycl::event>&);
+
+}  // namespace binomial
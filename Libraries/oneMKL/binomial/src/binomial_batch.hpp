@@ -0,0 +1,64 @@
+//==============================================================
+// Copyright © 2023 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+#ifndef __Binomial_Batch_HPP__
+#define __Binomial_Batch_HPP__
+
+#include <cstddef>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+// Binomial lattice pricer with the number of time steps, the option type
+// and the exercise style chosen at run time.
+//
+// Two mappings of options to work-items are available:
+//  - work_group: one option per work-group; each work-item owns a block of
+//    leaves and neighbouring blocks are exchanged through SLM every step.
+//  - sub_group: one option per sub-group of 16 work-items, several options
+//    per work-group; blocks are exchanged with sub-group shuffles, so no
+//    work-group barriers are needed. Only for small num_steps.
+// packing::automatic picks sub_group whenever the tree fits in a sub-group.
+namespace binomial {
+
+enum class option_type { call, put };
+enum class exercise_type { european, american };
+enum class packing { automatic, work_group, sub_group };
+
+template<typename DATA_TYPE>
+struct model {
+  int num_steps;
+  DATA_TYPE risk_free;
+  DATA_TYPE volatility;
+  option_type type = option_type::call;
+  exercise_type exercise = exercise_type::european;
+};
+
+// Structure of arrays; all pointers must be USM accessible on the device
+template<typename DATA_TYPE>
+struct option_batch {
+  std::size_t n;
+  const DATA_TYPE* stock_price;
+  const DATA_TYPE* option_strike;
+  const DATA_TYPE* option_years;
+  DATA_TYPE* result;
+};
+
+// The mapping packing::automatic resolves to on DEVICE
+packing choose_packing(const sycl::device& device, int num_steps);
+
+// Prices every option of BATCH and returns immediately. Throws
+// std::invalid_argument if num_steps is not positive, or is too large for
+// the requested packing on this device.
+template<typename DATA_TYPE>
+sycl::event price(sycl::queue& queue, const model<DATA_TYPE>& m,
+                  const option_batch<DATA_TYPE>& batch,
+                  packing mode = packing::automatic,
+                  const std::vector<sycl::event>& deps = {});
+
+}  // namespace binomial
+
+#endif  // __Binomial_Batch_HPP__
@@ -0,0 +1,184 @@
+//==============================================================
+// Copyright © 2023 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+// European and American options with binomial::price, for a long tree in
+// work-group mode and a short tree in both work-group and sub-group mode.
+// Device results are checked against a double precision host lattice.
+//
+// Usage: binomial_batch [num_options] [num_steps] [small_num_steps]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+#include "binomial.hpp"
+#include "binomial_batch.hpp"
+
+// Same lattice as the device pricer, one option at a time
+double binomial_ref_impl(double S, double X, double T, double r, double v,
+                         int steps, binomial::option_type type,
+                         binomial::exercise_type exercise) {
+  const double sign = type == binomial::option_type::call ? 1.0 : -1.0;
+  const double dt = T / steps;
+  const double v_dt = v * std::sqrt(dt);
+  const double df = std::exp(-r * dt);
+  const double u = std::exp(v_dt), d = std::exp(-v_dt);
+  const double pu = (std::exp(r * dt) - d) / (u - d);
+  const double pu_df = pu * df, pd_df = (1.0 - pu) * df;
+
+  std::vector<double> value(steps + 1), spot(steps + 1);
+  for (int j = 0; j <= steps; j++) {
+    spot[j] = S * std::exp(v_dt * (2 * j - steps));
+    value[j] = std::max(sign * (spot[j] - X), 0.0);
+  }
+  for (int i = steps; i > 0; i--) {
+    for (int j = 0; j < i; j++) {
+      value[j] = pu_df * value[j + 1] + pd_df * value[j];
+      if (exercise == binomial::exercise_type::american) {
+        spot[j] *= u;
+        value[j] = std::max(value[j], sign * (spot[j] - X));
+      }
+    }
+  }
+  return value[0];
+}
+
+template<typename DATA_TYPE>
+struct portfolio {
+  portfolio(sycl::queue& q, std::size_t n) : queue(q), n(n) {
+    for (auto** p : {&stock_price, &option_strike, &option_years, &result})
+      *p = sycl::malloc_shared<DATA_TYPE>(n, queue);
+
+    constexpr int rand_seed = 777;
+    std::mt19937_64 engine(rand_seed);
+    std::uniform_real_distribution<DATA_TYPE> spot(5.0, 50.0),
+        strike(10.0, 25.0), years(1.0, 5.0);
+    for (std::size_t opt = 0; opt < n; opt++) {
+      stock_price[opt] = spot(engine);
+      option_strike[opt] = strike(engine);
+      option_years[opt] = years(engine);
+    }
+  }
+  ~portfolio() {
+    for (auto* p : {stock_price, option_strike, option_years, result})
+      sycl::free(p, queue);
+  }
+
+  binomial::option_batch<DATA_TYPE> batch() const {
+    return {n, stock_price, option_strike, option_years, result};
+  }
+
+  // L1 norm against the host lattice over the first options; the host
+  // reference is O(num_steps^2) per option
+  double error(const binomial::model<DATA_TYPE>& m) const {
+    const std::size_t n_ref =
+        std::min<std::size_t>(n, m.num_steps > 512 ? 256 : 4096);
+    double sum_delta = 0.0, sum_ref = 0.0;
+    for (std::size_t opt = 0; opt < n_ref; opt++) {
+      const double ref = binomial_ref_impl(
+          stock_price[opt], option_strike[opt], option_years[opt],
+          m.risk_free, m.volatility, m.num_steps, m.type, m.exercise);
+      sum_delta += std::fabs(ref - result[opt]);
+      sum_ref += std::fabs(ref);
+    }
+    return sum_ref > 1E-5 ? sum_delta / sum_ref : sum_delta / n_ref;
+  }
+
+  sycl::queue& queue;
+  std::size_t n;
+  DATA_TYPE *stock_price, *option_strike, *option_years, *result;
+};
+
+template<typename DATA_TYPE>
+bool measure(sycl::queue& queue, portfolio<DATA_TYPE>& data,
+             binomial::option_type type, binomial::exercise_type exercise,
+             int steps, binomial::packing mode) {
+  const binomial::model<DATA_TYPE> m{steps, risk_free, volatility, type,
+                                     exercise};
+  if (mode == binomial::packing::automatic)
+    mode = binomial::choose_packing(queue.get_device(), steps);
+
+  binomial::price(queue, m, data.batch(), mode).wait();  // JIT, migration
+  timer t{};
+  binomial::price(queue, m, data.batch(), mode).wait();
+  t.stop();
+
+  const double error = data.error(m);
+  std::printf("%-9s %-5s %6d %-11s %16.3f %14.3E %s\n",
+              exercise == binomial::exercise_type::american ? "american"
+                                                            : "european",
+              type == binomial::option_type::call ? "call" : "put", steps,
+              mode == binomial::packing::sub_group ? "sub_group" : "work_group",
+              static_cast<double>(data.n) / t.duration(), error,
+              error < 5e-4 ? "PASSED" : "FAILED");
+  return error < 5e-4;
+}
+
+template<typename DATA_TYPE>
+bool run(std::size_t n, int steps, int small_steps) {
+  using binomial::exercise_type;
+  using binomial::option_type;
+  using binomial::packing;
+
+  sycl::queue queue;
+  std::printf(
+      "%s Precision Binomial Option Pricing running on %s, %zu options.\n",
+      sizeof(DATA_TYPE) > 4 ? "Double" : "Single",
+      queue.get_device().get_info<sycl::info::device::name>().c_str(), n);
+  std::printf("%-9s %-5s %6s %-11s %16s %14s\n", "Exercise", "Type", "Steps",
+              "Packing", "Options/s", "L1 norm");
+
+  portfolio<DATA_TYPE> data(queue, n);
+  bool passed = true;
+  for (auto exercise : {exercise_type::european, exercise_type::american})
+    for (auto type : {option_type::call, option_type::put})
+      passed &= measure(queue, data, type, exercise, steps, packing::automatic);
+
+  const bool packed = binomial::choose_packing(queue.get_device(),
+                                               small_steps) ==
+                      packing::sub_group;
+  for (auto exercise : {exercise_type::european, exercise_type::american}) {
+    passed &= measure(queue, data, option_type::put, exercise, small_steps,
+                      packing::work_group);
+    if (packed)
+      passed &= measure(queue, data, option_type::put, exercise, small_steps,
+                        packing::sub_group);
+  }
+  return passed;
+}
+
+int main(int argc, char** argv) {
+  const std::size_t n = argc > 1 ? std::stoull(argv[1]) : 256 * 1024;
+  const int steps = argc > 2 ? std::stoi(argv[2]) : 2048;
+  const int small_steps = argc > 3 ? std::stoi(argv[3]) : 100;
+
+  bool passed;
+  try {
+    if (sycl::queue{}.get_device().has(sycl::aspect::fp64)) {
+      passed = run<double>(n, steps, small_steps);
+    } else {
+      std::printf(
+          "Warning: could not find a device with double precision support. "
+          "Single precision is used.\n");
+      passed = run<float>(n, steps, small_steps);
+    }
+  } catch (std::exception const& e) {
+    std::printf("%s\n", e.what());
+    return 1;
+  }
+
+  if (!passed) {
+    std::printf("TEST FAILED\n");
+    return 1;
+  }
+  std::printf("TEST PASSED\n");
+  return 0;
+}
@@ -0,0 +1,292 @@
+//==============================================================
+// Copyright © 2023 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <sycl/sycl.hpp>
+
+#include "bs_batch.hpp"
+
+namespace bs {
+
+// Square root of t from its COMPUTE_TYPE approximation: one Newton step in
+// DATA_TYPE when the two types differ. For float approximations y*y is exact
+// in double, so the step leaves an error of a few double ulps.
+template<typename DATA_TYPE, typename COMPUTE_TYPE>
+static inline DATA_TYPE refine_sqrt(DATA_TYPE t, COMPUTE_TYPE sqrt_t)
+{
+    const DATA_TYPE y = sqrt_t;
+    if constexpr (std::is_same_v<DATA_TYPE, COMPUTE_TYPE>)
+        return y;
+    else
+        return y + (t - y * y) / (DATA_TYPE(2) * y);
+}
+
+/******* SYCL device *******/
+
+template<typename DATA_TYPE, typename COMPUTE_TYPE>
+class k_BlackScholesBatch;
+
+template<typename DATA_TYPE, typename COMPUTE_TYPE>
+static sycl::event submit_batch(sycl::queue& queue, const option_batch<DATA_TYPE>& batch,
+                                const std::vector<sycl::event>& deps)
+{
+    const std::size_t n = batch.n;
+    const std::size_t wg_size = std::min<std::size_t>(256,
+        queue.get_device().get_info<sycl::info::device::max_work_group_size>());
+    const std::size_t global_size = (n + wg_size - 1) / wg_size * wg_size;
+
+    const DATA_TYPE* stock_price = batch.stock_price;
+    const DATA_TYPE* option_strike = batch.option_strike;
+    const DATA_TYPE* option_years = batch.option_years;
+    const DATA_TYPE* risk_free = batch.risk_free;
+    const DATA_TYPE* volatility = batch.volatility;
+    DATA_TYPE* call_result = batch.call_result;
+    DATA_TYPE* put_result = batch.put_result;
+
+    return queue.submit([&](sycl::handler& cgh) {
+        cgh.depends_on(deps);
+        cgh.parallel_for<k_BlackScholesBatch<DATA_TYPE, COMPUTE_TYPE>>(
+            sycl::nd_range(sycl::range<1>(global_size), sycl::range<1>(wg_size)),
+            [=](sycl::nd_item<1> item) [[intel::kernel_args_restrict]] {
+                const std::size_t opt = item.get_global_linear_id();
+                if (opt >= n)
+                    return;
+                constexpr DATA_TYPE sqrt1_2 = 0.707106781186547524401;
+                const DATA_TYPE s = stock_price[opt];
+                const DATA_TYPE t = option_years[opt];
+                const DATA_TYPE x = option_strike[opt];
+                const DATA_TYPE r = risk_free[opt];
+                const DATA_TYPE sigma = volatility[opt];
+                // Evaluated in COMPUTE_TYPE, refined in DATA_TYPE
+                const COMPUTE_TYPE log_sx = sycl::log(static_cast<COMPUTE_TYPE>(s / x));
+                const DATA_TYPE sqrt_t = refine_sqrt(t, sycl::sqrt(static_cast<COMPUTE_TYPE>(t)));
+                const DATA_TYPE v_sqrt = sigma * sqrt_t;
+                const DATA_TYPE d1 = (static_cast<DATA_TYPE>(log_sx) + (r + DATA_TYPE(0.5) * sigma * sigma) * t) / v_sqrt;
+                const DATA_TYPE d2 = d1 - v_sqrt;
+                const DATA_TYPE n_d1 = DATA_TYPE(1. / 2.) + DATA_TYPE(1. / 2.) * sycl::erf(d1 * sqrt1_2);
+                const DATA_TYPE n_d2 = DATA_TYPE(1. / 2.) + DATA_TYPE(1. / 2.) * sycl::erf(d2 * sqrt1_2);
+                const DATA_TYPE exp_rt = sycl::exp(-r * t);
+
+                const DATA_TYPE XexpRT = x * exp_rt;
+                const DATA_TYPE call_val = s * n_d1 - XexpRT * n_d2;
+                call_result[opt] = call_val;
+                put_result[opt] = call_val + XexpRT - s;
+            });
+    });
+}
+
+template<typename DATA_TYPE>
+sycl::event price_device(sycl::queue& queue, const option_batch<DATA_TYPE>& batch, const std::vector<sycl::event>& deps)
+{
+    return submit_batch<DATA_TYPE, DATA_TYPE>(queue, batch, deps);
+}
+
+sycl::event price_device_mixed(sycl::queue& queue, const option_batch<double>& batch, const std::vector<sycl::event>& deps)
+{
+    return submit_batch<double, float>(queue, batch, deps);
+}
+
+template sycl::event price_device<float>(sycl::queue&, const option_batch<float>&, const std::vector<sycl::event>&);
+template sycl::event price_device<double>(sycl::queue&, const option_batch<double>&, const std::vector<sycl::event>&);
+
+/******* Host SIMD *******/
+
+// Polynomial approximations used by the host path. They are branch-free
+// (selects only) and inlined into the "omp simd" loop below, so the
+// compiler emits one vector instruction stream for the whole formula.
+// Inputs are assumed to be finite; log_poly expects a positive normal
+// argument.
+
+template<typename T> struct fp_traits;
+template<> struct fp_traits<float> {
+    using bits_t = std::int32_t;
+    static constexpr int mantissa_bits = 23;
+    static constexpr bits_t bias = 127;
+    static constexpr int exp_terms = 7;    // |y| <= ln2/2: error < 6e-9
+    static constexpr int log_terms = 5;    // |s| <= 0.172: error < 2e-9
+};
+template<> struct fp_traits<double> {
+    using bits_t = std::int64_t;
+    static constexpr int mantissa_bits = 52;
+    static constexpr bits_t bias = 1023;
+    static constexpr int exp_terms = 13;
+    static constexpr int log_terms = 12;
+};
+
+template<typename T>
+static inline T from_bits(typename fp_traits<T>::bits_t bits)
+{
+    T value;
+    std::memcpy(&value, &bits, sizeof(T));
+    return value;
+}
+
+template<typename T>
+static inline typename fp_traits<T>::bits_t to_bits(T value)
+{
+    typename fp_traits<T>::bits_t bits;
+    std::memcpy(&bits, &value, sizeof(T));
+    return bits;
+}
+
+// Cody-Waite split of ln(2): LN2_HI has enough trailing zero bits for
+// k*LN2_HI to be exact
+constexpr double LN2_HI = 0.693145751953125;
+constexpr double LN2_LO = 1.42860682030941723212e-6;
+
+// e^x = 2^k * e^y, y = x - k*ln2, e^y by its Taylor polynomial
+template<typename T>
+static inline T exp_poly(T x)
+{
+    using traits = fp_traits<T>;
+    constexpr T log2e = 1.44269504088896340736;
+    x = std::min(std::max(x, T(1 - traits::bias) * T(0.693147180559945309417)),
+                 T(traits::bias) * T(0.693147180559945309417));
+    const T k = std::floor(x * log2e + T(0.5));
+    const T y = (x - k * T(LN2_HI)) - k * T(LN2_LO);
+    T p = T(1);
+    for (int i = traits::exp_terms; i >= 1; --i)
+        p = T(1) + y * p * (T(1) / T(i));
+    const auto e = static_cast<typename traits::bits_t>(k) + traits::bias;
+    return p * from_bits<T>(e << traits::mantissa_bits);
+}
+
+// ln z = e*ln2 + ln m, m in [sqrt(0.5), sqrt(2)), ln m = 2 atanh((m-1)/(m+1))
+template<typename T>
+static inline T log_poly(T z)
+{
+    using traits = fp_traits<T>;
+    using bits_t = typename traits::bits_t;
+    constexpr bits_t mantissa_mask = (bits_t(1) << traits::mantissa_bits) - 1;
+    const bits_t bits = to_bits(z);
+    bits_t e = (bits >> traits::mantissa_bits) - traits::bias;
+    T m = from_bits<T>((bits & mantissa_mask) | (traits::bias << traits::mantissa_bits));
+    const bool big = m > T(1.41421356237309504880);
+    m = big ? m * T(0.5) : m;
+    e = big ? e + 1 : e;
+    const T s = (m - T(1)) / (m + T(1));
+    const T w = s * s;
+    T p = T(1) / T(2 * traits::log_terms + 1);
+    for (int k = traits::log_terms - 1; k >= 0; --k)
+        p = p * w + T(1) / T(2 * k + 1);
+    const T ef = static_cast<T>(e);
+    return ef * T(LN2_HI) + (ef * T(LN2_LO) + T(2) * s * p);
+}
+
+// Standard normal CDF
+template<typename T>
+static inline T cndf_poly(T input);
+
+// Abramowitz & Stegun 26.2.17, absolute error < 7.5e-8 (same as CNDF_C in
+// black_scholes_sycl.cpp)
+template<>
+inline float cndf_poly<float>(float input)
+{
+    constexpr float inv_sqrt_2xPI = 0.39894228040143270286f;
+    constexpr float CNDF_C1 = 0.2316419f;
+    constexpr float CNDF_C2 = 0.319381530f;
+    constexpr float CNDF_C3 = -0.356563782f;
+    constexpr float CNDF_C4 = 1.781477937f;
+    constexpr float CNDF_C5 = -1.821255978f;
+    constexpr float CNDF_C6 = 1.330274429f;
+
+    const float x = std::fabs(input);
+    const float k = 1.0f / (1.0f + CNDF_C1 * x);
+    const float poly = k * (CNDF_C2 + k * (CNDF_C3 + k * (CNDF_C4 + k * (CNDF_C5 + k * CNDF_C6))));
+    const float tail = inv_sqrt_2xPI * exp_poly(-0.5f * x * x) * poly;
+    return (input < 0.0f) ? tail : 1.0f - tail;
+}
+
+// Hart's rational approximation (as given by G. West, "Better
+// approximations to cumulative normal functions"), double precision
+template<>
+inline double cndf_poly<double>(double input)
+{
+    const double x = std::min(std::fabs(input), 37.0);
+    const double e = exp_poly(-0.5 * x * x);
+
+    double num = 3.52624965998911e-02 * x + 0.700383064443688;
+    num = num * x + 6.37396220353165;
+    num = num * x + 33.912866078383;
+    num = num * x + 112.079291497871;
+    num = num * x + 221.213596169931;
+    num = num * x + 220.206867912376;
+    double den = 8.83883476483184e-02 * x + 1.75566716318264;
+    den = den * x + 16.064177579207;
+    den = den * x + 86.7807322029461;
+    den = den * x + 296.564248779674;
+    den = den * x + 637.333633378831;
+    den = den * x + 793.826512519948;
+    den = den * x + 440.413735824752;
+    const double near_tail = e * num / den;
+
+    double cf = x + 0.65;
+    cf = x + 4.0 / cf;
+    cf = x + 3.0 / cf;
+    cf = x + 2.0 / cf;
+    cf = x + 1.0 / cf;
+    const double far_tail = e / cf / 2.506628274631;
+
+    const double tail = (x < 7.07106781186547) ? near_tail : far_tail;
+    return (input < 0.0) ? tail : 1.0 - tail;
+}
+
+template<typename DATA_TYPE, typename COMPUTE_TYPE>
+static void price_host_impl(const option_batch<DATA_TYPE>& batch)
+{
+    const std::size_t n = batch.n;
+    const DATA_TYPE* __restrict stock_price = batch.stock_price;
+    const DATA_TYPE* __restrict option_strike = batch.option_strike;
+    const DATA_TYPE* __restrict option_years = batch.option_years;
+    const DATA_TYPE* __restrict risk_free = batch.risk_free;
+    const DATA_TYPE* __restrict volatility = batch.volatility;
+    DATA_TYPE* __restrict call_result = batch.call_result;
+    DATA_TYPE* __restrict put_result = batch.put_result;
+
+#pragma omp simd
+    for (std::size_t opt = 0; opt < n; opt++) {
+        const DATA_TYPE s = stock_price[opt];
+        const DATA_TYPE t = option_years[opt];
+        const DATA_TYPE x = option_strike[opt];
+        const DATA_TYPE r = risk_free[opt];
+        const DATA_TYPE sigma = volatility[opt];
+        // Evaluated in COMPUTE_TYPE, refined in DATA_TYPE
+        const COMPUTE_TYPE log_sx = log_poly(static_cast<COMPUTE_TYPE>(s / x));
+        const DATA_TYPE sqrt_t = refine_sqrt(t, std::sqrt(static_cast<COMPUTE_TYPE>(t)));
+        const DATA_TYPE v_sqrt = sigma * sqrt_t;
+        const DATA_TYPE d1 = (static_cast<DATA_TYPE>(log_sx) + (r + DATA_TYPE(0.5) * sigma * sigma) * t) / v_sqrt;
+        const DATA_TYPE d2 = d1 - v_sqrt;
+        const DATA_TYPE n_d1 = cndf_poly(d1);
+        const DATA_TYPE n_d2 = cndf_poly(d2);
+        const DATA_TYPE exp_rt = exp_poly(-r * t);
+
+        const DATA_TYPE XexpRT = x * exp_rt;
+        const DATA_TYPE call_val = s * n_d1 - XexpRT * n_d2;
+        call_result[opt] = call_val;
+        put_result[opt] = call_val + XexpRT - s;
+    }
+}
+
+template<typename DATA_TYPE>
+void price_host(const option_batch<DATA_TYPE>& batch)
+{
+    price_host_impl<DATA_TYPE, DATA_TYPE>(batch);
+}
+
+void price_host_mixed(const option_batch<double>& batch)
+{
+    price_host_impl<double, float>(batch);
+}
+
+template void price_host<float>(const option_batch<float>&);
+template void price_host<double>(const option_batch<double>&);
+
+} // namespace bs
@@ -0,0 +1,60 @@
+//==============================================================
+// Copyright © 2023 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+#ifndef __BS_BATCH_HPP__
+#define __BS_BATCH_HPP__
+
+#include <cstddef>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+// Batch Black-Scholes pricer (libbs_batch).
+//
+// Prices European call and put options given per-option spot, strike,
+// maturity, risk-free rate and volatility, stored as separate arrays
+// (structure of arrays). The same formula is available
+//   - on a SYCL device (price_device), with pointers to USM allocations
+//     accessible on the queue's device, and
+//   - on the host (price_host), as an explicitly vectorized loop built on
+//     polynomial approximations of exp, log and the normal CDF.
+// The *_mixed variants take double precision inputs and outputs. They
+// evaluate log(S/X) and sqrt(T) in single precision and refine in double
+// precision: sqrt(T) by one Newton step, then d1, d2, the normal CDF and the
+// discount factor are recomputed in double from these values. The rounding
+// error of the logarithm shifts d1 and d2 alike, which leaves the price
+// unchanged to first order (S * N'(d1) = X * exp(-rT) * N'(d2)), so the
+// prices are close to double precision ones.
+
+namespace bs {
+
+template<typename DATA_TYPE>
+struct option_batch {
+    std::size_t n;
+    const DATA_TYPE* stock_price;
+    const DATA_TYPE* option_strike;
+    const DATA_TYPE* option_years;
+    const DATA_TYPE* risk_free;
+    const DATA_TYPE* volatility;
+    DATA_TYPE* call_result;
+    DATA_TYPE* put_result;
+};
+
+// Single and double precision pricing
+template<typename DATA_TYPE>
+sycl::event price_device(sycl::queue& queue, const option_batch<DATA_TYPE>& batch,
+                         const std::vector<sycl::event>& deps = {});
+template<typename DATA_TYPE>
+void price_host(const option_batch<DATA_TYPE>& batch);
+
+// Single precision evaluation, double precision refinement
+sycl::event price_device_mixed(sycl::queue& queue, const option_batch<double>& batch,
+                               const std::vector<sycl::event>& deps = {});
+void price_host_mixed(const option_batch<double>& batch);
+
+} // namespace bs
+
+#endif // __BS_BATCH_HPP__
@@ -0,0 +1,174 @@
+//==============================================================
+// Copyright © 2023 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+// Throughput of the libbs_batch pricer on the SYCL device and on the host
+// for single, mixed and double precision, and the accuracy gained by the
+// double precision refinement of the mixed variants.
+//
+// Usage: bs_batch_bench [num_options] [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include <sycl/sycl.hpp>
+
+#include "black_scholes.hpp"
+#include "bs_batch.hpp"
+
+template<typename DATA_TYPE>
+struct portfolio {
+    portfolio(sycl::queue& q, std::size_t n) : queue(q)
+    {
+        allocate(n);
+
+        // Generated on the host, so that double precision data can be used
+        // by the host pricer on devices without fp64 support
+        constexpr int rand_seed = 777;
+        std::mt19937_64 engine(rand_seed);
+        std::uniform_real_distribution<DATA_TYPE> spot(5.0, 50.0), strike(10.0, 25.0), years(1.0, 5.0);
+        std::uniform_real_distribution<DATA_TYPE> rate(0.01, 0.05), sigma(0.10, 0.50);
+        for (std::size_t opt = 0; opt < n; opt++) {
+            stock_price[opt] = spot(engine);
+            option_strike[opt] = strike(engine);
+            option_years[opt] = years(engine);
+            risk_free[opt] = rate(engine);
+            volatility[opt] = sigma(engine);
+        }
+    }
+    // Copy of the inputs of "source" rounded to DATA_TYPE
+    template<typename SOURCE_TYPE>
+    portfolio(sycl::queue& q, const portfolio<SOURCE_TYPE>& source) : queue(q)
+    {
+        allocate(source.batch.n);
+        for (std::size_t opt = 0; opt < batch.n; opt++) {
+            stock_price[opt] = source.stock_price[opt];
+            option_strike[opt] = source.option_strike[opt];
+            option_years[opt] = source.option_years[opt];
+            risk_free[opt] = source.risk_free[opt];
+            volatility[opt] = source.volatility[opt];
+        }
+    }
+    ~portfolio()
+    {
+        for (auto* p : {stock_price, option_strike, option_years, risk_free, volatility, call_result, put_result})
+            sycl::free(p, queue);
+    }
+
+    void allocate(std::size_t n)
+    {
+        for (auto** p : {&stock_price, &option_strike, &option_years, &risk_free, &volatility, &call_result, &put_result})
+            *p = sycl::malloc_shared<DATA_TYPE>(n, queue);
+        batch = {n, stock_price, option_strike, option_years, risk_free, volatility, call_result, put_result};
+    }
+
+    // L1 norm of the call price error against BlackScholesRefImpl
+    double error() const { return error(*this); }
+
+    // The same, with the reference computed from the inputs of "source"
+    // (the unrounded inputs of a copy)
+    template<typename SOURCE_TYPE>
+    double error(const portfolio<SOURCE_TYPE>& source) const
+    {
+        double sum_delta = 0.0, sum_ref = 0.0;
+        for (std::size_t opt = 0; opt < batch.n; opt++) {
+            double ref;
+            BlackScholesRefImpl(ref, source.stock_price[opt], source.option_strike[opt], source.option_years[opt],
+                                source.risk_free[opt], source.volatility[opt]);
+            sum_delta += std::fabs(ref - call_result[opt]);
+            sum_ref += std::fabs(ref);
+        }
+        return sum_delta / sum_ref;
+    }
+
+    sycl::queue& queue;
+    DATA_TYPE *stock_price, *option_strike, *option_years, *risk_free, *volatility, *call_result, *put_result;
+    bs::option_batch<DATA_TYPE> batch;
+};
+
+constexpr double tolerance = 5e-4;
+
+// Returns the L1 norm of the call price error
+template<typename DATA_TYPE, typename Body>
+static double measure(const char* target, const char* precision, portfolio<DATA_TYPE>& data, int iterations, Body&& body)
+{
+    body(); // warm-up (JIT compilation, page migration)
+    timer t{};
+    for (int i = 0; i < iterations; i++)
+        body();
+    t.stop();
+
+    const double error = data.error();
+    // Pricing Call and Put options at the same time, so 2*num_options
+    const double options_per_second = 2.0 * data.batch.n * iterations / t.duration();
+    std::printf("%-8s %-8s %14.5f %14.3E %s\n", target, precision, options_per_second / 1e9, error,
+                error < tolerance ? "PASSED" : "FAILED");
+    return error;
+}
+
+// Single precision pricing of "data" rounded to float, against the
+// reference of the double precision inputs
+template<typename Body>
+static double single_error(sycl::queue& queue, const portfolio<double>& data, Body&& body)
+{
+    portfolio<float> rounded(queue, data);
+    body(rounded.batch);
+    return rounded.error(data);
+}
+
+int main(int const argc, char const* argv[])
+{
+    const std::size_t n = argc > 1 ? std::stoull(argv[1]) : 4 * 1024 * 1024;
+    const int iterations = argc > 2 ? std::stoi(argv[2]) : 32;
+
+    sycl::queue queue;
+    const bool is_fp64 = queue.get_device().has(sycl::aspect::fp64);
+
+    std::printf("Batch Black&Scholes Option Pricing, %zu options, %d iterations\n", n, iterations);
+    std::printf("Device: %s\n\n", queue.get_device().get_info<sycl::info::device::name>().c_str());
+    std::printf("%-8s %-8s %14s %14s\n", "Target", "Mode", "GOptions/s", "L1 norm");
+
+    bool passed = true;
+    {
+        portfolio<float> data(queue, n);
+        passed &= measure("device", "single", data, iterations, [&] { bs::price_device(queue, data.batch).wait(); }) < tolerance;
+        passed &= measure("host", "single", data, iterations, [&] { bs::price_host(data.batch); }) < tolerance;
+    }
+    {
+        portfolio<double> data(queue, n);
+        double device_mixed = 0.0;
+        if (is_fp64) {
+            device_mixed = measure("device", "mixed", data, iterations, [&] { bs::price_device_mixed(queue, data.batch).wait(); });
+            passed &= device_mixed < tolerance;
+            passed &= measure("device", "double", data, iterations, [&] { bs::price_device(queue, data.batch).wait(); }) < tolerance;
+        } else {
+            std::printf("%-8s %-8s %14s\n", "device", "mixed", "no fp64");
+            std::printf("%-8s %-8s %14s\n", "device", "double", "no fp64");
+        }
+        const double host_mixed = measure("host", "mixed", data, iterations, [&] { bs::price_host_mixed(data.batch); });
+        passed &= host_mixed < tolerance;
+        passed &= measure("host", "double", data, iterations, [&] { bs::price_host(data.batch); }) < tolerance;
+
+        // Accuracy gained by the refinement: the same options priced in
+        // single precision from their inputs rounded to float
+        std::printf("\nRefinement of the mixed variants, L1 norm on the double precision data:\n");
+        std::printf("%-8s %14s %14s %14s\n", "Target", "single", "mixed", "gain");
+        if (is_fp64) {
+            const double device_single = single_error(queue, data, [&](auto& batch) { bs::price_device(queue, batch).wait(); });
+            std::printf("%-8s %14.3E %14.3E %14.1E\n", "device", device_single, device_mixed, device_single / device_mixed);
+        }
+        const double host_single = single_error(queue, data, [&](auto& batch) { bs::price_host(batch); });
+        std::printf("%-8s %14.3E %14.3E %14.1E\n", "host", host_single, host_mixed, host_single / host_mixed);
+    }
+
+    if (!passed) {
+        std::printf("TEST FAILED\n");
+        return 1;
+    }
+    std::printf("TEST PASSED\n");
+    return 0;
+}
@@ -8,9 +8,14 @@
 *
 *  Content:
 *      Function DPBLTRF for Cholesky factorization of symmetric
-*         positive definite block tridiagonal matrix.
+*         positive definite block tridiagonal matrix;
+*      Functions DPBLTRF_LOOKAHEAD and DPBLTRF_HYBRID for the same
+*         factorization pipelined through events (all on the device, or
+*         with diagonal blocks factored by host LAPACK).
 ************************************************************************/
 #include <cstdint>
+#include <limits>
+#include <vector>
 
 #include <sycl/sycl.hpp>
 #include "oneapi/mkl.hpp"
@@ -171,3 +176,250 @@ int64_t dpbltrf(sycl::queue queue, int64_t n, int64_t nb, double* d, int64_t ldd
 cleanup:
     return info;
 }
+
+
+
+// Stores in *INFO the 'global' order of the first leading minor which is
+// not positive definite, or 0 if there is none. POTRF leaves a failing
+// diagonal element non-positive (or NaN), and everything computed after it
+// inherits it, so the first diagonal element of L that is not positive
+// identifies the failure.
+static sycl::event find_nonpositive_diag(sycl::queue& queue, int64_t n, int64_t nb, const double* d, int64_t ldd,
+                                         int64_t* info, const std::vector<sycl::event>& deps) {
+    constexpr int64_t none = std::numeric_limits<int64_t>::max();
+    auto event1 = queue.fill(info, none, 1, deps);
+    auto event2 = queue.submit([&](sycl::handler& cgh) {
+        cgh.depends_on(event1);
+        cgh.parallel_for(sycl::range<1>(n*nb), [=](sycl::id<1> it) {
+            const int64_t g = it[0];
+            if (!(d[(g % nb) + g*ldd] > 0.0)) {
+                sycl::atomic_ref<int64_t, sycl::memory_order::relaxed, sycl::memory_scope::device,
+                                 sycl::access::address_space::global_space> first(*info);
+                first.fetch_min(g + 1);
+            }
+        });
+    });
+    return queue.submit([&](sycl::handler& cgh) {
+        cgh.depends_on(event2);
+        cgh.single_task([=]() {
+            if (*info == none)
+                *info = 0;
+        });
+    });
+}
+
+/************************************************************************
+* Pipelined block Cholesky factorization.
+*
+* Every diagonal block is split into
+*     D_K = ( D11      )   D11 is H by H, D22 is R by R, H + R = NB,
+*           ( D21  D22 )
+* and every sub-diagonal block into its column halves B_K = (B1 B2).
+* Step K then consists of
+*     L11 = chol(D11);  D21 := D21*L11^-t;  D22 := D22 - D21*D21^t;
+*     L22 = chol(D22);
+*     B1 := B1*L11^-t;  B2 := (B2 - B1*L21^t)*L22^-t;
+*     D_K+1 := D_K+1 - B1*B1^t - B2*B2^t,
+* with the B2*B2^t update split along the rows of D_K+1 so that the
+* factorization of D11 of the next block is submitted as soon as its own
+* update lands, while the updates of D21 and D22 are still in flight.
+* Likewise B1 and the B1*B1^t part of the update need only L11 and proceed
+* while L22 is being computed. All steps are chained through events; the
+* host waits only once, at the end.
+*
+* FACTOR(a, m, deps) submits the Cholesky factorization of the M by M
+* lower triangle stored at A (leading dimension LDD) and returns its event.
+************************************************************************/
+template <typename Factor>
+static int64_t dpbltrf_pipelined(sycl::queue& queue, int64_t n, int64_t nb, double* d, int64_t ldd, double* b, int64_t ldb,
+                                 int64_t* dinfo, Factor&& factor) {
+
+    // Matrix accessors
+    auto D = [=](int64_t i, int64_t j) -> double* { return &d[(i) + (j)*ldd]; };
+    auto B = [=](int64_t i, int64_t j) -> double* { return &b[(i) + (j)*ldb]; };
+
+    const int64_t h = nb / 2;
+    const int64_t r = nb - h;
+
+    // Pending updates of D11, D21 and D22 of the next diagonal block
+    sycl::event update11, update21, update22;
+    sycl::event last;
+
+    for (int64_t k = 0; k < n; k++) {
+        auto event1 = factor(D(0,k*nb), h, std::vector<sycl::event>{update11});
+        auto event2 = mkl::blas::trsm(queue, mkl::side::right, mkl::uplo::lower, mkl::transpose::trans,
+                mkl::diag::nonunit, r, h, 1.0, D(0,k*nb), ldd, D(h,k*nb), ldd, {event1, update21});
+        auto event3 = mkl::blas::syrk(queue, mkl::uplo::lower, mkl::transpose::nontrans, r, h,
+                -1.0, D(h,k*nb), ldd, 1.0, D(h,k*nb+h), ldd, {event2, update22});
+        auto event4 = factor(D(h,k*nb+h), r, std::vector<sycl::event>{event3});
+        if (k == n-1) {
+            last = event4;
+            break;
+        }
+
+        // Sub-diagonal block, first columns need L11 only
+        auto event5 = mkl::blas::trsm(queue, mkl::side::right, mkl::uplo::lower, mkl::transpose::trans,
+                mkl::diag::nonunit, nb, h, 1.0, D(0,k*nb), ldd, B(0,k*nb), ldb, {event1});
+        auto event6 = mkl::blas::syrk(queue, mkl::uplo::lower, mkl::transpose::nontrans, nb, h,
+                -1.0, B(0,k*nb), ldb, 1.0, D(0,(k+1)*nb), ldd, {event5});
+        auto event7 = mkl::blas::gemm(queue, mkl::transpose::nontrans, mkl::transpose::trans, nb, r, h,
+                -1.0, B(0,k*nb), ldb, D(h,k*nb), ldd, 1.0, B(0,k*nb+h), ldb, {event5, event2});
+        auto event8 = mkl::blas::trsm(queue, mkl::side::right, mkl::uplo::lower, mkl::transpose::trans,
+                mkl::diag::nonunit, nb, r, 1.0, D(h,k*nb+h), ldd, B(0,k*nb+h), ldb, {event7, event4});
+
+        // Remaining update of the next diagonal block, split by rows
+        update11 = mkl::blas::syrk(queue, mkl::uplo::lower, mkl::transpose::nontrans, h, r,
+                -1.0, B(0,k*nb+h), ldb, 1.0, D(0,(k+1)*nb), ldd, {event8, event6});
+        update21 = mkl::blas::gemm(queue, mkl::transpose::nontrans, mkl::transpose::trans, r, h, r,
+                -1.0, B(h,k*nb+h), ldb, B(0,k*nb+h), ldb, 1.0, D(h,(k+1)*nb), ldd, {event8, event6});
+        update22 = mkl::blas::syrk(queue, mkl::uplo::lower, mkl::transpose::nontrans, r, r,
+                -1.0, B(h,k*nb+h), ldb, 1.0, D(h,(k+1)*nb+h), ldd, {event8, event6});
+    }
+
+    find_nonpositive_diag(queue, n, nb, d, ldd, dinfo, {last}).wait_and_throw();
+    return *dinfo;
+}
+
+/************************************************************************
+* Definition:
+* ===========
+*   int64_t dpbltrf_lookahead(sycl::queue queue, int64_t n, int64_t nb, double* d, int64_t ldd, double* b, int64_t ldb) {
+*
+* Purpose:
+* ========
+* DPBLTRF_LOOKAHEAD computes the same factorization as DPBLTRF, with all
+* steps pipelined on the device (see DPBLTRF_PIPELINED above). Use an
+* out-of-order queue to let independent steps overlap.
+*
+* Arguments and INFO are the same as for DPBLTRF; additionally
+*     = -1000     memory buffer could not be allocated
+***********************************************************************/
+int64_t dpbltrf_lookahead(sycl::queue queue, int64_t n, int64_t nb, double* d, int64_t ldd, double* b, int64_t ldb) {
+
+    int64_t info = 0;
+    if (n < 0)
+        info = -1;
+    else if (nb < 0)
+        info = -2;
+    else if (ldd < nb)
+        info = -4;
+    else if (ldb < nb)
+        info = -6;
+
+    if (info)
+        return info;
+    if (n == 0 || nb < 2)
+        return dpbltrf(queue, n, nb, d, ldd, b, ldb);
+
+    sycl::context context = queue.get_context();
+    sycl::device device = queue.get_device();
+
+    // All POTRF calls are ordered by the pipeline, so they share one scratchpad
+    std::int64_t scratchpad_size = mkl::lapack::potrf_scratchpad_size<double>(queue, mkl::uplo::lower, nb - nb/2, ldd);
+    double* scratchpad = sycl::malloc_device<double>(scratchpad_size, device, context);
+    int64_t* dinfo = sycl::malloc_shared<int64_t>(1, device, context);
+    if ((scratchpad_size != 0 && !scratchpad) || !dinfo) {
+        info = -1000;
+        goto cleanup;
+    }
+
+    try {
+        info = dpbltrf_pipelined(queue, n, nb, d, ldd, b, ldb, dinfo,
+            [&](double* a, int64_t m, const std::vector<sycl::event>& deps) {
+                return mkl::lapack::potrf(queue, mkl::uplo::lower, m, a, ldd, scratchpad, scratchpad_size, deps);
+            });
+    } catch(mkl::lapack::exception const& e) {
+        // Handle LAPACK related exceptions happened during synchronous call
+        queue.wait();
+        std::cout << "Unexpected exception caught during synchronous call to LAPACK API:\ninfo: " << e.info() << std::endl;
+        info = e.info();
+    }
+
+cleanup:
+    sycl::free(dinfo, context);
+    sycl::free(scratchpad, context);
+    return info;
+}
+
+/************************************************************************
+* Definition:
+* ===========
+*   int64_t dpbltrf_hybrid(sycl::queue queue, int64_t n, int64_t nb, double* d, int64_t ldd, double* b, int64_t ldb) {
+*
+* Purpose:
+* ========
+* DPBLTRF_HYBRID computes the same factorization as DPBLTRF_LOOKAHEAD but
+* factors the small diagonal sub-blocks on the host CPU with LAPACKE_DPOTRF
+* while TRSM/SYRK/GEMM run on the device of QUEUE. Each sub-block is
+* packed by a kernel into a host USM buffer, factored in a host task and
+* unpacked back, so host and device never touch the same allocation at
+* the same time and the host steps take part in the event graph.
+*
+* Arguments and INFO are the same as for DPBLTRF_LOOKAHEAD.
+***********************************************************************/
+int64_t dpbltrf_hybrid(sycl::queue queue, int64_t n, int64_t nb, double* d, int64_t ldd, double* b, int64_t ldb) {
+
+    int64_t info = 0;
+    if (n < 0)
+        info = -1;
+    else if (nb < 0)
+        info = -2;
+    else if (ldd < nb)
+        info = -4;
+    else if (ldb < nb)
+        info = -6;
+
+    if (info)
+        return info;
+    if (n == 0 || nb < 2)
+        return dpbltrf(queue, n, nb, d, ldd, b, ldb);
+
+    sycl::context context = queue.get_context();
+    sycl::device device = queue.get_device();
+
+    // All POTRF calls are ordered by the pipeline, so they share one buffer
+    const int64_t ldh = nb - nb/2;
+    double* hblock = sycl::malloc_host<double>(ldh * ldh, context);
+    int64_t* dinfo = sycl::malloc_shared<int64_t>(1, device, context);
+    if (!hblock || !dinfo) {
+        info = -1000;
+        goto cleanup;
+    }
+
+    try {
+        info = dpbltrf_pipelined(queue, n, nb, d, ldd, b, ldb, dinfo,
+            [&](double* a, int64_t m, const std::vector<sycl::event>& deps) {
+                auto event1 = queue.submit([&](sycl::handler& cgh) {
+                    cgh.depends_on(deps);
+                    cgh.parallel_for(sycl::range<2>(m, m), [=](sycl::id<2> it) {
+                        hblock[it[1] + it[0]*ldh] = a[it[1] + it[0]*ldd];
+                    });
+                });
+                auto event2 = queue.submit([&](sycl::handler& cgh) {
+                    cgh.depends_on(event1);
+                    cgh.host_task([=]() {
+                        // A failure leaves a non-positive diagonal element,
+                        // which is reported after the pipeline completes
+                        LAPACKE_dpotrf(LAPACK_COL_MAJOR, 'L', m, hblock, ldh);
+                    });
+                });
+                return queue.submit([&](sycl::handler& cgh) {
+                    cgh.depends_on(event2);
+                    cgh.parallel_for(sycl::range<2>(m, m), [=](sycl::id<2> it) {
+                        if (it[1] >= it[0])
+                            a[it[1] + it[0]*ldd] = hblock[it[1] + it[0]*ldh];
+                    });
+                });
+            });
+    } catch(mkl::lapack::exception const& e) {
+        // Handle LAPACK related exceptions happened during synchronous call
+        queue.wait();
+        std::cout << "Unexpected exception caught during synchronous call to LAPACK API:\ninfo: " << e.info() << std::endl;
+        info = e.info();
+    }
+
+cleanup:
+    sycl::free(dinfo, context);
+    sycl::free(hblock, context);
+    return info;
+}
@@ -0,0 +1,170 @@
+//==============================================================
+// Copyright © 2020 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+/*
+ *
+ *  Content:
+ *      Timing of block Cholesky factorization variants
+ ************************************************************************
+ * Purpose:
+ * ========
+ * Measures run times of
+ *      DPBLTRF            - step by step, host waits after every call,
+ *      DPBLTRF_LOOKAHEAD  - pipelined through events on the device,
+ *      DPBLTRF_HYBRID     - pipelined, diagonal blocks factored on host,
+ * for randomly generated symmetric positive definite block tridiagonal
+ * matrices of varying number of blocks N and block size NB. Every
+ * factorization is verified by TEST_RES (see auxi.cpp).
+ *
+ * Usage: timing [N1,N2,...] [NB1,NB2,...]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+#include "oneapi/mkl.hpp"
+
+using namespace oneapi;
+
+int64_t dpbltrf(sycl::queue queue, int64_t n, int64_t nb, double* d, int64_t ldd, double* b, int64_t ldb);
+int64_t dpbltrf_lookahead(sycl::queue queue, int64_t n, int64_t nb, double* d, int64_t ldd, double* b, int64_t ldb);
+int64_t dpbltrf_hybrid(sycl::queue queue, int64_t n, int64_t nb, double* d, int64_t ldd, double* b, int64_t ldb);
+double test_res(int64_t, int64_t, double*, int64_t, double*, int64_t, double*, int64_t, double*, int64_t, double*, int64_t, double*, int64_t);
+
+template<typename T>
+using allocator_t = sycl::usm_allocator<T, sycl::usm::alloc::shared>;
+
+using factor_t = int64_t (*)(sycl::queue, int64_t, int64_t, double*, int64_t, double*, int64_t);
+
+static std::vector<int64_t> parse_list(const char* arg, std::vector<int64_t> values) {
+    if (arg) {
+        values.clear();
+        std::stringstream ss(arg);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            values.push_back(std::stoll(item));
+    }
+    return values;
+}
+
+int main(int argc, char* argv[]) {
+
+    if (sizeof(MKL_INT) != sizeof(int64_t)) {
+        std::cerr << "MKL_INT not 64bit" << std::endl;
+        return -1;
+    }
+
+    const std::vector<int64_t> ns  = parse_list(argc > 1 ? argv[1] : nullptr, {64, 256});
+    const std::vector<int64_t> nbs = parse_list(argc > 2 ? argv[2] : nullptr, {16, 32, 64, 128});
+    const int repetitions = 3;
+
+    int64_t info = 0;
+
+    // Asynchronous error handler
+    auto error_handler = [&] (sycl::exception_list exceptions) {
+        for (auto const& e : exceptions) {
+            try {
+                std::rethrow_exception(e);
+            } catch(mkl::lapack::exception const& e) {
+                // Handle LAPACK related exceptions happened during asynchronous call
+                info = e.info();
+                std::cout << "Unexpected exception caught during asynchronous LAPACK operation:\ninfo: " << e.info() << std::endl;
+            } catch(sycl::exception const& e) {
+                // Handle not LAPACK related exceptions happened during asynchronous call
+                std::cout << "Unexpected exception caught during asynchronous operation:\n" << e.what() << std::endl;
+                info = -1;
+            }
+        }
+    };
+
+    sycl::device device{sycl::default_selector_v};
+    sycl::queue queue(device, error_handler);
+    sycl::context context = queue.get_context();
+
+    if (device.get_info<sycl::info::device::double_fp_config>().empty()) {
+        std::cerr << "The sample uses double precision, which is not supported" << std::endl;
+        std::cerr << "by the selected device. Quitting." << std::endl;
+        return 0;
+    }
+
+    std::cout << "Device: " << device.get_info<sycl::info::device::name>() << "\n";
+    std::cout << "Best of " << repetitions << " runs, seconds\n\n";
+    std::cout << std::setw(6) << "N" << std::setw(6) << "NB"
+              << std::setw(14) << "dpbltrf" << std::setw(14) << "lookahead" << std::setw(14) << "hybrid" << "\n";
+
+    const std::vector<factor_t> variants = {dpbltrf, dpbltrf_lookahead, dpbltrf_hybrid};
+    const double eps = LAPACKE_dlamch('E');
+    allocator_t<double> allocator_d(context, device);
+
+    for (int64_t n : ns) {
+        for (int64_t nb : nbs) {
+            std::vector<double, allocator_t<double>>  d(nb * n*nb,     allocator_d);
+            std::vector<double, allocator_t<double>>  b(nb * (n-1)*nb, allocator_d);
+            std::vector<double> d1(nb * n*nb);
+            std::vector<double> b1(nb * (n-1)*nb);
+            std::vector<double> d2(nb * n*nb);
+            std::vector<double> b2(nb * (n-1)*nb);
+            std::vector<MKL_INT> iseed = {1, 2, 33, 15};
+
+            auto D2 = [=,&d2](int64_t i, int64_t j) -> double& { return d2[i + j*nb]; };
+
+            // Initializing the original matrix randomly
+            LAPACKE_dlarnv(2, iseed.data(), (n-1)*nb*nb, b2.data());
+            for (int64_t k = 0; k < n; k++) {
+                for (int64_t j = 0; j < nb; j++) {
+                    LAPACKE_dlarnv(2, iseed.data(), nb-j, &D2(j,k*nb+j));
+                    cblas_dcopy(nb-j, &D2(j+1, k*nb+j), 1, &D2(j, k*nb+j+1), nb);
+                }
+                // Diagonal dominance to make the matrix positive definite
+                for (int64_t j = 0; j < nb; j++) {
+                    D2(j, k*nb+j) += nb*3.0;
+                }
+            }
+
+            std::cout << std::setw(6) << n << std::setw(6) << nb;
+            for (auto factor : variants) {
+                double best = 0.0;
+                for (int rep = 0; rep < repetitions; rep++) {
+                    cblas_dcopy(n*nb*nb, d2.data(), 1, d.data(), 1);
+                    cblas_dcopy((n-1)*nb*nb, b2.data(), 1, b.data(), 1);
+
+                    auto start = std::chrono::steady_clock::now();
+                    try {
+                        info = factor(queue, n, nb, d.data(), nb, b.data(), nb);
+                    } catch(sycl::exception const& e) {
+                        // Handle not LAPACK related exceptions happened during synchronous call
+                        std::cout << "Unexpected exception caught during synchronous call to SYCL API:\n" << e.what() << std::endl;
+                        info = -1;
+                    }
+                    auto stop = std::chrono::steady_clock::now();
+                    if (info) {
+                        std::cout << "\nFactorization failed. info = " << info << std::endl;
+                        return 1;
+                    }
+                    const double time = std::chrono::duration<double>(stop - start).count();
+                    best = (rep == 0) ? time : std::min(best, time);
+                }
+
+                double res = test_res(n, nb, d.data(), nb, b.data(), nb, d1.data(), nb, b1.data(), nb, d2.data(), nb, b2.data(), nb);
+                if (res/eps > 5.0) {
+                    std::cout << "\nResidual test failed: ||A-L*L^t||_F/||A||_F = " << res << std::endl;
+                    return 1;
+                }
+                std::cout << std::setw(14) << std::setprecision(4) << best;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -9,16 +9,183 @@
 *  Content:
 *      Function DGEBLTTRF for LU factorization of general block 
 *         tridiagonal matrix;
+*      Function DGEBLTTRF_BATCH for LU factorizations of many general
+*         block tridiagonal matrices in one call;
 *      Function PTLDGETRF for partial LU factorization of general 
 *         rectangular matrix.
 ************************************************************************/
+#include <algorithm>
 #include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
 #include <sycl/sycl.hpp>
 #include "oneapi/mkl.hpp"
 
 using namespace oneapi;
 
-int64_t ptldgetrf(sycl::queue queue, int64_t m, int64_t n, int64_t k, double* a, int64_t lda, int64_t* ipiv);
+int64_t ptldgetrf(sycl::queue queue, int64_t m, int64_t n, int64_t k, double* a, int64_t lda, int64_t* ipiv,
+                  double* scratchpad, int64_t scratchpad_size, const std::vector<sycl::event>& deps, sycl::event& done);
+
+/************************************************************************
+* Panel kernels shared by DGEBLTTRF and DGEBLTTRF_BATCH.
+*
+* At step K the 2*NB x NCB*NB working panel (NCB = 3, or 2 for the last
+* step) maps onto the block tridiagonal storage as
+*          (D_K     C_K     0    )      on entry,
+*          (B_K     D_K+1   C_K+1)
+* and its factored blocks go back to D, DL, DU1 and DU2 (U_K,K+2). Each
+* work-item moves one element, so a panel of every matrix in the batch is
+* gathered (or scattered back) by a single kernel instead of several BLAS
+* copies per block column. Matrices of a batch are stored one after
+* another (see DGEBLTTRF_BATCH); panels are STRIDE_A elements apart.
+************************************************************************/
+static sycl::event gather_panel(sycl::queue& queue, int64_t n, int64_t nb, int64_t k, int64_t ncb, int64_t batch_size,
+                                const double* d, const double* dl, const double* du1, double* a, int64_t lda, int64_t stride_a,
+                                const std::vector<sycl::event>& deps) {
+    const int64_t stride_d  = nb * n*nb;
+    const int64_t stride_dl = nb * (n-1)*nb;
+    return queue.submit([&](sycl::handler& cgh) {
+        cgh.depends_on(deps);
+        cgh.parallel_for(sycl::range<3>(batch_size, ncb*nb, 2*nb), [=](sycl::id<3> it) {
+            const int64_t b = it[0];
+            const int64_t j = it[1];
+            const int64_t i = it[2];
+            const int64_t ii = i % nb;
+            const int64_t jj = (j % nb) + (k + j/nb) * nb;
+            const int64_t ij = ii + (jj - nb) * nb;
+            double value = 0.0;
+            if (i < nb) {
+                if (j < nb)
+                    value = d[b*stride_d + ii + jj*nb];
+                else if (j < 2*nb)
+                    value = du1[b*stride_dl + ij];
+            } else {
+                if (j < nb)
+                    value = dl[b*stride_dl + ii + jj*nb];
+                else if (j < 2*nb)
+                    value = d[b*stride_d + ii + jj*nb];
+                else
+                    value = du1[b*stride_dl + ij];
+            }
+            a[b*stride_a + i + j*lda] = value;
+        });
+    });
+}
+
+static sycl::event scatter_panel(sycl::queue& queue, int64_t n, int64_t nb, int64_t k, int64_t ncb, int64_t batch_size,
+                                 const double* a, int64_t lda, int64_t stride_a, double* d, double* dl, double* du1, double* du2,
+                                 const std::vector<sycl::event>& deps) {
+    const int64_t stride_d   = nb * n*nb;
+    const int64_t stride_dl  = nb * (n-1)*nb;
+    const int64_t stride_du2 = nb * std::max<int64_t>(n-2, 0)*nb;
+    return queue.submit([&](sycl::handler& cgh) {
+        cgh.depends_on(deps);
+        cgh.parallel_for(sycl::range<3>(batch_size, ncb*nb, 2*nb), [=](sycl::id<3> it) {
+            const int64_t b = it[0];
+            const int64_t j = it[1];
+            const int64_t i = it[2];
+            const int64_t ii = i % nb;
+            const int64_t jj = (j % nb) + (k + j/nb) * nb;
+            const int64_t ij = ii + (jj - nb) * nb;
+            const double value = a[b*stride_a + i + j*lda];
+            if (i < nb) {
+                if (j < nb)
+                    d[b*stride_d + ii + jj*nb] = value;
+                else if (j < 2*nb)
+                    du1[b*stride_dl + ij] = value;
+                else
+                    du2[b*stride_du2 + ii + (jj - 2*nb)*nb] = value;
+            } else {
+                if (j < nb)
+                    dl[b*stride_dl + ii + jj*nb] = value;
+                else if (j < 2*nb)
+                    d[b*stride_d + ii + jj*nb] = value;
+                else
+                    du1[b*stride_dl + ij] = value;
+            }
+        });
+    });
+}
+
+// Applies the row interchanges IPIV(1:K) of a panel to its columns K..N-1.
+// Pivots stay on the device: every work-item swaps within one column.
+static sycl::event apply_panel_pivots(sycl::queue& queue, int64_t batch_size, int64_t n, int64_t k, double* a, int64_t lda,
+                                      int64_t stride_a, const int64_t* ipiv, int64_t stride_ipiv,
+                                      const std::vector<sycl::event>& deps) {
+    return queue.submit([&](sycl::handler& cgh) {
+        cgh.depends_on(deps);
+        cgh.parallel_for(sycl::range<2>(batch_size, n-k), [=](sycl::id<2> it) {
+            double* col = a + it[0]*stride_a + (k + it[1])*lda;
+            const int64_t* piv = ipiv + it[0]*stride_ipiv;
+            for (int64_t i = 0; i < k; i++) {
+                const int64_t p = piv[i] - 1;
+                if (p != i) {
+                    const double tmp = col[i];
+                    col[i] = col[p];
+                    col[p] = tmp;
+                }
+            }
+        });
+    });
+}
+
+// Stores in INFO(b) the 'global' index of the first exactly zero diagonal
+// element of U of the b-th factored matrix, or 0 if there is none.
+static sycl::event find_zero_pivots(sycl::queue& queue, int64_t n, int64_t nb, int64_t batch_size, const double* d,
+                                    int64_t* info, const std::vector<sycl::event>& deps) {
+    constexpr int64_t none = std::numeric_limits<int64_t>::max();
+    const int64_t stride_d = nb * n*nb;
+    auto event1 = queue.fill(info, none, batch_size, deps);
+    auto event2 = queue.submit([&](sycl::handler& cgh) {
+        cgh.depends_on(event1);
+        cgh.parallel_for(sycl::range<2>(batch_size, n*nb), [=](sycl::id<2> it) {
+            const int64_t b = it[0];
+            const int64_t g = it[1];
+            if (d[b*stride_d + (g % nb) + g*nb] == 0.0) {
+                sycl::atomic_ref<int64_t, sycl::memory_order::relaxed, sycl::memory_scope::device,
+                                 sycl::access::address_space::global_space> first(info[b]);
+                first.fetch_min(g + 1);
+            }
+        });
+    });
+    return queue.submit([&](sycl::handler& cgh) {
+        cgh.depends_on(event2);
+        cgh.parallel_for(sycl::range<1>(batch_size), [=](sycl::id<1> b) {
+            if (info[b] == none)
+                info[b] = 0;
+        });
+    });
+}
+
+// Submit GETRF and GETRF_BATCH without breaking the chain of events. Where
+// the call itself reports exactly zero U(i,i), the queue is drained and the
+// following steps go on; the zero pivots are then found by find_zero_pivots
+// like all the others. Illegal arguments are still thrown.
+static sycl::event submit_getrf(sycl::queue& queue, int64_t m, int64_t n, double* a, int64_t lda, int64_t* ipiv,
+                                double* scratchpad, int64_t scratchpad_size, const std::vector<sycl::event>& deps) {
+    try {
+        return mkl::lapack::getrf(queue, m, n, a, lda, ipiv, scratchpad, scratchpad_size, deps);
+    } catch(mkl::lapack::exception const& e) {
+        if (e.info() < 0)
+            throw;
+        queue.wait();
+        return sycl::event();
+    }
+}
+
+static sycl::event submit_getrf_batch(sycl::queue& queue, int64_t m, int64_t n, double* a, int64_t lda, int64_t stride_a,
+                                      int64_t* ipiv, int64_t stride_ipiv, int64_t batch_size, double* scratchpad,
+                                      int64_t scratchpad_size, const std::vector<sycl::event>& deps) {
+    try {
+        return mkl::lapack::getrf_batch(queue, m, n, a, lda, stride_a, ipiv, stride_ipiv, batch_size,
+                                        scratchpad, scratchpad_size, deps);
+    } catch(mkl::lapack::batch_error const&) {
+        queue.wait();
+        return sycl::event();
+    }
+}
+
 
 /************************************************************************
 * Definition:
@@ -100,13 +267,8 @@ int64_t ptldgetrf(sycl::queue queue, int64_t m, int64_t n, int64_t k, double* a,
 ***********************************************************************/
 int64_t dgeblttrf(sycl::queue queue, int64_t n, int64_t nb, double* d, double* dl, double* du1, double* du2, int64_t* ipiv) {
 
-    // Matrix accessors
-    auto D    = [=,&d]    (int64_t i, int64_t j) -> double&  { return  d[i + j*nb];    };
-    auto DL   = [=,&dl]   (int64_t i, int64_t j) -> double&  { return  dl[i + j*nb];   };
-    auto DU1  = [=,&du1]  (int64_t i, int64_t j) -> double&  { return  du1[i + j*nb];  };
-    auto DU2  = [=,&du2]  (int64_t i, int64_t j) -> double&  { return  du2[i + j*nb];  };
     auto IPIV = [=,&ipiv] (int64_t i, int64_t j) -> int64_t& { return  ipiv[i + j*nb]; };
-    
+
     // Test the input arguments.
     int64_t info=0;
     if(n <= 0) 
@@ -119,140 +281,225 @@ int64_t dgeblttrf(sycl::queue queue, int64_t n, int64_t nb, double* d, double* d
     sycl::context context = queue.get_context();
     sycl::device device = queue.get_device();
 
-    // Allocating a contiguous USM array for partial factorizations
+    // Allocating a contiguous device array for partial factorizations, a
+    // scratchpad large enough for both the panel and the final getrf, and
+    // a shared slot receiving the index of the first zero pivot.
     const int64_t lda = 2*nb;
-    double* a = sycl::malloc_shared<double>(lda * 3*nb, device, context);
-    auto A = [=,&a](int64_t i, int64_t j) -> double& { return a[i + j*lda]; };
-    if (!a) {
+    double* a = sycl::malloc_device<double>(lda * 3*nb, device, context);
+    int64_t* dinfo = sycl::malloc_shared<int64_t>(1, device, context);
+    double* scratchpad = nullptr;
+    int64_t scratchpad_size = 0;
+    sycl::event event;
+    if (!a || !dinfo) {
+        info = -1000;
+        goto cleanup;
+    }
+    scratchpad_size = std::max(mkl::lapack::getrf_scratchpad_size<double>(queue, 2*nb,   nb, lda),
+                               mkl::lapack::getrf_scratchpad_size<double>(queue, 2*nb, 2*nb, lda));
+    scratchpad = sycl::malloc_device<double>(scratchpad_size, device, context);
+    if (!scratchpad) {
         info = -1000;
         goto cleanup;
     }
 
+    // All steps below are chained through events only; the host does not
+    // wait until the whole factorization has been submitted.
+    try {
+        for (int64_t k = 0; k < n-2; k++){
+            // Form a 2*NB x 3*NB submatrix
+            //     D_K   C_K 0
+            //     B_K D_K+1 C_K+1
+            auto event1 = gather_panel(queue, n, nb, k, 3, 1, d, dl, du1, a, lda, 0, {event});
 
-    for (int64_t k = 0; k < n-2; k++){
-        // Form a 2*NB x 3*NB submatrix
-        //     D_K   C_K 0
-        //     B_K D_K+1 C_K+1
-        for (int64_t j = 0; j < nb; j++) {
-            auto event1 = mkl::blas::copy(queue, nb,   &D(0,(k)*nb + j), 1,   &A(0,     j),1);
-            auto event2 = mkl::blas::copy(queue, nb,  &DL(0,(k)*nb + j), 1,   &A(nb,    j),1);
-            auto event3 = mkl::blas::copy(queue, nb, &DU1(0,(k)*nb + j), 1,   &A(0,  nb+j),1);
-            auto event4 = mkl::blas::copy(queue, nb,   &D(0,(k+1)*nb + j),     1,   &A(nb,  nb+j),1);
-            auto event5 = mkl::blas::copy(queue, nb, &DU1(0,(k+1)*nb + j),     1,   &A(nb,2*nb+j),1);
-            event1.wait_and_throw();
-            event2.wait_and_throw();
-            event3.wait_and_throw();
-            event4.wait_and_throw();
-            event5.wait_and_throw();
-
-            queue.submit([&](sycl::handler& cgh) {
-                    cgh.parallel_for(sycl::range<1>(nb), [=] (sycl::id<1> it) {
-                            const int64_t i = it[0];
-                            a[i + (2*nb + j)*lda] = 0.0;
-                            });
-                    });
-            queue.wait();
+            // Partial factorization of the submatrix
+            //     (D_K    C_K   0    )        (L_K,K    )   (U_K,K U_K,K+1, U_K,K+2)
+            //     (                  )  = P * (         ) *                          
+            //     (B_K  D_K+1   C_K+1)        (L_K+1,K+1)                            
+            //
+            //    (  0    0       0     )
+            //  + (                     )
+            //    (  0    D'_K+1  C'_K+1)
+            sycl::event event2;
+            info = ptldgetrf(queue, 2*nb, 3*nb, nb, a, lda, &IPIV(0,k), scratchpad, scratchpad_size, {event1}, event2);
+            if (info) {
+                queue.wait();
+                goto cleanup;
+            }
 
+            // Factorization results to be copied back to arrays:
+            // L_K,K, U_K,K, D'_K+1 -> D
+            // L_K+1,K -> DL
+            // U_K,K+1 -> DU1
+            // U_K,K+2 -> DU2
+            event = scatter_panel(queue, n, nb, k, 3, 1, a, lda, 0, d, dl, du1, du2, {event2});
         }
 
+        // Out of loop factorization of the last 2*NBx2*NB submatrix
+        //  (D_N-1    C_N-1)          (L_N-1,N-1      0)   (U_N-1,N-1   U_N-1,N )
+        //  (              ) = P_N-1* (                ) * (                    )
+        //  (B_N-1      D_N)          (  L_N,N-1  L_N,N)   (      0     U_N,N   )
+        auto event1 = gather_panel(queue, n, nb, n-2, 2, 1, d, dl, du1, a, lda, 0, {event});
 
+        // Pivoting array for the last factorization has 2*NB elements stored in
+        // two last columns of IPIV
+        auto event2 = submit_getrf(queue, 2*nb, 2*nb, a, lda, &IPIV(0,n-2), scratchpad, scratchpad_size, {event1});
 
-        // Partial factorization of the submatrix
-        //     (D_K    C_K   0    )        (L_K,K    )   (U_K,K U_K,K+1, U_K,K+2)
-        //     (                  )  = P * (         ) *                          
-        //     (B_K  D_K+1   C_K+1)        (L_K+1,K+1)                            
-        //
-        //    (  0    0       0     )
-        //  + (                     )
-        //    (  0    D'_K+1  C'_K+1)
-        info = ptldgetrf(queue, 2*nb, 3*nb, nb, &A(0,0), lda, &IPIV(0,k));
-        if (info > 0) {
-        // INFO is equal to the 'global' index of the element u_ii of the factor 
-        // U which is equal to zero
-            return info + k*nb;
-        }
+        // Copy the last result back to arrays:
+        // L_N-1,N-1, L_N,N, U_N-1,N-1, U_N,N  -> D
+        // L_N,N-1  -> DL
+        // U_N-1,N  -> DU1
+        auto event3 = scatter_panel(queue, n, nb, n-2, 2, 1, a, lda, 0, d, dl, du1, du2, {event2});
 
-        // Factorization results to be copied back to arrays:
-        // L_K,K, U_K,K, D'_K+1 -> D
-        // L_K+1,K -> DL
-        // U_K,K+1 -> DU1
-        // U_K,K+2 -> DU2
-        for(int64_t j = 0; j < nb; j++) {
-            auto event1 = mkl::blas::copy(queue, nb, &A( 0,     j), 1,   &D(0,k*nb + j), 1);
-            auto event2 = mkl::blas::copy(queue, nb, &A(nb,     j), 1,  &DL(0,k*nb + j), 1);
-            auto event3 = mkl::blas::copy(queue, nb, &A( 0,  nb+j), 1, &DU1(0,k*nb + j), 1);
-            auto event4 = mkl::blas::copy(queue, nb, &A(nb,  nb+j), 1,   &D(0,(k+1)*nb     + j), 1);
-            auto event5 = mkl::blas::copy(queue, nb, &A( 0,2*nb+j), 1, &DU2(0,k*nb + j), 1);
-            auto event6 = mkl::blas::copy(queue, nb, &A(nb,2*nb+j), 1, &DU1(0,(k+1)*nb     + j), 1);
-            event1.wait_and_throw();
-            event2.wait_and_throw();
-            event3.wait_and_throw();
-            event4.wait_and_throw();
-            event5.wait_and_throw();
-            event6.wait_and_throw();
-        }
+        // INFO is equal to the 'global' index of the first element u_ii of
+        // the factor U which is equal to zero
+        event = find_zero_pivots(queue, n, nb, 1, d, dinfo, {event3});
+        event.wait_and_throw();
+        info = *dinfo;
+    } catch(mkl::lapack::exception const& e) {
+        // Handle LAPACK related exceptions happened during synchronous call
+        queue.wait();
+        std::cout << "Unexpected exception caught during synchronous call to LAPACK API:\ninfo: " << e.info() << std::endl;
+        // A zero pivot reported by GETRF is 'local' to its panel, the
+        // 'global' index has been found on the device
+        if (e.info() > 0)
+            info = *dinfo;
+        else
+            info = e.info();
     }
 
-    // Out of loop factorization of the last 2*NBx2*NB submatrix
-    //  (D_N-1    C_N-1)          (L_N-1,N-1      0)   (U_N-1,N-1   U_N-1,N )
-    //  (              ) = P_N-1* (                ) * (                    )
-    //  (B_N-1      D_N)          (  L_N,N-1  L_N,N)   (      0     U_N,N   )
-    for(int64_t j = 0; j < nb; j++) {
-        auto event1 = mkl::blas::copy(queue, nb,   &D(0, (n-2)*nb + j), 1, &A(0,    j), 1);
-        auto event2 = mkl::blas::copy(queue, nb,  &DL(0, (n-2)*nb + j), 1, &A(nb+0,    j), 1);
-        auto event3 = mkl::blas::copy(queue, nb, &DU1(0, (n-2)*nb + j), 1, &A(   0, nb+j), 1);
-        auto event4 = mkl::blas::copy(queue, nb,   &D(0, (n-1)*nb + j), 1, &A(nb+0, nb+j), 1);
-        event1.wait_and_throw();
-        event2.wait_and_throw();
-        event3.wait_and_throw();
-        event4.wait_and_throw();
+cleanup:
+    sycl::free(scratchpad, context);
+    sycl::free(dinfo, context);
+    sycl::free(a, context);
+    return info;
+
+}
+
+
+/************************************************************************
+* Definition:
+* ===========
+*   int64_t dgeblttrf_batch(sycl::queue queue, int64_t n, int64_t nb, int64_t batch_size, double* d, double* dl, double* du1, double* du2, int64_t* ipiv, int64_t* info_array) {
+*
+* Purpose:
+* ========  
+* DGEBLTTRF_BATCH computes LU factorizations of BATCH_SIZE independent
+* general block tridiagonal matrices of the same shape, all in one call.
+* Each step of the block elimination is performed for the whole batch at
+* once: panels are gathered by one kernel, factored by GETRF_BATCH and
+* updated by TRSM_BATCH/GEMM_BATCH. Every matrix is factored exactly as
+* DGEBLTTRF would factor it.
+*
+* Arguments:
+* ==========  
+* QUEUE (input) sycl queue
+*     The device queue
+*
+* N (input) int64_t
+*     The number of block rows of every matrix.  N > 1.
+*
+* NB (input) int64_t
+*     The size of blocks.  NB > 0.
+*
+* BATCH_SIZE (input) int64_t
+*     The number of matrices.  BATCH_SIZE > 0.
+*
+* D, DL, DU1, DU2, IPIV (input/output) USM arrays
+*     The arrays of DGEBLTTRF for all matrices stored one after another:
+*     the data of the b-th matrix (0 <= b < BATCH_SIZE) starts at
+*         D    + b*NB*N*NB,
+*         DL   + b*NB*(N-1)*NB,
+*         DU1  + b*NB*(N-1)*NB,
+*         DU2  + b*NB*(N-2)*NB,
+*         IPIV + b*NB*N.
+*
+* INFO_ARRAY (output) int64_t USM array, dimension (BATCH_SIZE)
+*     INFO_ARRAY(b) is the INFO value of DGEBLTTRF for the b-th matrix:
+*     0 on success, i > 0 if U(i,i) of that matrix is exactly zero (the
+*     factorization of that matrix can be not completed).
+*     The array is filled on the device.
+*
+* INFO (return) int64_t
+*     = 0:        successful exit, also if some matrices are singular
+*                 (check INFO_ARRAY)
+*     = -1000     memory buffer could not be allocated
+*     < 0:        if INFO = -i, the i-th argument had an illegal value
+***********************************************************************/
+int64_t dgeblttrf_batch(sycl::queue queue, int64_t n, int64_t nb, int64_t batch_size, double* d, double* dl, double* du1, double* du2, int64_t* ipiv, int64_t* info_array) {
+
+    // Test the input arguments.
+    int64_t info=0;
+    if(n <= 1) 
+        info = -1;
+    else if(nb <= 0) 
+        info = -2;
+    else if(batch_size <= 0)
+        info = -3;
+    if(info) 
+        return info;
+
+    sycl::context context = queue.get_context();
+    sycl::device device = queue.get_device();
+
+    // One 2*NB x 3*NB panel per matrix
+    const int64_t lda = 2*nb;
+    const int64_t stride_a = lda * 3*nb;
+    const int64_t stride_ipiv = nb * n;
+    double* a = sycl::malloc_device<double>(stride_a * batch_size, device, context);
+    double* scratchpad = nullptr;
+    int64_t scratchpad_size = 0;
+    sycl::event event;
+    if (!a) {
+        info = -1000;
+        goto cleanup;
+    }
+    scratchpad_size = std::max(mkl::lapack::getrf_batch_scratchpad_size<double>(queue, 2*nb,   nb, lda, stride_a, stride_ipiv, batch_size),
+                               mkl::lapack::getrf_batch_scratchpad_size<double>(queue, 2*nb, 2*nb, lda, stride_a, stride_ipiv, batch_size));
+    scratchpad = sycl::malloc_device<double>(scratchpad_size, device, context);
+    if (!scratchpad) {
+        info = -1000;
+        goto cleanup;
     }
 
-    // Pivoting array for the last factorization has 2*NB elements stored in
-    // two last columns of IPIV
     try {
-        std::int64_t scratchpad_size = mkl::lapack::getrf_scratchpad_size<double>(queue, 2*nb, 2*nb, lda);
-        double* scratchpad = sycl::malloc_shared<double>(scratchpad_size, device, context);
-        if (!scratchpad) {
-            info = -1000;
-            goto cleanup;
+        for (int64_t k = 0; k < n-2; k++) {
+            auto event1 = gather_panel(queue, n, nb, k, 3, batch_size, d, dl, du1, a, lda, stride_a, {event});
+
+            // Batched version of PTLDGETRF(2*NB, 3*NB, NB)
+            auto event2 = submit_getrf_batch(queue, 2*nb, nb, a, lda, stride_a, ipiv + k*nb, stride_ipiv,
+                    batch_size, scratchpad, scratchpad_size, {event1});
+            auto event3 = apply_panel_pivots(queue, batch_size, 3*nb, nb, a, lda, stride_a, ipiv + k*nb, stride_ipiv, {event2});
+            auto event4 = mkl::blas::trsm_batch(queue, mkl::side::left, mkl::uplo::lower, mkl::transpose::nontrans, mkl::diag::unit,
+                    nb, 2*nb, 1.0, a, lda, stride_a, a + nb*lda, lda, stride_a, batch_size, {event3});
+            auto event5 = mkl::blas::gemm_batch(queue, mkl::transpose::nontrans, mkl::transpose::nontrans, nb, 2*nb, nb,
+                    -1.0, a + nb, lda, stride_a, a + nb*lda, lda, stride_a, 1.0, a + nb + nb*lda, lda, stride_a, batch_size, {event4});
+
+            event = scatter_panel(queue, n, nb, k, 3, batch_size, a, lda, stride_a, d, dl, du1, du2, {event5});
         }
-        auto event1 = mkl::lapack::getrf(queue, 2*nb, 2*nb, &A(0,0), lda, &IPIV(0,n-2), scratchpad, scratchpad_size );
-        event1.wait_and_throw();
-        sycl::free(scratchpad, context);
+
+        auto event1 = gather_panel(queue, n, nb, n-2, 2, batch_size, d, dl, du1, a, lda, stride_a, {event});
+        auto event2 = submit_getrf_batch(queue, 2*nb, 2*nb, a, lda, stride_a, ipiv + (n-2)*nb, stride_ipiv,
+                batch_size, scratchpad, scratchpad_size, {event1});
+        auto event3 = scatter_panel(queue, n, nb, n-2, 2, batch_size, a, lda, stride_a, d, dl, du1, du2, {event2});
+
+        // Singular matrices are reported through INFO_ARRAY only
+        event = find_zero_pivots(queue, n, nb, batch_size, d, info_array, {event3});
+        event.wait_and_throw();
+    } catch(mkl::lapack::batch_error const&) {
+        // Zero pivots reported by GETRF_BATCH are 'local' to their panels,
+        // the 'global' indices have been stored in INFO_ARRAY on the device
+        queue.wait();
     } catch(mkl::lapack::exception const& e) {
         // Handle LAPACK related exceptions happened during synchronous call
+        queue.wait();
         std::cout << "Unexpected exception caught during synchronous call to LAPACK API:\ninfo: " << e.info() << std::endl;
-        if (e.info() > 0) {
-        // INFO is equal to the 'global' index of the element u_ii of the factor  
-        // U which is equal to zero
-            info = e.info() + (n-2)*nb;
-        }
-        return info;
+        info = e.info();
     }
 
-    // Copy the last result back to arrays:
-    // L_N-1,N-1, L_N,N, U_N-1,N-1, U_N,N  -> D
-    // L_N,N-1  -> DL
-    // U_N-1,N  -> DU1
-    for (int64_t j = 0; j < nb; j++) {
-        auto event1 = mkl::blas::copy(queue, nb,    &A(0,      j), 1,   &D(0, (n-2)*nb + j), 1);
-        auto event2 = mkl::blas::copy(queue, nb, &A(nb+0,      j), 1,  &DL(0, (n-2)*nb + j), 1);
-        auto event3 = mkl::blas::copy(queue, nb,    &A(0, nb + j), 1, &DU1(0, (n-2)*nb + j), 1);
-        auto event4 = mkl::blas::copy(queue, nb, &A(nb+0, nb + j), 1,   &D(0, (n-1)*nb + j), 1);
-        event1.wait_and_throw();
-        event2.wait_and_throw();
-        event3.wait_and_throw();
-        event4.wait_and_throw();
-    }
-
-    sycl::free(a, context);
-    return info;
-
 cleanup:
+    sycl::free(scratchpad, context);
     sycl::free(a, context);
     return info;
-
 }
 
 
@@ -263,6 +510,9 @@ cleanup:
 * PTLDGETRF computes partial (in a case K<min(M,N)) LU factorization 
 * of matrix A = P*(L*U+A1)
 *
+* The routine only submits work: all steps are chained through events
+* and pivots are applied on the device, so it returns without waiting.
+*
 * Arguments:
 * ==========     
 *  M (input) int64_t
@@ -297,25 +547,25 @@ cleanup:
 *     The pivot indices; for 1 <= i <= min(M,K), row i of the
 *     matrix was interchanged with row IPIV(i).
 *
+*  SCRATCHPAD (workspace) double array, dimension (SCRATCHPAD_SIZE)
+*     Workspace for DGETRF, at least getrf_scratchpad_size(M,K,LDA)
+*     (or (M,N,LDA) if K >= min(M,N)) elements.
+*
+*  DEPS (input) events the factorization depends on
+*
+*  DONE (output) event signalling completion of the factorization
+*
 *  INFO (return) int64_t
-*     = 0:  successful exit
+*     = 0:  successful submission
 *     < 0:  if INFO = -i, the i-th argument had an illegal value
-*     > 0:  if INFO = i, U(i,i) is exactly zero. The factorization
-*           can be not completed. 
+*     Exactly zero U(i,i) are not reported: they are left in the factor U
+*     for the caller to find.
 ***********************************************************************/
-#undef    A
-#undef    D
-#undef   DL
-#undef  DU1
-#undef  DU2
-#undef IPIV
-int64_t ptldgetrf(sycl::queue queue, int64_t m, int64_t n, int64_t k, double* a, int64_t lda, int64_t* ipiv) {
+int64_t ptldgetrf(sycl::queue queue, int64_t m, int64_t n, int64_t k, double* a, int64_t lda, int64_t* ipiv,
+                  double* scratchpad, int64_t scratchpad_size, const std::vector<sycl::event>& deps, sycl::event& done) {
 
     auto A = [=,&a](int64_t i, int64_t j) -> double& { return a[i + j*lda]; };
 
-    sycl::context context = queue.get_context();
-    sycl::device device = queue.get_device();
-
     int64_t info=0;
     if(m < 0)
         info = -1;
@@ -330,52 +580,16 @@ int64_t ptldgetrf(sycl::queue queue, int64_t m, int64_t n, int64_t k, double* a,
         return info;
 
     if(k < std::min<int64_t>(m,n)) {
-
         // LU factorization of first K columns
-        {
-            try {
-                std::int64_t scratchpad_size = mkl::lapack::getrf_scratchpad_size<double>(queue, m, k, lda);
-                double* scratchpad = sycl::malloc_shared<double>(scratchpad_size, device, context);
-                if (!scratchpad) {
-                    info = -1000;
-                    return info;
-                }
-                auto event1 = mkl::lapack::getrf(queue, m, k, &A(0,0), lda, &ipiv[0], scratchpad, scratchpad_size );
-                event1.wait_and_throw();
-                sycl::free(scratchpad, context);
-            } catch(mkl::lapack::exception const& e) {
-                // Handle LAPACK related exceptions happened during synchronous call
-                std::cout << "Unexpected exception caught during synchronous call to LAPACK API:\ninfo: " << e.info() << std::endl;
-                if (e.info() > 0) {
-                    info = e.info();
-                }
-                return info;
-            }
-        }
-        for (int64_t i = 0; i < k; i++) {
-            if(ipiv[i] != i+1) {
-                // Applying permutations returned by DGETRF to last N-K columns
-                auto event1 = mkl::blas::swap(queue, n-k, &A(i,k), lda, &A(ipiv[i]-1, k), lda);
-                event1.wait_and_throw();
-            }
-        }
+        auto event1 = submit_getrf(queue, m, k, &A(0,0), lda, &ipiv[0], scratchpad, scratchpad_size, deps);
+        // Applying permutations returned by DGETRF to last N-K columns
+        auto event2 = apply_panel_pivots(queue, 1, n, k, &A(0,0), lda, 0, &ipiv[0], 0, {event1});
         // Updating A1
-        {
-            auto event1 = mkl::blas::trsm(queue, mkl::side::left, mkl::uplo::lower, mkl::transpose::nontrans, mkl::diag::unit, k, n-k, 1.0, &A(0,0), lda, &A(0,k), lda);
-            auto event2 = mkl::blas::gemm(queue, mkl::transpose::nontrans, mkl::transpose::nontrans, m-k, n-k, k, -1.0, &A(k,0), lda, &A(0,k), lda, 1.0, &A(k,k), lda, {event1});
-            event2.wait_and_throw();
-        }
+        auto event3 = mkl::blas::trsm(queue, mkl::side::left, mkl::uplo::lower, mkl::transpose::nontrans, mkl::diag::unit, k, n-k, 1.0, &A(0,0), lda, &A(0,k), lda, {event2});
+        done = mkl::blas::gemm(queue, mkl::transpose::nontrans, mkl::transpose::nontrans, m-k, n-k, k, -1.0, &A(k,0), lda, &A(0,k), lda, 1.0, &A(k,k), lda, {event3});
     }
     else {
-            std::int64_t scratchpad_size = mkl::lapack::getrf_scratchpad_size<double>(queue, m, n, lda);
-            double* scratchpad = sycl::malloc_shared<double>(scratchpad_size, device, context);
-            if (!scratchpad) {
-                info = -1000;
-                return info;
-            }
-            auto event1 = mkl::lapack::getrf(queue, m, n, &A(0,0), lda, &ipiv[0], scratchpad, scratchpad_size );
-            event1.wait_and_throw();
-            sycl::free(scratchpad, context);
+        done = submit_getrf(queue, m, n, &A(0,0), lda, &ipiv[0], scratchpad, scratchpad_size, deps);
     }
 
     return info;
@@ -0,0 +1,175 @@
+//==============================================================
+// Copyright © 2020 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+/*
+*
+*  Content:
+*      Example of batched LU factorization of many general block
+*      tridiagonal matrices
+************************************************************************
+* Purpose:
+* ========
+* Testing LU factorizations of BATCH_SIZE independent block tridiagonal
+* matrices computed by one call of function dgeblttrf_batch. Every
+* factorization is checked by calculating Frobenius norm of the residual
+* ||A-L*U|| with function resid1 (for source see file auxi.cpp). The time
+* of the batched call is compared against factoring the same matrices one
+* by one with dgeblttrf.
+* Input block tridiagonal matrices are randomly generated.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+#include "oneapi/mkl.hpp"
+
+using namespace oneapi;
+
+int64_t dgeblttrf(sycl::queue queue, int64_t n, int64_t nb, double* d, double* dl, double* du1, double* du2, int64_t* ipiv);
+int64_t dgeblttrf_batch(sycl::queue queue, int64_t n, int64_t nb, int64_t batch_size, double* d, double* dl, double* du1, double* du2, int64_t* ipiv, int64_t* info_array);
+double resid1( int64_t n, int64_t nb, double* dl,  double* d,  double* du1,  double* du2,  int64_t* ipiv,  double* dlcpy, double* dcpy, double* du1cpy);
+
+template<typename T>
+using allocator_t = sycl::usm_allocator<T, sycl::usm::alloc::shared>;
+
+int main(){
+
+    if (sizeof(MKL_INT) != sizeof(int64_t)) {
+        std::cerr << "MKL_INT not 64bit" << std::endl;
+        return -1;
+    }
+
+    int64_t n = 50;
+    int64_t nb = 16;
+    int64_t batch_size = 256;
+
+    const int64_t size_d   = nb * n*nb;
+    const int64_t size_dl  = nb * (n-1)*nb;
+    const int64_t size_du2 = nb * (n-2)*nb;
+    const int64_t size_piv = nb * n;
+
+    int64_t info = 0;
+
+    // Asynchronous error handler
+    auto error_handler = [&] (sycl::exception_list exceptions) {
+        for (auto const& e : exceptions) {
+            try {
+                std::rethrow_exception(e);
+            } catch(mkl::lapack::exception const& e) {
+                // Handle LAPACK related exceptions happened during asynchronous call
+                info = e.info();
+                std::cout << "Unexpected exception caught during asynchronous LAPACK operation:\ninfo: " << e.info() << std::endl;
+            } catch(sycl::exception const& e) {
+                // Handle not LAPACK related exceptions happened during asynchronous call
+                std::cout << "Unexpected exception caught during asynchronous operation:\n" << e.what() << std::endl;
+                info = -1;
+            }
+        }
+    };
+
+    sycl::device device{sycl::default_selector_v};
+    sycl::queue queue(device, error_handler);
+    sycl::context context = queue.get_context();
+
+    if (device.is_gpu() && device.get_platform().get_backend() != sycl::backend::ext_oneapi_level_zero) {
+        std::cerr << "This sample requires Level Zero when running on GPUs." << std::endl;
+        std::cerr << "Please check your system configuration." << std::endl;
+        return 0;
+    }
+
+    if (device.get_info<sycl::info::device::double_fp_config>().empty()) {
+        std::cerr << "This sample uses double precision, which is not supported" << std::endl;
+        std::cerr << "by the selected device. Quitting." << std::endl;
+        return 0;
+    }
+
+    allocator_t<double> allocator_d(context, device);
+    allocator_t<int64_t> allocator_i(context, device);
+
+    std::vector<double, allocator_t<double>> d(size_d * batch_size, allocator_d);
+    std::vector<double, allocator_t<double>> dl(size_dl * batch_size, allocator_d);
+    std::vector<double, allocator_t<double>> du1(size_dl * batch_size, allocator_d);
+    std::vector<double, allocator_t<double>> du2(size_du2 * batch_size, allocator_d);
+
+    std::vector<double, allocator_t<double>> dcpy(size_d * batch_size, allocator_d);
+    std::vector<double, allocator_t<double>> dlcpy(size_dl * batch_size, allocator_d);
+    std::vector<double, allocator_t<double>> du1cpy(size_dl * batch_size, allocator_d);
+
+    std::vector<int64_t, allocator_t<int64_t>> ipiv(size_piv * batch_size, allocator_i);
+    std::vector<int64_t, allocator_t<int64_t>> info_array(batch_size, allocator_i);
+    std::vector<MKL_INT> iseed = {9, 41, 11, 3};
+
+    std::cout << "Testing accuracy of batched LU factorization with pivoting" << std::endl;
+    std::cout << "of " << batch_size << " randomly generated block tridiagonal matrices" << std::endl;
+    std::cout << "(N = " << n << ", NB = " << nb << ") by calculating norms of the residual matrices." << std::endl;
+
+    // Initializing arrays randomly
+    LAPACKE_dlarnv(2, iseed.data(), size_d * batch_size, dcpy.data());
+    LAPACKE_dlarnv(2, iseed.data(), size_dl * batch_size, dlcpy.data());
+    LAPACKE_dlarnv(2, iseed.data(), size_dl * batch_size, du1cpy.data());
+
+    // Factoring the matrices one by one (for timing reference)
+    cblas_dcopy(size_d * batch_size, dcpy.data(), 1, d.data(), 1);
+    cblas_dcopy(size_dl * batch_size, dlcpy.data(), 1, dl.data(), 1);
+    cblas_dcopy(size_dl * batch_size, du1cpy.data(), 1, du1.data(), 1);
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        for (int64_t b = 0; b < batch_size && !info; b++) {
+            info = dgeblttrf(queue, n, nb, &d[b*size_d], &dl[b*size_dl], &du1[b*size_dl], &du2[b*size_du2], &ipiv[b*size_piv]);
+        }
+    } catch(sycl::exception const& e) {
+        // Handle not LAPACK related exceptions happened during synchronous call
+        std::cout << "Unexpected exception caught during synchronous call to SYCL API:\n" << e.what() << std::endl;
+        info = -1;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    if(info){
+        std::cout << "DGEBLTTRF returned nonzero INFO = " << info << std::endl;
+        return 1;
+    }
+    const double loop_time = std::chrono::duration<double>(stop - start).count();
+
+    // Factoring all matrices in one call
+    cblas_dcopy(size_d * batch_size, dcpy.data(), 1, d.data(), 1);
+    cblas_dcopy(size_dl * batch_size, dlcpy.data(), 1, dl.data(), 1);
+    cblas_dcopy(size_dl * batch_size, du1cpy.data(), 1, du1.data(), 1);
+
+    start = std::chrono::steady_clock::now();
+    try {
+        info = dgeblttrf_batch(queue, n, nb, batch_size, d.data(), dl.data(), du1.data(), du2.data(), ipiv.data(), info_array.data());
+    } catch(sycl::exception const& e) {
+        // Handle not LAPACK related exceptions happened during synchronous call
+        std::cout << "Unexpected exception caught during synchronous call to SYCL API:\n" << e.what() << std::endl;
+        info = -1;
+    }
+    stop = std::chrono::steady_clock::now();
+    if(info){
+        std::cout << "DGEBLTTRF_BATCH returned nonzero INFO = " << info << std::endl;
+        return 1;
+    }
+    const double batch_time = std::chrono::duration<double>(stop - start).count();
+
+    // Computing the ratios ||A - LU||_F/||A||_F for every matrix
+    double eps = 0.0;
+    for (int64_t b = 0; b < batch_size; b++) {
+        if (info_array[b]) {
+            std::cout << "Matrix " << b << " is singular, INFO = " << info_array[b] << std::endl;
+            return 1;
+        }
+        eps = std::max(eps, resid1(n, nb, &dl[b*size_dl], &d[b*size_d], &du1[b*size_dl], &du2[b*size_du2], &ipiv[b*size_piv],
+                                   &dlcpy[b*size_dl], &dcpy[b*size_d], &du1cpy[b*size_dl]));
+    }
+    std::cout << "max_(b=1,...,batch_size){||A(b) - L(b)U(b)||_F/||A(b)||_F} = " << eps << std::endl;
+    std::cout << "dgeblttrf loop:  " << loop_time  << " s" << std::endl;
+    std::cout << "dgeblttrf_batch: " << batch_time << " s" << std::endl;
+
+    return 0;
+}
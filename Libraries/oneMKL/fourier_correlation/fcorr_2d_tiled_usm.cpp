@@ -0,0 +1,345 @@
+//==============================================================
+// Copyright © 2023 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+//
+//  Content:
+//     This code implements template matching of small patches against a
+//     large image with a tiled (overlap-save) 2D Fourier correlation,
+//     using SYCL, oneMKL, and device unified shared memory (USM).
+//
+// =============================================================
+
+#include <mkl.h>
+#include <sycl/sycl.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <oneapi/mkl/dft.hpp>
+#include <oneapi/mkl/rng.hpp>
+
+namespace dft = oneapi::mkl::dft;
+using descriptor_t = dft::descriptor<dft::precision::SINGLE, dft::domain::REAL>;
+
+// Upper bound of the device memory used by the two tile buffers of a batch
+constexpr size_t max_batch_bytes = size_t{256} << 20;
+
+// Committed descriptors for batches of in-place 2D real DFTs of
+// n_rows x n_cols values, keyed by (n_rows, n_cols, batch size). Committing a
+// descriptor is expensive, so each geometry is committed once and reused for
+// every tile and every template.
+class descriptor_cache {
+public:
+  explicit descriptor_cache(sycl::queue& Q) : Q(Q) {}
+
+  descriptor_t& get(std::int64_t n_rows, std::int64_t n_cols,
+                    std::int64_t batch) {
+    auto& desc = cache[{n_rows, n_cols, batch}];
+    if (!desc) {
+      desc = std::make_unique<descriptor_t>(
+                std::vector<std::int64_t>{n_rows, n_cols});
+      // Same in-place layout as in fcorr_2d_usm, with consecutive transforms
+      // dist real (or dist / 2 complex) values apart
+      const std::int64_t dist = n_rows * 2 * (n_cols / 2 + 1);
+      desc->set_value(dft::config_param::NUMBER_OF_TRANSFORMS, batch);
+      desc->set_value(dft::config_param::FWD_DISTANCE, dist);
+      desc->set_value(dft::config_param::BWD_DISTANCE, dist / 2);
+      desc->set_value(dft::config_param::BACKWARD_SCALE,
+                      1.0f / (n_rows * n_cols));
+      desc->commit(Q);
+    }
+    return *desc;
+  }
+
+  size_t size() const { return cache.size(); }
+
+private:
+  sycl::queue& Q;
+  std::map<std::array<std::int64_t, 3>, std::unique_ptr<descriptor_t>> cache;
+};
+
+// Peaks are reduced as 64-bit keys ordered like (score, -position), so that
+// sycl::maximum finds the highest score and, on ties, the first position.
+static inline std::uint64_t encode_peak(float score, std::uint32_t pos) {
+  std::uint32_t bits = sycl::bit_cast<std::uint32_t>(score);
+  bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+  return (std::uint64_t{bits} << 32) | (0xFFFFFFFFu - pos);
+}
+
+static inline void decode_peak(std::uint64_t key, float& score,
+                               std::uint32_t& pos) {
+  std::uint32_t bits = static_cast<std::uint32_t>(key >> 32);
+  bits = (bits & 0x80000000u) ? (bits & 0x7FFFFFFFu) : ~bits;
+  score = sycl::bit_cast<float>(bits);
+  pos = 0xFFFFFFFFu - static_cast<std::uint32_t>(key);
+}
+
+struct match_result {
+  unsigned row, col;  // top-left corner of the best match in the image
+  float score;
+};
+
+// For every one of the n_tmpl templates (tmpl_rows x tmpl_cols each, stored
+// contiguously in tmpl), find the position (s, p) maximizing
+//   corr(s, p) =
+//    \sum_{j = 0}^{tmpl_rows - 1} \sum_{k = 0}^{tmpl_cols - 1} \
+//      img(s + j, p + k) * tmpl(j, k)
+// over all positions where the template fits in the img_rows x img_cols
+// image (row stride img_cols). img and tmpl must be device-accessible.
+//
+// The image is cut into overlapping tiles of tile_rows x tile_cols values
+// (overlap-save): the periodic correlation of a tile with the zero-padded
+// template is exact for the first (tile_rows - tmpl_rows + 1) x
+// (tile_cols - tmpl_cols + 1) shifts, and consecutive tiles start that many
+// rows or columns apart. Tiles are transformed in batches; the spectra of a
+// batch are reused for all templates, and the peaks are found on the device
+// so that only their coordinates are copied back.
+static std::vector<match_result>
+match_templates(sycl::queue& Q, descriptor_cache& cache,
+                const float* img, unsigned img_rows, unsigned img_cols,
+                const float* tmpl, unsigned n_tmpl,
+                unsigned tmpl_rows, unsigned tmpl_cols,
+                unsigned tile_rows, unsigned tile_cols) {
+  if (tmpl_rows > img_rows || tmpl_cols > img_cols ||
+      tmpl_rows > tile_rows || tmpl_cols > tile_cols) {
+    throw std::invalid_argument("Templates must fit in the image and tiles");
+  }
+  const size_t out_rows = img_rows - tmpl_rows + 1;
+  const size_t out_cols = img_cols - tmpl_cols + 1;
+  if (out_rows * out_cols > 0xFFFFFFFFull) {
+    throw std::invalid_argument("Image is too large for 32-bit positions");
+  }
+  const size_t step_rows = tile_rows - tmpl_rows + 1;
+  const size_t step_cols = tile_cols - tmpl_cols + 1;
+  const size_t n_tiles_cols = (out_cols + step_cols - 1) / step_cols;
+  const size_t n_tiles =
+      (out_rows + step_rows - 1) / step_rows * n_tiles_cols;
+  // Layout of a tile for in-place real transforms (see fcorr_2d_usm)
+  const size_t col_stride = 2 * (tile_cols / 2 + 1);
+  const size_t tile_dist = tile_rows * col_stride;
+  const size_t batch = std::max<size_t>(1, std::min<size_t>(n_tiles,
+      max_batch_bytes / (2 * tile_dist * sizeof(float))));
+
+  float* tiles = sycl::malloc_device<float>(batch * tile_dist, Q);
+  float* prod = sycl::malloc_device<float>(batch * tile_dist, Q);
+  float* tmpl_spec = sycl::malloc_device<float>(n_tmpl * tile_dist, Q);
+  std::uint64_t* peaks = sycl::malloc_device<std::uint64_t>(n_tmpl, Q);
+
+  // Spectra of the zero-padded templates, computed once
+  Q.parallel_for(sycl::range<3>{n_tmpl, tile_rows, tile_cols},
+                 [=](sycl::id<3> idx) {
+    const size_t t = idx[0], row = idx[1], col = idx[2];
+    tmpl_spec[t * tile_dist + row * col_stride + col] =
+        (row < tmpl_rows && col < tmpl_cols)
+            ? tmpl[(t * tmpl_rows + row) * tmpl_cols + col] : 0.0f;
+  });
+  dft::compute_forward(cache.get(tile_rows, tile_cols, n_tmpl), tmpl_spec);
+  Q.memset(peaks, 0, n_tmpl * sizeof(std::uint64_t));
+
+  // One descriptor for all batches: the last batch may hold fewer tiles, the
+  // unused slots are transformed but ignored
+  descriptor_t& tile_desc = cache.get(tile_rows, tile_cols, batch);
+  // Q is in order, so each operation waits for the previous one
+  for (size_t first = 0; first < n_tiles; first += batch) {
+    // tiles <- image tiles [first, first + batch), zero-padded past the edges
+    Q.parallel_for(sycl::range<3>{batch, tile_rows, tile_cols},
+                   [=](sycl::id<3> idx) {
+      const size_t t = first + idx[0];
+      const size_t row = (t / n_tiles_cols) * step_rows + idx[1];
+      const size_t col = (t % n_tiles_cols) * step_cols + idx[2];
+      tiles[idx[0] * tile_dist + idx[1] * col_stride + idx[2]] =
+          (t < n_tiles && row < img_rows && col < img_cols)
+              ? img[row * img_cols + col] : 0.0f;
+    });
+    // tiles <- DFT(tiles)
+    dft::compute_forward(tile_desc, tiles);
+
+    for (size_t t = 0; t < n_tmpl; t++) {
+      // prod <- tiles * CONJ(DFT(tmpl[t])) [component-wise, for every tile]
+      const float* spec = tmpl_spec + t * tile_dist;
+      Q.parallel_for(sycl::range<2>{batch, tile_dist / 2},
+                     [=](sycl::id<2> idx) {
+        const size_t i = 2 * (idx[0] * (tile_dist / 2) + idx[1]);
+        const size_t k = 2 * idx[1];
+        const float re = tiles[i], im = tiles[i + 1];
+        prod[i]     = re * spec[k] + im * spec[k + 1];
+        prod[i + 1] = im * spec[k] - re * spec[k + 1];
+      });
+      // prod <- (1 / (tile_rows * tile_cols)) * iDFT(prod)
+      dft::compute_backward(tile_desc, prod);
+      // peaks[t] <- max(peaks[t], valid correlation values of the batch)
+      Q.submit([&](sycl::handler& cgh) {
+        auto peak = sycl::reduction(peaks + t, sycl::maximum<std::uint64_t>());
+        cgh.parallel_for(sycl::range<3>{batch, step_rows, step_cols}, peak,
+                         [=](sycl::id<3> idx, auto& max_peak) {
+          const size_t tile = first + idx[0];
+          const size_t row = (tile / n_tiles_cols) * step_rows + idx[1];
+          const size_t col = (tile % n_tiles_cols) * step_cols + idx[2];
+          if (tile < n_tiles && row < out_rows && col < out_cols) {
+            max_peak.combine(encode_peak(
+                prod[idx[0] * tile_dist + idx[1] * col_stride + idx[2]],
+                static_cast<std::uint32_t>(row * out_cols + col)));
+          }
+        });
+      });
+    }
+  }
+
+  std::vector<std::uint64_t> keys(n_tmpl);
+  Q.memcpy(keys.data(), peaks, n_tmpl * sizeof(std::uint64_t)).wait();
+  std::vector<match_result> results(n_tmpl);
+  for (size_t t = 0; t < n_tmpl; t++) {
+    std::uint32_t pos;
+    decode_peak(keys[t], results[t].score, pos);
+    results[t].row = pos / out_cols;
+    results[t].col = pos % out_cols;
+  }
+
+  sycl::free(tiles, Q);
+  sycl::free(prod, Q);
+  sycl::free(tmpl_spec, Q);
+  sycl::free(peaks, Q);
+  return results;
+}
+
+int main(int argc, char **argv) {
+  // Usage: fcorr_2d_tiled_usm [img_rows] [img_cols] [tmpl_size] [n_tmpl]
+  //                           [tile_size]
+  const unsigned img_rows  = (argc <= 1) ? 2048 : std::stoi(argv[1]);
+  const unsigned img_cols  = (argc <= 2) ? 2048 : std::stoi(argv[2]);
+  const unsigned tmpl_size = (argc <= 3) ? 16 : std::stoi(argv[3]);
+  const unsigned n_tmpl    = (argc <= 4) ? 4 : std::stoi(argv[4]);
+  if (tmpl_size < 1 || n_tmpl < 1 ||
+      tmpl_size > img_rows || tmpl_size > img_cols)
+    throw std::invalid_argument("The templates must fit in the image.");
+  // Default tile size: power of two of at least 64 and 4 * tmpl_size, so that
+  // most of each tile yields valid correlation values
+  unsigned tile_size = 64;
+  while (tile_size < 4 * tmpl_size)
+    tile_size *= 2;
+  if (argc > 5)
+    tile_size = std::stoi(argv[5]);
+  if (tile_size < tmpl_size)
+    throw std::invalid_argument("The tiles must be larger than the templates.");
+
+  // The templates are copies of patches of a noisy image, so each of them
+  // must be found at the position it was taken from.
+  // This program returns 0 (resp. 1) if all templates are (resp. are not)
+  // found there with a score within error tolerance of the direct calculation.
+  int return_code = 0;
+
+  // Initialize SYCL queue
+  sycl::queue Q(sycl::default_selector_v, sycl::property::queue::in_order());
+  std::cout << "Running on: "
+            << Q.get_device().get_info<sycl::info::device::name>()
+            << std::endl;
+
+  // Image of zero-mean noise, generated on the device
+  auto img = sycl::malloc_device<float>(size_t{img_rows} * img_cols, Q);
+  oneapi::mkl::rng::philox4x32x10 engine(Q, 777);
+  oneapi::mkl::rng::uniform<float, oneapi::mkl::rng::uniform_method::standard>
+      rng_distribution(-1.0f, 1.0f);
+  oneapi::mkl::rng::generate(rng_distribution, engine,
+                             size_t{img_rows} * img_cols, img);
+
+  // Cut the templates from random positions of the image
+  std::mt19937 gen(777);
+  std::vector<unsigned> origin(2 * n_tmpl);
+  for (unsigned t = 0; t < n_tmpl; t++) {
+    origin[2 * t]     = gen() % (img_rows - tmpl_size + 1);
+    origin[2 * t + 1] = gen() % (img_cols - tmpl_size + 1);
+  }
+  auto dev_origin = sycl::malloc_device<unsigned>(2 * n_tmpl, Q);
+  auto tmpl = sycl::malloc_device<float>(n_tmpl * tmpl_size * tmpl_size, Q);
+  auto direct = sycl::malloc_device<float>(n_tmpl, Q);
+  Q.memcpy(dev_origin, origin.data(), 2 * n_tmpl * sizeof(unsigned));
+  Q.parallel_for(sycl::range<3>{n_tmpl, tmpl_size, tmpl_size},
+                 [=](sycl::id<3> idx) {
+    const size_t t = idx[0], row = idx[1], col = idx[2];
+    tmpl[(t * tmpl_size + row) * tmpl_size + col] =
+        img[(dev_origin[2 * t] + row) * img_cols + dev_origin[2 * t + 1] + col];
+  });
+  // Direct (naive) correlation at the expected peaks, for verification, and
+  // squared Frobenius norms of the templates
+  Q.parallel_for(sycl::range<1>{n_tmpl}, [=](sycl::id<1> idx) {
+    const size_t t = idx[0];
+    float sum = 0.0f;
+    for (size_t j = 0; j < tmpl_size; j++) {
+      for (size_t k = 0; k < tmpl_size; k++) {
+        sum += img[(dev_origin[2 * t] + j) * img_cols
+                   + dev_origin[2 * t + 1] + k]
+               * tmpl[(t * tmpl_size + j) * tmpl_size + k];
+      }
+    }
+    direct[t] = sum;
+  });
+  std::vector<float> direct_score(n_tmpl);
+  Q.memcpy(direct_score.data(), direct, n_tmpl * sizeof(float)).wait();
+
+  descriptor_cache cache(Q);
+  for (unsigned tile : {tile_size, 2 * tile_size}) {
+    const unsigned n_tiles =
+        ((img_rows - tmpl_size) / (tile - tmpl_size + 1) + 1) *
+        ((img_cols - tmpl_size) / (tile - tmpl_size + 1) + 1);
+    // The first call commits the descriptors of this tile size, the second
+    // one reuses them
+    match_templates(Q, cache, img, img_rows, img_cols, tmpl, n_tmpl,
+                    tmpl_size, tmpl_size, tile, tile);
+    const auto start = std::chrono::steady_clock::now();
+    const auto results =
+        match_templates(Q, cache, img, img_rows, img_cols, tmpl, n_tmpl,
+                        tmpl_size, tmpl_size, tile, tile);
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Tiles of " << tile << "x" << tile << ": " << n_tiles
+              << " tiles, " << n_tmpl << " templates of " << tmpl_size << "x"
+              << tmpl_size << " matched in " << elapsed.count() * 1e3
+              << " ms (" << n_tiles * n_tmpl / elapsed.count()
+              << " tiles/s, " << cache.size()
+              << " descriptors committed so far)." << std::endl;
+
+    const float num_elem = static_cast<float>(tile) * tile;
+    for (unsigned t = 0; t < n_tmpl; t++) {
+      // Error bound for the naive (sequential) sum of tmpl_size^2 products:
+      float max_err_threshold = tmpl_size * tmpl_size
+          * std::numeric_limits<float>::epsilon() * direct_score[t];
+      // Adding the error bound of the DFT-based calculation, as in
+      // fcorr_2d_usm, with nrm2(tile) <= sqrt(num_elem) since |img| <= 1 and
+      // nrm2(tmpl[t]) = sqrt(direct_score[t]):
+      max_err_threshold += 2.0f * (1.0f + std::log(num_elem))
+          * std::numeric_limits<float>::epsilon()
+          * std::sqrt(num_elem) * std::sqrt(direct_score[t]);
+      const float err = std::fabs(results[t].score - direct_score[t]);
+      if (results[t].row != origin[2 * t] ||
+          results[t].col != origin[2 * t + 1] || err > max_err_threshold) {
+        std::cerr << "An error was found when verifying the results." << std::endl;
+        std::cerr << "Template " << t << " taken from (" << origin[2 * t]
+                  << ", " << origin[2 * t + 1] << ") with score "
+                  << direct_score[t] << " was found at (" << results[t].row
+                  << ", " << results[t].col << ") with score "
+                  << results[t].score << " (verification threshold: "
+                  << max_err_threshold << ")." << std::endl;
+        return_code = 1;
+      }
+    }
+  }
+  if (return_code == 0) {
+    std::cout << "All " << n_tmpl << " templates were found at the positions "
+              << "they were taken from." << std::endl;
+  }
+
+  // Cleanup
+  sycl::free(img, Q);
+  sycl::free(tmpl, Q);
+  sycl::free(dev_origin, Q);
+  sycl::free(direct, Q);
+  return return_code;
+}
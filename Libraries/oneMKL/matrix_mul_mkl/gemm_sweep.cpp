@@ -0,0 +1,400 @@
+//==============================================================
+// Copyright © 2023 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+//
+// Contents:
+//     A matrix multiplication benchmark harness, using the oneAPI Math Kernel
+//     Library (oneMKL): sweeps over matrix shapes, precisions (fp64, fp32,
+//     tf32, bf16) and batching modes (gemm, gemm_batch with pointer arrays,
+//     strided gemm_batch), timed with event profiling, with CSV output.
+//
+
+#include <sycl/sycl.hpp>
+#include <oneapi/mkl.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "utilities.hpp"
+
+using namespace sycl;
+using oneapi::mkl::bfloat16;
+
+enum class precision { fp64, fp32, tf32, bf16 };
+enum class gemm_mode { gemm, batch, strided };
+
+static const char *precision_string(precision p)
+{
+    switch (p) {
+        case precision::fp64: return "fp64";
+        case precision::fp32: return "fp32";
+        case precision::tf32: return "tf32";
+        default:              return "bf16";
+    }
+}
+
+static const char *mode_string(gemm_mode m)
+{
+    switch (m) {
+        case gemm_mode::gemm:  return "gemm";
+        case gemm_mode::batch: return "batch";
+        default:               return "strided";
+    }
+}
+
+/* One benchmark point: batch independent (m x k) x (k x n) products */
+struct shape {
+    std::int64_t m, n, k, batch;
+};
+
+struct options {
+    std::vector<precision> precisions = {precision::fp64, precision::fp32, precision::tf32, precision::bf16};
+    std::vector<gemm_mode> modes = {gemm_mode::gemm, gemm_mode::batch, gemm_mode::strided};
+    /* Shapes for gemm mode: squares, then skinny, tall, deep and shallow products */
+    std::vector<shape> shapes = {{256, 256, 256, 1}, {512, 512, 512, 1}, {1024, 1024, 1024, 1},
+                                 {2048, 2048, 2048, 1}, {4096, 4096, 4096, 1},
+                                 {16384, 64, 1024, 1}, {64, 16384, 1024, 1},
+                                 {1024, 1024, 16384, 1}, {8192, 8192, 64, 1}};
+    /* Square sizes and number of matrices for the batched modes (0: about 4M elements per operand) */
+    std::vector<std::int64_t> batch_sizes = {4, 8, 16, 32, 64, 128};
+    std::int64_t batch_count = 0;
+    int warmup = 3;
+    int reps = 20;
+    std::string csv = "gemm_sweep.csv";
+};
+
+/* Timing statistics over the repetitions, in seconds */
+struct timing {
+    double median, p10, p90, min;
+};
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    return sorted[size_t(p * (sorted.size() - 1) + 0.5)];
+}
+
+static timing summarize(std::vector<double> times)
+{
+    std::sort(times.begin(), times.end());
+    return {percentile(times, 0.5), percentile(times, 0.1), percentile(times, 0.9), times.front()};
+}
+
+/* oneMKL compute mode: tf32 runs single precision GEMMs with tf32 multiplications */
+static oneapi::mkl::blas::compute_mode compute_mode(precision p)
+{
+    return (p == precision::tf32) ? oneapi::mkl::blas::compute_mode::float_to_tf32
+                                  : oneapi::mkl::blas::compute_mode::unset;
+}
+
+/* Ta: type of A and B, Tc: type of C and of the scalars */
+template <typename Ta, typename Tc>
+static
+bool bench(queue &Q, precision prec, gemm_mode mode, shape s, const options &opts, std::ostream &csv)
+{
+    using namespace oneapi::mkl;
+    const auto N = transpose::nontrans;
+    const auto cmode = compute_mode(prec);
+    const std::int64_t m = s.m, n = s.n, k = s.k, batch = s.batch;
+
+    /* Single products get padded leading dimensions, batched ones are packed */
+    const std::int64_t lda = (mode == gemm_mode::gemm) ? nice_ld<Ta>(m) : m;
+    const std::int64_t ldb = (mode == gemm_mode::gemm) ? nice_ld<Ta>(k) : k;
+    const std::int64_t ldc = (mode == gemm_mode::gemm) ? nice_ld<Tc>(m) : m;
+    const std::int64_t stride_a = lda * k, stride_b = ldb * n, stride_c = ldc * n;
+
+    auto A = malloc_device<Ta>(stride_a * batch, Q);
+    auto B = malloc_device<Ta>(stride_b * batch, Q);
+    auto C = malloc_device<Tc>(stride_c * batch, Q);
+    if (!A || !B || !C) {
+        std::cout << "  " << precision_string(prec) << " " << mode_string(mode) << ": allocation failed, skipped\n";
+        free(A, Q); free(B, Q); free(C, Q);
+        return true;
+    }
+
+    /* Pointer arrays for the group API of gemm_batch: one group of batch products */
+    const Ta **a_array = malloc_shared<const Ta *>(batch, Q);
+    const Ta **b_array = malloc_shared<const Ta *>(batch, Q);
+    Tc **c_array = malloc_shared<Tc *>(batch, Q);
+    for (std::int64_t i = 0; i < batch; i++) {
+        a_array[i] = A + i * stride_a;
+        b_array[i] = B + i * stride_b;
+        c_array[i] = C + i * stride_c;
+    }
+    transpose trans[1] = {N};
+    std::int64_t m_array[1] = {m}, n_array[1] = {n}, k_array[1] = {k};
+    std::int64_t lda_array[1] = {lda}, ldb_array[1] = {ldb}, ldc_array[1] = {ldc};
+    std::int64_t group_size[1] = {batch};
+    Tc alpha[1] = {Tc(1)}, beta[1] = {Tc(0)};
+
+    auto run = [&]() -> event {
+        switch (mode) {
+            case gemm_mode::gemm:
+                return blas::column_major::gemm(Q, N, N, m, n, k, alpha[0], A, lda, B, ldb,
+                                                beta[0], C, ldc, cmode);
+            case gemm_mode::batch:
+                return blas::column_major::gemm_batch(Q, trans, trans, m_array, n_array, k_array, alpha,
+                                                      a_array, lda_array, b_array, ldb_array, beta,
+                                                      c_array, ldc_array, 1, group_size, cmode);
+            default:
+                return blas::column_major::gemm_batch(Q, N, N, m, n, k, alpha[0], A, lda, stride_a,
+                                                      B, ldb, stride_b, beta[0], C, ldc, stride_c,
+                                                      batch, cmode);
+        }
+    };
+
+    constexpr int rd_size = 1048576;
+    std::vector<Ta> host_a(rd_size);
+    std::vector<Tc> host_c(rd_size);
+    bool ok = true;
+    try {
+        /* Verify with all-ones inputs: every entry of C must be k. The first
+         * call also initializes oneMKL and JIT-compiles its kernels. */
+        generate_ones(rd_size, host_a.data());
+        replicate_data(Q, A, stride_a * batch, host_a.data(), rd_size);
+        replicate_data(Q, B, stride_b * batch, host_a.data(), rd_size);
+        run().wait_and_throw();
+        for (std::int64_t i : {std::int64_t(0), batch - 1}) {
+            size_t elems = std::min<size_t>(stride_c, rd_size);
+            Q.copy(C + i * stride_c, host_c.data(), elems).wait();
+            for (size_t e = 0; e < elems; e++)
+                if (std::int64_t(e % ldc) < m && host_c[e] != Tc(k))
+                    ok = false;
+        }
+
+        /* Time random data */
+        generate_random_data(rd_size, host_a.data());
+        replicate_data(Q, A, stride_a * batch, host_a.data(), rd_size);
+        replicate_data(Q, B, stride_b * batch, host_a.data(), rd_size);
+        for (int i = 0; i < opts.warmup; i++)
+            run().wait_and_throw();
+
+        std::vector<double> device_times, host_times;
+        for (int i = 0; i < opts.reps; i++) {
+            auto start = std::chrono::steady_clock::now();
+            event e = run();
+            e.wait_and_throw();
+            auto end = std::chrono::steady_clock::now();
+            host_times.push_back(std::chrono::duration<double>(end - start).count());
+            device_times.push_back(1e-9 * (e.get_profiling_info<info::event_profiling::command_end>() -
+                                           e.get_profiling_info<info::event_profiling::command_start>()));
+        }
+        timing t = summarize(device_times), th = summarize(host_times);
+        double gflops = 2e-9 * double(m) * double(n) * double(k) * double(batch) / t.median;
+
+        std::cout << "  " << std::left << std::setw(5) << precision_string(prec) << std::setw(8) << mode_string(mode)
+                  << std::right << std::setw(7) << m << " x" << std::setw(6) << n << " x" << std::setw(6) << k
+                  << " x" << std::setw(5) << batch << std::fixed << std::setprecision(3)
+                  << std::setw(11) << t.median * 1e3 << " ms" << std::setw(11) << gflops << " GFLOP/s"
+                  << (ok ? "" : "  VERIFICATION FAILED") << "\n" << std::defaultfloat;
+        csv << precision_string(prec) << ',' << mode_string(mode) << ',' << m << ',' << n << ',' << k << ','
+            << batch << ',' << opts.reps << ',' << t.median * 1e3 << ',' << t.p10 * 1e3 << ',' << t.p90 * 1e3
+            << ',' << t.min * 1e3 << ',' << th.median * 1e3 << ',' << gflops << ',' << (ok ? "pass" : "fail")
+            << std::endl;
+    } catch (std::exception const &e) {
+        /* oneMKL or SYCL exception: precision or mode not supported on this device */
+        std::cout << "  " << precision_string(prec) << " " << mode_string(mode) << ": not supported (" << e.what()
+                  << ")\n";
+    }
+
+    free(c_array, Q); free(b_array, Q); free(a_array, Q);
+    free(C, Q); free(B, Q); free(A, Q);
+    return ok;
+}
+
+template <typename Ta, typename Tc>
+static
+bool sweep(queue &Q, precision prec, const options &opts, std::ostream &csv)
+{
+    bool ok = true;
+    for (auto mode : opts.modes) {
+        if (mode == gemm_mode::gemm) {
+            for (auto s : opts.shapes)
+                ok &= bench<Ta, Tc>(Q, prec, mode, s, opts, csv);
+        } else {
+            for (auto size : opts.batch_sizes) {
+                std::int64_t count = opts.batch_count;
+                if (count == 0)
+                    count = std::clamp<std::int64_t>((std::int64_t(1) << 22) / (size * size), 256, 65536);
+                ok &= bench<Ta, Tc>(Q, prec, mode, {size, size, size, count}, opts, csv);
+            }
+        }
+    }
+    return ok;
+}
+
+static
+void usage(const char *pname)
+{
+    std::cerr << "Usage:\n"
+              << "  " << pname << " [options]\n"
+              << "\n"
+              << "Options:\n"
+              << "  --types T,...        data types among fp64, fp32, tf32, bf16 (default: all supported)\n"
+              << "  --modes M,...        modes among gemm, batch (gemm_batch with pointer arrays) and\n"
+              << "                       strided (strided gemm_batch) (default: all)\n"
+              << "  --shapes MxNxK,...   shapes for gemm mode (default: squares from 256 to 4096, and\n"
+              << "                       skinny, tall, deep and shallow shapes)\n"
+              << "  --batch-sizes S,...  square sizes for the batched modes (default: 4,8,16,32,64,128)\n"
+              << "  --batch-count B      number of matrices for the batched modes (default: 65536 to 256,\n"
+              << "                       about 4M elements per operand)\n"
+              << "  --warmup W           untimed calls before timing (default: 3)\n"
+              << "  --reps R             timed calls (default: 20)\n"
+              << "  --csv FILE           CSV output file, - for standard output (default: gemm_sweep.csv)\n"
+              << "\n"
+              << "Times are measured with event profiling; the CSV file holds the median, 10th and 90th\n"
+              << "  percentiles and minimum device time, and the median host time, in milliseconds.\n"
+              << "\n"
+              << "This benchmark uses the default DPC++ device, which can be controlled using\n"
+              << "  the ONEAPI_DEVICE_SELECTOR environment variable\n";
+    std::exit(1);
+}
+
+static
+std::vector<std::string> split(const std::string &list, char sep)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    for (std::string item; std::getline(ss, item, sep);)
+        items.push_back(item);
+    return items;
+}
+
+static
+options parse_options(int argc, char **argv)
+{
+    options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        std::string value = argv[++i];
+        if (arg == "--types") {
+            opts.precisions.clear();
+            for (auto &t : split(value, ',')) {
+                if (t == "fp64") opts.precisions.push_back(precision::fp64);
+                else if (t == "fp32") opts.precisions.push_back(precision::fp32);
+                else if (t == "tf32") opts.precisions.push_back(precision::tf32);
+                else if (t == "bf16") opts.precisions.push_back(precision::bf16);
+                else usage(argv[0]);
+            }
+        } else if (arg == "--modes") {
+            opts.modes.clear();
+            for (auto &m : split(value, ',')) {
+                if (m == "gemm") opts.modes.push_back(gemm_mode::gemm);
+                else if (m == "batch") opts.modes.push_back(gemm_mode::batch);
+                else if (m == "strided") opts.modes.push_back(gemm_mode::strided);
+                else usage(argv[0]);
+            }
+        } else if (arg == "--shapes") {
+            opts.shapes.clear();
+            for (auto &s : split(value, ',')) {
+                auto dims = split(s, 'x');
+                if (dims.size() != 3)
+                    usage(argv[0]);
+                shape sh = {std::atol(dims[0].c_str()), std::atol(dims[1].c_str()), std::atol(dims[2].c_str()), 1};
+                if (sh.m <= 0 || sh.n <= 0 || sh.k <= 0)
+                    usage(argv[0]);
+                opts.shapes.push_back(sh);
+            }
+        } else if (arg == "--batch-sizes") {
+            opts.batch_sizes.clear();
+            for (auto &s : split(value, ',')) {
+                opts.batch_sizes.push_back(std::atol(s.c_str()));
+                if (opts.batch_sizes.back() <= 0)
+                    usage(argv[0]);
+            }
+        } else if (arg == "--batch-count") {
+            opts.batch_count = std::atol(value.c_str());
+        } else if (arg == "--warmup") {
+            opts.warmup = std::atoi(value.c_str());
+        } else if (arg == "--reps") {
+            opts.reps = std::atoi(value.c_str());
+        } else if (arg == "--csv") {
+            opts.csv = value;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (opts.batch_count < 0 || opts.warmup < 0 || opts.reps <= 0)
+        usage(argv[0]);
+    return opts;
+}
+
+static
+bool device_has_fp64(sycl::device const& D) {
+    return (D.get_info<sycl::info::device::double_fp_config>().size() != 0);
+}
+
+static
+void device_info(sycl::device const& D) {
+    std::cout << "oneMKL DPC++ GEMM benchmark harness\n"
+              << "-----------------------------------\n"
+              << "Platform:                " << D.get_platform().get_info<info::platform::name>()         << "\n"
+              << "Device:                  " << D.get_info<info::device::name>()                          << "\n"
+              << "Driver_version:          " << D.get_info<info::device::driver_version>()                << "\n"
+              << "Core/EU count:           " << D.get_info<info::device::max_compute_units>()             << "\n"
+              << "Maximum clock frequency: " << D.get_info<info::device::max_clock_frequency>() << " MHz" << "\n"
+              << "FP64 capability:         " << (device_has_fp64(D) ? "yes" : "no") << "\n"
+              << "\n"
+              ;
+}
+
+int main(int argc, char **argv)
+{
+    options opts = parse_options(argc, argv);
+
+    std::ofstream csv_file;
+    if (opts.csv != "-") {
+        csv_file.open(opts.csv);
+        if (!csv_file) {
+            std::cerr << "Cannot open " << opts.csv << "\n";
+            return 1;
+        }
+    }
+    std::ostream &csv = (opts.csv != "-") ? csv_file : std::cout;
+    csv << "precision,mode,m,n,k,batch,reps,median_ms,p10_ms,p90_ms,min_ms,host_median_ms,gflops,verification"
+        << std::endl;
+
+    bool g_success = true;
+    try {
+        device D(default_selector_v);
+        device_info(D);
+
+        context C(D);
+        queue Q(C, D, property::queue::enable_profiling{});
+
+        for (auto prec : opts.precisions) {
+            switch (prec) {
+                case precision::fp64:
+                    if (device_has_fp64(D))
+                        g_success &= sweep<double, double>(Q, prec, opts, csv);
+                    else
+                        std::cout << "  fp64: no FP64 capability on given SYCL device, skipped\n";
+                    break;
+                case precision::fp32:
+                case precision::tf32:
+                    g_success &= sweep<float, float>(Q, prec, opts, csv);
+                    break;
+                case precision::bf16:
+                    g_success &= sweep<bfloat16, float>(Q, prec, opts, csv);
+                    break;
+            }
+        }
+    } catch (sycl::exception const& e) {
+        std::cerr << "SYCL exception: " << e.what() << "\n";
+        return 139;
+    }
+
+    if (opts.csv != "-")
+        std::cout << "\nResults written to " << opts.csv << "\n";
+    return g_success ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+// Streaming repricing of changing portfolios with mc::pricer.
+//
+// Usage: montecarlo_portfolio [num_batches] [max_batch_size] [path_length]
+//
+// Batches of random size are filled on the host while previously submitted
+// batches are priced on the device. Every result is checked against the
+// Black-Scholes price, delta and vega.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+#include "montecarlo_pricer.hpp"
+#include "timer.hpp"
+
+template <typename DataType>
+struct bs_reference
+{
+    DataType price, delta, vega;
+};
+
+template <typename DataType>
+bs_reference<DataType> black_scholes(const mc::option<DataType>& opt)
+{
+    // BSM Formula: https://www.nobelprize.org/prizes/economic-sciences/1997/press-release/
+    const double S = opt.spot, L = opt.strike, t = opt.years, r = opt.risk_free, sigma = opt.volatility;
+    const double d1 = (std::log(S / L) + (r + 0.5 * sigma * sigma) * t) / (sigma * std::sqrt(t));
+    const double d2 = d1 - sigma * std::sqrt(t);
+    const double N_d1 = 0.5 + 0.5 * std::erf(d1 / std::sqrt(2.));
+    const double N_d2 = 0.5 + 0.5 * std::erf(d2 / std::sqrt(2.));
+    const double phi_d1 = std::exp(-0.5 * d1 * d1) / std::sqrt(2. * M_PI);
+    const double call = S * N_d1 - L * std::exp(-r * t) * N_d2;
+
+    bs_reference<DataType> ref;
+    if (opt.type == mc::option_type::call) {
+        ref.price = static_cast<DataType>(call);
+        ref.delta = static_cast<DataType>(N_d1);
+    } else {
+        ref.price = static_cast<DataType>(call - S + L * std::exp(-r * t));
+        ref.delta = static_cast<DataType>(N_d1 - 1.0);
+    }
+    ref.vega = static_cast<DataType>(S * phi_d1 * std::sqrt(t));
+    return ref;
+}
+
+template <typename DataType>
+void run(int num_batches, int max_batch_size, std::int64_t path_length)
+{
+    try {
+        sycl::queue my_queue;
+
+        timer tt{};
+        mc::pricer<DataType> pricer(my_queue, path_length);
+        tt.stop();
+
+        std::cout << "Streaming MonteCarlo European Option Pricing in " <<
+            (std::is_same_v<DataType, double> ? "Double" : "Single") << " precision" << std::endl;
+        std::cout << "Device: " << my_queue.get_device().get_info<sycl::info::device::name>() << std::endl;
+        std::cout << "Path Length = " << pricer.path_length() << ", sycl::vec size = " << pricer.vec_size() <<
+            ", Batches = " << num_batches << ", Max Batch Size = " << max_batch_size << std::endl;
+        std::cout << "Pricer set up in " << tt.duration() << " seconds" << std::endl;
+
+        // Ring of batch buffers: the host refills one while the others are priced
+        constexpr int ring_size = 3;
+        std::vector<mc::option<DataType>*> options(ring_size);
+        std::vector<mc::option_result<DataType>*> results(ring_size);
+        std::vector<sycl::event> done(ring_size);
+        std::vector<int> sizes(ring_size, 0);
+        for (int i = 0; i < ring_size; i++) {
+            options[i] = sycl::malloc_shared<mc::option<DataType>>(max_batch_size, my_queue);
+            results[i] = sycl::malloc_shared<mc::option_result<DataType>>(max_batch_size, my_queue);
+        }
+
+        std::mt19937 gen(777);
+        std::uniform_int_distribution<int> batch_size(1, max_batch_size);
+        std::uniform_real_distribution<DataType> spot(5.0, 50.0), strike(10.0, 25.0), years(1.0, 5.0);
+        std::uniform_real_distribution<DataType> risk_free(0.01, 0.08), volatility(0.1, 0.4);
+
+        double sum_price_err = 0.0, sum_price_ref = 0.0, sum_delta_err = 0.0, sum_vega_err = 0.0, sum_vega_ref = 0.0;
+        double sum_reserve = 0.0;
+        std::size_t num_options = 0;
+
+        auto check_batch = [&](int slot) {
+            done[slot].wait_and_throw();
+            for (int i = 0; i < sizes[slot]; i++) {
+                const auto ref = black_scholes(options[slot][i]);
+                const auto& res = results[slot][i];
+                const double delta = std::fabs(res.price - ref.price);
+                sum_price_err += delta;
+                sum_price_ref += std::fabs(ref.price);
+                if (delta > 1e-6)
+                    sum_reserve += res.confidence / delta;
+                sum_delta_err += std::fabs(res.delta - ref.delta);
+                sum_vega_err += std::fabs(res.vega - ref.vega);
+                sum_vega_ref += std::fabs(ref.vega);
+            }
+            num_options += sizes[slot];
+        };
+
+        tt.start();
+        for (int batch = 0; batch < num_batches; batch++) {
+            const int slot = batch % ring_size;
+            if (batch >= ring_size)
+                check_batch(slot);
+
+            sizes[slot] = batch_size(gen);
+            for (int i = 0; i < sizes[slot]; i++) {
+                options[slot][i] = { spot(gen), strike(gen), years(gen), risk_free(gen), volatility(gen),
+                                     (i % 2) ? mc::option_type::put : mc::option_type::call };
+            }
+            done[slot] = pricer.submit(options[slot], sizes[slot], results[slot]);
+        }
+        for (int batch = std::max(0, num_batches - ring_size); batch < num_batches; batch++)
+            check_batch(batch % ring_size);
+        tt.stop();
+
+        std::cout << "Completed in " << tt.duration() << " seconds. Options per second = " <<
+            static_cast<double>(num_options) / tt.duration() << std::endl;
+
+        for (int i = 0; i < ring_size; i++) {
+            sycl::free(options[i], my_queue);
+            sycl::free(results[i], my_queue);
+        }
+
+        std::cout << "Running quality test..." << std::endl;
+        sum_reserve /= static_cast<double>(num_options);
+        const double price_L1_norm = sum_price_err / sum_price_ref;
+        const double delta_mean_err = sum_delta_err / static_cast<double>(num_options);
+        const double vega_L1_norm = sum_vega_err / sum_vega_ref;
+        std::cout << "Price L1_Norm    = " << price_L1_norm << std::endl;
+        std::cout << "Average RESERVE  = " << sum_reserve << std::endl;
+        std::cout << "Delta mean error = " << delta_mean_err << std::endl;
+        std::cout << "Vega L1_Norm     = " << vega_L1_norm << std::endl;
+        if (sum_reserve > 1.0 && delta_mean_err < 1e-2 && vega_L1_norm < 1e-2) {
+            std::cout << "TEST PASSED" << std::endl;
+        }
+        else {
+            std::cout << "TEST FAILED" << std::endl;
+            exit(1);
+        }
+    }
+    catch (sycl::exception e) {
+        std::cout << e.what();
+        exit(1);
+    }
+}
+
+int main(int argc, char** argv){
+    const int num_batches = argc > 1 ? std::stoi(argv[1]) : 64;
+    const int max_batch_size = argc > 2 ? std::stoi(argv[2]) : 8192;
+    const std::int64_t path_length = argc > 3 ? std::stoll(argv[3]) : 262144;
+
+    bool is_fp64 = true;
+    {
+        sycl::queue test_queue;
+        is_fp64 = test_queue.get_device().has(sycl::aspect::fp64);
+    }
+    if (is_fp64) {
+        run<double>(num_batches, max_batch_size, path_length);
+    } else {
+        std::cout<<"Warning: could not find a device with double precision support. Single precision is used."<<std::endl;
+        run<float>(num_batches, max_batch_size, path_length);
+    }
+}
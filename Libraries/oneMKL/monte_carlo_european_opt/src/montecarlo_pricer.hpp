@@ -0,0 +1,265 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+#pragma once
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+#include <oneapi/mkl/rng/device.hpp>
+
+namespace mc {
+
+enum class option_type : std::int32_t { call, put };
+
+template<typename DataType>
+struct option
+{
+    DataType spot;
+    DataType strike;
+    DataType years;
+    DataType risk_free;
+    DataType volatility;
+    option_type type;
+};
+
+template<typename DataType>
+struct option_result
+{
+    DataType price;
+    DataType confidence;
+    DataType delta;
+    DataType vega;
+};
+
+namespace mkl_rng = oneapi::mkl::rng;
+
+template<int VecSize>
+#if USE_PHILOX
+using device_engine = mkl_rng::device::philox4x32x10<VecSize>;
+#elif USE_MRG
+using device_engine = mkl_rng::device::mrg32k3a<VecSize>;
+#else
+using device_engine = mkl_rng::device::mcg59<VecSize>;
+#endif
+
+template<typename Type, int>
+class k_price_portfolio; // can be useful for profiling
+template<typename Type, int>
+class k_initialize_pricer_state; // can be useful for profiling
+
+// Picks the sycl::vec width of the device engine: the preferred SIMD width
+// on CPUs (so one generate() call fills a whole register), 8 elsewhere,
+// where work-items of a sub-group already run in SIMD lanes and the vector
+// only amortizes generator state updates.
+template<typename DataType>
+int choose_vec_size(const sycl::device& device)
+{
+    if (!device.is_cpu())
+        return 8;
+    const unsigned width = std::is_same_v<DataType, double>
+        ? device.get_info<sycl::info::device::preferred_vector_width_double>()
+        : device.get_info<sycl::info::device::preferred_vector_width_float>();
+    int vec_size = 2;
+    while (vec_size < 16 && static_cast<unsigned>(vec_size * 2) <= width)
+        vec_size *= 2;
+    return vec_size;
+}
+
+// Monte Carlo pricer of European options that stays resident on a device.
+//
+// The device RNG states and the compiled kernels are created once by the
+// constructor and reused by every submit(), so a risk system can reprice
+// batches of arbitrary size as they arrive. Each work-group prices one
+// option at a time, walking the batch with a stride of the number of
+// work-groups; each work-item keeps its own generator state, which is
+// written back after every batch so consecutive batches draw fresh paths.
+//
+// Besides the price and its 95% confidence interval every result carries
+// delta and vega computed with pathwise derivatives from the same paths:
+//     delta = e^(-rT) E[1{ITM} S_T / S0],
+//     vega  = e^(-rT) E[1{ITM} S_T (ln(S_T/S0) - (r + sigma^2/2) T) / sigma],
+// negated for puts.
+template<typename DataType>
+class pricer
+{
+public:
+    // The number of paths per option is rounded up to a multiple of
+    // local_size * vec_size; path_length() returns the actual value.
+    pricer(sycl::queue& queue, std::int64_t path_length, std::uint32_t seed = 777, int vec_size = 0)
+        : queue_(queue.get_context(), queue.get_device(), sycl::property::queue::in_order{}),
+          vec_size_(vec_size ? vec_size : choose_vec_size<DataType>(queue.get_device()))
+    {
+        if (vec_size_ != 2 && vec_size_ != 4 && vec_size_ != 8 && vec_size_ != 16)
+            throw std::invalid_argument("vec_size must be 2, 4, 8 or 16");
+        if (path_length < 2)
+            throw std::invalid_argument("path_length must be > 1");
+
+        const sycl::device device = queue_.get_device();
+        local_size_ = std::min<std::size_t>(256, device.get_info<sycl::info::device::max_work_group_size>());
+        n_groups_ = 8 * static_cast<std::size_t>(device.get_info<sycl::info::device::max_compute_units>());
+        const std::size_t paths_per_block = local_size_ * vec_size_;
+        block_n_ = static_cast<int>((path_length + paths_per_block - 1) / paths_per_block);
+
+        switch (vec_size_) {
+            case 2: initialize<2>(seed); break;
+            case 4: initialize<4>(seed); break;
+            case 8: initialize<8>(seed); break;
+            default: initialize<16>(seed); break;
+        }
+    }
+
+    pricer(const pricer&) = delete;
+    pricer& operator=(const pricer&) = delete;
+
+    std::int64_t path_length() const { return static_cast<std::int64_t>(block_n_) * local_size_ * vec_size_; }
+    int vec_size() const { return vec_size_; }
+    sycl::queue& queue() { return queue_; }
+
+    // Prices COUNT options and returns immediately. OPTIONS and RESULTS must
+    // be USM allocations accessible on the pricer's device. Batches are
+    // executed in submission order.
+    sycl::event submit(const option<DataType>* options, std::size_t count, option_result<DataType>* results,
+                       const std::vector<sycl::event>& deps = {})
+    {
+        switch (vec_size_) {
+            case 2: return submit_impl<2>(options, count, results, deps);
+            case 4: return submit_impl<4>(options, count, results, deps);
+            case 8: return submit_impl<8>(options, count, results, deps);
+            default: return submit_impl<16>(options, count, results, deps);
+        }
+    }
+
+private:
+    template<int VecSize>
+    void initialize(std::uint32_t seed)
+    {
+        using EngineTypeDevice = device_engine<VecSize>;
+
+        // Build both kernels now so that the first batch does not pay for JIT
+        bundle_ = std::make_unique<sycl::kernel_bundle<sycl::bundle_state::executable>>(
+            sycl::get_kernel_bundle<sycl::bundle_state::executable>(queue_.get_context(), {queue_.get_device()},
+                {sycl::get_kernel_id<k_initialize_pricer_state<DataType, VecSize>>(),
+                 sycl::get_kernel_id<k_price_portfolio<DataType, VecSize>>()}));
+
+        const std::size_t n_states = n_groups_ * local_size_;
+        auto* rng_states = sycl::malloc_device<EngineTypeDevice>(n_states, queue_);
+        if (!rng_states)
+            throw std::bad_alloc();
+        auto q = queue_;
+        states_ = std::shared_ptr<void>(rng_states, [q](void* ptr) { sycl::free(ptr, q); });
+
+        queue_.submit([&](sycl::handler& cgh) {
+            cgh.use_kernel_bundle(*bundle_);
+            cgh.parallel_for<k_initialize_pricer_state<DataType, VecSize>>(
+                sycl::range<1>(n_states),
+                [=](sycl::item<1> idx) {
+                    auto id = idx[0];
+#if USE_MRG
+                    rng_states[id] = EngineTypeDevice({ seed, seed, seed, seed, seed, seed }, { 0, (4096 * id) });
+#else
+                    // Disjoint subsequences of 2^38 numbers per work-item
+                    rng_states[id] = EngineTypeDevice(seed, static_cast<std::uint64_t>(id) << 38);
+#endif
+                });
+        }).wait_and_throw();
+    }
+
+    template<int VecSize>
+    sycl::event submit_impl(const option<DataType>* options, std::size_t count, option_result<DataType>* results,
+                            const std::vector<sycl::event>& deps)
+    {
+        using EngineTypeDevice = device_engine<VecSize>;
+
+        auto* rng_states = static_cast<EngineTypeDevice*>(states_.get());
+        const std::size_t n_groups = std::max<std::size_t>(1, std::min(n_groups_, count));
+        const std::size_t local_size = local_size_;
+        const int block_n = block_n_;
+        const DataType fpath_lengthN = static_cast<DataType>(path_length());
+        const DataType stddev_denom = DataType(1) / (fpath_lengthN * (fpath_lengthN - DataType(1)));
+        const DataType confidence_denom = DataType(1.96) / std::sqrt(fpath_lengthN);
+
+        return queue_.submit([&](sycl::handler& cgh) {
+            cgh.depends_on(deps);
+            cgh.use_kernel_bundle(*bundle_);
+            cgh.parallel_for<k_price_portfolio<DataType, VecSize>>(
+                sycl::nd_range<1>({n_groups * local_size}, {local_size}),
+                [=](sycl::nd_item<1> item)
+                {
+                    auto local_state = rng_states[item.get_global_id()];
+
+                    for (std::size_t i_options = item.get_group_linear_id(); i_options < count; i_options += n_groups)
+                    {
+                        const option<DataType> opt = options[i_options];
+                        const DataType sign = (opt.type == option_type::call) ? DataType(1) : DataType(-1);
+                        const DataType drift = opt.risk_free + DataType(0.5) * opt.volatility * opt.volatility;
+                        const DataType MuByT = DataType(M_LOG2E) * (drift - opt.volatility * opt.volatility) * opt.years;
+                        const DataType VBySqrtT = DataType(M_LOG2E) * opt.volatility * sycl::sqrt(opt.years);
+                        DataType v0 = 0, v1 = 0, vd = 0, vv = 0;
+
+                        // Paths are generated in log2(S_T/S0)
+                        mkl_rng::device::gaussian<DataType> distr(MuByT, VBySqrtT);
+
+                        for (int block = 0; block < block_n; ++block)
+                        {
+                            auto rng_val_vec = mkl_rng::device::generate(distr, local_state);
+                            auto st_vec = opt.spot * sycl::exp2(rng_val_vec);
+                            for (int lane = 0; lane < VecSize; ++lane)
+                            {
+                                const DataType payoff = sycl::max(sign * (st_vec[lane] - opt.strike), DataType{});
+                                const DataType st_itm = payoff > DataType{} ? st_vec[lane] : DataType{};
+
+                                // reduce within the work-item
+                                v0 += payoff;
+                                v1 += payoff * payoff;
+                                vd += st_itm;
+                                vv += st_itm * rng_val_vec[lane];
+                            }
+                        }
+
+                        // reduce within the work-group
+                        v0 = sycl::reduce_over_group(item.get_group(), v0, std::plus<>());
+                        v1 = sycl::reduce_over_group(item.get_group(), v1, std::plus<>());
+                        vd = sycl::reduce_over_group(item.get_group(), vd, std::plus<>());
+                        vv = sycl::reduce_over_group(item.get_group(), vv, std::plus<>());
+
+                        if (item.get_local_id() == 0)
+                        {
+                            const DataType exprt = sycl::exp(-opt.risk_free * opt.years);
+                            const DataType std_dev = sycl::sqrt((fpath_lengthN * v1 - v0 * v0) * stddev_denom);
+                            option_result<DataType> res;
+                            res.price = exprt * v0 / fpath_lengthN;
+                            res.confidence = exprt * std_dev * confidence_denom;
+                            res.delta = sign * exprt * vd / (fpath_lengthN * opt.spot);
+                            res.vega = sign * exprt * (DataType(M_LN2) * vv - drift * opt.years * vd)
+                                / (fpath_lengthN * opt.volatility);
+                            results[i_options] = res;
+                        }
+                    }
+
+                    rng_states[item.get_global_id()] = local_state;
+                });
+        });
+    }
+
+    sycl::queue queue_;
+    int vec_size_;
+    std::size_t local_size_ = 0;
+    std::size_t n_groups_ = 0;
+    int block_n_ = 0;
+    std::shared_ptr<void> states_;
+    std::unique_ptr<sycl::kernel_bundle<sycl::bundle_state::executable>> bundle_;
+};
+
+} // namespace mc
@@ -0,0 +1,381 @@
+//==============================================================
+// Copyright © 2023 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+/*
+*
+*  Content:
+*       This file contains Multiple Simple and Weighted Random Sampling without
+*       replacement from large populations for DPC++ device interface of
+*       random number generators
+*
+*******************************************************************************/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+#include "oneapi/mkl/rng/device.hpp"
+
+using namespace oneapi;
+
+// Initialization value for random number generator
+static const auto seed = 777;
+
+// Sampling default parameters
+static const auto m_def = 100; // sample size
+static const auto n_def = 10000000; // population size
+static const auto num_exp_def = 100000; // number of experiments
+
+// Each experiment keeps the values it has drawn in an open-addressing hash set
+// in local memory, with at least twice as many slots as values, instead of the
+// whole population: local memory use grows with M, not with N.
+struct hash_set_layout {
+    hash_set_layout(sycl::queue& q, size_t m) {
+        log2_capacity = 1;
+        while ((size_t{1} << log2_capacity) < 2 * m) {
+            ++log2_capacity;
+        }
+        capacity = size_t{1} << log2_capacity;
+        auto device = q.get_device();
+        size_t local_mem = device.get_info<sycl::info::device::local_mem_size>();
+        size_t max_wg = device.get_info<sycl::info::device::max_work_group_size>();
+        wg_size = std::min<size_t>({256, max_wg, local_mem / (capacity * sizeof(std::uint32_t))});
+        if (wg_size == 0) {
+            throw std::invalid_argument("M is too large for the local memory of the device");
+        }
+    }
+    size_t log2_capacity;
+    size_t capacity;
+    // Experiments (one per work-item) of a work-group
+    size_t wg_size;
+};
+
+// Inserts value (> 0) in the hash set table of 2^log2_capacity slots
+// (0 marks an empty slot). Returns false if the value was already there.
+static inline bool hash_set_insert(std::uint32_t* table, size_t log2_capacity, std::uint32_t value) {
+    const std::uint32_t mask = (std::uint32_t{1} << log2_capacity) - 1;
+    // Fibonacci hashing, then linear probing
+    std::uint32_t slot = (value * 2654435769u) >> (32 - log2_capacity);
+    while (true) {
+        std::uint32_t current = table[slot];
+        if (current == value) {
+            return false;
+        }
+        if (current == 0) {
+            table[slot] = value;
+            return true;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+// Unbiased random integer from {0, ..., range - 1} (Lemire's method)
+template <typename EngineType>
+static inline std::uint32_t uniform_index(EngineType& engine, std::uint32_t range) {
+    oneapi::mkl::rng::device::bits<std::uint32_t> distr;
+    std::uint64_t prod = std::uint64_t{oneapi::mkl::rng::device::generate(distr, engine)} * range;
+    if (static_cast<std::uint32_t>(prod) < range) {
+        const std::uint32_t threshold = (0u - range) % range;
+        while (static_cast<std::uint32_t>(prod) < threshold) {
+            prod = std::uint64_t{oneapi::mkl::rng::device::generate(distr, engine)} * range;
+        }
+    }
+    return static_cast<std::uint32_t>(prod >> 32);
+}
+
+// Simple random sampling: num_exp samples of m unique numbers from 1, 2, ..., N
+// written to result[id * m, (id + 1) * m), with Floyd's algorithm. One
+// experiment per work-item, m random numbers per experiment whatever N is.
+sycl::event lottery_large(sycl::queue& q, size_t m, size_t n, size_t num_exp, std::uint32_t* result) {
+    if (m == 0 || m > n || n > UINT32_MAX) {
+        throw std::invalid_argument("1 <= M <= N < 2^32 is required");
+    }
+    hash_set_layout layout(q, m);
+    const size_t log2_capacity = layout.log2_capacity, capacity = layout.capacity;
+
+    return q.submit([&](sycl::handler& h) {
+        sycl::local_accessor<std::uint32_t> local_sets(sycl::range<1>{layout.wg_size * capacity}, h);
+        size_t global_size = (num_exp + layout.wg_size - 1) / layout.wg_size * layout.wg_size;
+        h.parallel_for(sycl::nd_range<1>(global_size, layout.wg_size),
+            [=](sycl::nd_item<1> item) {
+            size_t id = item.get_global_id(0);
+            if (id >= num_exp) {
+                return;
+            }
+            std::uint32_t* set = &local_sets[item.get_local_id(0) * capacity];
+            for (size_t i = 0; i < capacity; ++i) {
+                set[i] = 0;
+            }
+            // Create an object of basic random number generator (engine);
+            // each experiment uses its own subsequence of 2^32 numbers
+            oneapi::mkl::rng::device::philox4x32x10 engine(seed, id << 32);
+
+            // For j = N - M + 1, ..., N: draw t from {1, ..., j} and take it if
+            // it is new, j (which cannot have been taken yet) otherwise
+            std::uint32_t* res = result + id * m;
+            for (size_t j = n - m + 1; j <= n; ++j) {
+                std::uint32_t t = 1 + uniform_index(engine, static_cast<std::uint32_t>(j));
+                if (!hash_set_insert(set, log2_capacity, t)) {
+                    t = static_cast<std::uint32_t>(j);
+                    hash_set_insert(set, log2_capacity, t);
+                }
+                *res++ = t;
+            }
+        });
+    });
+}
+
+// Walker's alias table of a discrete distribution over 1, 2, ..., N in device
+// memory: number i + 1 is drawn by taking a uniform index i and keeping it with
+// probability prob[i], or taking alias[i] + 1 instead.
+struct alias_table {
+    alias_table(sycl::queue& q, const std::vector<float>& weights) : q(q), n(weights.size()) {
+        // Vose's construction, on the host
+        std::vector<float> host_prob(n);
+        std::vector<std::uint32_t> host_alias(n);
+        std::vector<std::uint32_t> small, large;
+        double sum = 0.0;
+        for (float w : weights) {
+            if (!(w >= 0.0f)) {
+                throw std::invalid_argument("Weights must be non-negative");
+            }
+            sum += w;
+            n_positive += w > 0.0f;
+        }
+        std::vector<double> scaled(n);
+        for (size_t i = 0; i < n; ++i) {
+            scaled[i] = weights[i] * n / sum;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            std::uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            host_prob[s] = static_cast<float>(scaled[s]);
+            host_alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        for (auto i : large) {
+            host_prob[i] = 1.0f;
+            host_alias[i] = i;
+        }
+        for (auto i : small) { // only due to rounding
+            host_prob[i] = 1.0f;
+            host_alias[i] = i;
+        }
+        prob = sycl::malloc_device<float>(n, q);
+        alias = sycl::malloc_device<std::uint32_t>(n, q);
+        q.memcpy(prob, host_prob.data(), n * sizeof(float));
+        q.memcpy(alias, host_alias.data(), n * sizeof(std::uint32_t));
+        q.wait_and_throw();
+    }
+    ~alias_table() {
+        sycl::free(prob, q);
+        sycl::free(alias, q);
+    }
+    sycl::queue& q;
+    size_t n;
+    // Numbers which can be drawn
+    size_t n_positive = 0;
+    float* prob;
+    std::uint32_t* alias;
+};
+
+// Weighted random sampling: num_exp samples of m unique numbers from
+// 1, 2, ..., N, drawn one after another with probabilities proportional to the
+// weights of the numbers not drawn yet, written to result[id * m, (id + 1) * m)
+// in drawing order. Numbers are drawn from the alias table and rejected if
+// already in the sample, which gives exactly these probabilities; the
+// expected number of rejections is small unless the sample holds most of the
+// total weight. At least m weights must be positive.
+sycl::event lottery_weighted(sycl::queue& q, size_t m, const alias_table& table, size_t num_exp,
+                             std::uint32_t* result) {
+    const size_t n = table.n;
+    if (m == 0 || m > table.n_positive || n > UINT32_MAX) {
+        throw std::invalid_argument("1 <= M <= (number of positive weights) and N < 2^32 are required");
+    }
+    hash_set_layout layout(q, m);
+    const size_t log2_capacity = layout.log2_capacity, capacity = layout.capacity;
+    const float* prob = table.prob;
+    const std::uint32_t* alias = table.alias;
+
+    return q.submit([&](sycl::handler& h) {
+        sycl::local_accessor<std::uint32_t> local_sets(sycl::range<1>{layout.wg_size * capacity}, h);
+        size_t global_size = (num_exp + layout.wg_size - 1) / layout.wg_size * layout.wg_size;
+        h.parallel_for(sycl::nd_range<1>(global_size, layout.wg_size),
+            [=](sycl::nd_item<1> item) {
+            size_t id = item.get_global_id(0);
+            if (id >= num_exp) {
+                return;
+            }
+            std::uint32_t* set = &local_sets[item.get_local_id(0) * capacity];
+            for (size_t i = 0; i < capacity; ++i) {
+                set[i] = 0;
+            }
+            oneapi::mkl::rng::device::philox4x32x10 engine(seed, id << 32);
+            oneapi::mkl::rng::device::bits<std::uint32_t> bits;
+
+            std::uint32_t* res = result + id * m;
+            for (size_t i = 0; i < m; ++i) {
+                std::uint32_t value;
+                do {
+                    std::uint32_t idx = uniform_index(engine, static_cast<std::uint32_t>(n));
+                    // Uniform float from [0, 1) with 24 random bits
+                    float u = (oneapi::mkl::rng::device::generate(bits, engine) >> 8) * 0x1.0p-24f;
+                    value = 1 + (u < prob[idx] ? idx : alias[idx]);
+                } while (!hash_set_insert(set, log2_capacity, value));
+                *res++ = value;
+            }
+        });
+    });
+}
+
+// Prints last 3 samples (at most 10 numbers of each)
+void print_results(std::vector<std::uint32_t>& res, size_t m) {
+    for (size_t i = res.size() / m - 3; i < res.size() / m; ++i) {
+        std::cout << "Sample " << i << " of " << res.size() / m << ": ";
+        for (size_t j = 0; j < std::min<size_t>(m, 10); ++j) {
+            std::cout << res[i * m + j] << ", ";
+        }
+        std::cout << (m > 10 ? "..." : "") << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+// Check whether every experiment contains unique numbers from the [1, n] range
+bool check_unique(std::vector<std::uint32_t> res, size_t m, size_t n) {
+    for (size_t i = 0; i < res.size() / m; ++i) {
+        auto first_iter = res.begin() + m * i;
+        std::sort(first_iter, first_iter + m);
+        if (std::adjacent_find(first_iter, first_iter + m) != first_iter + m ||
+            first_iter[0] < 1 || first_iter[m - 1] > n) {
+            std::cout << "Error: the experiment " << i << " contains duplicates or numbers out of range" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check that a fraction of draws (observed among total) is within 5 standard
+// deviations of the expected probability p
+bool check_fraction(const char* what, size_t observed, size_t total, double p) {
+    double fraction = static_cast<double>(observed) / total;
+    double tolerance = 5.0 * std::sqrt(p * (1.0 - p) / total);
+    std::cout << what << ": " << fraction << " (expected " << p << ")" << std::endl;
+    return std::fabs(fraction - p) <= tolerance;
+}
+
+int main(int argc, char ** argv) {
+
+    std::cout << std::endl;
+    std::cout << "Multiple Simple and Weighted Random Sampling without replacement" << std::endl;
+    std::cout << "Device Api, large populations" << std::endl;
+    std::cout << "---------------------------------------------------" << std::endl;
+
+    size_t m = m_def;
+    size_t n = n_def;
+    size_t num_exp = num_exp_def;
+    if(argc >= 4) {
+        m = atol(argv[1]);
+        n = atol(argv[2]);
+        num_exp = atol(argv[3]);
+        if(m == 0 || num_exp < 3 || m > n || n > UINT32_MAX) {
+            m = m_def;
+            n = n_def;
+            num_exp = num_exp_def;
+        }
+    }
+    std::cout << "M = " << m << ", N = " << n << ", Number of experiments = " << num_exp << std::endl;
+    // This exception handler will catch async exceptions
+    auto exception_handler = [&](sycl::exception_list exceptions) {
+        for(std::exception_ptr const& e : exceptions) {
+            try {
+                std::rethrow_exception(e);
+            } catch (sycl::exception const& e) {
+                std::cout << "Caught asynchronous SYCL exception:\n" << e.what() << std::endl;
+                std::terminate();
+            }
+        }
+    };
+
+    // Result storage
+    std::vector<std::uint32_t> uniform_vec(m * num_exp), weighted_vec(m * num_exp);
+
+    // Weights: numbers in the upper half of the population are 4 times as
+    // likely to be drawn as numbers in the lower half
+    std::vector<float> weights(n);
+    for (size_t i = 0; i < n; ++i) {
+        weights[i] = (i < n / 2) ? 1.0f : 4.0f;
+    }
+    const double p_upper = 4.0 * (n - n / 2) / (n / 2 + 4.0 * (n - n / 2));
+
+    try {
+        // Queue constructor passed exception handler
+        sycl::queue q(sycl::default_selector_v, exception_handler);
+        // Samples stay in a compact device array, ready for downstream kernels
+        std::uint32_t* result = sycl::malloc_device<std::uint32_t>(m * num_exp, q);
+
+        // Launch simple random sampling (the first launch includes JIT compilation)
+        lottery_large(q, m, n, num_exp, result).wait_and_throw();
+        auto start = std::chrono::steady_clock::now();
+        lottery_large(q, m, n, num_exp, result).wait_and_throw();
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        std::cout << "Simple sampling: " << m * num_exp / time.count() << " samples/s" << std::endl;
+        q.memcpy(uniform_vec.data(), result, m * num_exp * sizeof(std::uint32_t)).wait_and_throw();
+
+        // Launch weighted random sampling
+        alias_table table(q, weights);
+        lottery_weighted(q, m, table, num_exp, result).wait_and_throw();
+        start = std::chrono::steady_clock::now();
+        lottery_weighted(q, m, table, num_exp, result).wait_and_throw();
+        time = std::chrono::steady_clock::now() - start;
+        std::cout << "Weighted sampling: " << m * num_exp / time.count() << " samples/s" << std::endl;
+        q.memcpy(weighted_vec.data(), result, m * num_exp * sizeof(std::uint32_t)).wait_and_throw();
+
+        sycl::free(result, q);
+    } catch (...) {
+        // Some other exception detected
+        std::cout << "Failure" << std::endl;
+        std::terminate();
+    }
+
+    // Print output
+    std::cout << std::endl << "Simple sampling" << std::endl;
+    print_results(uniform_vec, m);
+    std::cout << "Weighted sampling" << std::endl;
+    print_results(weighted_vec, m);
+
+    // Every number of a simple sample is in the upper half of the population
+    // with probability (N - N / 2) / N; the first number of a weighted sample
+    // is drawn with probabilities proportional to the weights
+    size_t uniform_upper = std::count_if(uniform_vec.begin(), uniform_vec.end(),
+                                         [n](std::uint32_t val) { return val > n / 2; });
+    size_t weighted_upper = 0;
+    for (size_t i = 0; i < num_exp; ++i) {
+        weighted_upper += weighted_vec[i * m] > n / 2;
+    }
+
+    bool passed = check_unique(uniform_vec, m, n) && check_unique(weighted_vec, m, n);
+    passed &= check_fraction("Simple sampling, upper half fraction", uniform_upper, m * num_exp,
+                             static_cast<double>(n - n / 2) / n);
+    passed &= check_fraction("Weighted sampling, upper half fraction of first draws", weighted_upper,
+                             num_exp, p_upper);
+    if (!passed) {
+        std::cout << "TEST FAILED" << std::endl;
+        return 1;
+    }
+
+    std::cout << "TEST PASSED" << std::endl;
+    return 0;
+}
@@ -0,0 +1,359 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+using use = sycl::ext::oneapi::experimental::matrix::use;
+using layout = sycl::ext::oneapi::experimental::matrix::layout;
+using bfloat16 = sycl::ext::oneapi::bfloat16;
+template <typename T, use U, size_t R, size_t C, layout L = layout::dynamic>
+using joint_matrix =
+    sycl::ext::oneapi::experimental::matrix::joint_matrix<sycl::sub_group, T,
+                                                          U, R, C, L>;
+
+constexpr float ALPHA = 2.0;
+
+// Each sub-group owns MT x NT accumulator tiles of TM x TN, and a work-group
+// has SG_ROWS x SG_COLS sub-groups: it computes a BM x BN block of C, where
+// BM = SG_ROWS * MT * TM and BN = SG_COLS * NT * TN, stepping through K by
+// BK = K_TILES * TK.
+constexpr size_t MT = 2;
+constexpr size_t NT = 2;
+constexpr size_t SG_ROWS = 4;
+constexpr size_t SG_COLS = 2;
+constexpr size_t K_TILES = 2;
+
+template <typename KernelName> size_t get_sg_size(sycl::queue q) {
+  auto KernelID = sycl::get_kernel_id<KernelName>();
+  auto KB = sycl::get_kernel_bundle<sycl::bundle_state::executable>(
+      q.get_context(), {KernelID});
+  auto kernel = KB.get_kernel(KernelID);
+
+  return kernel.template get_info<
+      sycl::info::kernel_device_specific::max_sub_group_size>(q.get_device());
+}
+
+// All work-items of the group copy a rows x cols panel of a row-major matrix
+// with ld columns, starting at (r0, c0), into SLM; values past the last row
+// (n_rows) or column (n_cols) of the matrix are zero, so that edge blocks
+// need no special case in the multiplication.
+template <typename T>
+void load_panel(sycl::nd_item<2> it, const T *src, size_t n_rows,
+                size_t n_cols, size_t ld, size_t r0, size_t c0, T *dst,
+                size_t rows, size_t cols) {
+  size_t lid = it.get_local_linear_id();
+  size_t wg_size = it.get_local_range().size();
+  for (size_t i = lid; i < rows * cols; i += wg_size) {
+    size_t r = r0 + i / cols, c = c0 + i % cols;
+    dst[i] = (r < n_rows && c < n_cols) ? src[r * ld + c] : T(0.0f);
+  }
+}
+
+// C = ALPHA * A * B for row-major A (M x K), B (K x N) and C (M x N), with
+// runtime M, N and K. The A and B panels of a block are double-buffered in
+// SLM: while the sub-groups multiply the panels of one K step, the next ones
+// are loaded into the other buffer, with a single barrier per step.
+template <size_t TM, size_t TN, size_t TK> class jm_gemm;
+
+template <size_t TM, size_t TN, size_t TK>
+sycl::event joint_matrix_gemm(sycl::queue &q, const bfloat16 *A,
+                              const bfloat16 *B, float *C, size_t M, size_t N,
+                              size_t K) {
+  constexpr size_t BM = SG_ROWS * MT * TM;
+  constexpr size_t BN = SG_COLS * NT * TN;
+  constexpr size_t BK = K_TILES * TK;
+  const size_t sg_size = get_sg_size<jm_gemm<TM, TN, TK>>(q);
+  const size_t blocks_m = (M + BM - 1) / BM, blocks_n = (N + BN - 1) / BN;
+  const size_t steps = (K + BK - 1) / BK;
+
+  return q.submit([&](sycl::handler &h) {
+    sycl::local_accessor<bfloat16, 1> tile_a(sycl::range(2 * BM * BK), h);
+    sycl::local_accessor<bfloat16, 1> tile_b(sycl::range(2 * BK * BN), h);
+    // Staging area of partial tiles on the edges of C
+    sycl::local_accessor<float, 1> edge(
+        sycl::range(SG_ROWS * SG_COLS * TM * TN), h);
+    h.parallel_for<jm_gemm<TM, TN, TK>>(
+        sycl::nd_range<2>({blocks_m * SG_ROWS, blocks_n * SG_COLS * sg_size},
+                          {SG_ROWS, SG_COLS * sg_size}),
+        [=](sycl::nd_item<2> it) {
+          sycl::sub_group sg = it.get_sub_group();
+          const size_t sg_row = it.get_local_id(0);
+          const size_t sg_col = it.get_local_id(1) / sg_size;
+          const size_t m0 = it.get_group(0) * BM, n0 = it.get_group(1) * BN;
+          bfloat16 *a_base =
+              tile_a.template get_multi_ptr<sycl::access::decorated::no>()
+                  .get();
+          bfloat16 *b_base =
+              tile_b.template get_multi_ptr<sycl::access::decorated::no>()
+                  .get();
+
+          joint_matrix<bfloat16, use::a, TM, TK, layout::row_major> sub_a[MT];
+          joint_matrix<bfloat16, use::b, TK, TN, layout::row_major> sub_b[NT];
+          joint_matrix<float, use::accumulator, TM, TN> sub_c[MT][NT];
+#pragma unroll
+          for (size_t i = 0; i < MT; i++)
+#pragma unroll
+            for (size_t j = 0; j < NT; j++)
+              joint_matrix_fill(sg, sub_c[i][j], 0.0f);
+
+          load_panel(it, A, M, K, K, m0, 0, a_base, BM, BK);
+          load_panel(it, B, K, N, N, 0, n0, b_base, BK, BN);
+          sycl::group_barrier(it.get_group());
+
+          for (size_t s = 0; s < steps; s++) {
+            const size_t cur = s % 2;
+            if (s + 1 < steps) {
+              load_panel(it, A, M, K, K, m0, (s + 1) * BK,
+                         a_base + (1 - cur) * BM * BK, BM, BK);
+              load_panel(it, B, K, N, N, (s + 1) * BK, n0,
+                         b_base + (1 - cur) * BK * BN, BK, BN);
+            }
+            auto pA = tile_a.template get_multi_ptr<
+                          sycl::access::decorated::no>() +
+                      cur * BM * BK;
+            auto pB = tile_b.template get_multi_ptr<
+                          sycl::access::decorated::no>() +
+                      cur * BK * BN;
+#pragma unroll
+            for (size_t k = 0; k < K_TILES; k++) {
+#pragma unroll
+              for (size_t i = 0; i < MT; i++)
+                joint_matrix_load(sg, sub_a[i],
+                                  pA + ((sg_row * MT + i) * TM) * BK + k * TK,
+                                  BK);
+#pragma unroll
+              for (size_t j = 0; j < NT; j++)
+                joint_matrix_load(sg, sub_b[j],
+                                  pB + (k * TK) * BN + (sg_col * NT + j) * TN,
+                                  BN);
+#pragma unroll
+              for (size_t i = 0; i < MT; i++)
+#pragma unroll
+                for (size_t j = 0; j < NT; j++)
+                  joint_matrix_mad(sg, sub_c[i][j], sub_a[i], sub_b[j],
+                                   sub_c[i][j]);
+            }
+            sycl::group_barrier(it.get_group());
+          }
+
+          auto pC = sycl::address_space_cast<
+              sycl::access::address_space::global_space,
+              sycl::access::decorated::no>(C);
+          auto pEdge =
+              edge.template get_multi_ptr<sycl::access::decorated::no>() +
+              (sg_row * SG_COLS + sg_col) * TM * TN;
+          const size_t lane = sg.get_local_id()[0];
+#pragma unroll
+          for (size_t i = 0; i < MT; i++)
+#pragma unroll
+            for (size_t j = 0; j < NT; j++) {
+              const size_t r0 = m0 + (sg_row * MT + i) * TM;
+              const size_t c0 = n0 + (sg_col * NT + j) * TN;
+              joint_matrix_apply(sg, sub_c[i][j],
+                                 [=](float &x) { x *= ALPHA; });
+              // Whole tiles are stored directly when rows are 16-byte aligned
+              // (block stores); others go through SLM and are copied element
+              // by element within the bounds of C.
+              if (r0 + TM <= M && c0 + TN <= N && N % 4 == 0) {
+                joint_matrix_store(sg, sub_c[i][j], pC + r0 * N + c0, N,
+                                   layout::row_major);
+              } else {
+                joint_matrix_store(sg, sub_c[i][j], pEdge, TN,
+                                   layout::row_major);
+                sycl::group_barrier(sg);
+                for (size_t e = lane; e < TM * TN; e += sg_size) {
+                  size_t r = r0 + e / TN, c = c0 + e % TN;
+                  if (r < M && c < N)
+                    C[r * N + c] = pEdge[e];
+                }
+                sycl::group_barrier(sg);
+              }
+            }
+        });
+  });
+}
+
+// Same blocking and SLM double-buffering with scalar FMAs, for devices
+// without joint_matrix support such as CPUs without Intel AMX. The
+// joint_matrix kernels are never JIT-compiled for such a device, since each
+// kernel is in its own device image (-fsycl-device-code-split=per_kernel).
+class fallback_gemm_kernel;
+
+static sycl::event fallback_gemm(sycl::queue &q, const bfloat16 *A,
+                                 const bfloat16 *B, float *C, size_t M,
+                                 size_t N, size_t K) {
+  // 16 x 16 work-items, each computing 4 x 4 outputs strided by 16, so that
+  // neighboring work-items read neighboring SLM values
+  constexpr size_t T = 16, R = 4, BM = T * R, BN = T * R, BK = 32;
+  const size_t blocks_m = (M + BM - 1) / BM, blocks_n = (N + BN - 1) / BN;
+  const size_t steps = (K + BK - 1) / BK;
+
+  return q.submit([&](sycl::handler &h) {
+    sycl::local_accessor<bfloat16, 1> tile_a(sycl::range(2 * BM * BK), h);
+    sycl::local_accessor<bfloat16, 1> tile_b(sycl::range(2 * BK * BN), h);
+    h.parallel_for<fallback_gemm_kernel>(
+        sycl::nd_range<2>({blocks_m * T, blocks_n * T}, {T, T}),
+        [=](sycl::nd_item<2> it) {
+          const size_t ty = it.get_local_id(0), tx = it.get_local_id(1);
+          const size_t m0 = it.get_group(0) * BM, n0 = it.get_group(1) * BN;
+          bfloat16 *a_base =
+              tile_a.template get_multi_ptr<sycl::access::decorated::no>()
+                  .get();
+          bfloat16 *b_base =
+              tile_b.template get_multi_ptr<sycl::access::decorated::no>()
+                  .get();
+          float acc[R][R] = {};
+
+          load_panel(it, A, M, K, K, m0, 0, a_base, BM, BK);
+          load_panel(it, B, K, N, N, 0, n0, b_base, BK, BN);
+          sycl::group_barrier(it.get_group());
+
+          for (size_t s = 0; s < steps; s++) {
+            const size_t cur = s % 2;
+            if (s + 1 < steps) {
+              load_panel(it, A, M, K, K, m0, (s + 1) * BK,
+                         a_base + (1 - cur) * BM * BK, BM, BK);
+              load_panel(it, B, K, N, N, (s + 1) * BK, n0,
+                         b_base + (1 - cur) * BK * BN, BK, BN);
+            }
+            const bfloat16 *a = a_base + cur * BM * BK;
+            const bfloat16 *b = b_base + cur * BK * BN;
+            for (size_t k = 0; k < BK; k++) {
+              float av[R], bv[R];
+#pragma unroll
+              for (size_t i = 0; i < R; i++) {
+                av[i] = a[(ty + i * T) * BK + k];
+                bv[i] = b[k * BN + tx + i * T];
+              }
+#pragma unroll
+              for (size_t i = 0; i < R; i++)
+#pragma unroll
+                for (size_t j = 0; j < R; j++)
+                  acc[i][j] += av[i] * bv[j];
+            }
+            sycl::group_barrier(it.get_group());
+          }
+
+#pragma unroll
+          for (size_t i = 0; i < R; i++)
+#pragma unroll
+            for (size_t j = 0; j < R; j++) {
+              size_t r = m0 + ty + i * T, c = n0 + tx + j * T;
+              if (r < M && c < N)
+                C[r * N + c] = ALPHA * acc[i][j];
+            }
+        });
+  });
+}
+
+// Hardware tile shape of the device for bf16 inputs and fp32 accumulation,
+// or {0, 0, 0} without joint_matrix support
+struct tile_shape {
+  size_t m, n, k;
+};
+
+static tile_shape select_tiles(const sycl::device &d) {
+  std::vector<sycl::ext::oneapi::experimental::matrix::combination>
+      combinations;
+  try {
+    combinations = d.get_info<sycl::ext::oneapi::experimental::info::device::
+                                  matrix_combinations>();
+  } catch (sycl::exception const &) {
+  }
+  for (auto &c : combinations) {
+    if (c.nsize == 0) // Intel AMX
+      return {16, 16, 32};
+    if (c.nsize == 16) // architecture::intel_gpu_pvc
+      return {8, 16, 16};
+    if (c.nsize == 8) // architecture::intel_gpu_dg2*
+      return {8, 8, 16};
+  }
+  return {0, 0, 0};
+}
+
+static sycl::event gemm(sycl::queue &q, tile_shape t, const bfloat16 *A,
+                        const bfloat16 *B, float *C, size_t M, size_t N,
+                        size_t K) {
+  if (t.m == 16 && t.n == 16)
+    return joint_matrix_gemm<16, 16, 32>(q, A, B, C, M, N, K);
+  if (t.m == 8 && t.n == 16)
+    return joint_matrix_gemm<8, 16, 16>(q, A, B, C, M, N, K);
+  if (t.m == 8 && t.n == 8)
+    return joint_matrix_gemm<8, 8, 16>(q, A, B, C, M, N, K);
+  return fallback_gemm(q, A, B, C, M, N, K);
+}
+
+// Small integers, exactly represented in bf16, whose products summed over K
+// are exact in fp32: results can be compared exactly with the host reference
+static bool test(sycl::queue &q, tile_shape t, size_t M, size_t N, size_t K) {
+  bfloat16 *A = sycl::malloc_shared<bfloat16>(M * K, q);
+  bfloat16 *B = sycl::malloc_shared<bfloat16>(K * N, q);
+  float *C = sycl::malloc_shared<float>(M * N, q);
+  std::vector<float> a(M * K), b(K * N), ref(M * N, 0.0f);
+  for (size_t i = 0; i < M; i++)
+    for (size_t j = 0; j < K; j++)
+      A[i * K + j] = a[i * K + j] = float(int((3 * i + j) % 7) - 3);
+  for (size_t i = 0; i < K; i++)
+    for (size_t j = 0; j < N; j++)
+      B[i * N + j] = b[i * N + j] = float(int((i + 2 * j) % 5) - 2);
+  for (size_t i = 0; i < M; i++)
+    for (size_t k = 0; k < K; k++)
+      for (size_t j = 0; j < N; j++)
+        ref[i * N + j] += a[i * K + k] * b[k * N + j];
+
+  gemm(q, t, A, B, C, M, N, K).wait(); // warmup
+  auto start = std::chrono::steady_clock::now();
+  gemm(q, t, A, B, C, M, N, K).wait();
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           start)
+                 .count();
+
+  size_t errors = 0;
+  for (size_t i = 0; i < M * N; i++)
+    if (C[i] != ALPHA * ref[i]) {
+      if (errors++ < 5)
+        std::cout << "Incorrect result in matrix. i: " << i / N
+                  << ", j: " << i % N << ", Ref: " << ALPHA * ref[i]
+                  << ", Val: " << C[i] << "\n";
+    }
+  std::cout << M << " x " << N << " x " << K << ": " << s * 1e3 << " msec, "
+            << 2e-9 * M * N * K / s << " GFLOP/s, "
+            << (errors ? "failed" : "passed") << std::endl;
+
+  sycl::free(C, q);
+  sycl::free(B, q);
+  sycl::free(A, q);
+  return errors == 0;
+}
+
+int main(int argc, char **argv) {
+  sycl::queue q;
+  std::cout << "Device: " << q.get_device().get_info<sycl::info::device::name>()
+            << "\n";
+  tile_shape t = select_tiles(q.get_device());
+  if (t.m)
+    std::cout << "joint_matrix GEMM, " << t.m << " x " << t.n << " x " << t.k
+              << " tiles\n";
+  else
+    std::cout << "No joint_matrix support: SLM-tiled fallback GEMM\n";
+
+  bool passed = true;
+  if (argc == 4) {
+    passed = test(q, t, std::stoul(argv[1]), std::stoul(argv[2]),
+                  std::stoul(argv[3]));
+  } else {
+    // Block multiples, then shapes with partial blocks and partial K steps
+    passed &= test(q, t, 1024, 1024, 1024);
+    passed &= test(q, t, 1000, 1200, 700);
+    passed &= test(q, t, 77, 130, 45);
+    passed &= test(q, t, 1, 257, 33);
+  }
+  return !passed;
+}
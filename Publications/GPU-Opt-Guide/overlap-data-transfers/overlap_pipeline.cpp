@@ -0,0 +1,66 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+#include <iomanip>
+#include <iostream>
+#include <sycl/sycl.hpp>
+
+#include "pipeline.hpp"
+
+// Same workload as overlap_transfer, with fewer kernel iterations so that
+// transfers and computation take comparable times
+constexpr size_t N = 10 * 10000000;
+constexpr int KERNEL_ITERS = 100;
+
+static void print(const char *name, const pipeline_stats &s) {
+  std::cout << std::left << std::setw(12) << name << std::right
+            << std::setw(10) << s.chunk << std::setw(8) << s.chunks
+            << std::fixed << std::setprecision(2) << std::setw(11)
+            << s.wall * 1e3 << std::setw(11) << s.copy_in * 1e3
+            << std::setw(11) << s.compute * 1e3 << std::setw(11)
+            << s.copy_out * 1e3 << std::setw(9) << s.overlap() << "\n";
+}
+
+int main() {
+  sycl::queue q;
+  std::cout << "Device: " << q.get_device().get_info<sycl::info::device::name>()
+            << "\n";
+
+  float *host_data = sycl::malloc_host<float>(N, q);
+  for (size_t i = 0; i < N; i++)
+    host_data[i] = float(i % 1024);
+
+  auto add = [](float *chunk, size_t i) {
+    for (int k = 0; k < KERNEL_ITERS; k++)
+      chunk[i] += 1.0f;
+  };
+
+  pipeline<float> p(q);
+  std::vector<pipeline_stats> trace;
+  size_t tuned = p.tune(host_data, N, add, &trace);
+
+  std::cout << "Times in msec; stage times are summed over the chunks\n"
+            << "                 chunk  chunks       wall    copy-in    compute"
+               "   copy-out  overlap\n";
+  for (auto &s : trace)
+    print("tuning", s);
+
+  // One chunk (no overlap), the chunking of overlap_transfer, and the tuned
+  // chunk size, each adding KERNEL_ITERS to every value
+  print("one chunk", p.run(host_data, N, N, add));
+  print("10 chunks", p.run(host_data, N, N / 10, add));
+  print("tuned", p.run(host_data, N, tuned, add));
+
+  size_t errors = 0;
+  for (size_t i = 0; i < N; i++)
+    if (host_data[i] != float(i % 1024 + 3 * KERNEL_ITERS) && errors++ < 5)
+      std::cout << "Mismatch at position: " << i << " expected: "
+                << i % 1024 + 3 * KERNEL_ITERS << " got: " << host_data[i]
+                << "\n";
+  std::cout << (errors ? "Failed" : "Passed") << std::endl;
+
+  sycl::free(host_data, q);
+  return errors != 0;
+}
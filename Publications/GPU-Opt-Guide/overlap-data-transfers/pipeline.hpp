@@ -0,0 +1,173 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+#ifndef __PIPELINE
+#define __PIPELINE 1
+
+#include <algorithm>
+#include <chrono>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+// Timing of one pipeline run. Stage times are the summed execution times of
+// the copy-in, compute and copy-out commands, from event profiling.
+struct pipeline_stats {
+  size_t chunk = 0;
+  size_t chunks = 0;
+  double wall = 0;     // seconds
+  double copy_in = 0;  // seconds
+  double compute = 0;  // seconds
+  double copy_out = 0; // seconds
+
+  // Fraction of the possible overlap achieved: 0 when the stages run one
+  // after the other (wall = sum of the stages), 1 when everything but the
+  // busiest stage is hidden (wall = busiest stage).
+  double overlap() const {
+    double serial = copy_in + compute + copy_out;
+    double bottleneck = std::max({copy_in, compute, copy_out});
+    if (serial <= bottleneck)
+      return 0;
+    return std::clamp((serial - wall) / (serial - bottleneck), 0.0, 1.0);
+  }
+};
+
+// Runs f over a host range in chunks: each chunk is copied to a device
+// staging buffer, processed in place and copied back. Copy-in, compute and
+// copy-out are submitted to three in-order queues, so that the copies of some
+// chunks overlap the computation of others. At most depth chunks are in
+// flight: chunk c reuses the staging buffer of chunk c - depth, and its
+// copy-in waits for that chunk's copy-out.
+//
+// The host range should be allocated with sycl::malloc_host in the context of
+// the queue given to the constructor, so that copies are asynchronous.
+template <typename T> class pipeline {
+public:
+  explicit pipeline(sycl::queue &q, size_t depth = 3)
+      : q_(q), in_(make_queue(q)), compute_(make_queue(q)),
+        out_(make_queue(q)), depth_(std::max<size_t>(depth, 1)) {}
+  ~pipeline() { release(); }
+  pipeline(const pipeline &) = delete;
+  pipeline &operator=(const pipeline &) = delete;
+
+  // Calls f(chunk_data, i) on the device for every index i of every chunk,
+  // where chunk_data points to the chunk in device memory.
+  template <typename F>
+  pipeline_stats run(T *host, size_t n, size_t chunk, F f) {
+    pipeline_stats stats;
+    chunk = std::clamp<size_t>(chunk, 1, std::max<size_t>(n, 1));
+    stats.chunk = chunk;
+    stats.chunks = (n + chunk - 1) / chunk;
+    reserve(chunk, std::min(depth_, stats.chunks));
+
+    std::vector<sycl::event> in(stats.chunks), comp(stats.chunks),
+        out(stats.chunks);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < stats.chunks; c++) {
+      T *dev = buffers_[c % depth_];
+      T *src = host + c * chunk;
+      size_t len = std::min(chunk, n - c * chunk);
+      in[c] = in_.submit([&](sycl::handler &h) {
+        if (c >= depth_)
+          h.depends_on(out[c - depth_]);
+        h.memcpy(dev, src, len * sizeof(T));
+      });
+      comp[c] = compute_.submit([&](sycl::handler &h) {
+        h.depends_on(in[c]);
+        h.parallel_for(sycl::range<1>(len),
+                       [=](sycl::id<1> i) { f(dev, i[0]); });
+      });
+      out[c] = out_.submit([&](sycl::handler &h) {
+        h.depends_on(comp[c]);
+        h.memcpy(src, dev, len * sizeof(T));
+      });
+    }
+    out_.wait();
+    stats.wall = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+    for (size_t c = 0; c < stats.chunks; c++) {
+      stats.copy_in += duration(in[c]);
+      stats.compute += duration(comp[c]);
+      stats.copy_out += duration(out[c]);
+    }
+    return stats;
+  }
+
+  // Times f on a copy of the first sample values of the host range for
+  // chunk sizes from sample / 2 down to min_chunk values, halving each time,
+  // and returns the fastest. The host range is not modified. All timings are
+  // appended to trace if given.
+  template <typename F>
+  size_t tune(const T *host, size_t n, F f,
+              std::vector<pipeline_stats> *trace = nullptr,
+              size_t sample = size_t(1) << 26,
+              size_t min_chunk = size_t(1) << 16) {
+    sample = std::min(n, sample);
+    if (sample <= min_chunk)
+      return std::max<size_t>(sample, 1);
+    T *scratch = sycl::malloc_host<T>(sample, q_);
+    size_t best = sample;
+    double best_wall = 0;
+    bool warm = false;
+    for (size_t chunk = sample / 2; chunk >= min_chunk; chunk /= 2) {
+      std::copy(host, host + sample, scratch);
+      if (!warm) { // JIT compilation and staging buffer allocation
+        run(scratch, sample, chunk, f);
+        std::copy(host, host + sample, scratch);
+        warm = true;
+      }
+      pipeline_stats s = run(scratch, sample, chunk, f);
+      if (trace)
+        trace->push_back(s);
+      if (best_wall == 0 || s.wall < best_wall) {
+        best_wall = s.wall;
+        best = chunk;
+      }
+    }
+    sycl::free(scratch, q_);
+    return best;
+  }
+
+private:
+  static sycl::queue make_queue(sycl::queue &q) {
+    return sycl::queue(q.get_context(), q.get_device(),
+                       {sycl::property::queue::in_order(),
+                        sycl::property::queue::enable_profiling()});
+  }
+
+  static double duration(const sycl::event &e) {
+    return 1e-9 * (e.get_profiling_info<
+                       sycl::info::event_profiling::command_end>() -
+                   e.get_profiling_info<
+                       sycl::info::event_profiling::command_start>());
+  }
+
+  // Staging buffers are kept between runs, and only reallocated for larger
+  // chunks or when more of them are needed
+  void reserve(size_t chunk, size_t count) {
+    if (chunk <= capacity_ && count <= buffers_.size())
+      return;
+    release();
+    for (size_t i = 0; i < count; i++)
+      buffers_.push_back(sycl::malloc_device<T>(chunk, q_));
+    capacity_ = chunk;
+  }
+
+  void release() {
+    for (T *p : buffers_)
+      sycl::free(p, q_);
+    buffers_.clear();
+    capacity_ = 0;
+  }
+
+  sycl::queue &q_;
+  sycl::queue in_, compute_, out_;
+  size_t depth_;
+  size_t capacity_ = 0;
+  std::vector<T *> buffers_;
+};
+
+#endif
@@ -0,0 +1,343 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+#ifndef __REDUCE
+#define __REDUCE 1
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <typeinfo>
+#include <vector>
+
+// The strategies of reduction_1.cpp, for any type and operator:
+//  - builtin: each work-item combines elements_per_item values read in
+//    blocks, as in ComputeParallel8, and sycl::reduction combines the
+//    work-items (ComputeParallel5)
+//  - tree: the same blocked loads, then a tree reduction of the work-group in
+//    SLM writing one partial per work-group, repeated over the partials until
+//    one value is left (ComputeParallel7, ComputeTreeReduction2)
+//  - strided: one work-group per compute unit, each work-item combining the
+//    values a whole nd-range apart (ComputeParallel4), then tree passes
+// The atomic strategies (ComputeParallel1, 2) are left out: they only apply
+// to operators with atomic support.
+enum class reduce_strategy { builtin, tree, strided };
+
+inline const char *to_string(reduce_strategy s) {
+  return s == reduce_strategy::builtin
+             ? "builtin"
+             : (s == reduce_strategy::tree ? "tree" : "strided");
+}
+
+struct reduce_config {
+  reduce_strategy strategy = reduce_strategy::builtin;
+  int work_group_size = 256;  // power of 2
+  int elements_per_item = 16; // blocked strategies only
+};
+
+// Reduction of device-accessible arrays of T with an associative and
+// commutative operator. The first reducer created for a device, type and
+// operator times every strategy over a range of work-group sizes and
+// elements per work-item, and stores the fastest configuration in a cache
+// file, REDUCE_TUNING_CACHE or reduce_tuning.txt in the working directory.
+// Later reducers read it from there, or from memory in the same run.
+//
+// The cache is keyed by device name, driver version, and the typeid names of
+// T and Op, so it is only shared between runs of the same binary for
+// operators that are lambdas or local types.
+template <typename T, typename Op = sycl::plus<T>> class reducer {
+public:
+  // For operators with a known identity: sycl::plus, sycl::maximum, ...
+  explicit reducer(sycl::queue &q, Op op = {})
+      : reducer(q, sycl::known_identity_v<Op, T>, op) {}
+
+  reducer(sycl::queue &q, T identity, Op op = {},
+          std::size_t tune_size = std::size_t(1) << 24)
+      : q_(q), identity_(identity), op_(op) {
+    auto dev = q_.get_device();
+    max_wg_ = dev.get_info<sycl::info::device::max_work_group_size>();
+    compute_units_ = dev.get_info<sycl::info::device::max_compute_units>();
+    key_ = dev.get_info<sycl::info::device::name>() + " | " +
+           dev.get_info<sycl::info::device::driver_version>() + " | " +
+           typeid(T).name() + " | " + typeid(Op).name();
+    auto &known = configs();
+    auto it = known.find(key_);
+    if (it != known.end()) {
+      config_ = it->second;
+    } else {
+      tuned_ = !load();
+      if (tuned_) {
+        tune(tune_size);
+        save();
+      }
+      known[key_] = config_;
+    }
+  }
+  ~reducer() {
+    scratch_.wait();
+    sycl::free(partials_, q_);
+    sycl::free(result_, q_);
+  }
+  reducer(const reducer &) = delete;
+  reducer &operator=(const reducer &) = delete;
+
+  // Writes the reduction of data[0, n) to *result, which is overwritten.
+  // Both are device-accessible pointers.
+  sycl::event operator()(const T *data, std::size_t n, T *result,
+                         const std::vector<sycl::event> &deps = {}) {
+    return run(config_, data, n, result, deps);
+  }
+
+  // Blocking version, returning the result to the host
+  T operator()(const T *data, std::size_t n) {
+    if (!result_)
+      result_ = sycl::malloc_device<T>(1, q_);
+    T value;
+    auto e = (*this)(data, n, result_);
+    q_.copy(result_, &value, 1, e).wait();
+    return value;
+  }
+
+  const reduce_config &config() const { return config_; }
+
+  // True if the configuration was tuned by this reducer, false if it was
+  // read from the cache file or tuned earlier in this run
+  bool tuned() const { return tuned_; }
+
+  static std::string cache_path() {
+    const char *path = std::getenv("REDUCE_TUNING_CACHE");
+    return path ? path : "reduce_tuning.txt";
+  }
+
+private:
+  sycl::event run(const reduce_config &c, const T *data, std::size_t n,
+                  T *result, const std::vector<sycl::event> &deps) {
+    if (n == 0)
+      return q_.fill(result, identity_, 1, deps);
+    if (c.strategy == reduce_strategy::builtin)
+      return builtin(c, data, n, result, deps);
+
+    const std::size_t wg = c.work_group_size;
+    std::size_t groups;
+    if (c.strategy == reduce_strategy::strided)
+      groups = std::min<std::size_t>(compute_units_, (n + wg - 1) / wg);
+    else
+      groups = (n + wg * c.elements_per_item - 1) / (wg * c.elements_per_item);
+    const bool strided = c.strategy == reduce_strategy::strided;
+    if (groups == 1)
+      return pass(c, strided, data, n, result, 1, deps);
+
+    // Partials of the first pass, then of each tree pass, alternate between
+    // the two halves of the scratch buffer
+    reserve(2 * groups);
+    T *in = partials_, *out = partials_ + groups;
+    auto e = pass(c, strided, data, n, in, groups, after_scratch(deps));
+    n = groups;
+    while (n > 1) {
+      std::size_t per_group = wg * c.elements_per_item;
+      groups = (n + per_group - 1) / per_group;
+      e = pass(c, false, in, n, groups == 1 ? result : out, groups, {e});
+      std::swap(in, out);
+      n = groups;
+    }
+    return scratch_ = e;
+  }
+
+  // One partial per work-group. Blocked: work-group g reads the
+  // wg * elements_per_item values from g * wg * elements_per_item, with
+  // consecutive work-items reading consecutive values. Strided: work-item i
+  // reads i, i + global size, ...
+  sycl::event pass(const reduce_config &c, bool strided, const T *in,
+                   std::size_t n, T *out, std::size_t groups,
+                   const std::vector<sycl::event> &deps) {
+    const std::size_t wg = c.work_group_size;
+    const std::size_t global = groups * wg;
+    const std::size_t count =
+        strided ? (n + global - 1) / global : c.elements_per_item;
+    const T identity = identity_;
+    const Op op = op_;
+    return q_.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      sycl::local_accessor<T, 1> scratch(sycl::range<1>(wg), h);
+      h.parallel_for(
+          sycl::nd_range<1>(global, wg), [=](sycl::nd_item<1> it) {
+            const std::size_t lid = it.get_local_id(0);
+            const std::size_t group = it.get_group(0);
+            const std::size_t base =
+                strided ? it.get_global_id(0) : group * wg * count + lid;
+            const std::size_t step = strided ? global : wg;
+            T v = identity;
+            for (std::size_t i = 0; i < count; ++i) {
+              std::size_t idx = base + i * step;
+              if (idx < n)
+                v = op(v, in[idx]);
+            }
+            scratch[lid] = v;
+            for (std::size_t s = wg / 2; s > 0; s >>= 1) {
+              sycl::group_barrier(it.get_group());
+              if (lid < s)
+                scratch[lid] = op(scratch[lid], scratch[lid + s]);
+            }
+            if (lid == 0)
+              out[group] = scratch[0];
+          });
+    });
+  }
+
+  sycl::event builtin(const reduce_config &c, const T *data, std::size_t n,
+                      T *result, const std::vector<sycl::event> &deps) {
+    const std::size_t wg = c.work_group_size;
+    const std::size_t count = c.elements_per_item;
+    const std::size_t groups = (n + wg * count - 1) / (wg * count);
+    const T identity = identity_;
+    const Op op = op_;
+    return q_.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      auto sum = sycl::reduction(
+          result, identity, op_,
+          {sycl::property::reduction::initialize_to_identity()});
+      h.parallel_for(sycl::nd_range<1>(groups * wg, wg), sum,
+                     [=](sycl::nd_item<1> it, auto &acc) {
+                       const std::size_t base =
+                           it.get_group(0) * wg * count + it.get_local_id(0);
+                       T v = identity;
+                       for (std::size_t i = 0; i < count; ++i) {
+                         std::size_t idx = base + i * wg;
+                         if (idx < n)
+                           v = op(v, data[idx]);
+                       }
+                       acc.combine(v);
+                     });
+    });
+  }
+
+  std::vector<reduce_config> candidates() const {
+    std::vector<reduce_config> v;
+    for (int wg = 64; wg <= 1024 && std::size_t(wg) <= max_wg_; wg *= 2) {
+      for (int count : {4, 16, 64, 256}) {
+        v.push_back({reduce_strategy::builtin, wg, count});
+        v.push_back({reduce_strategy::tree, wg, count});
+      }
+      v.push_back({reduce_strategy::strided, wg, 16});
+    }
+    if (v.empty()) // devices with small work-groups, such as some CPUs
+      for (int count : {4, 16, 64, 256})
+        v.push_back({reduce_strategy::tree, 1, count});
+    return v;
+  }
+
+  // Best of three runs of every candidate on tune_size identity values,
+  // after one run to warm up
+  void tune(std::size_t tune_size) {
+    T *data = sycl::malloc_device<T>(tune_size, q_);
+    T *result = sycl::malloc_device<T>(1, q_);
+    q_.fill(data, identity_, tune_size).wait();
+    double best = 0;
+    for (const reduce_config &c : candidates()) {
+      run(c, data, tune_size, result, {}).wait();
+      for (int rep = 0; rep < 3; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        run(c, data, tune_size, result, {}).wait();
+        double t = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+        if (best == 0 || t < best) {
+          best = t;
+          config_ = c;
+        }
+      }
+    }
+    scratch_.wait();
+    sycl::free(result, q_);
+    sycl::free(data, q_);
+  }
+
+  // Cache lines are "key <TAB> strategy work_group_size elements_per_item";
+  // a later line for the same key wins
+  bool load() {
+    std::ifstream in(cache_path());
+    std::string line;
+    bool found = false;
+    while (std::getline(in, line)) {
+      auto tab = line.rfind('\t');
+      if (tab == std::string::npos || line.compare(0, tab, key_) != 0 ||
+          tab != key_.size())
+        continue;
+      std::istringstream fields(line.substr(tab + 1));
+      int strategy;
+      reduce_config c;
+      if (fields >> strategy >> c.work_group_size >> c.elements_per_item &&
+          strategy >= 0 && strategy <= int(reduce_strategy::strided) &&
+          c.work_group_size > 0 &&
+          std::size_t(c.work_group_size) <= max_wg_ &&
+          c.elements_per_item > 0) {
+        c.strategy = reduce_strategy(strategy);
+        config_ = c;
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  // Configurations found so far in this run
+  static std::map<std::string, reduce_config> &configs() {
+    static std::map<std::string, reduce_config> known;
+    return known;
+  }
+
+  void save() const {
+    std::ofstream out(cache_path(), std::ios::app);
+    out << key_ << '\t' << int(config_.strategy) << ' '
+        << config_.work_group_size << ' ' << config_.elements_per_item
+        << '\n';
+  }
+
+  // The scratch buffer is reused by every call: a call writing it waits for
+  // the previous one, which also makes growing it safe
+  std::vector<sycl::event> after_scratch(std::vector<sycl::event> deps) const {
+    deps.push_back(scratch_);
+    return deps;
+  }
+
+  void reserve(std::size_t n) {
+    if (n <= capacity_)
+      return;
+    scratch_.wait();
+    sycl::free(partials_, q_);
+    partials_ = sycl::malloc_device<T>(n, q_);
+    capacity_ = n;
+  }
+
+  sycl::queue q_;
+  T identity_;
+  Op op_;
+  std::size_t max_wg_ = 1, compute_units_ = 1;
+  std::string key_;
+  reduce_config config_;
+  bool tuned_ = false;
+  T *partials_ = nullptr, *result_ = nullptr;
+  std::size_t capacity_ = 0;
+  sycl::event scratch_;
+};
+
+// One-off reductions of data[0, n). The tuned configuration is looked up
+// once per run; scratch memory is allocated by every call, so repeated
+// reductions should keep a reducer instead.
+template <typename T, typename Op = sycl::plus<T>>
+T reduce(sycl::queue &q, const T *data, std::size_t n, Op op = {}) {
+  return reducer<T, Op>(q, op)(data, n);
+}
+
+template <typename T, typename Op>
+T reduce(sycl::queue &q, const T *data, std::size_t n, T identity, Op op) {
+  return reducer<T, Op>(q, identity, op)(data, n);
+}
+
+#endif
@@ -0,0 +1,130 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "reduce.hpp"
+
+constexpr size_t N = 10 * 1000 * 1000 + 7;
+
+// Custom type and operator, without a known identity
+struct range_t {
+  float lo, hi;
+};
+
+struct widen {
+  range_t operator()(const range_t &a, const range_t &b) const {
+    return {sycl::fmin(a.lo, b.lo), sycl::fmax(a.hi, b.hi)};
+  }
+};
+
+// Reduces the values with r, and prints its configuration and the time of
+// the second of two calls in msec
+template <typename T, typename Op>
+static T run(sycl::queue &q, const char *name, reducer<T, Op> &r,
+             const std::vector<T> &values) {
+  T *data = sycl::malloc_device<T>(values.size(), q);
+  q.copy(values.data(), data, values.size()).wait();
+  r(data, values.size());
+  auto start = std::chrono::steady_clock::now();
+  T value = r(data, values.size());
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  sycl::free(data, q);
+  const reduce_config &c = r.config();
+  std::cout << name << ": " << to_string(c.strategy)
+            << ", work-group size " << c.work_group_size
+            << ", elements per item " << c.elements_per_item
+            << (r.tuned() ? " (tuned)" : " (cached)") << ", " << ms
+            << " msec\n";
+  return value;
+}
+
+template <typename T>
+static bool check(const char *name, T value, T expected, T tolerance = T(0)) {
+  bool ok = value >= expected - tolerance && value <= expected + tolerance;
+  if (!ok)
+    std::cout << "ERROR: " << name << " expected " << expected << " but got "
+              << value << "\n";
+  return ok;
+}
+
+int main() {
+  // The default device, which can be a CPU
+  sycl::queue q;
+  std::cout << "Device: " << q.get_device().get_info<sycl::info::device::name>()
+            << "\n";
+  std::cout << "Tuning cache: " << reducer<int>::cache_path() << "\n";
+  bool ok = true;
+
+  std::vector<float> f(N);
+  for (size_t i = 0; i < N; ++i)
+    f[i] = float(i % 1000) / 1000.0f - 0.25f;
+  double f_sum = 0;
+  float lo = std::numeric_limits<float>::max(), hi = -lo;
+  for (float v : f) {
+    f_sum += v;
+    lo = std::min(lo, v);
+    hi = std::max(hi, v);
+  }
+
+  {
+    reducer<float> r(q);
+    float sum = run(q, "float sum", r, f);
+    ok &= check("float sum", double(sum), f_sum, 1e-4 * std::fabs(f_sum));
+  }
+
+  if (q.get_device().has(sycl::aspect::fp64)) {
+    std::vector<double> d(f.begin(), f.end());
+    reducer<double> r(q);
+    double sum = run(q, "double sum", r, d);
+    ok &= check("double sum", sum, f_sum, 1e-9 * std::fabs(f_sum));
+  }
+
+  {
+    std::vector<std::int64_t> v(N);
+    for (size_t i = 0; i < N; ++i)
+      v[i] = std::int64_t(i) * (i % 2 ? 1 : -3);
+    std::int64_t sum = 0, max = v[0];
+    for (auto x : v) {
+      sum += x;
+      max = std::max(max, x);
+    }
+    reducer<std::int64_t> r_sum(q);
+    ok &= check("int64 sum", run(q, "int64 sum", r_sum, v), sum);
+    reducer<std::int64_t, sycl::maximum<std::int64_t>> r_max(q);
+    ok &= check("int64 max", run(q, "int64 max", r_max, v), max);
+  }
+
+  {
+    std::vector<range_t> v(N);
+    for (size_t i = 0; i < N; ++i)
+      v[i] = {f[i], f[i]};
+    const float inf = std::numeric_limits<float>::infinity();
+    reducer<range_t, widen> r(q, range_t{inf, -inf});
+    range_t range = run(q, "float range", r, v);
+    ok &= check("range low", range.lo, lo);
+    ok &= check("range high", range.hi, hi);
+  }
+
+  // One-off reduction, with the configuration tuned above
+  {
+    std::int64_t *data = sycl::malloc_shared<std::int64_t>(1000, q);
+    for (int i = 0; i < 1000; ++i)
+      data[i] = i + 1;
+    ok &= check("reduce", reduce(q, data, 1000), std::int64_t(500500));
+    sycl::free(data, q);
+  }
+
+  std::cout << (ok ? "SUCCESS" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+#ifndef __CONVOLUTION
+#define __CONVOLUTION 1
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <oneapi/mkl/dft.hpp>
+#include <sycl/sycl.hpp>
+#include <utility>
+#include <vector>
+
+// How pixels outside the image are read:
+//  - clamp: the nearest edge pixel (aaa|abcd|ddd)
+//  - zero: 0
+//  - mirror: reflection about the edge pixel (dcb|abcd|cba)
+enum class boundary { clamp, zero, mirror };
+
+// Direct: SLM tiles with halos. FFT: product of 2D real DFTs, whose cost does
+// not depend on the kernel size.
+enum class convolution_path { automatic, direct, fft };
+
+// Index of coordinate i in [0, n) under boundary mode b, or -1 for a zero.
+inline int extend(int i, int n, boundary b) {
+  if (i >= 0 && i < n)
+    return i;
+  switch (b) {
+  case boundary::zero:
+    return -1;
+  case boundary::clamp:
+    return i < 0 ? 0 : n - 1;
+  default: {
+    if (n == 1)
+      return 0;
+    int period = 2 * (n - 1);
+    i %= period;
+    if (i < 0)
+      i += period;
+    return i < n ? i : period - i;
+  }
+  }
+}
+
+// 2D convolution of row-major float images, for runtime kernel sizes, in the
+// (unflipped) form used for image filters:
+//
+//   out[y][x] = sum_{i < kh, j < kw} k[i][j] *
+//                                    in[y + i - kh / 2][x + j - kw / 2]
+//
+// Images and kernels are device-accessible pointers. The direct path gives
+// every work-group a TILE x TILE block of outputs; all its work-items load the
+// (TILE + kh - 1) x (TILE + kw - 1) input tile and the kernel into SLM
+// together, with consecutive work-items reading consecutive pixels, before
+// computing one output each. Separable kernels run two direct passes, 1 x kw
+// then kh x 1, through a temporary image. Kernels with more than fft_taps
+// taps, or whose tile does not fit in SLM, use the FFT path.
+class convolution_2d {
+public:
+  static constexpr int TILE = 16;
+  static constexpr int fft_taps = 32 * 32;
+
+  explicit convolution_2d(sycl::queue &q) : q_(q) {}
+  ~convolution_2d() {
+    scratch_.wait();
+    for (float *p : {tmp_, spectrum_, kernel_spectrum_})
+      sycl::free(p, q_);
+  }
+  convolution_2d(const convolution_2d &) = delete;
+  convolution_2d &operator=(const convolution_2d &) = delete;
+
+  // Generic kh x kw kernel
+  sycl::event operator()(const float *in, float *out, int rows, int cols,
+                         const float *k, int kh, int kw, boundary b,
+                         convolution_path path = convolution_path::automatic,
+                         const std::vector<sycl::event> &deps = {}) {
+    if (path == convolution_path::automatic)
+      path = (kh * kw > fft_taps || !fits_slm(kh, kw))
+                 ? convolution_path::fft
+                 : convolution_path::direct;
+    if (path == convolution_path::fft)
+      return fft(in, out, rows, cols, k, kh, kw, b, deps);
+    return direct(in, out, rows, cols, k, kh, kw, b, deps);
+  }
+
+  // Separable kernel: kx (kw taps) along rows, then ky (kh taps) along
+  // columns, equivalent to the generic kernel k[i][j] = ky[i] * kx[j].
+  sycl::event separable(const float *in, float *out, int rows, int cols,
+                        const float *kx, int kw, const float *ky, int kh,
+                        boundary b, const std::vector<sycl::event> &deps = {}) {
+    reserve(tmp_, tmp_size_, std::size_t(rows) * cols);
+    auto e = direct(in, tmp_, rows, cols, kx, 1, kw, b, after_scratch(deps));
+    return scratch_ = direct(tmp_, out, rows, cols, ky, kh, 1, b, {e});
+  }
+
+  bool fits_slm(int kh, int kw) const {
+    std::size_t floats =
+        std::size_t(TILE + kh - 1) * (TILE + kw - 1) + std::size_t(kh) * kw;
+    return floats * sizeof(float) <=
+           q_.get_device().get_info<sycl::info::device::local_mem_size>();
+  }
+
+  // Number of committed DFT descriptors
+  std::size_t descriptors() const { return descriptors_.size(); }
+
+private:
+  using descriptor_t =
+      oneapi::mkl::dft::descriptor<oneapi::mkl::dft::precision::SINGLE,
+                                   oneapi::mkl::dft::domain::REAL>;
+
+  sycl::event direct(const float *in, float *out, int rows, int cols,
+                     const float *k, int kh, int kw, boundary b,
+                     const std::vector<sycl::event> &deps) {
+    const int th = TILE + kh - 1, tw = TILE + kw - 1;
+    const int tile_size = th * tw;
+    sycl::range<2> global{std::size_t((rows + TILE - 1) / TILE * TILE),
+                          std::size_t((cols + TILE - 1) / TILE * TILE)};
+    return q_.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      sycl::local_accessor<float, 1> tile(sycl::range(tile_size + kh * kw), h);
+      h.parallel_for(
+          sycl::nd_range<2>(global, sycl::range<2>(TILE, TILE)),
+          [=](sycl::nd_item<2> it) {
+            const int lid = it.get_local_linear_id();
+            const int wg_size = TILE * TILE;
+            const int y0 = it.get_group(0) * TILE - kh / 2;
+            const int x0 = it.get_group(1) * TILE - kw / 2;
+
+            // Cooperative load of the tile with its halo, then of the kernel
+            for (int i = lid; i < tile_size; i += wg_size) {
+              int gy = extend(y0 + i / tw, rows, b);
+              int gx = extend(x0 + i % tw, cols, b);
+              tile[i] = (gy < 0 || gx < 0) ? 0.0f : in[gy * cols + gx];
+            }
+            for (int i = lid; i < kh * kw; i += wg_size)
+              tile[tile_size + i] = k[i];
+            sycl::group_barrier(it.get_group());
+
+            const int y = it.get_global_id(0), x = it.get_global_id(1);
+            if (y >= rows || x >= cols)
+              return;
+            const int ly = it.get_local_id(0), lx = it.get_local_id(1);
+            float sum = 0.0f;
+            for (int i = 0; i < kh; ++i)
+              for (int j = 0; j < kw; ++j)
+                sum += tile[tile_size + i * kw + j] *
+                       tile[(ly + i) * tw + lx + j];
+            out[y * cols + x] = sum;
+          });
+    });
+  }
+
+  // The image extended by the boundary mode to (rows + kh - 1) x
+  // (cols + kw - 1), zero-padded to P x Q, is correlated with the
+  // zero-padded kernel through DFTs: the periodic result does not wrap
+  // around for the rows x cols outputs.
+  sycl::event fft(const float *in, float *out, int rows, int cols,
+                  const float *k, int kh, int kw, boundary b,
+                  const std::vector<sycl::event> &deps) {
+    const int P = fft_size(rows + kh - 1), Q = fft_size(cols + kw - 1);
+    // In-place real DFT layout: rows of ld reals, or ld / 2 complex values
+    const int ld = 2 * (Q / 2 + 1);
+    const std::size_t size = std::size_t(P) * ld;
+    reserve(spectrum_, spectrum_size_, size);
+    reserve(kernel_spectrum_, kernel_spectrum_size_, size);
+    descriptor_t &desc = descriptor(P, Q);
+    float *img = spectrum_, *ker = kernel_spectrum_;
+    const std::vector<sycl::event> after = after_scratch(deps);
+
+    auto e_img = q_.parallel_for(
+        sycl::range<2>(P, ld), after, [=](sycl::id<2> idx) {
+          int y = idx[0], x = idx[1];
+          float v = 0.0f;
+          if (y < rows + kh - 1 && x < cols + kw - 1) {
+            int gy = extend(y - kh / 2, rows, b);
+            int gx = extend(x - kw / 2, cols, b);
+            v = (gy < 0 || gx < 0) ? 0.0f : in[gy * cols + gx];
+          }
+          img[y * ld + x] = v;
+        });
+    auto e_ker = q_.parallel_for(
+        sycl::range<2>(P, ld), after, [=](sycl::id<2> idx) {
+          int y = idx[0], x = idx[1];
+          ker[y * ld + x] = (y < kh && x < kw) ? k[y * kw + x] : 0.0f;
+        });
+    auto f_img = oneapi::mkl::dft::compute_forward(desc, img, {e_img});
+    auto f_ker = oneapi::mkl::dft::compute_forward(desc, ker, {e_ker});
+
+    // img <- img * conj(ker), over the P x (Q / 2 + 1) complex coefficients
+    auto e_mul = q_.parallel_for(
+        sycl::range<1>(size / 2), {f_img, f_ker}, [=](sycl::id<1> idx) {
+          std::size_t i = 2 * idx[0];
+          float ar = img[i], ai = img[i + 1];
+          float br = ker[i], bi = ker[i + 1];
+          img[i] = ar * br + ai * bi;
+          img[i + 1] = ai * br - ar * bi;
+        });
+    auto e_bwd = oneapi::mkl::dft::compute_backward(desc, img, {e_mul});
+    return scratch_ = q_.parallel_for(sycl::range<2>(rows, cols), e_bwd,
+                                      [=](sycl::id<2> idx) {
+                                        int y = idx[0], x = idx[1];
+                                        out[y * cols + x] = img[y * ld + x];
+                                      });
+  }
+
+  // Smallest n' >= n whose only prime factors are 2, 3 and 5
+  static int fft_size(int n) {
+    for (;; ++n) {
+      int m = n;
+      for (int p : {2, 3, 5})
+        while (m % p == 0)
+          m /= p;
+      if (m == 1)
+        return n;
+    }
+  }
+
+  // Committed in-place descriptors, one per transform size, reused by later
+  // calls since committing is expensive
+  descriptor_t &descriptor(int P, int Q) {
+    auto &desc = descriptors_[{P, Q}];
+    if (!desc) {
+      desc = std::make_unique<descriptor_t>(std::vector<std::int64_t>{P, Q});
+      desc->set_value(oneapi::mkl::dft::config_param::BACKWARD_SCALE,
+                      1.0f / (float(P) * Q));
+      desc->commit(q_);
+    }
+    return *desc;
+  }
+
+  // Scratch buffers are reused by every call: a call writing them waits for
+  // the previous one, which also makes growing them safe
+  std::vector<sycl::event> after_scratch(std::vector<sycl::event> deps) const {
+    deps.push_back(scratch_);
+    return deps;
+  }
+
+  // Grows a device scratch buffer to at least n floats
+  void reserve(float *&p, std::size_t &capacity, std::size_t n) {
+    if (n <= capacity)
+      return;
+    scratch_.wait();
+    sycl::free(p, q_);
+    p = sycl::malloc_device<float>(n, q_);
+    capacity = n;
+  }
+
+  sycl::queue &q_;
+  float *tmp_ = nullptr, *spectrum_ = nullptr, *kernel_spectrum_ = nullptr;
+  std::size_t tmp_size_ = 0, spectrum_size_ = 0, kernel_spectrum_size_ = 0;
+  sycl::event scratch_;
+  std::map<std::pair<int, int>, std::unique_ptr<descriptor_t>> descriptors_;
+};
+
+#endif
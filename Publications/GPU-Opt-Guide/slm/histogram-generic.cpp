@@ -0,0 +1,134 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "histogram.hpp"
+
+constexpr std::size_t N = 1 << 24;
+constexpr int REPS = 10;
+
+// Uniform values in [0, bins)
+static std::vector<std::uint32_t> uniform_input(std::size_t bins) {
+  std::vector<std::uint32_t> v(N);
+  std::mt19937 gen(2009);
+  std::uniform_int_distribution<std::uint32_t> dist(0, bins - 1);
+  for (auto &x : v)
+    x = dist(gen);
+  return v;
+}
+
+// Zipfian values in [0, bins): P(k) proportional to 1 / (k + 1)^s, so that
+// the first bins collect most of the values
+static std::vector<std::uint32_t> zipf_input(std::size_t bins,
+                                             double s = 1.1) {
+  std::vector<double> cdf(bins);
+  double sum = 0;
+  for (std::size_t k = 0; k < bins; k++)
+    cdf[k] = sum += 1 / std::pow(k + 1.0, s);
+  std::vector<std::uint32_t> v(N);
+  std::mt19937 gen(2009);
+  std::uniform_real_distribution<double> dist(0, sum);
+  for (auto &x : v)
+    x = std::min<std::size_t>(
+        std::lower_bound(cdf.begin(), cdf.end(), dist(gen)) - cdf.begin(),
+        bins - 1);
+  return v;
+}
+
+template <std::size_t Bins>
+bool run(sycl::queue &q, const char *name,
+         const std::vector<std::uint32_t> &input) {
+  std::vector<std::uint32_t> expected(Bins, 0);
+  for (auto x : input)
+    expected[x]++;
+
+  std::uint32_t *d_input = sycl::malloc_device<std::uint32_t>(N, q);
+  std::uint32_t *d_counts = sycl::malloc_device<std::uint32_t>(Bins, q);
+  q.copy(input.data(), d_input, N).wait();
+
+  bool ok = true;
+  sycl::device d = q.get_device();
+  auto automatic = histogram<std::uint32_t, Bins>::select_strategy(d);
+  for (auto s : {histogram_strategy::registers, histogram_strategy::slm,
+                 histogram_strategy::global}) {
+    if (!histogram<std::uint32_t, Bins>::supports(d, s))
+      continue;
+    histogram<std::uint32_t, Bins> hist(q, s);
+    // Aggregation does not apply to the register strategy
+    for (bool aggregate : {false, true}) {
+      if (s == histogram_strategy::registers && aggregate)
+        continue;
+      std::vector<double> times;
+      hist(d_input, N, d_counts, aggregate).wait(); // warmup
+      for (int r = 0; r < REPS; r++) {
+        auto e = hist(d_input, N, d_counts, aggregate);
+        e.wait();
+        times.push_back(
+            (e.template get_profiling_info<
+                 sycl::info::event_profiling::command_end>() -
+             e.template get_profiling_info<
+                 sycl::info::event_profiling::command_start>()) *
+            1e-6);
+      }
+      std::sort(times.begin(), times.end());
+
+      std::vector<std::uint32_t> counts(Bins);
+      q.copy(d_counts, counts.data(), Bins).wait();
+      bool match = counts == expected;
+      ok &= match;
+
+      std::cout << std::setw(8) << Bins << std::setw(9) << name
+                << std::setw(11) << to_string(s) << std::setw(11)
+                << (s == histogram_strategy::registers
+                        ? "-"
+                        : (aggregate ? "yes" : "no"))
+                << std::setw(11) << std::fixed << std::setprecision(3)
+                << times[REPS / 2] << " ms" << std::setw(9)
+                << N / (times[REPS / 2] * 1e6) << " Gelem/s"
+                << (s == automatic ? "  (default)" : "")
+                << (match ? "" : "  MISMATCH") << "\n";
+    }
+  }
+
+  sycl::free(d_counts, q);
+  sycl::free(d_input, q);
+  return ok;
+}
+
+template <std::size_t Bins> bool run_inputs(sycl::queue &q) {
+  bool ok = run<Bins>(q, "uniform", uniform_input(Bins));
+  ok &= run<Bins>(q, "zipf", zipf_input(Bins));
+  return ok;
+}
+
+int main() {
+  sycl::queue q{sycl::gpu_selector_v,
+                sycl::property::queue::enable_profiling{}};
+  std::cout << "Device: " << q.get_device().get_info<sycl::info::device::name>()
+            << "\n";
+  std::cout << "Histogram of " << N << " values, median of " << REPS
+            << " runs\n";
+  std::cout << "    bins    input   strategy  aggregate     kernel time"
+               "     throughput\n";
+
+  // Register, SLM and global-sized histograms, including bin counts that are
+  // not powers of two
+  bool ok = run_inputs<64>(q);
+  ok &= run_inputs<1000>(q);
+  ok &= run_inputs<12000>(q);
+  ok &= run_inputs<1 << 20>(q);
+
+  std::cout << (ok ? "All histograms match the host results"
+                   : "Histogram mismatch")
+            << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,274 @@
+//==============================================================
+// Copyright © 2022 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+#ifndef __HISTOGRAM
+#define __HISTOGRAM 1
+
+#include <algorithm>
+#include <cstdint>
+#include <sycl/sycl.hpp>
+#include <type_traits>
+#include <vector>
+
+// Where the partial histograms live while the input is scanned:
+//  - registers: each sub-group keeps a private histogram spread over the
+//    registers of its work-items; no atomics until the final flush.
+//  - slm: each work-group keeps a histogram in shared local memory, updated
+//    with local atomics and flushed to global memory at the end.
+//  - global: every update is an atomic on the global histogram.
+enum class histogram_strategy { registers, slm, global };
+
+inline const char *to_string(histogram_strategy s) {
+  switch (s) {
+  case histogram_strategy::registers:
+    return "registers";
+  case histogram_strategy::slm:
+    return "slm";
+  default:
+    return "global";
+  }
+}
+
+// Counts the values of an integral input in [0, Bins) into a device histogram
+// of Bins 32-bit counters; values outside that range are ignored. Bins can be
+// any positive number.
+//
+// With aggregation enabled, the slm and global strategies first merge equal
+// bins within a sub-group: the lowest pending work-item becomes the leader,
+// all work-items holding the leader's bin are counted with a sub-group
+// reduction and the leader issues a single atomic for them. This is repeated
+// for a few rounds, and the remaining work-items update their bins one by one.
+// On skewed data most of a sub-group hits a few hot bins, so this removes most
+// of the atomics to the same address; on uniform data it costs a few
+// sub-group operations per element.
+template <typename T, std::size_t Bins> class histogram {
+  static_assert(std::is_integral_v<T>, "histogram input must be integral");
+  static_assert(Bins > 0 && Bins < (std::size_t(1) << 31));
+
+public:
+  // Sub-group size of the register strategy: bin b is held by work-item
+  // b % sub_group_size, in its private counter b / sub_group_size.
+  static constexpr int sub_group_size = 16;
+  static constexpr std::size_t max_register_bins = 4 * sub_group_size;
+  static constexpr int aggregation_rounds = 2;
+
+  explicit histogram(sycl::queue &q)
+      : q_(q), strategy_(select_strategy(q.get_device())) {}
+  histogram(sycl::queue &q, histogram_strategy s) : q_(q), strategy_(s) {}
+
+  histogram_strategy strategy() const { return strategy_; }
+
+  // Registers for a handful of bins, SLM when the histogram fits in half of
+  // the local memory (leaving room for more than one work-group per core),
+  // global atomics otherwise.
+  static histogram_strategy select_strategy(const sycl::device &d) {
+    if (supports(d, histogram_strategy::registers))
+      return histogram_strategy::registers;
+    if (supports(d, histogram_strategy::slm))
+      return histogram_strategy::slm;
+    return histogram_strategy::global;
+  }
+
+  static bool supports(const sycl::device &d, histogram_strategy s) {
+    switch (s) {
+    case histogram_strategy::registers: {
+      auto sizes = d.get_info<sycl::info::device::sub_group_sizes>();
+      return Bins <= max_register_bins &&
+             std::find(sizes.begin(), sizes.end(), sub_group_size) !=
+                 sizes.end();
+    }
+    case histogram_strategy::slm:
+      return d.get_info<sycl::info::device::local_mem_type>() !=
+                 sycl::info::local_mem_type::none &&
+             Bins * sizeof(std::uint32_t) <=
+                 d.get_info<sycl::info::device::local_mem_size>() / 2;
+    default:
+      return true;
+    }
+  }
+
+  // Zeroes counts, then counts the n values of input. Both pointers must be
+  // accessible from the device of the queue.
+  sycl::event operator()(const T *input, std::size_t n, std::uint32_t *counts,
+                         bool aggregate = true,
+                         const std::vector<sycl::event> &deps = {}) {
+    auto zero = q_.submit([&](sycl::handler &h) {
+      h.depends_on(deps);
+      h.fill(counts, std::uint32_t(0), Bins);
+    });
+    if (n == 0)
+      return zero;
+
+    sycl::device d = q_.get_device();
+    std::size_t wg_size = std::min<std::size_t>(
+        256, d.get_info<sycl::info::device::max_work_group_size>());
+    if (wg_size >= sub_group_size)
+      wg_size -= wg_size % sub_group_size;
+    // Enough work-groups to fill the device, each scanning at least
+    // min_items_per_thread values per work-item, so that the cost of
+    // initializing and flushing the partial histograms is amortized.
+    constexpr std::size_t min_items_per_thread = 32;
+    std::size_t max_groups =
+        8 * d.get_info<sycl::info::device::max_compute_units>();
+    std::size_t groups = std::clamp<std::size_t>(
+        n / (wg_size * min_items_per_thread), 1, max_groups);
+    sycl::nd_range<1> range{groups * wg_size, wg_size};
+
+    switch (strategy_) {
+    case histogram_strategy::registers:
+      if constexpr (Bins <= max_register_bins)
+        return registers(input, n, counts, range, zero);
+      else
+        throw sycl::exception(sycl::make_error_code(sycl::errc::invalid),
+                              "too many bins for the register strategy");
+    case histogram_strategy::slm:
+      return slm(input, n, counts, range, aggregate, zero);
+    default:
+      return global(input, n, counts, range, aggregate, zero);
+    }
+  }
+
+private:
+  using local_counter =
+      sycl::atomic_ref<std::uint32_t, sycl::memory_order::relaxed,
+                       sycl::memory_scope::work_group,
+                       sycl::access::address_space::local_space>;
+  using global_counter =
+      sycl::atomic_ref<std::uint32_t, sycl::memory_order::relaxed,
+                       sycl::memory_scope::device,
+                       sycl::access::address_space::global_space>;
+
+  // Bin of a value, or Bins if it is out of range
+  static std::uint32_t bin_of(T x) {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<U>(x) < Bins ? static_cast<std::uint32_t>(x)
+                                    : std::uint32_t(Bins);
+  }
+
+  // Every sub-group scans blocks of consecutive values, one per work-item,
+  // so that the loads are coalesced; the loop bounds are uniform across the
+  // sub-group, as required by the sub-group collectives in the body.
+  template <typename F>
+  static void for_each_block(sycl::nd_item<1> it, std::size_t n,
+                             const T *input, F &&f) {
+    auto sg = it.get_sub_group();
+    std::size_t lane = sg.get_local_id()[0];
+    std::size_t sg_start = it.get_global_id(0) - lane;
+    for (std::size_t base = sg_start; base < n;
+         base += it.get_global_range(0)) {
+      std::size_t i = base + lane;
+      f(i < n ? bin_of(input[i]) : std::uint32_t(Bins));
+    }
+  }
+
+  // Applies add(bin, count) for every valid bin of the sub-group, merging
+  // equal bins for aggregation_rounds leaders when aggregate is set.
+  template <typename Add>
+  static void update(sycl::sub_group sg, std::uint32_t bin, bool aggregate,
+                     Add &&add) {
+    bool pending = bin < Bins;
+    if (aggregate) {
+      std::uint32_t lane = sg.get_local_id()[0];
+      std::uint32_t none = sg.get_local_range()[0];
+      for (int r = 0; r < aggregation_rounds; r++) {
+        std::uint32_t leader =
+            sycl::reduce_over_group(sg, pending ? lane : none,
+                                    sycl::minimum<std::uint32_t>());
+        if (leader == none)
+          break;
+        std::uint32_t leader_bin = sycl::select_from_group(sg, bin, leader);
+        bool match = pending && bin == leader_bin;
+        std::uint32_t count = sycl::reduce_over_group(
+            sg, match ? 1u : 0u, sycl::plus<std::uint32_t>());
+        if (lane == leader)
+          add(leader_bin, count);
+        pending = pending && !match;
+      }
+    }
+    if (pending)
+      add(bin, 1u);
+  }
+
+  sycl::event registers(const T *input, std::size_t n, std::uint32_t *counts,
+                        sycl::nd_range<1> range, sycl::event dep) {
+    constexpr int per_item = (Bins + sub_group_size - 1) / sub_group_size;
+    return q_.submit([&](sycl::handler &h) {
+      h.depends_on(dep);
+      h.parallel_for(range, [=](sycl::nd_item<1> it)
+                                [[sycl::reqd_sub_group_size(sub_group_size)]] {
+        auto sg = it.get_sub_group();
+        std::uint32_t lane = sg.get_local_id()[0];
+        std::uint32_t private_counts[per_item] = {};
+        for_each_block(it, n, input, [&](std::uint32_t bin) {
+#pragma unroll
+          for (int j = 0; j < sub_group_size; j++) {
+            std::uint32_t b = sycl::select_from_group(sg, bin, j);
+            // Constant indices keep the counters in registers. Out of range
+            // values (b == Bins) may land in a counter past the last bin,
+            // which is never flushed.
+#pragma unroll
+            for (int k = 0; k < per_item; k++)
+              if (b == k * sub_group_size + lane)
+                private_counts[k]++;
+          }
+        });
+        for (int k = 0; k < per_item; k++) {
+          std::uint32_t b = k * sub_group_size + lane;
+          if (b < Bins && private_counts[k] != 0)
+            global_counter(counts[b]).fetch_add(private_counts[k]);
+        }
+      });
+    });
+  }
+
+  sycl::event slm(const T *input, std::size_t n, std::uint32_t *counts,
+                  sycl::nd_range<1> range, bool aggregate, sycl::event dep) {
+    return q_.submit([&](sycl::handler &h) {
+      h.depends_on(dep);
+      sycl::local_accessor<std::uint32_t, 1> local_counts(sycl::range{Bins},
+                                                          h);
+      h.parallel_for(range, [=](sycl::nd_item<1> it) {
+        std::size_t lid = it.get_local_id(0);
+        std::size_t wg_size = it.get_local_range(0);
+        for (std::size_t b = lid; b < Bins; b += wg_size)
+          local_counts[b] = 0;
+        sycl::group_barrier(it.get_group());
+
+        for_each_block(it, n, input, [&](std::uint32_t bin) {
+          update(it.get_sub_group(), bin, aggregate,
+                 [&](std::uint32_t b, std::uint32_t c) {
+                   local_counter(local_counts[b]).fetch_add(c);
+                 });
+        });
+        sycl::group_barrier(it.get_group());
+
+        for (std::size_t b = lid; b < Bins; b += wg_size)
+          if (local_counts[b] != 0)
+            global_counter(counts[b]).fetch_add(local_counts[b]);
+      });
+    });
+  }
+
+  sycl::event global(const T *input, std::size_t n, std::uint32_t *counts,
+                     sycl::nd_range<1> range, bool aggregate,
+                     sycl::event dep) {
+    return q_.submit([&](sycl::handler &h) {
+      h.depends_on(dep);
+      h.parallel_for(range, [=](sycl::nd_item<1> it) {
+        for_each_block(it, n, input, [&](std::uint32_t bin) {
+          update(it.get_sub_group(), bin, aggregate,
+                 [&](std::uint32_t b, std::uint32_t c) {
+                   global_counter(counts[b]).fetch_add(c);
+                 });
+        });
+      });
+    });
+  }
+
+  sycl::queue &q_;
+  histogram_strategy strategy_;
+};
+
+#endif